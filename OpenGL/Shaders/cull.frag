@@ -0,0 +1,9 @@
+#version 330 core
+
+// Additively blended, one per surviving record on its group's texel
+out float count;
+
+void main()
+{
+	count = 1.0;
+}
@@ -0,0 +1,108 @@
+#version 330 core
+
+// One point per DrawBatch record, decides whether the copy is drawn in this view.
+// cull.geom passes the survivors on to transform feedback in input order.
+
+layout (location = 3) in mat4 instanceModel;
+layout (location = 7) in vec2 instanceMaterial;
+layout (location = 8) in ivec2 batchLightInfo;
+layout (location = 9) in ivec4 batchLights0;
+layout (location = 10) in ivec4 batchLights1;
+layout (location = 11) in vec4 localSphere;		// object space centre, radius
+layout (location = 12) in int group;
+
+// Must match CullMode in GpuCulling.h
+const int CULL_FRUSTUM = 0;
+const int CULL_RANGE = 1;
+
+uniform int cullMode;
+uniform vec4 frustumPlanes[6];		// inward facing, normalised
+uniform vec4 rangeSphere;			// light position, far plane
+
+uniform bool occlusion;
+uniform mat4 occlusionViewProjection;	// the camera the Hi-Z pyramid was built from
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+
+out CullRecord
+{
+	mat4 model;
+	vec2 material;
+	flat ivec2 lightInfo;
+	flat ivec4 lights0;
+	flat ivec4 lights1;
+	flat int group;
+	flat int visible;
+} record;
+
+bool InFrustum(vec3 center, float radius)
+{
+	for(int i = 0; i < 6; i++)
+	{
+		if(dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius) return false;
+	}
+	return true;
+}
+
+// Screen box of the sphere against the farthest depth the pyramid holds over it
+bool Occluded(vec3 center, float radius)
+{
+	vec2 minUV = vec2(1.0);
+	vec2 maxUV = vec2(0.0);
+	float nearest = 1.0;
+	for(int i = 0; i < 8; i++)
+	{
+		vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = occlusionViewProjection * vec4(corner, 1.0);
+		if(clip.w <= 0.0) return false;		// reaches behind the camera
+
+		vec3 ndc = clip.xyz / clip.w;
+		minUV = min(minUV, ndc.xy * 0.5 + 0.5);
+		maxUV = max(maxUV, ndc.xy * 0.5 + 0.5);
+		nearest = min(nearest, ndc.z * 0.5 + 0.5);
+	}
+	if(nearest <= 0.0) return false;
+
+	// Pick the level where the box spans at most 2x2 texels, a level L texel covers 2^L level 0 texels
+	ivec2 size = textureSize(hiZ, 0);
+	ivec2 low = clamp(ivec2(clamp(minUV, 0.0, 1.0) * vec2(size)), ivec2(0), size - 1);
+	ivec2 high = clamp(ivec2(clamp(maxUV, 0.0, 1.0) * vec2(size)), ivec2(0), size - 1);
+
+	int level = 0;
+	while(level < hiZLevels - 1 && any(greaterThan((high >> level) - (low >> level), ivec2(1)))) level++;
+
+	// Sized the way GpuCulling allocates the levels, not queried per level
+	ivec2 last = max(size >> level, ivec2(1)) - 1;
+	ivec2 a = min(low >> level, last);
+	ivec2 b = min(high >> level, last);
+	float farthest = max(max(texelFetch(hiZ, a, level).r, texelFetch(hiZ, ivec2(b.x, a.y), level).r),
+		max(texelFetch(hiZ, ivec2(a.x, b.y), level).r, texelFetch(hiZ, b, level).r));
+
+	return nearest > farthest;
+}
+
+void main()
+{
+	// Same conservative sphere as TransformBounds in Bounds.h
+	float scale = max(length(instanceModel[0].xyz), max(length(instanceModel[1].xyz), length(instanceModel[2].xyz)));
+	vec3 center = (instanceModel * vec4(localSphere.xyz, 1.0)).xyz;
+	float radius = localSphere.w * scale;
+
+	bool visible;
+	if(cullMode == CULL_RANGE)
+	{
+		visible = distance(center, rangeSphere.xyz) <= rangeSphere.w + radius;
+	}
+	else
+	{
+		visible = InFrustum(center, radius) && !(occlusion && Occluded(center, radius));
+	}
+
+	record.model = instanceModel;
+	record.material = instanceMaterial;
+	record.lightInfo = batchLightInfo;
+	record.lights0 = batchLights0;
+	record.lights1 = batchLights1;
+	record.group = group;
+	record.visible = visible ? 1 : 0;
+}
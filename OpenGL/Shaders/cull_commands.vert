@@ -0,0 +1,34 @@
+#version 330 core
+
+// One point per DrawBatch command, rewrites it for the records cull.geom kept.
+// Groups were captured back to back, so a group's first record is the sum of the counts before it.
+
+layout (location = 0) in uvec4 command;		// index count, first index, base vertex, group
+
+uniform sampler2D groupCounts;
+
+// Captured interleaved as DrawElementsIndirectCommand
+flat out uint outCount;
+flat out uint outInstanceCount;
+flat out uint outFirstIndex;
+flat out int outBaseVertex;
+flat out uint outBaseInstance;
+
+void main()
+{
+	int group = int(command.w);
+
+	uint baseInstance = 0u;
+	for(int i = 0; i < group; i++)
+	{
+		baseInstance += uint(texelFetch(groupCounts, ivec2(i, 0), 0).r);
+	}
+
+	outCount = command.x;
+	outInstanceCount = uint(texelFetch(groupCounts, ivec2(group, 0), 0).r);
+	outFirstIndex = command.y;
+	outBaseVertex = int(command.z);
+	outBaseInstance = baseInstance;
+
+	gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,57 @@
+#version 330 core
+
+in vec2 TexCoord;
+
+out vec4 colour;
+
+struct Material
+{
+	float specularIntensity;
+	float shininess;
+};
+
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormalShininess;
+uniform sampler2D gDepth;
+
+uniform mat4 inverseViewProjection;
+
+// Rebuilt per pixel from the G-buffer, lighting.glsl reads them like the forward inputs
+vec3 FragPos;
+vec3 Normal;
+vec4 DirectionalLightSpacePos;
+float ViewDepth;
+Material material;
+
+#include "lighting.glsl"
+#include "gbuffer_encoding.glsl"
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	
+	// Nothing was drawn here, keep the skybox
+	if(depth == 1.0)
+	{
+		discard;
+	}
+	
+	vec4 worldPos = inverseViewProjection * vec4(vec3(TexCoord, depth) * 2.0 - 1.0, 1.0);
+	FragPos = worldPos.xyz / worldPos.w;
+	ViewDepth = -(view * vec4(FragPos, 1.0)).z;
+	DirectionalLightSpacePos = directionalLightTransform * vec4(FragPos, 1.0);
+	
+	vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+	vec4 normalShininess = texelFetch(gNormalShininess, pixel, 0);
+	Normal = DecodeNormal(normalShininess.rg);
+	material.specularIntensity = albedoSpecular.a;
+	material.shininess = DecodeShininess(normalShininess.b);
+	
+	vec4 finalColour = CalcDirectionalLight();
+	finalColour += CalcPointLights();
+	finalColour += CalcSpotLights();
+	finalColour += CalcClusteredLights();
+	
+	colour = vec4(albedoSpecular.rgb, 1.0) * finalColour;
+}
@@ -0,0 +1,7 @@
+#version 330 core
+
+// Depth only, colour writes are off while it runs
+void main()
+{
+
+}
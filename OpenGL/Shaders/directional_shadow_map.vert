@@ -1,10 +1,10 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
-uniform mat4 directionalLightTransform;
+#include "uniform_blocks.glsl"
+#include "instancing.glsl"
 
 void main()
 {
-    gl_Position = directionalLightTransform * model * vec4(aPos, 1.0);
+    gl_Position = directionalLightTransform * ModelMatrix() * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec2 TexCoord;
+in vec3 Normal;
+flat in vec2 SurfaceMaterial;
+
+layout (location = 0) out vec4 albedoSpecular;
+layout (location = 1) out vec4 normalShininess;
+
+uniform sampler2D theTexture;
+
+#include "uniform_blocks.glsl"
+#include "gbuffer_encoding.glsl"
+
+void main()
+{
+	albedoSpecular = vec4(texture(theTexture, TexCoord).rgb, clamp(SurfaceMaterial.x, 0.0, 1.0));
+	normalShininess = vec4(EncodeNormal(normalize(Normal)), EncodeShininess(SurfaceMaterial.y), 0.0);
+}
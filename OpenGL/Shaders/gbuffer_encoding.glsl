@@ -0,0 +1,36 @@
+// G-buffer packing shared by gbuffer.frag and deferred_lighting.frag
+
+const float SHININESS_LOG2_RANGE = 10.0;	// shininess 1..1024
+
+vec2 OctWrap(vec2 v)
+{
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Octahedral normal, two 10 bit channels are plenty for lighting
+vec2 EncodeNormal(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	n.xy = n.z >= 0.0 ? n.xy : OctWrap(n.xy);
+	return n.xy * 0.5 + 0.5;
+}
+
+vec3 DecodeNormal(vec2 e)
+{
+	e = e * 2.0 - 1.0;
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+float EncodeShininess(float shininess)
+{
+	return clamp(log2(max(shininess, 1.0)) / SHININESS_LOG2_RANGE, 0.0, 1.0);
+}
+
+float DecodeShininess(float encoded)
+{
+	return exp2(encoded * SHININESS_LOG2_RANGE);
+}
@@ -0,0 +1,37 @@
+#version 330 core
+
+// Builds one level of the max depth pyramid. The source texture's base level is set to the
+// level being read, so lod 0 here is the previous level (or the depth buffer itself when copying).
+
+uniform sampler2D source;
+uniform bool copy;
+
+out float depth;
+
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	if(copy)
+	{
+		depth = texelFetch(source, texel, 0).r;
+		return;
+	}
+
+	// 2x2 footprint, odd sized sources fold their last row/column into the last texel
+	ivec2 sourceSize = textureSize(source, 0);
+	ivec2 first = texel * 2;
+	ivec2 last = first + 1;
+	if((sourceSize.x & 1) != 0 && first.x + 3 == sourceSize.x) last.x++;
+	if((sourceSize.y & 1) != 0 && first.y + 3 == sourceSize.y) last.y++;
+	last = min(last, sourceSize - 1);
+
+	float farthest = 0.0;
+	for(int y = first.y; y <= last.y; y++)
+	{
+		for(int x = first.x; x <= last.x; x++)
+		{
+			farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+		}
+	}
+	depth = farthest;
+}
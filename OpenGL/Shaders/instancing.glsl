@@ -0,0 +1,29 @@
+// Per-instance attributes streamed by Model::SetInstances or DrawBatch, vertex shaders only.
+// Plain meshes leave these arrays disabled and DrawBlock.drawSource at DRAW_SOURCE_BLOCK.
+
+layout (location = 3) in mat4 instanceModel;		// takes locations 3 to 6
+layout (location = 7) in vec2 instanceMaterial;		// specular intensity, shininess
+layout (location = 8) in ivec2 batchLightInfo;		// object light count, culled light mask
+layout (location = 9) in ivec4 batchLights0;		// object light indices
+layout (location = 10) in ivec4 batchLights1;
+
+mat4 ModelMatrix()
+{
+	return drawSource != DRAW_SOURCE_BLOCK ? instanceModel : model;
+}
+
+vec2 MaterialParams()
+{
+	return drawSource != DRAW_SOURCE_BLOCK ? instanceMaterial : vec2(specularIntensity, shininess);
+}
+
+ivec2 LightInfo()
+{
+	return drawSource == DRAW_SOURCE_BATCH ? batchLightInfo : ivec2(objectLightCount, culledLightMask);
+}
+
+ivec4 LightIndices(int group)
+{
+	if (drawSource == DRAW_SOURCE_BATCH) return group == 0 ? batchLights0 : batchLights1;
+	return objectLights[group];
+}
@@ -0,0 +1,387 @@
+// Shared lighting for shader.frag and deferred_lighting.frag.
+// The includer declares FragPos, Normal, DirectionalLightSpacePos, ViewDepth
+// and a Material named material before including this file, and fills the
+// draw* light selection below if it has one.
+//
+// ShaderCache variants specialise it with #defines, anything left undefined
+// falls back to the uniforms:
+//   POINT_LIGHT_COUNT, SPOT_LIGHT_COUNT             fixed light counts, the loops unroll
+//   DIRECTIONAL_SHADOW_FILTER, OMNI_SHADOW_FILTER   fixed tier, the other tiers compile out
+//   CLUSTERED_LIGHTS, OBJECT_LIGHTS                 0 drops that scene light path
+
+#include "uniform_blocks.glsl"
+
+// Shadow filter tiers, must match ShadowFilter in CommonValues.h
+const int SHADOW_FILTER_HARD = 0;
+const int SHADOW_FILTER_PCF1 = 1;
+const int SHADOW_FILTER_PCF4 = 2;
+const int SHADOW_FILTER_POISSON = 3;
+const int SHADOW_FILTER_VSM = 4;
+const int SHADOW_POISSON_TAPS = 16;
+
+#ifdef POINT_LIGHT_COUNT
+#define POINT_LIGHTS POINT_LIGHT_COUNT
+#else
+#define POINT_LIGHTS pointLightCount
+#endif
+
+#ifdef SPOT_LIGHT_COUNT
+#define SPOT_LIGHTS SPOT_LIGHT_COUNT
+#else
+#define SPOT_LIGHTS spotLightCount
+#endif
+
+#ifndef CLUSTERED_LIGHTS
+#define CLUSTERED_LIGHTS 1
+#endif
+
+#ifndef OBJECT_LIGHTS
+#define OBJECT_LIGHTS 1
+#endif
+
+// Per-draw light selection, nothing listed and nothing culled unless the includer sets it
+int drawObjectLightCount = 0;
+int drawCulledLightMask = 0;
+ivec4 drawObjectLights[MAX_OBJECT_LIGHTS / 4];
+
+const float VSM_MIN_VARIANCE = 0.00002;
+const float VSM_BLEED_REDUCTION = 0.3;
+
+// Samplers can't live in a uniform block, their units are fixed in Shader::CompileProgram
+struct OmniShadowMap
+{
+	samplerCubeShadow shadowMap;
+	samplerCube momentsMap;
+};
+
+uniform sampler2DShadow directionalShadowMap;
+uniform sampler2D directionalMomentsMap;
+uniform OmniShadowMap omniShadowMaps[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+
+// Clustered lights, layout written by ClusteredLighting::Build
+uniform samplerBuffer clusterLights;		// 4 texels per light
+uniform usamplerBuffer clusterIndices;		// [offset, count] per cluster, then light indices
+uniform ivec3 clusterDims;					// z == 0 disables the clustered lights
+uniform vec2 clusterTileSize;
+uniform vec2 clusterZParams;				// slice = log(depth) * x - y
+
+const vec2 poissonDisk[SHADOW_POISSON_TAPS] = vec2[]
+(
+	vec2(-0.94201624, -0.39906216), vec2( 0.94558609, -0.76890725),
+	vec2(-0.09418410, -0.92938870), vec2( 0.34495938,  0.29387760),
+	vec2(-0.91588581,  0.45771432), vec2(-0.81544232, -0.87912464),
+	vec2(-0.38277543,  0.27676845), vec2( 0.97484398,  0.75648379),
+	vec2( 0.44323325, -0.97511554), vec2( 0.53742981, -0.47373420),
+	vec2(-0.26496911, -0.41893023), vec2( 0.79197514,  0.19090188),
+	vec2(-0.24188840,  0.99706507), vec2(-0.81409955,  0.91437590),
+	vec2( 0.19984126,  0.78641367), vec2( 0.14383161, -0.14100790)
+);
+
+// Per-pixel disk rotation, interleaved gradient noise keeps it stable and cheap
+mat2 PoissonRotation()
+{
+	float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+	float s = sin(angle);
+	float c = cos(angle);
+	return mat2(c, s, -s, c);
+}
+
+// Chebyshev upper bound on the lit fraction, rescaled to cut light bleeding
+float CalcVarianceLit(vec2 moments, float reference)
+{
+	if(reference <= moments.x)
+	{
+		return 1.0;
+	}
+	
+	float variance = max(moments.y - moments.x * moments.x, VSM_MIN_VARIANCE);
+	float d = reference - moments.x;
+	float pMax = variance / (variance + d * d);
+	return clamp((pMax - VSM_BLEED_REDUCTION) / (1.0 - VSM_BLEED_REDUCTION), 0.0, 1.0);
+}
+
+float CalcDirectionalShadowFactor(DirectionalLight light)
+{
+#ifdef DIRECTIONAL_SHADOW_FILTER
+	const int filterTier = DIRECTIONAL_SHADOW_FILTER;
+#else
+	int filterTier = directionalShadowFilter;
+#endif
+	
+	vec3 projCoords = DirectionalLightSpacePos.xyz / DirectionalLightSpacePos.w;
+	projCoords = (projCoords * 0.5) + 0.5;
+	
+	if(projCoords.z > 1.0)
+	{
+		return 0.0;
+	}
+	
+	vec3 normal = normalize(Normal);
+	vec3 lightDir = -normalize(directionalLight.direction);
+	
+	float bias = max(0.0005 * (1.0 - dot(normal, lightDir)), 0.00005);
+	float reference = projCoords.z - bias;
+	
+	if(filterTier == SHADOW_FILTER_VSM)
+	{
+		return 1.0 - CalcVarianceLit(texture(directionalMomentsMap, projCoords.xy).rg, reference);
+	}
+	
+	// HARD and PCF1 only differ by the texture filter set on the shadow map
+	float lit = 0.0;
+	vec2 texelSize = 1.0 / textureSize(directionalShadowMap, 0);
+	if(filterTier == SHADOW_FILTER_PCF4)
+	{
+		lit += texture(directionalShadowMap, vec3(projCoords.xy + vec2(-1.0, -1.0) * texelSize, reference));
+		lit += texture(directionalShadowMap, vec3(projCoords.xy + vec2( 1.0, -1.0) * texelSize, reference));
+		lit += texture(directionalShadowMap, vec3(projCoords.xy + vec2(-1.0,  1.0) * texelSize, reference));
+		lit += texture(directionalShadowMap, vec3(projCoords.xy + vec2( 1.0,  1.0) * texelSize, reference));
+		lit *= 0.25;
+	}
+	else if(filterTier == SHADOW_FILTER_POISSON)
+	{
+		mat2 rotation = PoissonRotation();
+		for(int i = 0; i < SHADOW_POISSON_TAPS; ++i)
+		{
+			vec2 offset = rotation * poissonDisk[i] * 2.0 * texelSize;
+			lit += texture(directionalShadowMap, vec3(projCoords.xy + offset, reference));
+		}
+		lit /= float(SHADOW_POISSON_TAPS);
+	}
+	else
+	{
+		lit = texture(directionalShadowMap, vec3(projCoords.xy, reference));
+	}
+	
+	return 1.0 - lit;
+}
+
+// shadowIndex is only a constant once the light loops unroll, which the
+// specialised variants guarantee. The generic shader leans on the driver.
+float CalcOmniShadowFactor(PointLight light, int shadowIndex)
+{
+#ifdef OMNI_SHADOW_FILTER
+	const int filterTier = OMNI_SHADOW_FILTER;
+#else
+	int filterTier = omniShadows[shadowIndex].filterTier;
+#endif
+	
+	vec3 fragToLight = FragPos - light.position;
+	float farPlane = omniShadows[shadowIndex].farPlane;
+	
+	float bias = 0.15;
+	float reference = (length(fragToLight) - bias) / farPlane;   // map stores distance / farPlane
+	
+	if(filterTier == SHADOW_FILTER_VSM)
+	{
+		return 1.0 - CalcVarianceLit(texture(omniShadowMaps[shadowIndex].momentsMap, fragToLight).rg, reference);
+	}
+	
+	if(filterTier == SHADOW_FILTER_HARD || filterTier == SHADOW_FILTER_PCF1)
+	{
+		return 1.0 - texture(omniShadowMaps[shadowIndex].shadowMap, vec4(fragToLight, reference));
+	}
+	
+	// Offset the lookup vector in the plane facing the light
+	float viewDistance = length(eyePosition - FragPos);
+	float diskRadius = (1.0 + (viewDistance / farPlane)) / 25.0;
+	vec3 axis = normalize(fragToLight);
+	vec3 tangent = normalize(cross(axis, abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+	vec3 bitangent = cross(axis, tangent);
+	
+	float lit = 0.0;
+	if(filterTier == SHADOW_FILTER_PCF4)
+	{
+		lit += texture(omniShadowMaps[shadowIndex].shadowMap, vec4(fragToLight + (-tangent - bitangent) * diskRadius, reference));
+		lit += texture(omniShadowMaps[shadowIndex].shadowMap, vec4(fragToLight + ( tangent - bitangent) * diskRadius, reference));
+		lit += texture(omniShadowMaps[shadowIndex].shadowMap, vec4(fragToLight + (-tangent + bitangent) * diskRadius, reference));
+		lit += texture(omniShadowMaps[shadowIndex].shadowMap, vec4(fragToLight + ( tangent + bitangent) * diskRadius, reference));
+		lit *= 0.25;
+	}
+	else
+	{
+		mat2 rotation = PoissonRotation();
+		for(int i = 0; i < SHADOW_POISSON_TAPS; ++i)
+		{
+			vec2 offset = rotation * poissonDisk[i] * diskRadius;
+			lit += texture(omniShadowMaps[shadowIndex].shadowMap, vec4(fragToLight + tangent * offset.x + bitangent * offset.y, reference));
+		}
+		lit /= float(SHADOW_POISSON_TAPS);
+	}
+	
+	return 1.0 - lit;
+}
+
+vec4 CalcLightByDirection(Light light, vec3 direction, float shadowFactor)
+{
+	vec4 ambientColour = vec4(light.colour, 1.0f) * light.ambientIntensity;
+	
+	float diffuseFactor = max(dot(normalize(Normal), -normalize(direction)), 0.0f);
+	vec4 diffuseColour = vec4(light.colour * light.diffuseIntensity * diffuseFactor, 1.0f);
+	
+	vec4 specularColour = vec4(0, 0, 0, 0);
+	
+	if(diffuseFactor > 0.0f)
+	{
+		vec3 fragToEye = normalize(eyePosition - FragPos);
+		vec3 reflectedVertex = normalize(reflect(direction, normalize(Normal)));
+		
+		float specularFactor = dot(fragToEye, reflectedVertex);
+		if(specularFactor > 0.0f)
+		{
+			specularFactor = pow(specularFactor, material.shininess);
+			specularColour = vec4(light.colour * material.specularIntensity * specularFactor, 1.0f);
+		}
+	}
+
+	return (ambientColour + (1.0 - shadowFactor) * (diffuseColour + specularColour));
+}
+
+vec4 CalcDirectionalLight()
+{
+	float shadowFactor = CalcDirectionalShadowFactor(directionalLight);
+	return CalcLightByDirection(directionalLight.base, directionalLight.direction, shadowFactor);
+}
+
+vec4 CalcPointLight(PointLight pLight, int shadowIndex)
+{
+	vec3 direction = FragPos - pLight.position;
+	float distance = length(direction);
+	direction = normalize(direction);
+
+	float shadowFactor = CalcOmniShadowFactor(pLight, shadowIndex);
+	
+	vec4 colour = CalcLightByDirection(pLight.base, direction, shadowFactor);
+	float attenuation = pLight.exponent * distance * distance +
+						pLight.linear * distance +
+						pLight.constant;
+	
+	return (colour / attenuation);
+}
+
+vec4 CalcSpotLight(SpotLight sLight, int shadowIndex)
+{
+	vec3 rayDirection = normalize(FragPos - sLight.base.position);
+	float slFactor = dot(rayDirection, sLight.direction);
+	
+	if(slFactor > sLight.edge)
+	{
+		vec4 colour = CalcPointLight(sLight.base, shadowIndex);
+		
+		return colour * (1.0f - (1.0f - slFactor)*(1.0f/(1.0f - sLight.edge)));
+		
+	} else {
+		return vec4(0, 0, 0, 0);
+	}
+}
+
+vec4 CalcPointLights()
+{
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for(int i = 0; i < POINT_LIGHTS; i++)
+	{
+		if((drawCulledLightMask & (1 << i)) != 0) continue;
+		totalColour += CalcPointLight(pointLights[i], i);
+	}
+	
+	return totalColour;
+}
+
+vec4 CalcSpotLights()
+{
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for(int i = 0; i < SPOT_LIGHTS; i++)
+	{
+		if((drawCulledLightMask & (1 << (i + POINT_LIGHTS))) != 0) continue;
+		totalColour += CalcSpotLight(spotLights[i], i + POINT_LIGHTS);
+	}
+	
+	return totalColour;
+}
+
+vec4 CalcClusteredLight(int lightIndex)
+{
+	int base = lightIndex * 4;
+	vec4 positionRadius = texelFetch(clusterLights, base);
+	vec4 colourDiffuse = texelFetch(clusterLights, base + 1);
+	vec4 attenuationAmbient = texelFetch(clusterLights, base + 2);
+	vec4 directionEdge = texelFetch(clusterLights, base + 3);
+	
+	vec3 direction = FragPos - positionRadius.xyz;
+	float distance = length(direction);
+	if(distance >= positionRadius.w)
+	{
+		return vec4(0, 0, 0, 0);
+	}
+	direction /= max(distance, 0.0001);
+	
+	float slFactor = dot(direction, directionEdge.xyz);
+	if(slFactor <= directionEdge.w)
+	{
+		return vec4(0, 0, 0, 0);
+	}
+	
+	Light light;
+	light.colour = colourDiffuse.rgb;
+	light.ambientIntensity = attenuationAmbient.w;
+	light.diffuseIntensity = colourDiffuse.w;
+	
+	vec4 colour = CalcLightByDirection(light, direction, 0.0);
+	float attenuation = attenuationAmbient.z * distance * distance +
+						attenuationAmbient.y * distance +
+						attenuationAmbient.x;
+	
+	// Window the falloff so lights reach zero at the radius they were binned with
+	float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+	colour *= window * window / attenuation;
+	
+	if(directionEdge.w > -1.0)
+	{
+		colour *= 1.0 - (1.0 - slFactor) / (1.0 - directionEdge.w);
+	}
+	
+	return colour;
+}
+
+vec4 CalcClusteredLights()
+{
+#if CLUSTERED_LIGHTS == 0
+	return vec4(0, 0, 0, 0);
+#else
+	if(clusterDims.z == 0)
+	{
+		return vec4(0, 0, 0, 0);
+	}
+	
+	ivec2 tile = ivec2(gl_FragCoord.xy / clusterTileSize);
+	int slice = int(floor(log(ViewDepth) * clusterZParams.x - clusterZParams.y));
+	ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), clusterDims - 1);
+	int clusterIndex = (cluster.z * clusterDims.y + cluster.y) * clusterDims.x + cluster.x;
+	
+	int offset = int(texelFetch(clusterIndices, clusterIndex * 2).r);
+	int count = int(texelFetch(clusterIndices, clusterIndex * 2 + 1).r);
+	
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for(int i = 0; i < count; i++)
+	{
+		totalColour += CalcClusteredLight(int(texelFetch(clusterIndices, offset + i).r));
+	}
+	
+	return totalColour;
+#endif
+}
+
+vec4 CalcObjectLights()
+{
+#if OBJECT_LIGHTS == 0
+	return vec4(0, 0, 0, 0);
+#else
+	vec4 totalColour = vec4(0, 0, 0, 0);
+	for(int i = 0; i < drawObjectLightCount; i++)
+	{
+		totalColour += CalcClusteredLight(drawObjectLights[i / 4][i % 4]);
+	}
+	
+	return totalColour;
+#endif
+}
@@ -0,0 +1,7 @@
+#version 330 core
+
+// Colour and depth writes are off, only the samples passed count
+void main()
+{
+
+}
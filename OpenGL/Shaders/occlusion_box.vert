@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Unit cube to clip space, OcclusionQueries folds the box and camera into one matrix
+uniform mat4 boxTransform;
+
+void main()
+{
+    gl_Position = boxTransform * vec4(aPos, 1.0);
+}
@@ -3,9 +3,10 @@
 
 layout (location = 0) in vec3 aPos;	
 
-uniform mat4 model;
+#include "uniform_blocks.glsl"
+#include "instancing.glsl"
 
 void main()
 {
-	gl_Position = model * vec4(aPos, 1.0);
+	gl_Position = ModelMatrix() * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 330 core
+
+in vec4 FragPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
+out vec2 moments;
+
+void main()
+{
+	float distance = length(FragPos.xyz - lightPos) / farPlane;
+	gl_FragDepth = distance;
+	
+	float dx = dFdx(distance);
+	float dy = dFdy(distance);
+	moments = vec2(distance, distance * distance + 0.25 * (dx * dx + dy * dy));
+}
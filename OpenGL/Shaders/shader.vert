@@ -1,30 +1,55 @@
 #version 330 core
 
+// Must match VertexFormat in CommonValues.h
+#define VERTEX_FORMAT_STANDARD 0
+#define VERTEX_FORMAT_POSITION 1
+
+#ifndef VERTEX_FORMAT
+#define VERTEX_FORMAT VERTEX_FORMAT_STANDARD
+#endif
+
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec2 tex;
 layout (location = 2) in vec3 norm;
 
+// The depth pre-pass variant has to land on exactly the same depth for GL_EQUAL
+invariant gl_Position;
+
 out vec4 vCol;
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
 out vec4 DirectionalLightSpacePos;
+out float ViewDepth;
+flat out vec2 SurfaceMaterial;
+
+#include "uniform_blocks.glsl"
+#include "instancing.glsl"
 
-uniform mat4 model;
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 directionalLightTransform;
+flat out ivec2 SurfaceLightInfo;
+flat out ivec4 SurfaceLights[MAX_OBJECT_LIGHTS / 4];
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(pos, 1.0);
-	DirectionalLightSpacePos = directionalLightTransform * model * vec4(pos, 1.0);
+	mat4 world = ModelMatrix();
+	gl_Position = projection * view * world * vec4(pos, 1.0);
+	
+#if VERTEX_FORMAT == VERTEX_FORMAT_STANDARD
+	DirectionalLightSpacePos = directionalLightTransform * world * vec4(pos, 1.0);
+	
+	SurfaceMaterial = MaterialParams();
+	SurfaceLightInfo = LightInfo();
+	SurfaceLights[0] = LightIndices(0);
+	SurfaceLights[1] = LightIndices(1);
 	
 	vCol = vec4(clamp(pos, 0.0f, 1.0f), 1.0f);
 	
 	TexCoord = tex;
 	
-	Normal = mat3(transpose(inverse(model))) * norm;
+	Normal = mat3(transpose(inverse(world))) * norm;
+	
+	FragPos = (world * vec4(pos, 1.0)).xyz; 
 	
-	FragPos = (model * vec4(pos, 1.0)).xyz; 
+	ViewDepth = -(view * vec4(FragPos, 1.0)).z;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+// std140 blocks shared by every program through the fixed binding points in
+// CommonValues.h. UniformBlocks.h mirrors them field for field, keep both in step.
+
+const int MAX_POINT_LIGHTS = 3;
+const int MAX_SPOT_LIGHTS = 3;
+const int MAX_OBJECT_LIGHTS = 8;
+
+// Where a draw's transform, material and light list come from, must match DrawSource in CommonValues.h
+const int DRAW_SOURCE_BLOCK = 0;		// DrawBlock
+const int DRAW_SOURCE_INSTANCE = 1;		// instance attributes, lights from DrawBlock
+const int DRAW_SOURCE_BATCH = 2;		// instance attributes, lights too
+
+struct Light
+{
+	vec3 colour;
+	float ambientIntensity;
+	float diffuseIntensity;
+};
+
+struct DirectionalLight 
+{
+	Light base;
+	vec3 direction;
+};
+
+struct PointLight
+{
+	Light base;
+	vec3 position;
+	float constant;
+	float linear;
+	float exponent;
+};
+
+struct SpotLight
+{
+	PointLight base;
+	vec3 direction;
+	float edge;
+};
+
+struct OmniShadow
+{
+	float farPlane;
+	int filterTier;
+};
+
+// Camera, once per view
+layout(std140) uniform FrameBlock
+{
+	mat4 projection;
+	mat4 view;
+	vec3 eyePosition;
+};
+
+// Lights and their shadow parameters, once per frame
+layout(std140) uniform LightBlock
+{
+	DirectionalLight directionalLight;
+	PointLight pointLights[MAX_POINT_LIGHTS];
+	SpotLight spotLights[MAX_SPOT_LIGHTS];
+	OmniShadow omniShadows[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];	// point lights then spot lights
+	mat4 directionalLightTransform;
+	int pointLightCount;
+	int spotLightCount;
+	int directionalShadowFilter;
+};
+
+// Object transform, material and light list, once per draw
+layout(std140) uniform DrawBlock
+{
+	mat4 model;
+	float specularIntensity;
+	float shininess;
+	int objectLightCount;
+	int culledLightMask;								// shadowed lights skipped for this draw, bit = shadow index
+	ivec4 objectLights[MAX_OBJECT_LIGHTS / 4];		// indices into clusterLights, 4 per ivec4
+	int drawSource;									// DRAW_SOURCE_*, see instancing.glsl
+};
@@ -0,0 +1,23 @@
+#version 330 core
+
+in vec2 TexCoord;
+
+out vec2 moments;
+
+uniform sampler2D source;
+uniform vec2 blurStep;
+
+// 9 tap gaussian folded into 5 bilinear fetches
+const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main()
+{
+	vec2 result = texture(source, TexCoord).rg * weights[0];
+	for(int i = 1; i < 3; i++)
+	{
+		result += texture(source, TexCoord + blurStep * offsets[i]).rg * weights[i];
+		result += texture(source, TexCoord - blurStep * offsets[i]).rg * weights[i];
+	}
+	moments = result;
+}
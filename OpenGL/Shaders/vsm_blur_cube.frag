@@ -0,0 +1,36 @@
+#version 330 core
+
+in vec2 TexCoord;
+
+out vec2 moments;
+
+uniform samplerCube source;
+uniform vec2 blurStep;
+uniform int face;
+
+const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+// Face coordinates in [-1, 1] to a lookup direction, inverse of the GL cube map face selection
+vec3 FaceDirection(vec2 st)
+{
+	if(face == 0) return vec3( 1.0, -st.y, -st.x);
+	if(face == 1) return vec3(-1.0, -st.y,  st.x);
+	if(face == 2) return vec3( st.x,  1.0,  st.y);
+	if(face == 3) return vec3( st.x, -1.0, -st.y);
+	if(face == 4) return vec3( st.x, -st.y,  1.0);
+	return vec3(-st.x, -st.y, -1.0);
+}
+
+void main()
+{
+	vec2 st = TexCoord * 2.0 - 1.0;
+	
+	vec2 result = texture(source, FaceDirection(st)).rg * weights[0];
+	for(int i = 1; i < 3; i++)
+	{
+		result += texture(source, FaceDirection(st + blurStep * offsets[i])).rg * weights[i];
+		result += texture(source, FaceDirection(st - blurStep * offsets[i])).rg * weights[i];
+	}
+	moments = result;
+}
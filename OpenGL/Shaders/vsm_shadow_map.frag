@@ -0,0 +1,13 @@
+#version 330 core
+
+out vec2 moments;
+
+void main()
+{
+	float depth = gl_FragCoord.z;
+	
+	// Slope term keeps sloped receivers from self shadowing after the blur
+	float dx = dFdx(depth);
+	float dy = dFdy(depth);
+	moments = vec2(depth, depth * depth + 0.25 * (dx * dx + dy * dy));
+}
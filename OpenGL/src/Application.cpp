@@ -3,6 +3,11 @@
 #include <iostream>
 #include <stb/stb_image.h>
 #include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 
 #include <fstream>
 #include <sstream>
@@ -17,12 +22,31 @@
 
 #include "Window.h"
 #include "Shader.h"
+#include "ShaderCache.h"
+#include "UniformBlocks.h"
 #include "Mesh.h"
 #include "Texture.h"
 #include "DirectionalLight.h"
 #include "Material.h"
 #include "PointLight.h"
 #include "SpotLight.h"
+#include "ClusteredLighting.h"
+#include "GBuffer.h"
+#include "FullscreenTriangle.h"
+#include "GLState.h"
+#include "LightAssignment.h"
+#include "DrawBatch.h"
+#include "GpuCulling.h"
+#include "SoftwareOcclusion.h"
+#include "OcclusionQueries.h"
+#include "DepthPrepass.h"
+#include "FrameGraph.h"
+#include "GpuProfiler.h"
+#include "FramePacer.h"
+#include "JobSystem.h"
+#include "AssetTask.h"
+#include "Simulation.h"
+#include "Bench.h"
 
 #include "Model.h"
 #include "Skybox.h"
@@ -30,26 +54,33 @@
 #include "io/keyboard.h"
 #include "io/mouse.h"
 #include "io/camera.h"
+#include "io/InputQueue.h"
+#include "io/InputRecorder.h"
 
 const float toRadians = 3.14159265f / 180.0f;
 
 // Use GLuint for uniform locations
-GLuint uniformSpecularIntensity = 0;
-GLuint uniformShininess = 0;
-GLuint uniformEyePosition = 0;
-GLuint uniformProjection = 0, uniformView = 0, uniformModel = 0;
 GLuint uniformOmniLightPos = 0;
 GLuint uniformFarPlane = 0;
 
-GLuint uniformLightView = 0;
-GLuint uniformLightProjection = 0;
+// Camera, light and per-draw uniforms shared by every program
+UniformBlocks uniformBlocks;
+
 bool showLightView = true;  // Toggle with V key
 
 std::vector<Mesh*> meshList;
 std::vector<Shader> shaderList;
-std::vector<Window> windowList;
 Shader directionalShadowShader;
 Shader omniShadowShader;
+Shader directionalVarianceShader;
+Shader omniVarianceShader;
+Shader geometryShader;
+Shader deferredLightingShader;
+
+// Lighting shaders specialised for the current lights and filters, P falls back to the generic ones
+ShaderCache litShaders;
+ShaderCache deferredLightingShaders;
+bool specializedShaders = true;
 
 // Cameras
 Camera cameras[2] = {
@@ -92,10 +123,125 @@ Skybox skybox;
 unsigned int spotLightCount = 0;
 unsigned int pointLightCount = 0;
 
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// Unshadowed lights over the floor, C cycles how they are assigned to fragments
+enum SceneLightMode
+{
+    SCENE_LIGHTS_OFF,
+    SCENE_LIGHTS_CLUSTERED,
+    SCENE_LIGHTS_PER_OBJECT,     // forward only, deferred falls back to the clusters
+    SCENE_LIGHT_MODE_COUNT
+};
+const char* sceneLightModeNames[SCENE_LIGHT_MODE_COUNT] = { "off", "clustered", "per-object" };
+
+ClusteredLighting clusteredLighting;
+std::vector<ClusterLight> sceneLights;
+std::vector<glm::vec3> sceneLightOrigins;
+int sceneLightMode = SCENE_LIGHTS_OFF;
+bool clusteredLightingReady = false;
 
-float sunAngle = 0.0f;
+// Everything RenderScene draws, rebuilt once per frame by UpdateScene
+struct SceneObject
+{
+    Mesh* mesh;
+    Model* model;          // drawn instead of mesh when set
+    Texture* texture;      // models bind their own
+    Material* material;
+    glm::mat4 transform;
+    bool instanced;        // draws every copy given to Model::SetInstances, transform unused
+    const OccluderMesh* occluder;  // hides other objects from the software occlusion, nullptr for none
+};
+std::vector<SceneObject> sceneObjects;
+std::vector<BoundingSphere> sceneBounds;
+
+// Instanced copies of the water tower, I cycles how many
+const unsigned int towerInstanceCounts[] = { 0, 100, 1000, 10000 };
+const int TOWER_INSTANCE_SETTINGS = sizeof(towerInstanceCounts) / sizeof(towerInstanceCounts[0]);
+int towerInstanceSetting = 0;
+BoundingSphere towerInstanceBounds;
+
+// K strongest lights per object for forward draws, shadowed lights are culled per object in every mode
+LightAssignment lightAssignment;
+std::vector<ClusterLight> shadowedLightDescriptions;
+const std::vector<ClusterLight> noSceneLights;
+
+// Whole scene in one indirect draw per texture, toggle with B key
+DrawBatch drawBatch;
+bool batchedDraws = false;
+bool drawBatchReady = false;
+
+// What each scene object was batched from, the batch is only built again when one changes
+struct DrawBatchSource
+{
+    const void* source;     // mesh or model
+    size_t meshes;
+    GLsizei copies;
+    GLuint baseInstance;
+    unsigned int instanceVersion;
+};
+std::vector<DrawBatchSource> drawBatchSources;
+
+// GPU frustum and Hi-Z occlusion culling of the batch, toggle with U key.
+// Without indirect draws the culled views need a readback, toggle with Y key
+GpuCulling gpuCulling;
+bool gpuCullingEnabled = false;
+bool gpuCullingReady = false;
+
+// Batch views: 0 draws everything, then the camera, the sun and every point then spot light
+const unsigned int CULL_VIEW_CAMERA = 1;
+const unsigned int CULL_VIEW_SUN = 2;
+const unsigned int CULL_VIEW_OMNI = 3;
+
+// CPU occlusion culling of the per-object draws, toggle with O key
+SoftwareOcclusion softwareOcclusion;
+bool softwareOcclusionEnabled = false;
+OccluderMesh floorOccluder;
+std::vector<GLsizei> sceneVisibleCopies;   // per scene object, what the camera passes submit
+std::vector<std::vector<BoundingSphere>> sceneInstanceBounds;  // per instanced scene object, every copy
+std::vector<unsigned char> instanceVisible;
+
+// Hardware occlusion queries for the heavy models, toggle with Q key
+OcclusionQueries occlusionQueries;
+bool occlusionQueriesEnabled = false;
+bool occlusionQueriesReady = false;
+
+// Depth-only pass ahead of the forward lit pass, Z cycles off/on/auto
+DepthPrepass depthPrepass;
+bool depthPrepassReady = false;
+const char* depthPrepassModeNames[DEPTH_PREPASS_MODE_COUNT] = { "off", "on", "auto" };
+
+// Deferred renderer, toggle with R key
+GBuffer gBuffer;
+bool deferredRendering = false;
+bool deferredReady = false;
+
+// Passes of the frame, K dumps the last one with pass timings
+FrameGraph frameGraph;
+
+// CPU and GPU time per pass and scope, X writes profile.csv and profile.json
+GpuProfiler gpuProfiler;
+FramePacer framePacer;
+int swapInterval = 1;
+const double frameRateLimits[] = { 0.0, 30.0, 60.0, 120.0 };
+const unsigned int FRAME_RATE_LIMITS = 4;
+unsigned int frameRateLimitSetting = 0;
+
+// --bench runs a scenario file offscreen instead of the interactive loop
+Bench bench;
+std::vector<Model*> hiddenModels;   // left out of the scene by the scenario
+InputRecorder inputRecorder;
+
+// Fragments written by the geometry pass, read back a frame late like the main pass time
+GLuint geometrySampleQueries[2] = { 0, 0 };
+unsigned int geometryQueryFrame = 0;
+double geometrySamplesTotal = 0.0;
+unsigned int geometrySampleFrames = 0;
+
+double lastFrame = 0.0;
+
+// The sun, the aircraft and the scene lights animate on the simulation thread, sceneState is
+// where they are this frame
+Simulation simulation;
+SimState sceneState;
 float sunSpeed = 1.0f;
 
 unsigned int SCR_WIDTH = 1280, SCR_HEIGHT = 1024;
@@ -104,18 +250,259 @@ float x, y, z;
 // WireFrame
 bool wireframeMode = false;
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-    glViewport(0, 0, width, height);
+// Shadow filter tiers, F cycles the directional light and G the point/spot lights
+int directionalShadowFilter = SHADOW_FILTER_PCF4;
+int omniShadowFilter = SHADOW_FILTER_PCF4;
+
+// Main pass GPU time for the current filter tiers, read back a frame late so it never stalls
+GLuint mainPassQueries[2] = { 0, 0 };
+unsigned int mainPassQueryFrame = 0;
+double mainPassTimeTotal = 0.0;
+unsigned int mainPassTimeFrames = 0;
+
+void framebuffer_size_callback(int width, int height) {
     SCR_WIDTH = width;
     SCR_HEIGHT = height;
 }
 
-GLfloat seahawkAngle = 0.0f;
 float seahawkAngularSpeed = 10.0f; // Set lower to decrease speed (was ~6 deg/s at 60 FPS with 0.1f/frame)
+
+void ApplyShadowFilters()
+{
+    mainLight.SetShadowFilter(static_cast<ShadowFilter>(directionalShadowFilter));
+    for (size_t i = 0; i < pointLightCount; i++) {
+        pointLights[i].SetShadowFilter(static_cast<ShadowFilter>(omniShadowFilter));
+    }
+    for (size_t i = 0; i < spotLightCount; i++) {
+        spotLights[i].SetShadowFilter(static_cast<ShadowFilter>(omniShadowFilter));
+    }
+}
+
+void ReadMainPassTime()
+{
+    if (mainPassQueryFrame == 0) return;
+
+    GLuint query = mainPassQueries[(mainPassQueryFrame - 1) % 2];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return; // drop the sample rather than wait on the GPU
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    mainPassTimeTotal += static_cast<double>(elapsed) / 1000000.0;
+    mainPassTimeFrames++;
+}
+
+void ReportMainPassTiming()
+{
+    if (mainPassTimeFrames > 0) {
+        printf("%s, %s shaders, shadow filters dir=%s omni=%s: main pass %.3f ms avg over %u frames\n",
+            deferredRendering ? "Deferred" : "Forward", specializedShaders ? "specialized" : "generic",
+            ShadowFilterName(directionalShadowFilter), ShadowFilterName(omniShadowFilter),
+            mainPassTimeTotal / mainPassTimeFrames, mainPassTimeFrames);
+        printf("Uniform blocks: %.1f uploads, %.0f bytes, %.1f unchanged skipped per frame\n",
+            uniformBlocks.GetAverageUploads(), uniformBlocks.GetAverageBytes(), uniformBlocks.GetAverageSkipped());
+        printf("GL state: %.1f calls issued, %.1f redundant suppressed per frame\n",
+            GLState::GetAverageIssued(), GLState::GetAverageSuppressed());
+        if (batchedDraws) {
+            printf("Draw batch (%s): %.1f commands in %.1f draw calls per frame\n",
+                drawBatch.IsIndirect() ? "indirect" : "loop", drawBatch.GetAverageCommands(), drawBatch.GetAverageDrawCalls());
+        }
+        if (batchedDraws && gpuCullingEnabled && gpuCulling.GetAverageRecords() > 0.0) {
+            printf("GPU culling: %.0f of %.0f records visible to the camera\n",
+                gpuCulling.GetAverageVisible(), gpuCulling.GetAverageRecords());
+        }
+        if (!batchedDraws && occlusionQueriesEnabled) {
+            printf("Occlusion queries: %.1f boxes per frame, %.1f of %.1f heavy models hidden\n",
+                occlusionQueries.GetAverageQueries(), occlusionQueries.GetAverageHidden(), occlusionQueries.GetAverageTracked());
+        }
+        if (!deferredRendering && depthPrepassReady && depthPrepass.GetMode() != DEPTH_PREPASS_OFF) {
+            printf("Depth pre-pass (%s): on %.0f%% of frames, %.0f fragments shaded instead of %.0f (overdraw %.2f), %.0f shaded without it\n",
+                depthPrepassModeNames[depthPrepass.GetMode()], depthPrepass.GetPrepassRate() * 100.0,
+                depthPrepass.GetAverageShadedWith(), depthPrepass.GetAverageRasterized(), depthPrepass.GetOverdraw(),
+                depthPrepass.GetAverageShadedWithout());
+        }
+        if (!batchedDraws && softwareOcclusionEnabled) {
+            printf("Software occlusion: %.1f occluders, %.0f triangles, raster %.3f ms, test %.3f ms, %.1f%% of tested culled\n",
+                softwareOcclusion.GetAverageOccluders(), softwareOcclusion.GetAverageTriangles(),
+                softwareOcclusion.GetAverageRasterTime(), softwareOcclusion.GetAverageTestTime(), softwareOcclusion.GetCullRate() * 100.0);
+        }
+    }
+    mainPassTimeTotal = 0.0;
+    mainPassTimeFrames = 0;
+    uniformBlocks.ResetStats();
+    GLState::ResetStats();
+    drawBatch.ResetStats();
+    gpuCulling.ResetStats();
+    softwareOcclusion.ResetStats();
+    occlusionQueries.ResetStats();
+    depthPrepass.ResetStats();
+}
     
-void processInput(GLFWwindow* mainWindow, double dt)
+void ReadGeometrySamples()
+{
+    if (geometryQueryFrame == 0) return;
+
+    GLuint query = geometrySampleQueries[(geometryQueryFrame - 1) % 2];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return;
+
+    GLuint samples = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &samples);
+    geometrySamplesTotal += samples;
+    geometrySampleFrames++;
+}
+
+void ReportGBuffer()
+{
+    const double megabyte = 1024.0 * 1024.0;
+    double pixels = static_cast<double>(gBuffer.GetWidth()) * gBuffer.GetHeight();
+    printf("G-buffer %ux%u: %.2f MB, %u bytes per pixel\n", gBuffer.GetWidth(), gBuffer.GetHeight(),
+        gBuffer.GetMemorySize() / megabyte, GBuffer::BYTES_PER_PIXEL);
+
+    if (geometrySampleFrames > 0) {
+        // Every passing fragment writes all targets, the lighting pass reads each pixel once
+        double samples = geometrySamplesTotal / geometrySampleFrames;
+        printf("G-buffer traffic per frame: %.2f MB written (overdraw %.2f), %.2f MB read by lighting\n",
+            samples * GBuffer::BYTES_PER_PIXEL / megabyte, samples / pixels, gBuffer.GetMemorySize() / megabyte);
+    }
+    geometrySamplesTotal = 0.0;
+    geometrySampleFrames = 0;
+}
+
+void CreateSceneLights()
+{
+    const int gridSize = 16;
+    for (int i = 0; i < gridSize * gridSize; i++) {
+        int gx = i % gridSize, gz = i / gridSize;
+        glm::vec3 origin(-9.0f + 18.0f * gx / (gridSize - 1), -1.5f, -9.0f + 18.0f * gz / (gridSize - 1));
+
+        // Spread the hue around the colour wheel
+        float hue = 6.0f * static_cast<float>(i) / (gridSize * gridSize);
+        glm::vec3 colour = glm::clamp(glm::vec3(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f)), 0.0f, 1.0f);
+
+        ClusterLight light(origin, colour, 0.0f, 1.0f, 1.0f, 0.7f, 4.0f);
+        if (i % 4 == 3) {
+            // Every fourth one is a spot light pointing at the floor
+            light.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            light.edge = cosf(40.0f * toRadians);
+            light.position.y = 0.0f;
+            light.exponent = 1.0f;
+        }
+
+        sceneLights.push_back(light);
+        sceneLightOrigins.push_back(light.position);
+    }
+}
+
+void UpdateSceneLights()
 {
-    if (Keyboard::key(GLFW_KEY_ESCAPE))
+    for (size_t i = 0; i < sceneLights.size() && i < sceneState.lightPositions.size(); i++) {
+        sceneLights[i].position = sceneState.lightPositions[i];
+    }
+}
+
+void ReportSceneLights()
+{
+    if (sceneLightMode == SCENE_LIGHTS_CLUSTERED || (sceneLightMode == SCENE_LIGHTS_PER_OBJECT && deferredRendering)) {
+        printf("Clustered lights: %u lights, %u indices, max %u per cluster, build %.3f ms\n",
+            clusteredLighting.GetLightCount(), clusteredLighting.GetIndexCount(),
+            clusteredLighting.GetMaxLightsPerCluster(), clusteredLighting.GetBuildTime());
+    }
+
+    if (!deferredRendering && lightAssignment.GetObjectCount() > 0) {
+        printf("Light assignment: %u objects, %u of %u candidate lights evaluated (%.1f per object, max %u), %u objects over %u lights, %.3f ms\n",
+            lightAssignment.GetObjectCount(), lightAssignment.GetEvaluatedCount(), lightAssignment.GetCandidateCount(),
+            static_cast<double>(lightAssignment.GetEvaluatedCount()) / lightAssignment.GetObjectCount(),
+            lightAssignment.GetMaxLightsPerObject(), lightAssignment.GetCappedObjectCount(), ObjectLightList::MAX_LIGHTS,
+            lightAssignment.GetAssignTime());
+    }
+}
+
+ClusterLight DescribeLight(PointLight& light)
+{
+    glm::vec3 attenuation = light.GetAttenuation();
+    return ClusterLight(light.GetPosition(), light.GetColour(), light.GetAmbientIntensity(), light.GetDiffuseIntensity(),
+        attenuation.x, attenuation.y, attenuation.z);
+}
+
+ClusterLight DescribeLight(SpotLight& light)
+{
+    ClusterLight description = DescribeLight(static_cast<PointLight&>(light));
+    description.direction = glm::normalize(light.GetDirection());
+    description.edge = light.GetEdge();
+    if (!light.IsOn()) {
+        description.ambientIntensity = 0.0f;
+        description.diffuseIntensity = 0.0f;
+    }
+    return description;
+}
+
+// Ranks lights for every object from the positions the shaders were last given
+void AssignObjectLights()
+{
+    shadowedLightDescriptions.clear();
+    for (size_t i = 0; i < pointLightCount; i++) {
+        shadowedLightDescriptions.push_back(DescribeLight(pointLights[i]));
+    }
+    for (size_t i = 0; i < spotLightCount; i++) {
+        shadowedLightDescriptions.push_back(DescribeLight(spotLights[i]));
+    }
+
+    lightAssignment.Assign(sceneBounds, shadowedLightDescriptions,
+        sceneLightMode == SCENE_LIGHTS_PER_OBJECT ? sceneLights : noSceneLights);
+}
+
+// Square grid of towers around the origin, every copy turned and alternating materials
+void BuildTowerInstances(unsigned int count)
+{
+    const float scale = 0.1f;
+    glm::vec3 extent = (Old_Water_Tower.GetBoundsMax() - Old_Water_Tower.GetBoundsMin()) * scale;
+    float spacing = std::max(extent.x, extent.z) * 1.5f;
+    unsigned int side = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<float>(count))));
+
+    // Copies are independent, only the merged bounds need them in order
+    std::vector<InstanceData> instances(count);
+    std::vector<BoundingSphere> bounds(count);
+    JobSystem::Get().ParallelFor(count, 256, [&](size_t first, size_t last) {
+        for (unsigned int i = static_cast<unsigned int>(first); i < last; i++) {
+            float gridX = (static_cast<float>(i % side) - side * 0.5f) * spacing;
+            float gridZ = (static_cast<float>(i / side) - side * 0.5f) * spacing;
+
+            glm::mat4 transform(1.0f);
+            transform = glm::translate(transform, glm::vec3(gridX, -2.0f, gridZ));
+            transform = glm::rotate(transform, (i * 37.0f) * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
+            transform = glm::scale(transform, glm::vec3(scale));
+
+            Material* material = ((i % side) + (i / side)) % 2 ? &dullMaterial : &shinyMaterial;
+            instances[i] = { transform, material->GetSpecularIntensity(), material->GetShininess() };
+            bounds[i] = TransformBounds(Old_Water_Tower.GetBoundsMin(), Old_Water_Tower.GetBoundsMax(), transform);
+        }
+    });
+    for (unsigned int i = 0; i < count; i++) {
+        towerInstanceBounds = i == 0 ? bounds[i] : MergeBounds(towerInstanceBounds, bounds[i]);
+    }
+
+    Old_Water_Tower.SetInstances(instances);
+}
+
+// Everything queued since the last drain into Keyboard and Mouse, in the order it came
+void DrainInput()
+{
+    InputEvent event;
+    while (InputQueue::events().pop(event)) {
+        inputRecorder.record(event);
+        InputQueue::dispatch(event);
+    }
+}
+
+// Input over the frame from frameStart to frameEnd seconds
+void processInput(GLFWwindow* mainWindow, double frameStart, double frameEnd)
+{
+    DrainInput();
+
+    if (Keyboard::key(GLFW_KEY_ESCAPE) && mainWindow)
         glfwSetWindowShouldClose(mainWindow, true);
 
     if (Keyboard::keyWentDown(GLFW_KEY_TAB)) {
@@ -135,24 +522,148 @@ void processInput(GLFWwindow* mainWindow, double dt)
         showLightView = !showLightView;
     }
 
-    // Move camera
-    if (Keyboard::key(GLFW_KEY_W)) {
-        cameras[activeCam].updateCameraPos(CameraDirection::FORWARD, dt);
+    // Shadow filter tiers
+    if (Keyboard::keyWentDown(GLFW_KEY_F)) {
+        ReportMainPassTiming();
+        directionalShadowFilter = (directionalShadowFilter + 1) % SHADOW_FILTER_COUNT;
+        ApplyShadowFilters();
+    }
+    if (Keyboard::keyWentDown(GLFW_KEY_G)) {
+        ReportMainPassTiming();
+        omniShadowFilter = (omniShadowFilter + 1) % SHADOW_FILTER_COUNT;
+        ApplyShadowFilters();
+    }
+
+    // Scene light assignment
+    if (Keyboard::keyWentDown(GLFW_KEY_C) && clusteredLightingReady) {
+        ReportMainPassTiming();
+        ReportSceneLights();
+        sceneLightMode = (sceneLightMode + 1) % SCENE_LIGHT_MODE_COUNT;
+        printf("Scene lights %s\n", sceneLightModeNames[sceneLightMode]);
+    }
+
+    // Forward / deferred renderer
+    if (Keyboard::keyWentDown(GLFW_KEY_R) && deferredReady) {
+        ReportMainPassTiming();
+        if (deferredRendering) ReportGBuffer();
+        deferredRendering = !deferredRendering;
+        printf("%s renderer\n", deferredRendering ? "Deferred" : "Forward");
+    }
+
+    // Specialized / generic lighting shaders
+    if (Keyboard::keyWentDown(GLFW_KEY_P)) {
+        ReportMainPassTiming();
+        specializedShaders = !specializedShaders;
+        printf("%s lighting shaders, %zu forward and %zu deferred variants compiled\n",
+            specializedShaders ? "Specialized" : "Generic", litShaders.GetVariantCount(), deferredLightingShaders.GetVariantCount());
+    }
+
+    // Batched / per object draws
+    if (Keyboard::keyWentDown(GLFW_KEY_B) && drawBatchReady) {
+        ReportMainPassTiming();
+        batchedDraws = !batchedDraws;
+        occlusionQueries.Reset();   // the queries stop while batched, their results go stale
+        printf("%s draws\n", batchedDraws ? "Batched" : "Per object");
+    }
+
+    // GPU culling of the batched draws
+    if (Keyboard::keyWentDown(GLFW_KEY_U) && gpuCullingReady) {
+        ReportMainPassTiming();
+        gpuCullingEnabled = !gpuCullingEnabled;
+        gpuCulling.InvalidateHiZ();
+        printf("GPU culling %s%s\n", gpuCullingEnabled ? "on" : "off", gpuCullingEnabled && !batchedDraws ? ", applies to batched draws (B)" :
+            gpuCullingEnabled && !drawBatch.UsesCulledViews() ? ", the draw loop needs its readback (Y)" : "");
     }
-    if (Keyboard::key(GLFW_KEY_S)) {
-        cameras[activeCam].updateCameraPos(CameraDirection::BACKWARD, dt);
+
+    // Reading the culled views back for the GL 3.3 draw loop, waits on the GPU every pass
+    if (Keyboard::keyWentDown(GLFW_KEY_Y) && gpuCullingReady && !drawBatch.IsIndirect()) {
+        ReportMainPassTiming();
+        drawBatch.SetLoopReadback(!drawBatch.IsLoopReadback());
+        gpuCulling.InvalidateHiZ();
+        printf("GPU culling readback %s\n", drawBatch.IsLoopReadback() ? "on" : "off");
+    }
+
+    // Software occlusion culling of the per-object draws
+    if (Keyboard::keyWentDown(GLFW_KEY_O)) {
+        ReportMainPassTiming();
+        softwareOcclusionEnabled = !softwareOcclusionEnabled;
+        printf("Software occlusion culling %s%s\n", softwareOcclusionEnabled ? "on" : "off",
+            softwareOcclusionEnabled && batchedDraws ? ", applies to per-object draws (B)" : "");
+    }
+
+    // Occlusion queries with conditional rendering
+    if (Keyboard::keyWentDown(GLFW_KEY_Q) && occlusionQueriesReady) {
+        ReportMainPassTiming();
+        occlusionQueriesEnabled = !occlusionQueriesEnabled;
+        occlusionQueries.Reset();
+        printf("Occlusion queries %s%s\n", occlusionQueriesEnabled ? "on" : "off",
+            occlusionQueriesEnabled && batchedDraws ? ", applies to per-object draws (B)" : "");
+    }
+
+    // Depth pre-pass for the forward path
+    if (Keyboard::keyWentDown(GLFW_KEY_Z) && depthPrepassReady) {
+        ReportMainPassTiming();
+        depthPrepass.SetMode((depthPrepass.GetMode() + 1) % DEPTH_PREPASS_MODE_COUNT);
+        printf("Depth pre-pass %s%s\n", depthPrepassModeNames[depthPrepass.GetMode()],
+            deferredRendering ? ", applies to forward rendering (R)" : "");
+    }
+
+    // Frame graph passes in the order they ran, with the timings since the last dump
+    if (Keyboard::keyWentDown(GLFW_KEY_K)) {
+        frameGraph.Dump();
     }
-    if (Keyboard::key(GLFW_KEY_D)) {
-        cameras[activeCam].updateCameraPos(CameraDirection::RIGHT, dt);
+
+    // Rolling pass timings, plus the kept frames as CSV and a Chrome trace
+    if (Keyboard::keyWentDown(GLFW_KEY_X)) {
+        gpuProfiler.Report();
+        framePacer.Report();
+        simulation.Report();
+        JobSystem::Get().Report();
+        if (gpuProfiler.WriteCsv("profile.csv") && gpuProfiler.WriteChromeTrace("profile.json") && framePacer.WriteCsv("latency.csv")) {
+            printf("Wrote %u frames to profile.csv, profile.json and latency.csv\n", gpuProfiler.GetFrameCount());
+        }
     }
-    if (Keyboard::key(GLFW_KEY_A)) {
-        cameras[activeCam].updateCameraPos(CameraDirection::LEFT, dt);
+
+    // Frame pacing: frames the CPU may run ahead, a frame-rate limit and vsync
+    if (Keyboard::keyWentDown(GLFW_KEY_M)) {
+        framePacer.Report();
+        framePacer.SetMaxFramesInFlight(framePacer.GetMaxFramesInFlight() % FramePacer::MAX_FRAMES_IN_FLIGHT + 1);
+        framePacer.ResetStats();
+        printf("%u frames in flight at most\n", framePacer.GetMaxFramesInFlight());
     }
-    if (Keyboard::key(GLFW_KEY_SPACE)) {
-        cameras[activeCam].updateCameraPos(CameraDirection::UP, dt);
+    if (Keyboard::keyWentDown(GLFW_KEY_N)) {
+        framePacer.Report();
+        frameRateLimitSetting = (frameRateLimitSetting + 1) % FRAME_RATE_LIMITS;
+        framePacer.SetFrameRateLimit(frameRateLimits[frameRateLimitSetting]);
+        framePacer.ResetStats();
+        if (frameRateLimits[frameRateLimitSetting] > 0.0) printf("Frame rate limited to %.0f fps\n", frameRateLimits[frameRateLimitSetting]);
+        else printf("No frame-rate limit\n");
     }
-    if (Keyboard::key(GLFW_KEY_LEFT_SHIFT)) {
-        cameras[activeCam].updateCameraPos(CameraDirection::DOWN, dt);
+    if (Keyboard::keyWentDown(GLFW_KEY_J)) {
+        framePacer.Report();
+        swapInterval = swapInterval ? 0 : 1;
+        framePacer.ResetStats();
+        printf("Vsync %s\n", swapInterval ? "on" : "off");
+    }
+
+    // Instanced water towers
+    if (Keyboard::keyWentDown(GLFW_KEY_I)) {
+        ReportMainPassTiming();
+        towerInstanceSetting = (towerInstanceSetting + 1) % TOWER_INSTANCE_SETTINGS;
+        BuildTowerInstances(towerInstanceCounts[towerInstanceSetting]);
+        printf("%u instanced water towers\n", towerInstanceCounts[towerInstanceSetting]);
+    }
+
+    // Move camera for as long as each key was down during the frame, a tap shorter than a
+    // frame still moves and a key let go halfway moves half as far
+    const int moveKeys[] = { GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_A, GLFW_KEY_SPACE, GLFW_KEY_LEFT_SHIFT };
+    const CameraDirection moveDirections[] = { CameraDirection::FORWARD, CameraDirection::BACKWARD, CameraDirection::RIGHT,
+        CameraDirection::LEFT, CameraDirection::UP, CameraDirection::DOWN };
+    for (int i = 0; i < 6; i++) {
+        double held = Keyboard::heldTime(moveKeys[i], frameStart, frameEnd);
+        if (held > 0.0) {
+            cameras[activeCam].updateCameraPos(moveDirections[i], held);
+        }
     }
 
     double dx = Mouse::getDX(), dy = Mouse::getDY();
@@ -279,16 +790,17 @@ void CreateObject() {
     calcAverageNormals(indices, indicesCount, vertices, verticesCount, 8, 5);
 
     Mesh* obj1 = new Mesh();
-    obj1->CreateMesh(vertices, indices, verticesCount, indicesCount);
+    obj1->CreateMesh(vertices, indices, verticesCount, indicesCount, true);
     meshList.push_back(obj1);
 
     Mesh* obj2 = new Mesh();
-    obj2->CreateMesh(vertices, indices, verticesCount, indicesCount);
+    obj2->CreateMesh(vertices, indices, verticesCount, indicesCount, true);
     meshList.push_back(obj2);
 
     Mesh* obj3 = new Mesh();
-    obj3->CreateMesh(floorVertices, floorIndices, 32, 6);
+    obj3->CreateMesh(floorVertices, floorIndices, 32, 6, true);
     meshList.push_back(obj3);
+    floorOccluder = MakeOccluder(floorVertices, 32, floorIndices, 6);
 }
 
 
@@ -300,140 +812,479 @@ void CreateShader()
 
     directionalShadowShader.CreateFromFiles("Shaders/directional_shadow_map.vert", "Shaders/directional_shadow_map.frag");
     omniShadowShader.CreateFromFiles("Shaders/omni_shadow_map.vert", "Shaders/omni_shadow_map.geom", "Shaders/omni_shadow_map.frag");
+    directionalVarianceShader.CreateFromFiles("Shaders/directional_shadow_map.vert", "Shaders/vsm_shadow_map.frag");
+    omniVarianceShader.CreateFromFiles("Shaders/omni_shadow_map.vert", "Shaders/omni_shadow_map.geom", "Shaders/omni_vsm_shadow_map.frag");
+    geometryShader.CreateFromFiles("Shaders/shader.vert", "Shaders/gbuffer.frag");
+    deferredLightingShader.CreateFromFiles("Shaders/fullscreen.vert", "Shaders/deferred_lighting.frag");
+
+    // Variants compile on first use, so only the combinations actually drawn get built
+    litShaders.Init("Shaders/shader.vert", "Shaders/shader.frag");
+    deferredLightingShaders.Init("Shaders/fullscreen.vert", "Shaders/deferred_lighting.frag");
+}
 
-    // Initialize light viewport uniforms
-    uniformLightView = shaderList[0].GetViewLocation();
-    uniformLightProjection = shaderList[0].GetProjectionLocation();
+// Every read and decode starts at once on the workers, each upload runs on the main thread as
+// its decode lands
+AssetTask LoadAssets(std::vector<std::string> skyboxFaces)
+{
+    std::vector<AssetTask> loads;
+    loads.push_back(brickTexture.LoadAsync(true));
+    loads.push_back(dirtTexture.LoadAsync(true));
+    loads.push_back(plainTexture.LoadAsync(true));
+    loads.push_back(seahawk.LoadModelAsync("Models/Seahawk.obj"));
+    loads.push_back(AirPlane.LoadModelAsync("Models/Airplane.obj"));
+    loads.push_back(Old_Water_Tower.LoadModelAsync("Models/old_water_tower_OBJ.obj"));
+    loads.push_back(skybox.LoadAsync(skyboxFaces));
+    co_return co_await AssetTask::WhenAll(std::move(loads));
 }
 
+// Only objects given an occluder hide others with it, models included
+void AddSceneObject(Mesh* mesh, Model* model, Texture* texture, Material* material, const glm::mat4& transform,
+    const OccluderMesh* occluder = nullptr)
+{
+    if (model && std::find(hiddenModels.begin(), hiddenModels.end(), model) != hiddenModels.end()) return;
+
+    SceneObject object = { mesh, model, texture, material, transform, false, occluder };
+    sceneObjects.push_back(object);
 
-void RenderScene()
+    if (model) {
+        sceneBounds.push_back(TransformBounds(model->GetBoundsMin(), model->GetBoundsMax(), transform));
+    }
+    else {
+        sceneBounds.push_back(TransformBounds(mesh->GetBoundsMin(), mesh->GetBoundsMax(), transform));
+    }
+}
+
+// Lights see the copies as one object inside bounds
+void AddInstancedObject(Model* model, Material* material, const BoundingSphere& bounds)
+{
+    SceneObject object = { nullptr, model, nullptr, material, glm::mat4(1.0f), true, nullptr };
+    sceneObjects.push_back(object);
+    sceneBounds.push_back(bounds);
+}
+
+// The animated objects in SimState::transforms
+enum SimObject
+{
+    SIM_SEAHAWK,
+    SIM_AIRPLANE,
+    SIM_OBJECT_COUNT
+};
+
+// One simulation tick, on the simulation thread. Only reads what's set up before it starts
+void StepSimulation(SimState& state, double time, float step)
+{
+    state.sunAngle += sunSpeed * step;
+    if (state.sunAngle > 6.28318f) state.sunAngle -= 6.28318f;
+
+    float radius = 25.0f;
+    float fixedY = 15.0f;
+    glm::vec3 lightPos(radius * cos(state.sunAngle), fixedY, radius * sin(state.sunAngle));
+    state.sunDirection = glm::normalize(-lightPos);
+
+    state.seahawkAngle += seahawkAngularSpeed * step;
+    if (state.seahawkAngle >= 360.0f) {
+        state.seahawkAngle -= 360.0f;
+    }
+
+    // Both circle the middle of the scene
+    glm::quat orbit = glm::angleAxis(-state.seahawkAngle * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
+    state.transforms.resize(SIM_OBJECT_COUNT);
+
+    SimTransform& seahawkTransform = state.transforms[SIM_SEAHAWK];
+    seahawkTransform.position = orbit * glm::vec3(15.0f, 1.0f, 0.0f);
+    seahawkTransform.orientation = orbit * glm::angleAxis(-20.0f * toRadians, glm::vec3(0.0f, 0.0f, 1.0f));
+    seahawkTransform.scale = glm::vec3(0.03f, 0.03f, 0.03f);
+
+    SimTransform& airplaneTransform = state.transforms[SIM_AIRPLANE];
+    airplaneTransform.position = orbit * glm::vec3(-50.0f, 5.0f, 0.0f);
+    airplaneTransform.orientation = orbit * glm::angleAxis(-90.0f * toRadians, glm::vec3(1.0f, 0.0f, 0.0f))
+        * glm::angleAxis(35.0f * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
+    airplaneTransform.scale = glm::vec3(0.006f, 0.006f, 0.006f);
+
+    state.lightPositions.resize(sceneLightOrigins.size());
+    for (size_t i = 0; i < sceneLightOrigins.size(); i++) {
+        float phase = static_cast<float>(time) + static_cast<float>(i) * 0.37f;
+        state.lightPositions[i] = sceneLightOrigins[i] + glm::vec3(cosf(phase), 0.0f, sinf(phase)) * 0.5f;
+    }
+}
+
+// Places the objects once per frame where the simulation has them, every pass then draws the same list
+void UpdateScene()
 {
+    sceneObjects.clear();
+    sceneBounds.clear();
+
     glm::mat4 model(1.0f);
 
     model = glm::translate(model, glm::vec3(0.0f, 0.0f, -2.5f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.UseTexture();
-    shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-    //meshList[0]->RenderMesh();
+    //AddSceneObject(meshList[0], nullptr, &brickTexture, &shinyMaterial, model);
 
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, 4.0f, -2.5f));
 	//model = glm::rotate(model, static_cast<float>(glfwGetTime()), glm::vec3(0.0f, 1.0f, 0.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.UseTexture();
-    dullMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-    //meshList[1]->RenderMesh();
+    //AddSceneObject(meshList[1], nullptr, &brickTexture, &dullMaterial, model);
 
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, -2.0f, 0.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    plainTexture.UseTexture();
-    shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-    meshList[2]->RenderMesh();
+    AddSceneObject(meshList[2], nullptr, &plainTexture, &shinyMaterial, model, &floorOccluder);
 
-    seahawkAngle += seahawkAngularSpeed * deltaTime;
-    if (seahawkAngle >= 360.0f) {
-        seahawkAngle -= 360.0f;
-    }
-
-    model = glm::mat4(1.0f);
-    model = glm::rotate(model, -seahawkAngle * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::translate(model, glm::vec3(15.0f, 1.0f, 0.0f));
-    model = glm::rotate(model, -20.0f * toRadians, glm::vec3(0.0f, 0.0f, 1.0f));
-    model = glm::scale(model, glm::vec3(0.03f, 0.03f, 0.03f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-    seahawk.RenderModel(wireframeMode);
+    model = sceneState.transforms[SIM_SEAHAWK].GetMatrix();
+    AddSceneObject(nullptr, &seahawk, nullptr, &shinyMaterial, model);
 
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(-4.0f, 2.0f, 0.0f));
     model = glm::scale(model, glm::vec3(0.03f, 0.03f, 0.03f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-    //seahawk.RenderModel(wireframeMode);
+    //AddSceneObject(nullptr, &seahawk, nullptr, &shinyMaterial, model);
 
-    model = glm::mat4(1.0f);
-    model = glm::rotate(model, -seahawkAngle * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::translate(model, glm::vec3(-50.0f, 5.0f, 0.0f));
-    model = glm::rotate(model, -90.0f * toRadians, glm::vec3(1.0f, 0.0f, 0.0f));
-    model = glm::rotate(model, 35.0f * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(0.006f, 0.006f, 0.006f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-    AirPlane.RenderModel(wireframeMode);
+    model = sceneState.transforms[SIM_AIRPLANE].GetMatrix();
+    AddSceneObject(nullptr, &AirPlane, nullptr, &shinyMaterial, model);
 
     model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, 2.0f, 0.0f));
     model = glm::scale(model, glm::vec3(0.3f, 0.3f, 0.3f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    shinyMaterial.UseMaterial(uniformSpecularIntensity, uniformShininess);
-    Old_Water_Tower.RenderModel(wireframeMode);
+    AddSceneObject(nullptr, &Old_Water_Tower, nullptr, &shinyMaterial, model);
 
+    if (Old_Water_Tower.GetInstanceCount() > 0) {
+        AddInstancedObject(&Old_Water_Tower, &shinyMaterial, towerInstanceBounds);
+    }
 }
 
-void DirectionalShadowMapPass(DirectionalLight* light, float angle)
+DrawBatchSource GetDrawBatchSource(const SceneObject& object)
 {
-    directionalShadowShader.UseShader();
+    DrawBatchSource source = { object.mesh, 1, 1, 0, 0 };
+    if (object.model) {
+        source.source = object.model;
+        source.meshes = object.model->GetMeshCount();
+    }
+    if (object.instanced) {
+        source.copies = object.model->GetInstanceCount();
+        source.instanceVersion = object.model->GetInstanceVersion();
+    }
+    return source;
+}
 
-    glViewport(0, 0, light->getShadowMap()->GetShadowWidth(), light->getShadowMap()->GetShadowHeight());
-    light->getShadowMap()->Write();
-    glClear(GL_DEPTH_BUFFER_BIT);
+// Records and commands for every scene object, replayed by each pass. They stay on the GPU while
+// the scene has the same objects, a frame then only rewrites the records that moved or lit differently
+void BuildDrawBatch()
+{
+    bool rebuild = drawBatchSources.size() != sceneObjects.size();
+    for (size_t i = 0; i < sceneObjects.size() && !rebuild; i++) {
+        DrawBatchSource source = GetDrawBatchSource(sceneObjects[i]);
+        const DrawBatchSource& built = drawBatchSources[i];
+        rebuild = source.source != built.source || source.meshes != built.meshes || source.copies != built.copies;
+    }
 
-    // IMPORTANT: set the global uniformModel to the depth shader's model location
-    uniformModel = directionalShadowShader.GetModelLocation();
+    if (!rebuild) {
+        for (size_t i = 0; i < sceneObjects.size(); i++) {
+            SceneObject& object = sceneObjects[i];
+            DrawBatchSource& built = drawBatchSources[i];
+            const ObjectLightList* lights = deferredRendering ? nullptr : &lightAssignment.GetObjectLights(i);
+
+            // Instanced copies are only sent again when SetInstances gave new ones
+            if (object.instanced) {
+                bool moved = object.model->GetInstanceVersion() != built.instanceVersion;
+                drawBatch.UpdateRecords(built.baseInstance, built.copies, moved ? object.model->GetInstances().data() : nullptr, lights);
+                built.instanceVersion = object.model->GetInstanceVersion();
+            }
+            else {
+                InstanceData record = { object.transform, object.material->GetSpecularIntensity(), object.material->GetShininess() };
+                drawBatch.UpdateRecords(built.baseInstance, 1, &record, lights);
+            }
+        }
+        drawBatch.Upload();
+        return;
+    }
 
-    // Use the same light transform as the main pass
-    glm::mat4 lightTransform = light->CalculateLightTransform(angle);
-    directionalShadowShader.SetDirectionalLightTransform(&lightTransform);
+    drawBatch.Begin();
+    drawBatchSources.resize(sceneObjects.size());
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& object = sceneObjects[i];
+        const ObjectLightList* lights = deferredRendering ? nullptr : &lightAssignment.GetObjectLights(i);
+
+        GLuint baseInstance;
+        GLsizei copies = 1;
+        if (object.instanced) {
+            const std::vector<InstanceData>& instances = object.model->GetInstances();
+            copies = static_cast<GLsizei>(instances.size());
+            baseInstance = drawBatch.AddRecords(instances.data(), copies, lights,
+                LocalBounds(object.model->GetBoundsMin(), object.model->GetBoundsMax()));
+        }
+        else {
+            InstanceData record = { object.transform, object.material->GetSpecularIntensity(), object.material->GetShininess() };
+            glm::vec4 bounds = object.model ? LocalBounds(object.model->GetBoundsMin(), object.model->GetBoundsMax())
+                : LocalBounds(object.mesh->GetBoundsMin(), object.mesh->GetBoundsMax());
+            baseInstance = drawBatch.AddRecords(&record, 1, lights, bounds);
+        }
 
-    directionalShadowShader.Validate();
+        if (object.model) {
+            for (size_t m = 0; m < object.model->GetMeshCount(); m++) {
+                drawBatch.AddDraw(object.model->GetMesh(m), object.model->GetMeshTexture(m), baseInstance, copies);
+            }
+        }
+        else {
+            drawBatch.AddDraw(object.mesh, object.texture, baseInstance, copies);
+        }
+
+        drawBatchSources[i] = GetDrawBatchSource(object);
+        drawBatchSources[i].baseInstance = baseInstance;
+    }
+    drawBatch.Upload();
+}
+
+// Culls the batch for every view on the GPU, the Hi-Z pyramid is last frame's
+void CullDrawBatch(const glm::mat4& cameraViewProjection)
+{
+    gpuCulling.CullFrustum(drawBatch, CULL_VIEW_CAMERA, cameraViewProjection, true);
+    gpuCulling.CullFrustum(drawBatch, CULL_VIEW_SUN, mainLight.CalculateLightTransform(sceneState.sunAngle), false);
+    for (size_t i = 0; i < pointLightCount; i++) {
+        gpuCulling.CullRange(drawBatch, CULL_VIEW_OMNI + i, pointLights[i].GetPosition(), pointLights[i].GetFarPlane());
+    }
+    for (size_t i = 0; i < spotLightCount; i++) {
+        gpuCulling.CullRange(drawBatch, CULL_VIEW_OMNI + pointLightCount + i, spotLights[i].GetPosition(), spotLights[i].GetFarPlane());
+    }
+}
+
+// Rasterizes the occluders on the CPU and decides what the camera passes submit.
+// The visible instanced copies get a range of their own, the shadow passes still draw them all
+void OcclusionCullScene(const glm::mat4& cameraViewProjection)
+{
+    // Every copy's bounds once, for the occluders and the tests both
+    sceneInstanceBounds.resize(sceneObjects.size());
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& object = sceneObjects[i];
+        if (!object.instanced) continue;
+
+        const std::vector<InstanceData>& instances = object.model->GetInstances();
+        std::vector<BoundingSphere>& bounds = sceneInstanceBounds[i];
+        bounds.resize(instances.size());
+        JobSystem::Get().ParallelFor(instances.size(), 256, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++) {
+                bounds[c] = TransformBounds(object.model->GetBoundsMin(), object.model->GetBoundsMax(), instances[c].transform);
+            }
+        });
+    }
+
+    softwareOcclusion.Begin(cameraViewProjection);
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& object = sceneObjects[i];
+        if (!object.occluder) continue;
+
+        if (object.instanced) {
+            const std::vector<InstanceData>& instances = object.model->GetInstances();
+            for (size_t c = 0; c < instances.size(); c++) {
+                softwareOcclusion.AddOccluder(object.occluder, instances[c].transform, sceneInstanceBounds[i][c]);
+            }
+        }
+        else {
+            softwareOcclusion.AddOccluder(object.occluder, object.transform, sceneBounds[i]);
+        }
+    }
+    softwareOcclusion.Rasterize();
+
+    sceneVisibleCopies.resize(sceneObjects.size());
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& object = sceneObjects[i];
+        if (!object.instanced) {
+            sceneVisibleCopies[i] = softwareOcclusion.IsVisible(sceneBounds[i]) ? 1 : 0;
+            continue;
+        }
+
+        softwareOcclusion.AreVisible(sceneInstanceBounds[i], instanceVisible);
+        sceneVisibleCopies[i] = object.model->SetVisibleInstances(instanceVisible);
+    }
+}
+
+// Box queries for the heavy models against the camera pass depth, the next frame's camera pass
+// draws them conditionally on the result
+void IssueOcclusionQueries(const glm::mat4& cameraViewProjection)
+{
+    if (!occlusionQueriesEnabled || batchedDraws) return;
+
+    occlusionQueries.BeginQueries(cameraViewProjection, cameras[activeCam].getCameraPosition());
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& object = sceneObjects[i];
+        if (object.model && !object.instanced) {
+            occlusionQueries.Query(i, *object.model, object.transform);
+        }
+    }
+    occlusionQueries.EndQueries();
+}
+
+// objectLights sends each object's light list with the draw, forward lit pass only.
+// cullView picks the batch's culled copy for the pass when GPU culling is on, and
+// CULL_VIEW_CAMERA also skips what the software occlusion hid and what the occlusion queries failed.
+// Depth-only passes draw with VERTEX_FORMAT_POSITION, from the meshes' position streams
+void RenderScene(bool objectLights = false, unsigned int cullView = 0, int vertexFormat = VERTEX_FORMAT_STANDARD)
+{
+    if (batchedDraws) {
+        uniformBlocks.SetBatchedDraw(objectLights);
+        drawBatch.Draw(wireframeMode, gpuCullingEnabled ? cullView : 0, vertexFormat);
+        return;
+    }
+
+    bool occlusion = softwareOcclusionEnabled && cullView == CULL_VIEW_CAMERA;
+    bool conditional = occlusionQueriesEnabled && cullView == CULL_VIEW_CAMERA;
+    for (size_t i = 0; i < sceneObjects.size(); i++) {
+        SceneObject& object = sceneObjects[i];
+        if (occlusion && sceneVisibleCopies[i] == 0) continue;
+
+        uniformBlocks.SetDraw(object.transform, object.material, objectLights ? &lightAssignment.GetObjectLights(i) : nullptr,
+            object.instanced ? DRAW_SOURCE_INSTANCE : DRAW_SOURCE_BLOCK);
+        if (object.texture && vertexFormat == VERTEX_FORMAT_STANDARD) object.texture->UseTexture();
+
+        if (object.instanced) {
+            object.model->RenderModelInstanced(wireframeMode, occlusion, vertexFormat);
+        }
+        else if (object.model) {
+            if (!conditional || !occlusionQueries.Render(i, *object.model, wireframeMode, vertexFormat)) {
+                object.model->RenderModel(wireframeMode, vertexFormat);
+            }
+        }
+        else {
+            object.mesh->RenderMesh(vertexFormat);
+        }
+    }
+}
+
+// The flashlight hangs under the camera and points where it looks
+void AimFlashlight()
+{
+    glm::vec3 lowerLight = cameras[activeCam].getCameraPosition();
+    lowerLight.y -= 0.3f;
+    spotLights[0].SetFlash(lowerLight, cameras[activeCam].getCameraDirection());
+}
+
+// Every light, its shadow parameters and the sun transform, once per frame for all programs
+void UpdateLights(float sunAngle)
+{
+    uniformBlocks.SetDirectionalLight(&mainLight, mainLight.CalculateLightTransform(sunAngle));
+    uniformBlocks.SetPointLights(pointLights, pointLightCount, 0);
+    uniformBlocks.SetSpotLights(spotLights, spotLightCount, pointLightCount);
+    uniformBlocks.UploadLights();
+}
+
+// Shadow map units are fixed in Shader::CompileProgram, moments maps only exist for VSM lights
+void BindShadowMaps()
+{
+    mainLight.getShadowMap()->Read(GL_TEXTURE2);
+    if (mainLight.getMomentsMap()) mainLight.getMomentsMap()->Read(GL_TEXTURE0 + SHADOW_MOMENTS_UNIT);
+
+    for (size_t i = 0; i < pointLightCount; i++) {
+        pointLights[i].getShadowMap()->Read(GL_TEXTURE3 + i);
+        if (pointLights[i].getMomentsMap()) pointLights[i].getMomentsMap()->Read(GL_TEXTURE0 + SHADOW_MOMENTS_UNIT + 1 + i);
+    }
+    for (size_t i = 0; i < spotLightCount; i++) {
+        spotLights[i].getShadowMap()->Read(GL_TEXTURE3 + pointLightCount + i);
+        if (spotLights[i].getMomentsMap()) spotLights[i].getMomentsMap()->Read(GL_TEXTURE0 + SHADOW_MOMENTS_UNIT + 1 + pointLightCount + i);
+    }
+}
+
+void DirectionalShadowMapPass(DirectionalLight* light)
+{
+    // VSM lights render moments instead of plain depth, then blur them
+    bool variance = light->GetShadowFilter() == SHADOW_FILTER_VSM;
+    Shader& depthShader = variance ? directionalVarianceShader : directionalShadowShader;
+    ShadowMap* target = variance ? light->getMomentsMap() : light->getShadowMap();
+
+    depthShader.UseShader();
+
+    GLState::Viewport(0, 0, target->GetShadowWidth(), target->GetShadowHeight());
+    target->Write();
+    if (variance) {
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    else {
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // The light transform comes from LightBlock, the same one the main pass reads
+    depthShader.Validate();
 
     // Optional: reduce self-shadowing (acne) by rendering front faces into the depth map
-    GLboolean wasCullEnabled = glIsEnabled(GL_CULL_FACE);
-    if (!wasCullEnabled) glEnable(GL_CULL_FACE);
-    glCullFace(GL_FRONT);
+    bool wasCullEnabled = GLState::IsEnabled(GL_CULL_FACE);
+    if (!wasCullEnabled) GLState::SetEnabled(GL_CULL_FACE, true);
+    GLState::CullFace(GL_FRONT);
 
     // Render ALL casters into the shadow map
-    RenderScene();
+    RenderScene(false, CULL_VIEW_SUN, VERTEX_FORMAT_POSITION);
 
     // Restore cull state
-    glCullFace(GL_BACK);
-    if (!wasCullEnabled) glDisable(GL_CULL_FACE);
+    GLState::CullFace(GL_BACK);
+    if (!wasCullEnabled) GLState::SetEnabled(GL_CULL_FACE, false);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    target->Prefilter();
+
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
 
-void OmniShadowMapPass(PointLight* light)
+void OmniShadowMapPass(PointLight* light, unsigned int cullView)
 {
-    omniShadowShader.UseShader();
+    bool variance = light->GetShadowFilter() == SHADOW_FILTER_VSM;
+    Shader& depthShader = variance ? omniVarianceShader : omniShadowShader;
+    ShadowMap* target = variance ? light->getMomentsMap() : light->getShadowMap();
 
-    glViewport(0, 0, light->getShadowMap()->GetShadowWidth(), light->getShadowMap()->GetShadowHeight());
+    depthShader.UseShader();
 
-    light->getShadowMap()->Write();
-    glClear(GL_DEPTH_BUFFER_BIT);
+    GLState::Viewport(0, 0, target->GetShadowWidth(), target->GetShadowHeight());
 
-	uniformModel = omniShadowShader.GetModelLocation();
-    uniformOmniLightPos = omniShadowShader.GetOmniLightPosLocation();
-    uniformFarPlane = omniShadowShader.GetFarPlaneLocation();
+    target->Write();
+    if (variance) {
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+    else {
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    uniformOmniLightPos = depthShader.GetOmniLightPosLocation();
+    uniformFarPlane = depthShader.GetFarPlaneLocation();
 
     glUniform3f(uniformOmniLightPos, light->GetPosition().x, light->GetPosition().y, light->GetPosition().z);
     glUniform1f(uniformFarPlane, light->GetFarPlane());
-    omniShadowShader.SetLightMatrices(light->CalculateLightTransform());
+    depthShader.SetLightMatrices(light->CalculateLightTransform());
 
-    omniShadowShader.Validate();
+    depthShader.Validate();
 
-    RenderScene();
+    RenderScene(false, cullView, VERTEX_FORMAT_POSITION);
+
+    target->Prefilter();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void RenderLightViewport()
+// What the lighting shaders see this frame, baked in as #defines
+ShaderPermutation LightingPermutation(int sceneLights)
+{
+    ShaderPermutation permutation;
+    permutation.pointLights = pointLightCount;
+    permutation.spotLights = spotLightCount;
+    permutation.directionalFilter = directionalShadowFilter;
+    permutation.omniFilter = omniShadowFilter;     // ApplyShadowFilters gives every omni light the same tier
+    permutation.clusteredLights = sceneLights == SCENE_LIGHTS_CLUSTERED;
+    permutation.objectLights = sceneLights == SCENE_LIGHTS_PER_OBJECT;
+    return permutation;
+}
+
+Shader* GetLitShader(int sceneLights)
+{
+    if (!specializedShaders) return &shaderList[0];
+    return litShaders.Get(LightingPermutation(sceneLights));
+}
+
+Shader* GetDeferredLightingShader()
 {
-    if (!showLightView) return;
+    if (!specializedShaders) return &deferredLightingShader;
 
+    // Per-object lists are forward only, the deferred pass uses the clusters instead
+    int sceneLights = sceneLightMode == SCENE_LIGHTS_OFF ? SCENE_LIGHTS_OFF : SCENE_LIGHTS_CLUSTERED;
+    return deferredLightingShaders.Get(LightingPermutation(sceneLights));
+}
+
+void RenderLightViewport()
+{
     // Mini viewport rectangle
     const GLint vpX = static_cast<GLint>(SCR_WIDTH) - 320;
     const GLint vpY = 5;
@@ -441,22 +1292,16 @@ void RenderLightViewport()
     const GLsizei vpH = 300;
 
     // Limit clear to the mini-viewport
-    glViewport(vpX, vpY, vpW, vpH);
-    glEnable(GL_SCISSOR_TEST);
+    GLState::Viewport(vpX, vpY, vpW, vpH);
+    GLState::SetEnabled(GL_SCISSOR_TEST, true);
     glScissor(vpX, vpY, vpW, vpH);
     glClearColor(0.05f, 0.05f, 0.08f, 1.0f); // subtle background to make it visible
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glDisable(GL_SCISSOR_TEST);
+    GLState::SetEnabled(GL_SCISSOR_TEST, false);
 
-    // Use main scene shader for colorful output
-    shaderList[0].UseShader();
-
-    const GLuint modelLoc = shaderList[0].GetModelLocation();
-    const GLuint projLoc  = shaderList[0].GetProjectionLocation();
-    const GLuint viewLoc  = shaderList[0].GetViewLocation();
-    const GLuint eyeLoc = shaderList[0].GetEyePositionLocation();
-    const GLuint specLoc = shaderList[0].GetSpecularIntensityLocation();
-    const GLuint shineLoc = shaderList[0].GetShininessLocation();
+    // Use main scene shader for colorful output, scene lights stay off in here
+    Shader* shader = GetLitShader(SCENE_LIGHTS_OFF);
+    shader->UseShader();
 
     // Construct a reasonable light camera for viewing
     // Eye is opposite to light direction so we "look along" the light
@@ -471,111 +1316,483 @@ void RenderLightViewport()
     // Replace with mainLight.GetLightProjection() if available.
     const glm::mat4 lightProj = glm::ortho(-30.0f, 30.0f, -30.0f, 30.0f, 0.1f, 100.0f);
 
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(lightProj));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(lightView));
-
-    glUniform3f(eyeLoc, eye.x, eye.y, eye.z);  // Light eye position
-    glUniform1f(specLoc, 1.0f);                // Specular intensity
-    glUniform1f(shineLoc, 256.0f);             // Shininess
+    uniformBlocks.SetCamera(lightProj, lightView, eye);  // Light eye position
 
-    // Lights/textures as normal
-    shaderList[0].SetDirectionalLight(&mainLight);
-    mainLight.getShadowMap()->Read(GL_TEXTURE2);
-    shaderList[0].SetDirectionalShadowMap(2);
-    shaderList[0].SetTexture(1);
+    // Lights/textures as normal, the lights themselves are already in LightBlock
+    BindShadowMaps();
+    shader->SetDirectionalShadowMap(2);
+    shader->SetTexture(1);
+    shader->SetClusters(nullptr);
 
-    shaderList[0].Validate();
+    shader->Validate();
 
     // Render the scene into the mini viewport
     RenderScene();
 
-    glUseProgram(0);
+    GLState::UseProgram(0);
+}
+
+// Shadow maps and clusters shared by the forward and deferred lighting shaders
+void SetSceneLighting(Shader& shader, glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+{
+    BindShadowMaps();
+    shader.SetDirectionalShadowMap(2);
+
+    if (sceneLightMode == SCENE_LIGHTS_CLUSTERED || (sceneLightMode == SCENE_LIGHTS_PER_OBJECT && deferredRendering)) {
+        clusteredLighting.Build(sceneLights, viewMatrix, projectionMatrix, 0.1f, 100.0f, SCR_WIDTH, SCR_HEIGHT);
+        shader.SetClusters(&clusteredLighting);
+    }
+    else if (sceneLightMode == SCENE_LIGHTS_PER_OBJECT) {
+        // Light data only, the lists come with each draw
+        clusteredLighting.UploadLights(sceneLights);
+        shader.SetClusters(nullptr);
+        clusteredLighting.Bind();
+    }
+    else {
+        shader.SetClusters(nullptr);
+    }
 }
 
-void RenderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix, float sunAngle)
+void RenderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
 {
-    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    GLState::Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    uniformBlocks.SetCamera(projectionMatrix, viewMatrix, cameras[activeCam].getCameraPosition());
+
+    // Lines don't fill the depth the lit pass would test against
+    bool prepass = depthPrepassReady && depthPrepass.BeginFrame(SCR_WIDTH, SCR_HEIGHT) && !wireframeMode;
+    if (prepass) {
+        gpuProfiler.BeginScope("Depth pre-pass");
+        depthPrepass.BeginDepth();
+        RenderScene(false, CULL_VIEW_CAMERA, VERTEX_FORMAT_POSITION);
+        depthPrepass.EndDepth();
+        gpuProfiler.EndScope();
+    }
+
+    gpuProfiler.BeginScope("Skybox");
 	skybox.DrawSkybox(viewMatrix, projectionMatrix);
+    gpuProfiler.EndScope();
 
-    shaderList[0].UseShader();
+    Shader* shader = GetLitShader(sceneLightMode);
+    shader->UseShader();
 
-    uniformModel = shaderList[0].GetModelLocation();
-    uniformProjection = shaderList[0].GetProjectionLocation();
-    uniformView = shaderList[0].GetViewLocation();
-    uniformEyePosition = shaderList[0].GetEyePositionLocation();
-    uniformSpecularIntensity = shaderList[0].GetSpecularIntensityLocation();
-    uniformShininess = shaderList[0].GetShininessLocation();
+    SetSceneLighting(*shader, projectionMatrix, viewMatrix);
+    shader->SetTexture(1);
 
-    glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
-    glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
-    glUniform3f(uniformEyePosition, cameras[activeCam].getCameraPosition().x, cameras[activeCam].getCameraPosition().y, cameras[activeCam].getCameraPosition().z);
+    shader->Validate();
 
-    shaderList[0].SetDirectionalLight(&mainLight);
-    shaderList[0].SetPointLights(pointLights, pointLightCount, 3, 0);
-    shaderList[0].SetSpotLights(spotLights, spotLightCount, 3 + pointLightCount, pointLightCount);
-    
-    glm::mat4 lightTransform = mainLight.CalculateLightTransform(sunAngle);
-    shaderList[0].SetDirectionalLightTransform(&lightTransform);
-    mainLight.getShadowMap()->Read(GL_TEXTURE2);
-    shaderList[0].SetTexture(1);
-    shaderList[0].SetDirectionalShadowMap(2);
+    if (depthPrepassReady) depthPrepass.BeginShading(prepass);
+    RenderScene(true, CULL_VIEW_CAMERA);
+    if (depthPrepassReady) depthPrepass.EndShading();
+    IssueOcclusionQueries(projectionMatrix * viewMatrix);
+}
 
-    glm::vec3 lowerLight = cameras[activeCam].getCameraPosition();
-    lowerLight.y -= 0.3f;
-    spotLights[0].SetFlash(lowerLight, cameras[activeCam].getCameraDirection());
+// 1. Geometry pass, surfaces only. The frame graph has the G-buffer bound
+void GeometryPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+{
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    shaderList[0].Validate();
+    geometryShader.UseShader();
 
-    RenderScene();
+    uniformBlocks.SetCamera(projectionMatrix, viewMatrix, cameras[activeCam].getCameraPosition());
+    geometryShader.SetTexture(1);
+
+    geometryShader.Validate();
+
+    ReadGeometrySamples();
+    glBeginQuery(GL_SAMPLES_PASSED, geometrySampleQueries[geometryQueryFrame % 2]);
+    RenderScene(false, CULL_VIEW_CAMERA);
+    glEndQuery(GL_SAMPLES_PASSED);
+    geometryQueryFrame++;
+    IssueOcclusionQueries(projectionMatrix * viewMatrix);
 }
 
-int main() {
-    int success;
-    char infoLog[512];
+// 2. Lighting pass, every light evaluated once per visible pixel
+void DeferredLightingPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix)
+{
+    GLState::Viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    Window mainWindow(SCR_WIDTH, SCR_HEIGHT);
-    if (mainWindow.Initialise() != 0) {
-        std::cerr << "Failed to initialize window" << std::endl;
-        return -1;
+    gpuProfiler.BeginScope("Skybox");
+    skybox.DrawSkybox(viewMatrix, projectionMatrix);
+    gpuProfiler.EndScope();
+
+    Shader* lightingShader = GetDeferredLightingShader();
+    lightingShader->UseShader();
+
+    SetSceneLighting(*lightingShader, projectionMatrix, viewMatrix);
+
+    glm::mat4 inverseViewProjection = glm::inverse(projectionMatrix * viewMatrix);
+    lightingShader->SetGBuffer(&gBuffer, &inverseViewProjection);
+
+    lightingShader->Validate();
+
+    GLState::SetEnabled(GL_DEPTH_TEST, false);
+    FullscreenTriangle::Draw();
+    GLState::SetEnabled(GL_DEPTH_TEST, true);
+}
+
+// Declares the frame and runs it. The light viewport only counts as an output while it's shown,
+// otherwise the graph culls it, and the G-buffer lives just from the geometry pass to the last reader
+void RenderFrame(glm::mat4 projection, glm::mat4 view, bool culling)
+{
+    frameGraph.Begin();
+
+    FrameGraph::Resource backbuffer = frameGraph.Import("Backbuffer");
+    FrameGraph::Resource cullViews = frameGraph.Import("Cull views");
+    FrameGraph::Resource hiZ = frameGraph.Import("Hi-Z");
+    FrameGraph::Resource lightView = frameGraph.Import("Light view");
+    frameGraph.MarkOutput(backbuffer);
+    if (showLightView) frameGraph.MarkOutput(lightView);
+
+    // Last frame's Hi-Z is read before this frame's replaces it
+    if (culling) {
+        FrameGraph::Pass cull = frameGraph.AddPass("Cull", [=]() { CullDrawBatch(projection * view); });
+        frameGraph.Read(cull, hiZ);
+        frameGraph.Write(cull, cullViews);
     }
 
-    glfwSetFramebufferSizeCallback(mainWindow.getWindow(), framebuffer_size_callback);
+    std::vector<FrameGraph::Resource> shadowMaps;
+    FrameGraph::Resource sunShadow = frameGraph.Import("Sun shadow map");
+    FrameGraph::Pass sunPass = frameGraph.AddPass("Sun shadow", []() { DirectionalShadowMapPass(&mainLight); });
+    frameGraph.Read(sunPass, cullViews);
+    frameGraph.Write(sunPass, sunShadow);
+    shadowMaps.push_back(sunShadow);
+
+    for (size_t i = 0; i < pointLightCount + spotLightCount; i++) {
+        PointLight* light = i < pointLightCount ? &pointLights[i] : static_cast<PointLight*>(&spotLights[i - pointLightCount]);
+        unsigned int cullView = CULL_VIEW_OMNI + static_cast<unsigned int>(i);
+        std::string name = "Omni shadow " + std::to_string(i);
+
+        FrameGraph::Resource shadowMap = frameGraph.Import((name + " map").c_str());
+        FrameGraph::Pass pass = frameGraph.AddPass(name.c_str(), [=]() { OmniShadowMapPass(light, cullView); });
+        frameGraph.Read(pass, cullViews);
+        frameGraph.Write(pass, shadowMap);
+        shadowMaps.push_back(shadowMap);
+    }
 
-    // keyboard input
-    glfwSetKeyCallback(mainWindow.getWindow(), Keyboard::keyCallback);
+    // The main pass time spans everything that draws the camera view
+    FrameGraph::Resource sceneDepth = backbuffer;
+    if (deferredRendering) {
+        FrameTextureDesc albedo = { (GLsizei)std::max(SCR_WIDTH, 1u), (GLsizei)std::max(SCR_HEIGHT, 1u), GL_RGBA8 };
+        FrameTextureDesc normal = albedo, depth = albedo;
+        normal.internalFormat = GL_RGB10_A2;
+        depth.internalFormat = GL_DEPTH_COMPONENT24;
+
+        FrameGraph::Resource albedoSpecular = frameGraph.Create("G-buffer albedo", albedo);
+        FrameGraph::Resource normalShininess = frameGraph.Create("G-buffer normal", normal);
+        FrameGraph::Resource gBufferDepth = frameGraph.Create("G-buffer depth", depth);
+        sceneDepth = gBufferDepth;
+
+        FrameGraph::Pass geometry = frameGraph.AddPass("G-buffer", [=]() {
+            gBuffer.SetTargets(frameGraph.GetTexture(albedoSpecular), frameGraph.GetTexture(normalShininess),
+                frameGraph.GetTexture(gBufferDepth), albedo.width, albedo.height);
+            ReadMainPassTime();
+            glBeginQuery(GL_TIME_ELAPSED, mainPassQueries[mainPassQueryFrame % 2]);
+            GeometryPass(projection, view);
+        });
+        frameGraph.Read(geometry, cullViews);
+        frameGraph.Attach(geometry, albedoSpecular, GL_COLOR_ATTACHMENT0);
+        frameGraph.Attach(geometry, normalShininess, GL_COLOR_ATTACHMENT1);
+        frameGraph.Attach(geometry, gBufferDepth, GL_DEPTH_ATTACHMENT);
+
+        FrameGraph::Pass lighting = frameGraph.AddPass("Deferred lighting", [=]() {
+            DeferredLightingPass(projection, view);
+            glEndQuery(GL_TIME_ELAPSED);
+            mainPassQueryFrame++;
+        });
+        frameGraph.Read(lighting, albedoSpecular);
+        frameGraph.Read(lighting, normalShininess);
+        frameGraph.Read(lighting, gBufferDepth);
+        for (FrameGraph::Resource shadowMap : shadowMaps) frameGraph.Read(lighting, shadowMap);
+        frameGraph.Write(lighting, backbuffer);
+    }
+    else {
+        FrameGraph::Pass forward = frameGraph.AddPass("Forward", [=]() {
+            ReadMainPassTime();
+            glBeginQuery(GL_TIME_ELAPSED, mainPassQueries[mainPassQueryFrame % 2]);
+            RenderPass(projection, view);
+            glEndQuery(GL_TIME_ELAPSED);
+            mainPassQueryFrame++;
+        });
+        frameGraph.Read(forward, cullViews);
+        for (FrameGraph::Resource shadowMap : shadowMaps) frameGraph.Read(forward, shadowMap);
+        frameGraph.Write(forward, backbuffer);
+    }
 
-    // mouse input
-    glfwSetCursorPosCallback(mainWindow.getWindow(), Mouse::cursorPosCallback);
-    glfwSetMouseButtonCallback(mainWindow.getWindow(), Mouse::mouseButtonCallback);
-    glfwSetScrollCallback(mainWindow.getWindow(), Mouse::scrollCallback);
+    // Next frame's occlusion tests run against this frame's depth
+    if (culling) {
+        FrameGraph::Pass pyramid = frameGraph.AddPass("Hi-Z", [=]() {
+            GLuint depth = deferredRendering ? frameGraph.GetTexture(sceneDepth) : 0;
+            gpuCulling.BuildHiZ(depth, SCR_WIDTH, SCR_HEIGHT, projection * view);
+        });
+        frameGraph.Read(pyramid, sceneDepth);
+        frameGraph.Write(pyramid, hiZ);
+        frameGraph.MarkOutput(hiZ);
+    }
+
+    // Drawn over the corner of the window, so after everything else that draws or reads there.
+    // It only declares the window while shown, writing an output would keep it from being culled
+    FrameGraph::Pass lightViewport = frameGraph.AddPass("Light viewport", []() { RenderLightViewport(); });
+    frameGraph.Read(lightViewport, sunShadow);
+    frameGraph.Write(lightViewport, lightView);
+    if (showLightView) frameGraph.Write(lightViewport, backbuffer);
 
-    glfwSetInputMode(mainWindow.getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    frameGraph.Compile();
+    frameGraph.Execute();
+}
+
+// Mouse motion that came in while the frame was updating turns the camera before its view is
+// built, a few milliseconds less between moving the mouse and seeing it
+void SampleLateInput(GLFWwindow* window)
+{
+    inputRecorder.beginLateInput();
+    if (window) glfwPollEvents();
+    DrainInput();
+
+    double dx = Mouse::getDX(), dy = Mouse::getDY();
+    if (dx != 0 || dy != 0) {
+        cameras[activeCam].updateCameraDirection(dx, dy);
+    }
+}
+
+// One frame at currentTime seconds, input is read from window when there is one or comes from a replay
+void RunFrame(double currentTime, GLFWwindow* window)
+{
+    double frameStart = lastFrame;
+    lastFrame = currentTime;
+
+    gpuProfiler.BeginFrame();
+    gpuProfiler.BeginScope("Update");
+    // The ticks this frame needs run while the input is handled
+    simulation.AdvanceTo(currentTime);
+    JobSystem::Get().RunMainThreadJobs();
+    bool input = window || inputRecorder.isReplaying();
+    if (input) processInput(window, frameStart, currentTime);
+
+    simulation.Sample(currentTime, sceneState);
+    mainLight.SetDirection(sceneState.sunDirection);
+    UpdateSceneLights();
+    UpdateScene();
+    AimFlashlight();
+    if (!deferredRendering) AssignObjectLights();
+    if (batchedDraws) BuildDrawBatch();
+
+    // The late input turns the camera, so the flashlight is aimed again before the lights go up
+    if (input) SampleLateInput(window);
+    AimFlashlight();
+    UpdateLights(sceneState.sunAngle);
+    glm::mat4 view = cameras[activeCam].getViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(cameras[activeCam].zoom),
+        static_cast<float>(SCR_WIDTH) / static_cast<float>(SCR_HEIGHT), 0.1f, 100.0f);
+    bool culling = batchedDraws && gpuCullingEnabled && drawBatch.UsesCulledViews();
+    bool softwareCulling = !batchedDraws && softwareOcclusionEnabled;
+    if (softwareCulling) OcclusionCullScene(projection * view);
+    gpuProfiler.EndScope();
+
+    // Culling, shadow maps, main scene, Hi-Z and the light viewport
+    RenderFrame(projection, view, culling);
+
+    uniformBlocks.EndFrame();
+    bench.EndFrame(GLState::GetFrameDraws());   // only counts inside a bench run
+    GLState::EndFrame();
+    drawBatch.EndFrame();
+    if (softwareCulling) softwareOcclusion.EndFrame();
+    GLState::UseProgram(0);
+    gpuProfiler.EndFrame();
+}
+
+// Settings the keys would otherwise toggle, anything the GL can't do stays off
+void ApplyBenchScenario(const BenchScenario& scenario)
+{
+    deferredRendering = scenario.deferred && deferredReady;
+    specializedShaders = scenario.specializedShaders;
+    sceneLightMode = clusteredLightingReady ? scenario.sceneLights : SCENE_LIGHTS_OFF;
+
+    pointLightCount = std::min(pointLightCount, scenario.pointLights);
+    spotLightCount = std::min(spotLightCount, scenario.spotLights);
+    directionalShadowFilter = scenario.directionalFilter;
+    omniShadowFilter = scenario.omniFilter;
+    ApplyShadowFilters();
+
+    if (!scenario.models.empty()) {
+        const char* modelNames[] = { "seahawk", "airplane", "tower" };
+        Model* models[] = { &seahawk, &AirPlane, &Old_Water_Tower };
+        for (int i = 0; i < 3; i++) {
+            if (std::find(scenario.models.begin(), scenario.models.end(), modelNames[i]) == scenario.models.end()) {
+                hiddenModels.push_back(models[i]);
+            }
+        }
+    }
+    if (scenario.towers > 0) BuildTowerInstances(scenario.towers);
+
+    batchedDraws = scenario.batched && drawBatchReady;
+    gpuCullingEnabled = scenario.gpuCulling && gpuCullingReady;
+    if (gpuCullingReady) drawBatch.SetViewCount(CULL_VIEW_OMNI + pointLightCount + spotLightCount);
+    softwareOcclusionEnabled = scenario.softwareOcclusion;
+    occlusionQueriesEnabled = scenario.occlusionQueries && occlusionQueriesReady;
+    occlusionQueries.Reset();
+    showLightView = scenario.lightView;
+    if (depthPrepassReady) depthPrepass.SetMode(scenario.depthPrepass);
+}
+
+// Warm-up then measured frames on a fixed timestep, the camera on the scenario's path
+int RunBench(const char* output)
+{
+    const BenchScenario& scenario = bench.GetScenario();
+    printf("Bench %s: %ux%u, %u warm-up and %u measured frames on %s\n", scenario.name.c_str(),
+        scenario.width, scenario.height, scenario.warmupFrames, scenario.measuredFrames, (const char*)glGetString(GL_RENDERER));
+
+    for (unsigned int frame = 0; frame < bench.GetFrameCount(); frame++) {
+        if (frame == scenario.warmupFrames) {
+            gpuProfiler.Flush();
+            gpuProfiler.SetHistoryFrames(scenario.measuredFrames);
+            gpuProfiler.ResetStats();
+        }
+
+        glm::vec3 position, target;
+        bench.GetCamera(frame, position, target);
+        cameras[activeCam].lookAt(position, target);
+
+        bench.BeginFrame(frame);
+        RunFrame(bench.GetFrameTime(frame), nullptr);
+        if (frame + 1 < bench.GetFrameCount()) simulation.AdvanceTo(bench.GetFrameTime(frame + 1));
+    }
+    gpuProfiler.Flush();
+
+    gpuProfiler.Report();
+    if (!bench.WriteResults(output, gpuProfiler)) return -1;
+    if (output) printf("Wrote %s\n", output);
+    return 0;
+}
+
+// Everything global that holds GL objects lets go of them here, while the context is still
+// current. Their destructors run after the window is gone and find nothing left to delete
+void ReleaseGL()
+{
+    glDeleteQueries(2, mainPassQueries);
+    glDeleteQueries(2, geometrySampleQueries);
+    mainPassQueries[0] = mainPassQueries[1] = 0;
+    geometrySampleQueries[0] = geometrySampleQueries[1] = 0;
+
+    // Cleanup BOTH meshes before exit
+    for (auto mesh : meshList) {
+        if (mesh) {
+            mesh->ClearMesh();
+            delete mesh;
+        }
+    }
+    meshList.clear();
+
+    brickTexture.ClearTexture();
+    dirtTexture.ClearTexture();
+    plainTexture.ClearTexture();
+    seahawk.ClearModel();
+    AirPlane.ClearModel();
+    Old_Water_Tower.ClearModel();
+    cubus_faun_912_21d.ClearModel();
+
+    shaderList.clear();
+    directionalShadowShader.ClearShader();
+    omniShadowShader.ClearShader();
+    directionalVarianceShader.ClearShader();
+    omniVarianceShader.ClearShader();
+    geometryShader.ClearShader();
+    deferredLightingShader.ClearShader();
+    litShaders.Clear();
+    deferredLightingShaders.Clear();
+
+    uniformBlocks.Release();
+    clusteredLighting.Release();
+    drawBatch.Release();
+    gpuCulling.Release();
+    occlusionQueries.Release();
+    depthPrepass.Release();
+    frameGraph.Release();
+    gpuProfiler.Release();
+    framePacer.Release();
+    bench.Release();
+}
+
+// Where a recorded or replayed session ended up, a replay of a recording should print the same
+void ReportSession()
+{
+    const Camera& camera = cameras[activeCam];
+    printf("%s ended after %u frames: camera %d at (%.9g, %.9g, %.9g) yaw %.9g pitch %.9g, sun angle %.9g, seahawk angle %.9g\n",
+        inputRecorder.isReplaying() ? "Replay" : "Recording", inputRecorder.getFrame(), activeCam,
+        camera.cameraPos.x, camera.cameraPos.y, camera.cameraPos.z, camera.yaw, camera.pitch, sceneState.sunAngle, sceneState.seahawkAngle);
+}
+
+int main(int argc, char** argv) {
+    int success;
+    char infoLog[512];
+
+    // OpenGL --bench scenario.txt [--out results.json], results go to stdout without --out
+    // OpenGL --record session.rec
+    // OpenGL --replay session.rec [--timestep seconds] [--headless], recorded frame times without --timestep
+    const char* benchScenario = nullptr;
+    const char* benchOutput = nullptr;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    double replayTimestep = 0.0;
+    bool headless = false;
+    for (int i = 1; i < argc; i++) {
+        bool value = i + 1 < argc;
+        if (strcmp(argv[i], "--bench") == 0 && value) benchScenario = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && value) benchOutput = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && value) recordPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && value) replayPath = argv[++i];
+        else if (strcmp(argv[i], "--timestep") == 0 && value) replayTimestep = atof(argv[++i]);
+        else if (strcmp(argv[i], "--headless") == 0) headless = true;
+    }
+    if (benchScenario) {
+        if (!bench.Load(benchScenario)) return -1;
+        SCR_WIDTH = bench.GetScenario().width;
+        SCR_HEIGHT = bench.GetScenario().height;
+    }
+
+    // Benchmarks need no display, the window takes the keyboard and mouse otherwise
+    Window* mainWindow = Window::Create(SCR_WIDTH, SCR_HEIGHT, benchScenario != nullptr || (replayPath && headless));
+    if (!mainWindow) {
+        std::cerr << "Failed to initialize window" << std::endl;
+        return -1;
+    }
+    SCR_WIDTH = static_cast<unsigned int>(mainWindow->getBufferWidth());
+    SCR_HEIGHT = static_cast<unsigned int>(mainWindow->getBufferHeight());
+    mainWindow->setResizeCallback(framebuffer_size_callback);
+    JobSystem::Get().Init();
 
     CreateShader();
     CreateObject();
 
     brickTexture = Texture("Textures/brick.png");
-    brickTexture.LoadTextureA();
     dirtTexture = Texture("Textures/dirt.png");
-    dirtTexture.LoadTextureA();
     plainTexture = Texture("Textures/plain.png");
-    plainTexture.LoadTextureA();
 
     shinyMaterial = Material(1.0f, 256.0f);
     dullMaterial = Material(0.3f, 4.0f);
 
     seahawk = Model();
-    seahawk.LoadModel("Models/Seahawk.obj");
-
 	AirPlane = Model();
-	AirPlane.LoadModel("Models/Airplane.obj");
-
     Old_Water_Tower = Model();
-    Old_Water_Tower.LoadModel("Models/old_water_tower_OBJ.obj");
+
+    std::vector<std::string> skyboxFaces;
+    skyboxFaces.push_back("Textures/Skybox/px.png"); // +X
+    skyboxFaces.push_back("Textures/Skybox/nx.png"); // -X
+    skyboxFaces.push_back("Textures/Skybox/py.png"); // +Y
+    skyboxFaces.push_back("Textures/Skybox/ny.png"); // -Y
+    skyboxFaces.push_back("Textures/Skybox/pz.png"); // +Z
+    skyboxFaces.push_back("Textures/Skybox/nz.png"); // -Z
+
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    bool loaded = LoadAssets(skyboxFaces).Wait();
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - loadStart;
+    printf("Assets loaded in %.0f ms%s\n", loadTime.count(), loaded ? "" : ", some failed");
 
     // Directional light: white, some ambient + diffuse
     mainLight = DirectionalLight(
@@ -630,74 +1847,98 @@ int main() {
     );
     //spotLightCount++;
 
-    std::vector<std::string> skyboxFaces;
-    skyboxFaces.push_back("Textures/Skybox/px.png"); // +X
-    skyboxFaces.push_back("Textures/Skybox/nx.png"); // -X
-    skyboxFaces.push_back("Textures/Skybox/py.png"); // +Y
-    skyboxFaces.push_back("Textures/Skybox/ny.png"); // -Y
-    skyboxFaces.push_back("Textures/Skybox/pz.png"); // +Z
-    skyboxFaces.push_back("Textures/Skybox/nz.png"); // -Z
+    if (!uniformBlocks.Init()) {
+        std::cerr << "Failed to create uniform blocks" << std::endl;
+        ReleaseGL();
+        delete mainWindow;
+        return -1;
+    }
 
-    skybox = Skybox(skyboxFaces);
+    ApplyShadowFilters();
+    glGenQueries(2, mainPassQueries);
+
+    clusteredLightingReady = clusteredLighting.Init();
+
+    deferredReady = gBuffer.Init();
+    gpuProfiler.Init();
+    framePacer.Init();
+    frameGraph.SetProfiler(&gpuProfiler);
+    glGenQueries(2, geometrySampleQueries);
+    CreateSceneLights();
+
+    // From here on the animation runs on its own thread
+    SimState initialState = {};
+    StepSimulation(initialState, 0.0, 0.0f);
+    simulation.Start(initialState, 1.0 / 60.0, StepSimulation);
+
+    drawBatchReady = drawBatch.Init(mainWindow->getProcLoader());
+    gpuCullingReady = drawBatchReady && gpuCulling.Init();
+    occlusionQueriesReady = occlusionQueries.Init();
+    depthPrepassReady = depthPrepass.Init();
+    if (gpuCullingReady) {
+        drawBatch.SetViewCount(CULL_VIEW_OMNI + pointLightCount + spotLightCount);
+    }
 
     x = 0.0f;
     y = 0.0f;
     z = 3.0f;
 
-    glEnable(GL_DEPTH_TEST);
-
-    // Render loop
-    while (!mainWindow.getShouldClose()) {
-        double currentTime = glfwGetTime();
-        deltaTime = static_cast<float>(currentTime - lastFrame);
-        lastFrame = static_cast<float>(currentTime);
-
-        sunAngle += sunSpeed * deltaTime;
-        if (sunAngle > 6.28318f) sunAngle -= 6.28318f;
-
-        float radius = 25.0f;
-        float fixedY = 15.0f;
-        float xPos = radius * cos(sunAngle);
-        float zPos = radius * sin(sunAngle);
-        glm::vec3 lightPos(xPos, fixedY, zPos);
-        glm::vec3 lightDir = glm::normalize(-lightPos);
-        mainLight.SetDirection(lightDir);
+    GLState::SetEnabled(GL_DEPTH_TEST, true);
 
-        processInput(mainWindow.getWindow(), deltaTime);
-
-        // 1. Shadow passes FIRST
-        DirectionalShadowMapPass(&mainLight, sunAngle);
-        for (size_t i = 0; i < pointLightCount; i++) {
-            OmniShadowMapPass(&pointLights[i]);
-        }
-        for (size_t i = 0; i < spotLightCount; i++) {
-            OmniShadowMapPass(&spotLights[i]);
+    int result = 0;
+    if (benchScenario) {
+        result = -1;
+        if (bench.Init()) {
+            ApplyBenchScenario(bench.GetScenario());
+            result = RunBench(benchOutput);
         }
-
-        // 2. MAIN SCENE - clears entire screen ONCE
-        glm::mat4 view = cameras[activeCam].getViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(cameras[activeCam].zoom),
-            static_cast<float>(SCR_WIDTH) / static_cast<float>(SCR_HEIGHT), 0.1f, 100.0f);
-        RenderPass(projection, view, sunAngle);
-
-        // 3. LIGHT VIEWPORT - NO FULL CLEAR, only depth
-        glm::mat4 lightTransform = mainLight.CalculateLightTransform(sunAngle);
-        RenderLightViewport();  // Fixed call
-
-        glUseProgram(0);
-        mainWindow.swapBuffers();
-        mainWindow.pollEvents();
     }
+    else {
+        GLFWwindow* window = mainWindow->getWindow();
+        if (window) glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        int appliedSwapInterval = swapInterval;
+        mainWindow->setSwapInterval(appliedSwapInterval);
+
+        // Both start with the first frame, input and timing from before it would be lost
+        if (replayPath) {
+            if (!inputRecorder.startReplay(replayPath, window, replayTimestep)) result = -1;
+        }
+        else if (recordPath && window) {
+            if (!inputRecorder.startRecording(recordPath)) result = -1;
+        }
 
-
-    // Cleanup BOTH meshes before exit
-    for (auto mesh : meshList) {
-        if (mesh) {
-            mesh->ClearMesh();
-            delete mesh;
+        // Render loop
+        while (result == 0 && !mainWindow->getShouldClose() && !inputRecorder.isFinished()) {
+            if (swapInterval != appliedSwapInterval) {
+                appliedSwapInterval = swapInterval;
+                mainWindow->setSwapInterval(appliedSwapInterval);
+            }
+            framePacer.BeginFrame();
+            RunFrame(inputRecorder.beginFrame(window ? glfwGetTime() : 0.0), window);
+            mainWindow->swapBuffers();
+            // Next frame starts no earlier than now, its ticks can run while this one waits on the GPU.
+            // A replay's frame times aren't the clock's
+            if (window && !inputRecorder.isReplaying()) simulation.AdvanceTo(glfwGetTime());
+            framePacer.EndFrame();
+            mainWindow->pollEvents();
         }
+
+        if (inputRecorder.isRecording() || inputRecorder.isReplaying()) ReportSession();
+        inputRecorder.stop();
+
+        ReportMainPassTiming();
+        ReportSceneLights();
+        frameGraph.Dump();
+        gpuProfiler.Report();
+        framePacer.Report();
+        simulation.Report();
+        JobSystem::Get().Report();
+        if (deferredRendering) ReportGBuffer();
     }
-    meshList.clear();
 
-    return 0;
+    simulation.Stop();
+    JobSystem::Get().Shutdown();
+    ReleaseGL();
+    delete mainWindow;
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "AssetTask.h"
+
+std::coroutine_handle<> AssetTask::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+{
+	promise_type& promise = handle.promise();
+	void* waiting = promise.continuation.exchange(&promise, std::memory_order_acq_rel);
+
+	// Read the continuation first, the frame may be gone after this
+	std::coroutine_handle<> next = waiting ? std::coroutine_handle<>::from_address(waiting) : std::noop_coroutine();
+	if (promise.references.fetch_sub(1, std::memory_order_acq_rel) == 1) handle.destroy();
+	return next;
+}
+
+bool AssetTask::Awaiter::await_ready() const noexcept
+{
+	return handle.promise().continuation.load(std::memory_order_acquire) == &handle.promise();
+}
+
+bool AssetTask::Awaiter::await_suspend(std::coroutine_handle<> waiting) noexcept
+{
+	void* expected = nullptr;
+	return handle.promise().continuation.compare_exchange_strong(expected, waiting.address(), std::memory_order_acq_rel);
+}
+
+AssetTask::AssetTask(AssetTask&& other) noexcept
+{
+	handle = other.handle;
+	other.handle = nullptr;
+}
+
+AssetTask& AssetTask::operator=(AssetTask&& other) noexcept
+{
+	if (this != &other)
+	{
+		Release();
+		handle = other.handle;
+		other.handle = nullptr;
+	}
+	return *this;
+}
+
+bool AssetTask::IsDone() const
+{
+	return !handle || handle.promise().continuation.load(std::memory_order_acquire) == &handle.promise();
+}
+
+// Runs done once task has finished, wherever it finished
+static AssetTask SignalWhenDone(const AssetTask& task, Job* done)
+{
+	co_await task;
+	JobSystem::Get().Run(done);
+	co_return true;
+}
+
+bool AssetTask::Wait() const
+{
+	if (!handle) return false;
+	if (IsDone()) return handle.promise().result;
+
+	// done holds waiting open until the task finishes, Wait on it runs everything else meanwhile
+	JobSystem& jobs = JobSystem::Get();
+	Job* waiting = jobs.Create(nullptr);
+	Job* done = jobs.Create(nullptr, waiting);
+	AssetTask signal = SignalWhenDone(*this, done);
+	jobs.Run(waiting);
+	jobs.Wait(waiting);
+	return handle.promise().result;
+}
+
+AssetTask AssetTask::WhenAll(std::vector<AssetTask> tasks)
+{
+	// They're all under way already, waiting on each in turn only waits as long as the slowest
+	bool loaded = true;
+	for (AssetTask& task : tasks)
+	{
+		if (!co_await task) loaded = false;
+	}
+	co_return loaded;
+}
+
+void AssetTask::Release()
+{
+	if (handle && handle.promise().references.fetch_sub(1, std::memory_order_acq_rel) == 1) handle.destroy();
+	handle = nullptr;
+}
+
+AssetTask::~AssetTask()
+{
+	Release();
+}
+
+bool ResumeOnWorker::await_ready() const noexcept
+{
+	JobSystem& jobs = JobSystem::Get();
+	return !jobs.IsMainThread() || jobs.GetWorkerCount() == 0;
+}
+
+void ResumeOnWorker::await_suspend(std::coroutine_handle<> handle) const
+{
+	JobSystem& jobs = JobSystem::Get();
+	Job* job = jobs.Create([handle]() { handle.resume(); });
+	jobs.Detach(job);
+	jobs.RunOnWorker(job);
+}
+
+bool ResumeOnMainThread::await_ready() const noexcept
+{
+	return JobSystem::Get().IsMainThread();
+}
+
+void ResumeOnMainThread::await_suspend(std::coroutine_handle<> handle) const
+{
+	JobSystem& jobs = JobSystem::Get();
+	Job* job = jobs.Create([handle]() { handle.resume(); });
+	jobs.Detach(job);
+	jobs.RunOnMainThread(job);
+}
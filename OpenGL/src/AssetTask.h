@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <vector>
+
+#include "JobSystem.h"
+
+// An asset load written as a coroutine that co_returns whether it worked. It starts as soon as
+// it's called, co_await ResumeOnWorker() moves the rest of it onto the job system's workers for
+// file reads and decodes, co_await ResumeOnMainThread() back to the main thread for GL.
+//
+// co_await on a task gives its result once it's done and picks up on the thread it finished on,
+// Wait does the same for plain code on the main thread, running jobs and uploads meanwhile.
+// Loads started together overlap, so
+//
+//	std::vector<AssetTask> loads;
+//	for (Model& model : models) loads.push_back(model.LoadModelAsync(...));
+//	co_await AssetTask::WhenAll(std::move(loads));
+//
+// takes about as long as its slowest read or the sum of its uploads, whichever is longer. The
+// task can go before the load does, which then finishes on its own
+class AssetTask
+{
+public:
+	struct promise_type;
+
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+		void await_resume() const noexcept {}
+	};
+
+	struct promise_type
+	{
+		bool result = false;
+		// The coroutine waiting on this one, or the promise itself once it's done
+		std::atomic<void*> continuation{ nullptr };
+		// The task's and the coroutine's, the last to let go frees the frame
+		std::atomic<int> references{ 2 };
+
+		AssetTask get_return_object() { return AssetTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_never initial_suspend() const noexcept { return {}; }
+		FinalAwaiter final_suspend() const noexcept { return {}; }
+		void return_value(bool value) { result = value; }
+		void unhandled_exception() { result = false; }
+	};
+
+	struct Awaiter
+	{
+		std::coroutine_handle<promise_type> handle;
+
+		bool await_ready() const noexcept;
+		// false when the task finished in between, the awaiting coroutine carries straight on
+		bool await_suspend(std::coroutine_handle<> waiting) noexcept;
+		bool await_resume() const noexcept { return handle.promise().result; }
+	};
+
+	AssetTask() {}
+	AssetTask(AssetTask&& other) noexcept;
+	AssetTask& operator=(AssetTask&& other) noexcept;
+	AssetTask(const AssetTask&) = delete;
+	AssetTask& operator=(const AssetTask&) = delete;
+
+	bool IsDone() const;
+	// Only one coroutine may wait on a task
+	Awaiter operator co_await() const noexcept { return Awaiter{ handle }; }
+	// Main thread. Runs jobs, main thread ones included, until the task is done
+	bool Wait() const;
+
+	// Done once every task is, true if they all loaded
+	static AssetTask WhenAll(std::vector<AssetTask> tasks);
+
+	~AssetTask();
+
+private:
+	explicit AssetTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+	void Release();
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+// The rest of the coroutine runs as a job on a worker, never the main thread even while it waits.
+// Stays put on a worker already, or with no workers
+struct ResumeOnWorker
+{
+	bool await_ready() const noexcept;
+	void await_suspend(std::coroutine_handle<> handle) const;
+	void await_resume() const noexcept {}
+};
+
+// The rest of the coroutine runs from the main thread's queue, for GL
+struct ResumeOnMainThread
+{
+	bool await_ready() const noexcept;
+	void await_suspend(std::coroutine_handle<> handle) const;
+	void await_resume() const noexcept {}
+};
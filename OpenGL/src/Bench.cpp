@@ -0,0 +1,366 @@
+#include "Bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "CommonValues.h"
+#include "DepthPrepass.h"
+
+BenchScenario::BenchScenario()
+{
+	name = "bench";
+	width = 1280;
+	height = 720;
+	warmupFrames = 60;
+	measuredFrames = 300;
+	timestep = 1.0f / 60.0f;
+
+	// The interactive defaults
+	deferred = false;
+	specializedShaders = true;
+	directionalFilter = SHADOW_FILTER_PCF4;
+	omniFilter = SHADOW_FILTER_PCF4;
+	sceneLights = 0;
+	pointLights = 2;
+	spotLights = 1;
+	towers = 0;
+	batched = false;
+	gpuCulling = false;
+	softwareOcclusion = false;
+	occlusionQueries = false;
+	lightView = true;
+	depthPrepass = DEPTH_PREPASS_AUTO;
+}
+
+static double Now()
+{
+	std::chrono::duration<double, std::milli> now = std::chrono::steady_clock::now().time_since_epoch();
+	return now.count();
+}
+
+Bench::Bench()
+{
+	queryIssued[0] = queryIssued[1] = false;
+	frame = 0;
+	measuring = false;
+	frameStart = 0.0;
+}
+
+bool Bench::Load(const char* path)
+{
+	std::ifstream fileStream(path, std::ios::in);
+	if (!fileStream.is_open())
+	{
+		printf("Failed to read %s! File doesn't exist.\n", path);
+		return false;
+	}
+
+	std::string line;
+	unsigned int lineNumber = 0;
+	while (std::getline(fileStream, line))
+	{
+		lineNumber++;
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) line.erase(comment);
+
+		std::istringstream stream(line);
+		std::vector<std::string> words;
+		std::string word;
+		while (stream >> word)
+		{
+			words.push_back(word);
+		}
+		if (words.empty()) continue;
+
+		if (!ParseLine(words))
+		{
+			printf("%s:%u: can't read \"%s\"\n", path, lineNumber, line.c_str());
+			return false;
+		}
+	}
+
+	if (scenario.camera.empty())
+	{
+		BenchCameraKey key = { glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 0.0f) };
+		scenario.camera.push_back(key);
+	}
+	if (scenario.width == 0 || scenario.height == 0 || scenario.measuredFrames == 0)
+	{
+		printf("%s: needs a resolution and at least one measured frame\n", path);
+		return false;
+	}
+	return true;
+}
+
+static bool ParseSwitch(const std::string& word, bool& value)
+{
+	if (word == "on") value = true;
+	else if (word == "off") value = false;
+	else return false;
+	return true;
+}
+
+static int ParseName(const std::string& word, const char* const* names, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (word == names[i]) return i;
+	}
+	return -1;
+}
+
+bool Bench::ParseLine(const std::vector<std::string>& words)
+{
+	const std::string& key = words[0];
+	size_t values = words.size() - 1;
+	auto number = [&](size_t i) { return std::atof(words[i].c_str()); };
+
+	if (key == "name" && values == 1) scenario.name = words[1];
+	else if (key == "resolution" && values == 2)
+	{
+		scenario.width = (unsigned int)number(1);
+		scenario.height = (unsigned int)number(2);
+	}
+	else if (key == "warmup" && values == 1) scenario.warmupFrames = (unsigned int)number(1);
+	else if (key == "frames" && values == 1) scenario.measuredFrames = (unsigned int)number(1);
+	else if (key == "timestep" && values == 1) scenario.timestep = (float)number(1);
+	else if (key == "renderer" && values == 1)
+	{
+		if (words[1] != "forward" && words[1] != "deferred") return false;
+		scenario.deferred = words[1] == "deferred";
+	}
+	else if (key == "shaders" && values == 1)
+	{
+		if (words[1] != "specialized" && words[1] != "generic") return false;
+		scenario.specializedShaders = words[1] == "specialized";
+	}
+	else if (key == "shadow_filter" && values == 2)
+	{
+		static const char* const filters[SHADOW_FILTER_COUNT] = { "HARD", "PCF1", "PCF4", "POISSON", "VSM" };
+		scenario.directionalFilter = ParseName(words[1], filters, SHADOW_FILTER_COUNT);
+		scenario.omniFilter = ParseName(words[2], filters, SHADOW_FILTER_COUNT);
+		if (scenario.directionalFilter < 0 || scenario.omniFilter < 0) return false;
+	}
+	else if (key == "scene_lights" && values == 1)
+	{
+		static const char* const modes[] = { "off", "clustered", "per-object" };
+		scenario.sceneLights = ParseName(words[1], modes, 3);
+		if (scenario.sceneLights < 0) return false;
+	}
+	else if (key == "point_lights" && values == 1) scenario.pointLights = (unsigned int)number(1);
+	else if (key == "spot_lights" && values == 1) scenario.spotLights = (unsigned int)number(1);
+	else if (key == "models") scenario.models.assign(words.begin() + 1, words.end());
+	else if (key == "towers" && values == 1) scenario.towers = (unsigned int)number(1);
+	else if (key == "batched" && values == 1) return ParseSwitch(words[1], scenario.batched);
+	else if (key == "gpu_culling" && values == 1) return ParseSwitch(words[1], scenario.gpuCulling);
+	else if (key == "software_occlusion" && values == 1) return ParseSwitch(words[1], scenario.softwareOcclusion);
+	else if (key == "occlusion_queries" && values == 1) return ParseSwitch(words[1], scenario.occlusionQueries);
+	else if (key == "light_view" && values == 1) return ParseSwitch(words[1], scenario.lightView);
+	else if (key == "depth_prepass" && values == 1)
+	{
+		static const char* const modes[DEPTH_PREPASS_MODE_COUNT] = { "off", "on", "auto" };
+		scenario.depthPrepass = ParseName(words[1], modes, DEPTH_PREPASS_MODE_COUNT);
+		if (scenario.depthPrepass < 0) return false;
+	}
+	else if (key == "camera" && values == 6)
+	{
+		BenchCameraKey cameraKey;
+		cameraKey.position = glm::vec3(number(1), number(2), number(3));
+		cameraKey.target = glm::vec3(number(4), number(5), number(6));
+		scenario.camera.push_back(cameraKey);
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+bool Bench::Init()
+{
+	cpuFrameTimes.reserve(scenario.measuredFrames);
+	drawCalls.reserve(scenario.measuredFrames);
+	triangles.reserve(scenario.measuredFrames);
+	return true;
+}
+
+static glm::vec3 CatmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+{
+	float t2 = t * t, t3 = t2 * t;
+	return 0.5f * (2.0f * p1 + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+void Bench::GetCamera(unsigned int frame, glm::vec3& position, glm::vec3& target) const
+{
+	const std::vector<BenchCameraKey>& keys = scenario.camera;
+	int last = (int)keys.size() - 1;
+
+	// 0 to 1 over the measured frames, both ends hit a key exactly
+	float t = 0.0f;
+	if (IsMeasured(frame) && scenario.measuredFrames > 1)
+	{
+		t = (float)(frame - scenario.warmupFrames) / (scenario.measuredFrames - 1);
+	}
+
+	float along = t * last;
+	int segment = std::min((int)along, std::max(last - 1, 0));
+	float local = along - segment;
+
+	// End keys repeat so the curve starts and stops on them
+	const BenchCameraKey& k0 = keys[std::max(segment - 1, 0)];
+	const BenchCameraKey& k1 = keys[segment];
+	const BenchCameraKey& k2 = keys[std::min(segment + 1, last)];
+	const BenchCameraKey& k3 = keys[std::min(segment + 2, last)];
+
+	position = CatmullRom(k0.position, k1.position, k2.position, k3.position, local);
+	target = CatmullRom(k0.target, k1.target, k2.target, k3.target, local);
+}
+
+void Bench::BeginFrame(unsigned int frame)
+{
+	this->frame = frame;
+	measuring = IsMeasured(frame);
+	frameStart = Now();
+
+	if (measuring)
+	{
+		ReadTriangles(false);
+		GLState::BeginTriangleCount(&triangleQueries[frame % 2]);
+	}
+}
+
+void Bench::EndFrame(unsigned int frameDrawCalls)
+{
+	if (!measuring) return;
+
+	GLState::EndTriangleCount();
+	queryIssued[frame % 2] = true;
+
+	cpuFrameTimes.push_back(Now() - frameStart);
+	drawCalls.push_back(frameDrawCalls);
+}
+
+void Bench::ReadTriangles(bool wait)
+{
+	// Last frame's, with two sets the GPU has a frame to finish them
+	for (unsigned int i = 1; i <= 2; i++)
+	{
+		unsigned int slot = (frame + i) % 2;
+		if (!queryIssued[slot]) continue;
+
+		const TriangleQueries& queries = triangleQueries[slot];
+		GLint available = 0;
+		for (size_t q = 0; q < queries.used; q++)
+		{
+			glGetQueryObjectiv(queries.queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) break;
+		}
+		if (!available && !wait) continue;
+
+		GLuint total = 0;
+		for (size_t q = 0; q < queries.used; q++)
+		{
+			GLuint count = 0;
+			glGetQueryObjectuiv(queries.queries[q], GL_QUERY_RESULT, &count);
+			total += count;
+		}
+		triangles.push_back(total);
+		queryIssued[slot] = false;
+	}
+}
+
+// min/avg/p95/p99 as a JSON object, nearest rank percentiles
+static void WriteStats(FILE* file, std::vector<double> values)
+{
+	if (values.empty())
+	{
+		fprintf(file, "null");
+		return;
+	}
+
+	std::sort(values.begin(), values.end());
+	double sum = 0.0;
+	for (double value : values)
+	{
+		sum += value;
+	}
+	auto percentile = [&](double p) {
+		size_t rank = (size_t)std::ceil(p * values.size());
+		return values[rank > 0 ? rank - 1 : 0];
+	};
+
+	fprintf(file, "{\"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+		values.front(), sum / values.size(), percentile(0.95), percentile(0.99), values.back());
+}
+
+bool Bench::WriteResults(const char* path, const GpuProfiler& profiler)
+{
+	ReadTriangles(true);
+
+	FILE* file = path ? fopen(path, "w") : stdout;
+	if (!file)
+	{
+		printf("Failed to write %s\n", path);
+		return false;
+	}
+
+	const char* vendor = (const char*)glGetString(GL_VENDOR);
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"scenario\": \"%s\",\n", scenario.name.c_str());
+	fprintf(file, "  \"gl\": {\"vendor\": \"%s\", \"renderer\": \"%s\", \"version\": \"%s\"},\n",
+		vendor ? vendor : "", renderer ? renderer : "", version ? version : "");
+	fprintf(file, "  \"resolution\": [%u, %u],\n", scenario.width, scenario.height);
+	fprintf(file, "  \"warmup_frames\": %u,\n", scenario.warmupFrames);
+	fprintf(file, "  \"measured_frames\": %zu,\n", cpuFrameTimes.size());
+	fprintf(file, "  \"gpu_frames\": %u,\n", profiler.GetFrameCount());
+
+	fprintf(file, "  \"cpu_frame_ms\": ");
+	WriteStats(file, cpuFrameTimes);
+	fprintf(file, ",\n  \"draw_calls\": ");
+	WriteStats(file, drawCalls);
+	fprintf(file, ",\n  \"triangles\": ");
+	WriteStats(file, triangles);
+
+	fprintf(file, ",\n  \"scopes\": {");
+	bool first = true;
+	for (const std::string& name : profiler.GetScopeNames())
+	{
+		ProfileStats stats;
+		if (!profiler.GetStats(name, stats)) continue;
+
+		fprintf(file, "%s\n    \"%s\": {\"frames\": %u, \"gpu_ms\": {\"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f}, "
+			"\"cpu_ms\": {\"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f}}",
+			first ? "" : ",", name.c_str(), stats.samples,
+			stats.gpuMin, stats.gpuAverage, stats.gpuP95, stats.gpuP99,
+			stats.cpuMin, stats.cpuAverage, stats.cpuP95, stats.cpuP99);
+		first = false;
+	}
+	fprintf(file, "\n  }\n}\n");
+
+	if (file != stdout) fclose(file);
+	return true;
+}
+
+void Bench::Release()
+{
+	for (TriangleQueries& queries : triangleQueries)
+	{
+		if (!queries.queries.empty()) glDeleteQueries((GLsizei)queries.queries.size(), queries.queries.data());
+		queries.queries.clear();
+		queries.used = 0;
+	}
+	queryIssued[0] = queryIssued[1] = false;
+}
+
+Bench::~Bench()
+{
+	Release();
+}
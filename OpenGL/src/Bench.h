@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "GpuProfiler.h"
+
+// Point the camera passes through, looking at target
+struct BenchCameraKey
+{
+	glm::vec3 position;
+	glm::vec3 target;
+};
+
+// What a benchmark run renders, read from a text file of "key value..." lines, # starts a comment:
+//
+//   name          towers-deferred
+//   resolution    1280 720
+//   warmup        60
+//   frames        300
+//   timestep      0.016667          animation step per frame, so every run sees the same frames
+//   renderer      forward | deferred
+//   shaders       specialized | generic
+//   shadow_filter PCF4 PCF1         directional then point/spot, HARD PCF1 PCF4 POISSON VSM
+//   scene_lights  off | clustered | per-object
+//   point_lights  2                 shadowed lights kept, the rest are switched off
+//   spot_lights   1
+//   models        seahawk airplane tower     anything not listed is left out, all when missing
+//   towers        1000              instanced water towers
+//   batched       on | off          and gpu_culling, software_occlusion, occlusion_queries, light_view
+//   depth_prepass off | on | auto
+//   camera        0 2 10   0 0 0    one line per key, position then target
+//
+// The camera follows a Catmull-Rom spline through the keys over the measured frames, the
+// warm-up frames sit at the first key.
+struct BenchScenario
+{
+	std::string name;
+	unsigned int width, height;
+	unsigned int warmupFrames, measuredFrames;
+	float timestep;
+
+	bool deferred;
+	bool specializedShaders;
+	int directionalFilter, omniFilter;
+	int sceneLights;				// SceneLightMode order: off, clustered, per-object
+	unsigned int pointLights, spotLights;
+	std::vector<std::string> models;
+	unsigned int towers;
+	bool batched, gpuCulling, softwareOcclusion, occlusionQueries, lightView;
+	int depthPrepass;				// DepthPrepassMode
+
+	std::vector<BenchCameraKey> camera;
+
+	BenchScenario();
+};
+
+// Runs a scenario's frames and writes what they cost as JSON: CPU frame time, every profiler
+// scope's GPU and CPU time, draw calls and triangles. Triangles are the GL_PRIMITIVES_GENERATED
+// count of every scene draw, shadow passes included, with GLState leaving out the GPU culling's
+// points, fullscreen triangles and query proxies.
+// Frames go to the headless window's offscreen target.
+class Bench
+{
+public:
+	Bench();
+
+	bool Load(const char* path);
+	const BenchScenario& GetScenario() const { return scenario; }
+
+	// With the context current
+	bool Init();
+
+	unsigned int GetFrameCount() const { return scenario.warmupFrames + scenario.measuredFrames; }
+	bool IsMeasured(unsigned int frame) const { return frame >= scenario.warmupFrames; }
+	double GetFrameTime(unsigned int frame) const { return frame * (double)scenario.timestep; }
+	void GetCamera(unsigned int frame, glm::vec3& position, glm::vec3& target) const;
+
+	// Around everything a frame does, drawCalls from GLState before it ends the frame.
+	// EndFrame does nothing outside a run
+	void BeginFrame(unsigned int frame);
+	void EndFrame(unsigned int drawCalls);
+
+	// After the last frame, the profiler flushed
+	bool WriteResults(const char* path, const GpuProfiler& profiler);
+
+	// The triangle queries, before the context goes
+	void Release();
+
+	~Bench();
+
+private:
+	bool ParseLine(const std::vector<std::string>& words);
+	void ReadTriangles(bool wait);
+
+	BenchScenario scenario;
+
+	TriangleQueries triangleQueries[2];
+	bool queryIssued[2];
+	unsigned int frame;
+	bool measuring;
+	double frameStart;
+
+	std::vector<double> cpuFrameTimes;
+	std::vector<double> drawCalls;
+	std::vector<double> triangles;
+};
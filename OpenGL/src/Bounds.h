@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+
+#include <glm\glm.hpp>
+
+// World space sphere around an object, cheap enough to test against every light
+struct BoundingSphere
+{
+	glm::vec3 center;
+	float radius;
+};
+
+// Sphere around an object space box after transform, conservative under non-uniform scale
+inline BoundingSphere TransformBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform)
+{
+	float scale = std::max(glm::length(glm::vec3(transform[0])),
+		std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+	BoundingSphere sphere;
+	sphere.center = glm::vec3(transform * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+	sphere.radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+	return sphere;
+}
+
+// Object space sphere around a box packed as centre + radius, the GPU culling applies the transform itself
+inline glm::vec4 LocalBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	return glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+}
+
+// Smallest sphere holding both
+inline BoundingSphere MergeBounds(const BoundingSphere& a, const BoundingSphere& b)
+{
+	glm::vec3 offset = b.center - a.center;
+	float distance = glm::length(offset);
+	if (distance + b.radius <= a.radius) return a;
+	if (distance + a.radius <= b.radius) return b;
+
+	BoundingSphere sphere;
+	sphere.radius = (distance + a.radius + b.radius) * 0.5f;
+	sphere.center = a.center + offset * ((sphere.radius - a.radius) / distance);
+	return sphere;
+}
@@ -0,0 +1,356 @@
+#include "ClusteredLighting.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#include <glm\gtc\matrix_transform.hpp>
+
+#include "CommonValues.h"
+#include "GLState.h"
+#include "JobSystem.h"
+
+ClusterLight::ClusterLight()
+{
+	position = glm::vec3(0.0f);
+	colour = glm::vec3(1.0f);
+	ambientIntensity = 0.0f;
+	diffuseIntensity = 1.0f;
+	constant = 1.0f;
+	linear = 0.0f;
+	exponent = 1.0f;
+	direction = glm::vec3(0.0f);
+	edge = -2.0f;
+}
+
+ClusterLight::ClusterLight(glm::vec3 pos, glm::vec3 col, GLfloat aIntensity, GLfloat dIntensity,
+	GLfloat con, GLfloat lin, GLfloat exp)
+{
+	position = pos;
+	colour = col;
+	ambientIntensity = aIntensity;
+	diffuseIntensity = dIntensity;
+	constant = con;
+	linear = lin;
+	exponent = exp;
+	direction = glm::vec3(0.0f);
+	edge = -2.0f;
+}
+
+GLfloat ClusterLight::CalcRadius() const
+{
+	GLfloat peak = std::max(std::max(colour.r, colour.g), colour.b) * std::max(diffuseIntensity, ambientIntensity);
+	GLfloat cutoff = peak * 256.0f / 5.0f;
+
+	if (cutoff <= constant) return 0.0f;
+
+	// Solve exponent * d^2 + linear * d + constant = cutoff
+	if (exponent > 0.0f)
+	{
+		return (-linear + sqrtf(linear * linear - 4.0f * exponent * (constant - cutoff))) / (2.0f * exponent);
+	}
+	if (linear > 0.0f)
+	{
+		return (cutoff - constant) / linear;
+	}
+	return 1000.0f;
+}
+
+ClusteredLighting::ClusteredLighting()
+{
+	lightBuffer = 0;
+	lightTexture = 0;
+	clusterBuffer = 0;
+	clusterTexture = 0;
+
+	boundsProjection = glm::mat4(0.0f);
+	boundsNear = 0.0f;
+	boundsFar = 0.0f;
+	boundsWidth = boundsHeight = 0;
+
+	tileSize = glm::vec2(1.0f);
+	zScale = 0.0f;
+	zBias = 0.0f;
+
+	lightCount = 0;
+	indexCount = 0;
+	maxLightsPerCluster = 0;
+	buildTime = 0.0;
+}
+
+bool ClusteredLighting::Init()
+{
+	GLint maxUnits = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+	if (maxUnits <= CLUSTER_INDICES_UNIT)
+	{
+		printf("Clustered lighting needs %d texture units, only %d available\n", CLUSTER_INDICES_UNIT + 1, maxUnits);
+		return false;
+	}
+
+	glGenBuffers(1, &lightBuffer);
+	glGenTextures(1, &lightTexture);
+	glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * 4, nullptr, GL_STREAM_DRAW);
+	GLState::BindTexture(GL_TEXTURE_BUFFER, lightTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+
+	glGenBuffers(1, &clusterBuffer);
+	glGenTextures(1, &clusterTexture);
+	glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint) * 2 * CLUSTER_X * CLUSTER_Y * CLUSTER_Z, nullptr, GL_STREAM_DRAW);
+	GLState::BindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, clusterBuffer);
+
+	GLState::BindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	sliceIndices.resize(CLUSTER_Z);
+	return true;
+}
+
+void ClusteredLighting::BuildClusterBounds(const glm::mat4& projection, GLfloat nearPlane, GLfloat farPlane, unsigned int screenWidth,
+	unsigned int screenHeight, const glm::vec2& tilePixels)
+{
+	glm::vec2 ndcTile = 2.0f * tilePixels / glm::vec2((GLfloat)screenWidth, (GLfloat)screenHeight);
+	glm::mat4 invProjection = glm::inverse(projection);
+	clusterMin.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z);
+	clusterMax.resize(CLUSTER_X * CLUSTER_Y * CLUSTER_Z);
+
+	for (unsigned int z = 0; z < CLUSTER_Z; z++)
+	{
+		GLfloat sliceNear = nearPlane * powf(farPlane / nearPlane, (GLfloat)z / CLUSTER_Z);
+		GLfloat sliceFar = nearPlane * powf(farPlane / nearPlane, (GLfloat)(z + 1) / CLUSTER_Z);
+
+		for (unsigned int y = 0; y < CLUSTER_Y; y++)
+		{
+			for (unsigned int x = 0; x < CLUSTER_X; x++)
+			{
+				glm::vec3 minPoint(FLT_MAX), maxPoint(-FLT_MAX);
+
+				for (int corner = 0; corner < 4; corner++)
+				{
+					// Tile corner on the near plane, then slid along its view ray to both slice depths
+					glm::vec2 ndc(-1.0f + ndcTile.x * (x + (corner & 1)), -1.0f + ndcTile.y * (y + (corner >> 1)));
+					glm::vec4 onNear = invProjection * glm::vec4(ndc, -1.0f, 1.0f);
+					glm::vec3 ray = glm::vec3(onNear) / onNear.w;
+					ray /= -ray.z;
+
+					minPoint = glm::min(minPoint, glm::min(ray * sliceNear, ray * sliceFar));
+					maxPoint = glm::max(maxPoint, glm::max(ray * sliceNear, ray * sliceFar));
+				}
+
+				unsigned int cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+				clusterMin[cluster] = minPoint;
+				clusterMax[cluster] = maxPoint;
+			}
+		}
+	}
+
+	boundsProjection = projection;
+	boundsNear = nearPlane;
+	boundsFar = farPlane;
+	boundsWidth = screenWidth;
+	boundsHeight = screenHeight;
+}
+
+void ClusteredLighting::AssignSlices(unsigned int firstSlice, unsigned int lastSlice)
+{
+	const unsigned int sliceClusters = CLUSTER_X * CLUSTER_Y;
+	std::vector<GLuint> offsets(sliceClusters);
+
+	for (unsigned int z = firstSlice; z < lastSlice; z++)
+	{
+		// Counts for every cluster in the slice first, the light lists follow
+		std::vector<GLuint>& slice = sliceIndices[z];
+		slice.assign(sliceClusters, 0);
+
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (size_t i = 0; i < lightRanges.size(); i++)
+			{
+				const LightRange& range = lightRanges[i];
+				if ((int)z < range.minZ || (int)z > range.maxZ) continue;
+
+				for (int y = range.minY; y <= range.maxY; y++)
+				{
+					for (int x = range.minX; x <= range.maxX; x++)
+					{
+						unsigned int local = y * CLUSTER_X + x;
+						unsigned int cluster = z * sliceClusters + local;
+
+						glm::vec3 closest = glm::clamp(range.center, clusterMin[cluster], clusterMax[cluster]);
+						glm::vec3 delta = closest - range.center;
+						if (glm::dot(delta, delta) > range.radius * range.radius) continue;
+
+						if (pass == 0)
+						{
+							slice[local]++;
+						}
+						else
+						{
+							slice[offsets[local]++] = (GLuint)i;
+						}
+					}
+				}
+			}
+
+			if (pass == 0)
+			{
+				GLuint total = sliceClusters;
+				for (unsigned int c = 0; c < sliceClusters; c++)
+				{
+					offsets[c] = total;
+					total += slice[c];
+				}
+				slice.resize(total);
+			}
+		}
+	}
+}
+
+void ClusteredLighting::UploadLights(const std::vector<ClusterLight>& lights)
+{
+	lightCount = (unsigned int)std::min(lights.size(), (size_t)MAX_LIGHTS);
+	lightData.resize(std::max(lightCount, 1u) * 4);
+
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		const ClusterLight& light = lights[i];
+		lightData[i * 4 + 0] = glm::vec4(light.position, light.CalcRadius());
+		lightData[i * 4 + 1] = glm::vec4(light.colour, light.diffuseIntensity);
+		lightData[i * 4 + 2] = glm::vec4(light.constant, light.linear, light.exponent, light.ambientIntensity);
+		lightData[i * 4 + 3] = glm::vec4(light.direction, light.edge);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * lightData.size(), &lightData[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLighting::Build(const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+	GLfloat nearPlane, GLfloat farPlane, unsigned int screenWidth, unsigned int screenHeight)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Tiles are whole pixels so the shader can index them straight from gl_FragCoord
+	glm::vec2 tilePixels(ceilf((GLfloat)screenWidth / CLUSTER_X), ceilf((GLfloat)screenHeight / CLUSTER_Y));
+
+	if (projection != boundsProjection || nearPlane != boundsNear || farPlane != boundsFar ||
+		screenWidth != boundsWidth || screenHeight != boundsHeight)
+	{
+		BuildClusterBounds(projection, nearPlane, farPlane, screenWidth, screenHeight, tilePixels);
+	}
+	tileSize = tilePixels;
+	zScale = CLUSTER_Z / logf(farPlane / nearPlane);
+	zBias = CLUSTER_Z * logf(nearPlane) / logf(farPlane / nearPlane);
+
+	UploadLights(lights);
+	lightRanges.clear();
+
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		GLfloat radius = lightData[i * 4].w;
+
+		LightRange range;
+		range.center = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+		range.radius = radius;
+
+		GLfloat depth = -range.center.z;
+		if (radius <= 0.0f || depth + radius < nearPlane || depth - radius > farPlane)
+		{
+			lightRanges.push_back(range);
+			lightRanges.back().minZ = 1;
+			lightRanges.back().maxZ = 0;
+			continue;
+		}
+
+		range.minZ = (int)floorf(logf(std::max(depth - radius, nearPlane)) * zScale - zBias);
+		range.maxZ = (int)floorf(logf(std::min(depth + radius, farPlane)) * zScale - zBias);
+		range.minZ = glm::clamp(range.minZ, 0, (int)CLUSTER_Z - 1);
+		range.maxZ = glm::clamp(range.maxZ, 0, (int)CLUSTER_Z - 1);
+
+		range.minX = 0; range.maxX = CLUSTER_X - 1;
+		range.minY = 0; range.maxY = CLUSTER_Y - 1;
+
+		// Spheres fully in front of the camera get a screen rectangle from their projected box
+		if (depth - radius > nearPlane)
+		{
+			glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+			for (int corner = 0; corner < 8; corner++)
+			{
+				glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+				glm::vec4 clip = projection * glm::vec4(range.center + offset, 1.0f);
+				glm::vec2 ndc = glm::vec2(clip) / clip.w;
+				ndcMin = glm::min(ndcMin, ndc);
+				ndcMax = glm::max(ndcMax, ndc);
+			}
+
+			glm::vec2 screen((GLfloat)screenWidth, (GLfloat)screenHeight);
+			glm::vec2 tileMin = glm::floor((ndcMin * 0.5f + 0.5f) * screen / tilePixels);
+			glm::vec2 tileMax = glm::floor((ndcMax * 0.5f + 0.5f) * screen / tilePixels);
+			range.minX = glm::clamp((int)tileMin.x, 0, (int)CLUSTER_X - 1);
+			range.maxX = glm::clamp((int)tileMax.x, 0, (int)CLUSTER_X - 1);
+			range.minY = glm::clamp((int)tileMin.y, 0, (int)CLUSTER_Y - 1);
+			range.maxY = glm::clamp((int)tileMax.y, 0, (int)CLUSTER_Y - 1);
+		}
+
+		lightRanges.push_back(range);
+	}
+
+	// Slices never share clusters, so each job fills its own slices without locking
+	JobSystem::Get().ParallelFor(CLUSTER_Z, 1, [this](size_t first, size_t last) {
+		AssignSlices((unsigned int)first, (unsigned int)last);
+	});
+
+	// Flatten to [offset, count] per cluster followed by every list back to back
+	const unsigned int sliceClusters = CLUSTER_X * CLUSTER_Y;
+	const unsigned int clusterCount = sliceClusters * CLUSTER_Z;
+	clusterData.resize(clusterCount * 2);
+	indexCount = 0;
+	maxLightsPerCluster = 0;
+
+	for (unsigned int z = 0; z < CLUSTER_Z; z++)
+	{
+		const std::vector<GLuint>& slice = sliceIndices[z];
+		GLuint listStart = (GLuint)clusterData.size();
+		clusterData.insert(clusterData.end(), slice.begin() + sliceClusters, slice.end());
+
+		for (unsigned int c = 0; c < sliceClusters; c++)
+		{
+			unsigned int cluster = z * sliceClusters + c;
+			clusterData[cluster * 2] = listStart;
+			clusterData[cluster * 2 + 1] = slice[c];
+			listStart += slice[c];
+			maxLightsPerCluster = std::max(maxLightsPerCluster, slice[c]);
+		}
+		indexCount += (unsigned int)(slice.size() - sliceClusters);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(GLuint) * clusterData.size(), &clusterData[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void ClusteredLighting::Bind()
+{
+	GLState::BindTexture(CLUSTER_LIGHTS_UNIT, GL_TEXTURE_BUFFER, lightTexture);
+	GLState::BindTexture(CLUSTER_INDICES_UNIT, GL_TEXTURE_BUFFER, clusterTexture);
+}
+
+void ClusteredLighting::Release()
+{
+	if (lightTexture) GLState::DeleteTexture(lightTexture);
+	if (lightBuffer) glDeleteBuffers(1, &lightBuffer);
+	if (clusterTexture) GLState::DeleteTexture(clusterTexture);
+	if (clusterBuffer) glDeleteBuffers(1, &clusterBuffer);
+	lightTexture = lightBuffer = clusterTexture = clusterBuffer = 0;
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+	Release();
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm\glm.hpp>
+
+// Unshadowed light handled by the clustered path. A spot light has edge > -1,
+// a point light keeps the default and passes the cone test everywhere.
+struct ClusterLight
+{
+	glm::vec3 position;
+	glm::vec3 colour;
+	GLfloat ambientIntensity;
+	GLfloat diffuseIntensity;
+	GLfloat constant, linear, exponent;
+	glm::vec3 direction;
+	GLfloat edge;
+
+	ClusterLight();
+	ClusterLight(glm::vec3 pos, glm::vec3 col, GLfloat aIntensity, GLfloat dIntensity,
+		GLfloat con, GLfloat lin, GLfloat exp);
+
+	// Distance where the light falls under ~2% of its peak, lights are cut off there
+	GLfloat CalcRadius() const;
+};
+
+// Splits the view frustum into CLUSTER_X * CLUSTER_Y screen tiles and CLUSTER_Z
+// exponential depth slices, bins lights into them by attenuation radius on CPU
+// threads and uploads the result as texture buffers for shader.frag.
+class ClusteredLighting
+{
+public:
+	static const unsigned int CLUSTER_X = 16;
+	static const unsigned int CLUSTER_Y = 9;
+	static const unsigned int CLUSTER_Z = 24;
+	static const unsigned int MAX_LIGHTS = 1024;
+
+	ClusteredLighting();
+
+	bool Init();
+	void Build(const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+		GLfloat nearPlane, GLfloat farPlane, unsigned int screenWidth, unsigned int screenHeight);
+	void Bind();
+
+	// Light data only, for shaders that get their light lists some other way. Build calls it too
+	void UploadLights(const std::vector<ClusterLight>& lights);
+
+	unsigned int GetLightCount() const { return lightCount; }
+	unsigned int GetIndexCount() const { return indexCount; }
+	unsigned int GetMaxLightsPerCluster() const { return maxLightsPerCluster; }
+	double GetBuildTime() const { return buildTime; }
+
+	glm::ivec3 GetDimensions() const { return glm::ivec3(CLUSTER_X, CLUSTER_Y, CLUSTER_Z); }
+	glm::vec2 GetTileSize() const { return tileSize; }
+	GLfloat GetZScale() const { return zScale; }
+	GLfloat GetZBias() const { return zBias; }
+
+	// The light and cluster buffers, before the context goes
+	void Release();
+
+	~ClusteredLighting();
+
+private:
+	struct LightRange
+	{
+		glm::vec3 center;
+		GLfloat radius;
+		int minX, maxX, minY, maxY, minZ, maxZ;
+	};
+
+	// Tiles of tilePixels whole pixels, the last row and column running off the screen like the shader's
+	void BuildClusterBounds(const glm::mat4& projection, GLfloat nearPlane, GLfloat farPlane, unsigned int screenWidth,
+		unsigned int screenHeight, const glm::vec2& tilePixels);
+	void AssignSlices(unsigned int firstSlice, unsigned int lastSlice);
+
+	GLuint lightBuffer, lightTexture;
+	GLuint clusterBuffer, clusterTexture;
+
+	std::vector<glm::vec4> lightData;			// 4 texels per light, layout matches CalcClusteredLight in shader.frag
+	std::vector<LightRange> lightRanges;
+	std::vector<glm::vec3> clusterMin, clusterMax;	// view space bounds, rebuilt when the projection or screen changes
+	std::vector<std::vector<GLuint>> sliceIndices;	// per slice: counts for its clusters, then their light lists
+	std::vector<GLuint> clusterData;			// [offset, count] per cluster, then all light indices
+
+	glm::mat4 boundsProjection;
+	GLfloat boundsNear, boundsFar;
+	unsigned int boundsWidth, boundsHeight;
+
+	glm::vec2 tileSize;
+	GLfloat zScale, zBias;
+
+	unsigned int lightCount, indexCount, maxLightsPerCluster;
+	double buildTime;
+};
@@ -6,4 +6,60 @@
 const int	MAX_POINT_LIGHTS = 3;
 const int	MAX_SPOT_LIGHTS = 3;
 
-#endif
\ No newline at end of file
+// Shadow filter tiers, cheapest first. Must match the SHADOW_FILTER_* constants in shader.frag.
+enum ShadowFilter
+{
+	SHADOW_FILTER_HARD = 0,		// 1 hardware compare, nearest filtering
+	SHADOW_FILTER_PCF1,			// 1 hardware compare, bilinear (2x2 PCF for free)
+	SHADOW_FILTER_PCF4,			// 4 bilinear hardware compares
+	SHADOW_FILTER_POISSON,		// SHADOW_POISSON_TAPS compares on a per-pixel rotated Poisson disk
+	SHADOW_FILTER_VSM,			// prefiltered variance shadow map, 1 trilinear fetch
+	SHADOW_FILTER_COUNT
+};
+
+const int	SHADOW_POISSON_TAPS = 16;
+
+// Moment maps get their own units so they never share one with a shadow sampler:
+// directional on SHADOW_MOMENTS_UNIT, point then spot lights on the units after it
+const int	SHADOW_MOMENTS_UNIT = 9;
+
+// Clustered light buffers, unit 0 is free in the lit shader once every shadow sampler has its own unit
+const int	CLUSTER_LIGHTS_UNIT = 0;
+const int	CLUSTER_INDICES_UNIT = 16;
+
+// Deferred lighting inputs, the lighting pass has no theTexture so its unit is reused
+const int	GBUFFER_ALBEDO_UNIT = 1;
+const int	GBUFFER_NORMAL_UNIT = 17;
+const int	GBUFFER_DEPTH_UNIT = 18;
+
+// GPU culling inputs, only the cull shaders sample these
+const int	HIZ_UNIT = 19;
+const int	CULL_COUNTS_UNIT = 20;
+
+// Uniform block binding points, every program's blocks are bound to these when it links
+const int	FRAME_BLOCK_BINDING = 0;
+const int	LIGHT_BLOCK_BINDING = 1;
+const int	DRAW_BLOCK_BINDING = 2;
+
+// Vertex streams a shader.vert variant reads, must match VERTEX_FORMAT_* in shader.vert
+enum VertexFormat
+{
+	VERTEX_FORMAT_STANDARD = 0,	// position, uv, normal as laid out by Mesh
+	VERTEX_FORMAT_POSITION,		// position only, for depth-only passes
+};
+
+// Where a draw's transform, material and light list come from, must match DRAW_SOURCE_* in uniform_blocks.glsl
+enum DrawSource
+{
+	DRAW_SOURCE_BLOCK = 0,		// DrawBlock
+	DRAW_SOURCE_INSTANCE,		// instance attributes (Model::SetInstances), lights from DrawBlock
+	DRAW_SOURCE_BATCH,			// DrawBatch's per-draw attributes, lights too
+};
+
+inline const char* ShadowFilterName(int filter)
+{
+	static const char* names[SHADOW_FILTER_COUNT] = { "HARD", "PCF1", "PCF4", "POISSON", "VSM" };
+	return (filter >= 0 && filter < SHADOW_FILTER_COUNT) ? names[filter] : "UNKNOWN";
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include "DepthPrepass.h"
+#include "ShaderCache.h"
+#include "GLState.h"
+
+DepthPrepass::DepthPrepass()
+{
+	mode = DEPTH_PREPASS_AUTO;
+	active = false;
+	overdrawThreshold = 1.5;
+	probeInterval = 120;
+	framesSinceProbe = 0;
+
+	depthQueries[0] = depthQueries[1] = 0;
+	shadedQueries[0] = shadedQueries[1] = 0;
+	slotPrepass[0] = slotPrepass[1] = false;
+	slotIssued[0] = slotIssued[1] = false;
+	frame = 0;
+	prepass = false;
+	width = height = 0;
+
+	ResetStats();
+}
+
+bool DepthPrepass::Init()
+{
+	// shader.vert without the lighting outputs, the same transform as the lit pass
+	ShaderPermutation permutation;
+	permutation.vertexFormat = VERTEX_FORMAT_POSITION;
+	depthShader.CreateFromFiles("Shaders/shader.vert", "Shaders/depth_prepass.frag", permutation.GetDefines());
+
+	GLint linked = GL_FALSE;
+	if (depthShader.GetShaderID()) glGetProgramiv(depthShader.GetShaderID(), GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		printf("Depth pre-pass shader failed to build\n");
+		return false;
+	}
+
+	glGenQueries(2, depthQueries);
+	glGenQueries(2, shadedQueries);
+	return true;
+}
+
+bool DepthPrepass::BeginFrame(unsigned int width, unsigned int height)
+{
+	this->width = width;
+	this->height = height;
+	ReadBack();
+
+	if (mode == DEPTH_PREPASS_OFF) return false;
+	if (mode == DEPTH_PREPASS_ON || active) return true;
+
+	// Check the real overdraw now and then, the estimate can't see it when little of the screen is covered
+	if (++framesSinceProbe >= probeInterval)
+	{
+		framesSinceProbe = 0;
+		return true;
+	}
+	return false;
+}
+
+void DepthPrepass::ReadBack()
+{
+	if (frame == 0) return;
+
+	unsigned int slot = (frame - 1) % 2;
+	if (!slotIssued[slot]) return;
+
+	// Drop the counts rather than wait on the GPU
+	GLint available = 0;
+	glGetQueryObjectiv(shadedQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return;
+	if (slotPrepass[slot])
+	{
+		glGetQueryObjectiv(depthQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+	}
+	slotIssued[slot] = false;
+
+	GLuint shaded = 0;
+	glGetQueryObjectuiv(shadedQueries[slot], GL_QUERY_RESULT, &shaded);
+	totalFrames++;
+
+	if (slotPrepass[slot])
+	{
+		GLuint rasterized = 0;
+		glGetQueryObjectuiv(depthQueries[slot], GL_QUERY_RESULT, &rasterized);
+		totalPrepassFrames++;
+		totalRasterized += rasterized;
+		totalShadedWith += shaded;
+
+		active = shaded > 0 && rasterized >= overdrawThreshold * shaded;
+	}
+	else
+	{
+		// Every pixel covered once at most, so this never overstates the overdraw
+		totalShadedWithout += shaded;
+
+		active = shaded >= overdrawThreshold * width * height;
+	}
+	if (active) framesSinceProbe = 0;
+}
+
+void DepthPrepass::BeginDepth()
+{
+	depthShader.UseShader();
+	depthShader.Validate();
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glBeginQuery(GL_SAMPLES_PASSED, depthQueries[frame % 2]);
+}
+
+void DepthPrepass::EndDepth()
+{
+	glEndQuery(GL_SAMPLES_PASSED);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void DepthPrepass::BeginShading(bool prepass)
+{
+	this->prepass = prepass;
+	if (prepass)
+	{
+		// Same vertices through the same invariant gl_Position, so the lit pass matches exactly
+		GLState::DepthFunc(GL_EQUAL);
+		GLState::DepthMask(GL_FALSE);
+	}
+	glBeginQuery(GL_SAMPLES_PASSED, shadedQueries[frame % 2]);
+}
+
+void DepthPrepass::EndShading()
+{
+	glEndQuery(GL_SAMPLES_PASSED);
+	if (prepass)
+	{
+		GLState::DepthFunc(GL_LESS);
+		GLState::DepthMask(GL_TRUE);
+	}
+
+	slotPrepass[frame % 2] = prepass;
+	slotIssued[frame % 2] = true;
+	frame++;
+}
+
+void DepthPrepass::ResetStats()
+{
+	totalFrames = totalPrepassFrames = 0;
+	totalRasterized = totalShadedWith = totalShadedWithout = 0.0;
+}
+
+void DepthPrepass::Release()
+{
+	if (depthQueries[0])
+	{
+		glDeleteQueries(2, depthQueries);
+		glDeleteQueries(2, shadedQueries);
+	}
+	depthQueries[0] = depthQueries[1] = shadedQueries[0] = shadedQueries[1] = 0;
+}
+
+DepthPrepass::~DepthPrepass()
+{
+	Release();
+}
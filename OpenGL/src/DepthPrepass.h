@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "Shader.h"
+
+enum DepthPrepassMode
+{
+	DEPTH_PREPASS_OFF = 0,
+	DEPTH_PREPASS_ON,
+	DEPTH_PREPASS_AUTO,		// on while the measured overdraw is worth the extra geometry pass
+	DEPTH_PREPASS_MODE_COUNT
+};
+
+// Depth-only pass ahead of the forward lit pass. The scene is drawn once with the position-only
+// shader.vert variant and colour writes off, then the lit pass runs with GL_EQUAL and no depth
+// writes, so every pixel runs the lighting shader once however many surfaces cover it.
+//
+// Both passes are counted with GL_SAMPLES_PASSED, read back a frame late. With the pre-pass the
+// depth pass count is what the lit pass would have shaded without it, so the overdraw is exact.
+// Without it the lit count over the screen size is a lower bound, and a single pre-pass frame
+// every so often measures the real number. AUTO switches on that.
+class DepthPrepass
+{
+public:
+	DepthPrepass();
+
+	bool Init();
+
+	// Per frame, before the camera pass. Reads back the last counts, true when the pre-pass should run
+	bool BeginFrame(unsigned int width, unsigned int height);
+
+	// Around the pre-pass draws, the camera block has to be set already
+	void BeginDepth();
+	void EndDepth();
+
+	// Around the lit draws, EQUAL depth with no writes after a pre-pass
+	void BeginShading(bool prepass);
+	void EndShading();
+
+	void SetMode(int mode) { this->mode = mode; framesSinceProbe = 0; }
+	int GetMode() const { return mode; }
+	void SetOverdrawThreshold(double threshold) { overdrawThreshold = threshold; }
+	void SetProbeInterval(unsigned int frames) { probeInterval = frames; }
+
+	// Stats over the frames read back since ResetStats
+	double GetPrepassRate() const { return totalFrames ? (double)totalPrepassFrames / totalFrames : 0.0; }
+	double GetAverageShadedWith() const { return totalPrepassFrames ? totalShadedWith / totalPrepassFrames : 0.0; }
+	double GetAverageShadedWithout() const
+	{
+		unsigned int frames = totalFrames - totalPrepassFrames;
+		return frames ? totalShadedWithout / frames : 0.0;
+	}
+	double GetAverageRasterized() const { return totalPrepassFrames ? totalRasterized / totalPrepassFrames : 0.0; }
+	double GetOverdraw() const { return totalShadedWith > 0.0 ? totalRasterized / totalShadedWith : 0.0; }
+	void ResetStats();
+
+	// The sample queries, before the context goes
+	void Release();
+
+	~DepthPrepass();
+
+private:
+	void ReadBack();
+
+	Shader depthShader;
+
+	int mode;
+	bool active;	// AUTO's current choice
+	double overdrawThreshold;
+	unsigned int probeInterval, framesSinceProbe;
+
+	// Double buffered so the counts are a frame old when read
+	GLuint depthQueries[2], shadedQueries[2];
+	bool slotPrepass[2], slotIssued[2];
+	unsigned int frame;
+	bool prepass;
+	unsigned int width, height;
+
+	unsigned int totalFrames, totalPrepassFrames;
+	double totalRasterized, totalShadedWith, totalShadedWithout;
+};
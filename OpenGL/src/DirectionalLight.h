@@ -11,8 +11,7 @@ public:
 		GLfloat aIntensity, GLfloat dIntensity,
 		GLfloat xDir, GLfloat yDir, GLfloat zDir);
 
-	void UseLight(GLfloat ambientIntensityLocation, GLfloat ambientColourLocation,
-		GLfloat diffuseIntensityLocation, GLfloat directionLocation);
+	void GetLightData(DirectionalLightData& data) const;
 
 	void SetDirection(const glm::vec3& dir) { direction = dir; }
 	const glm::vec3& GetDirection() const { return direction; }
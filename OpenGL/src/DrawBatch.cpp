@@ -0,0 +1,575 @@
+#include "DrawBatch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "GLState.h"
+
+DrawBatch::DrawBatch()
+{
+	multiDrawElementsIndirect = nullptr;
+	indirect = false;
+	loopReadback = false;
+
+	vertexBuffer = indexBuffer = 0;
+	vertexCapacity = vertexUsed = indexCapacity = indexUsed = 0;
+
+	positionBuffer = positionIndexBuffer = 0;
+	positionCapacity = positionUsed = positionIndexCapacity = 0;
+	positionStreams = true;
+
+	boundsBuffer = commandSourceBuffer = 0;
+	recordVAO = commandVAO = 0;
+	recordCapacity = commandCapacity = 0;
+	rebuild = false;
+	groupCount = 0;
+
+	ResetStats();
+}
+
+static bool HasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+		if (extension && strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+bool DrawBatch::Init(GLADloadproc loader)
+{
+	// baseInstance in the commands needs base_instance as well on pre 4.3 contexts
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	bool supported = major > 4 || (major == 4 && minor >= 3) ||
+		(HasExtension("GL_ARB_multi_draw_indirect") && HasExtension("GL_ARB_base_instance"));
+
+	if (supported && loader)
+	{
+		multiDrawElementsIndirect = (MultiDrawElementsIndirectProc)loader("glMultiDrawElementsIndirect");
+	}
+	indirect = multiDrawElementsIndirect != nullptr;
+
+	View source = { 0, 0, 0, 0, 0, 0 };
+	glGenVertexArrays(1, &source.VAO);
+	glGenVertexArrays(1, &source.positionVAO);
+	glGenBuffers(1, &source.records);
+	if (indirect)
+	{
+		glGenBuffers(1, &source.commands);
+	}
+	views.push_back(source);
+	SetupView(views[0]);
+
+	// Culling reads every record once as a point, model and light attributes as in SetupView
+	glGenBuffers(1, &boundsBuffer);
+	glGenVertexArrays(1, &recordVAO);
+	GLState::BindVertexArray(recordVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, source.records);
+	const GLsizei stride = sizeof(BatchDrawData);
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)(i * sizeof(glm::vec4)));
+	}
+	glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(InstanceData, specularIntensity));
+	glVertexAttribIPointer(8, 2, GL_INT, stride, (void*)offsetof(BatchDrawData, objectLightCount));
+	glVertexAttribIPointer(9, 4, GL_INT, stride, (void*)offsetof(BatchDrawData, objectLights));
+	glVertexAttribIPointer(10, 4, GL_INT, stride, (void*)(offsetof(BatchDrawData, objectLights) + 4 * sizeof(GLint)));
+	glBindBuffer(GL_ARRAY_BUFFER, boundsBuffer);
+	glVertexAttribPointer(11, 4, GL_FLOAT, GL_FALSE, sizeof(RecordBounds), (void*)offsetof(RecordBounds, sphere));
+	glVertexAttribIPointer(12, 1, GL_INT, sizeof(RecordBounds), (void*)offsetof(RecordBounds, group));
+	for (GLuint i = 3; i <= 12; i++) glEnableVertexAttribArray(i);
+
+	glGenBuffers(1, &commandSourceBuffer);
+	glGenVertexArrays(1, &commandVAO);
+	GLState::BindVertexArray(commandVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, commandSourceBuffer);
+	glVertexAttribIPointer(0, 4, GL_UNSIGNED_INT, sizeof(CommandSource), (void*)0);
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::BindVertexArray(0);
+
+	printf("Draw batch: %s\n", indirect ? "glMultiDrawElementsIndirect" : "GL 4.3 indirect draws unavailable, looping");
+	return true;
+}
+
+void DrawBatch::SetIndirect(bool enabled)
+{
+	indirect = enabled && IsIndirectSupported();
+}
+
+void DrawBatch::SetViewCount(unsigned int count)
+{
+	if (views.empty()) return;
+
+	count = std::max(count, 1u);
+	while (views.size() > count)
+	{
+		View& view = views.back();
+		GLState::DeleteVertexArray(view.VAO);
+		GLState::DeleteVertexArray(view.positionVAO);
+		glDeleteBuffers(1, &view.records);
+		glDeleteBuffers(1, &view.commands);
+		views.pop_back();
+	}
+	while (views.size() < count)
+	{
+		// Culled views always get a command buffer, without indirect draws it is read back
+		View view = { 0, 0, 0, 0, 0, 0 };
+		glGenVertexArrays(1, &view.VAO);
+		glGenVertexArrays(1, &view.positionVAO);
+		glGenBuffers(1, &view.records);
+		glGenBuffers(1, &view.commands);
+		views.push_back(view);
+		SetupView(views.back());
+
+		// The new buffers have no storage yet
+		recordCapacity = commandCapacity = 0;
+		rebuild = true;
+	}
+}
+
+// Grows a pool buffer, keeping what is already in it
+void DrawBatch::Reserve(GLuint& buffer, GLsizeiptr& capacity, GLsizeiptr used, GLsizeiptr needed)
+{
+	if (used + needed <= capacity) return;
+
+	GLsizeiptr newCapacity = std::max<GLsizeiptr>(std::max<GLsizeiptr>(capacity * 2, used + needed), 1 << 20);
+
+	GLuint newBuffer = 0;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, nullptr, GL_STATIC_DRAW);
+
+	if (buffer)
+	{
+		if (used > 0)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+		}
+		glDeleteBuffers(1, &buffer);
+	}
+
+	buffer = newBuffer;
+	capacity = newCapacity;
+	for (View& view : views)
+	{
+		SetupView(view);
+	}
+}
+
+const DrawBatch::PoolEntry& DrawBatch::Pool(Mesh* mesh)
+{
+	auto found = pool.find(mesh);
+	if (found != pool.end()) return found->second;
+
+	// Same 8 float layout as Mesh, indices stay mesh relative and baseVertex offsets them
+	GLsizeiptr vertexBytes = mesh->GetVertexCount() * 8 * sizeof(GLfloat);
+	GLsizeiptr indexBytes = mesh->GetIndexCount() * sizeof(GLuint);
+	Reserve(vertexBuffer, vertexCapacity, vertexUsed, vertexBytes);
+	Reserve(indexBuffer, indexCapacity, indexUsed, indexBytes);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, mesh->GetVertexBuffer());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, vertexUsed, vertexBytes);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, mesh->GetIndexBuffer());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indexUsed, indexBytes);
+
+	// Room for every full vertex so baseVertex lines up, the welded stream may use less of it
+	GLsizeiptr positionBytes = mesh->GetVertexCount() * sizeof(glm::vec3);
+	Reserve(positionBuffer, positionCapacity, positionUsed, positionBytes);
+	Reserve(positionIndexBuffer, positionIndexCapacity, indexUsed, indexBytes);
+	if (mesh->HasPositionStream())
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh->GetPositionBuffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, positionBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, positionUsed, mesh->GetPositionCount() * sizeof(glm::vec3));
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh->GetPositionIndexBuffer());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, positionIndexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indexUsed, indexBytes);
+	}
+	else
+	{
+		positionStreams = false;
+	}
+
+	PoolEntry entry;
+	entry.baseVertex = static_cast<GLint>(vertexUsed / (8 * sizeof(GLfloat)));
+	entry.firstIndex = static_cast<GLuint>(indexUsed / sizeof(GLuint));
+	vertexUsed += vertexBytes;
+	positionUsed += positionBytes;
+	indexUsed += indexBytes;
+
+	return pool.emplace(mesh, entry).first->second;
+}
+
+void DrawBatch::SetupView(View& view)
+{
+	GLState::BindVertexArray(view.VAO);
+
+	// Vertices, as in Mesh::CreateMesh
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	if (vertexBuffer)
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
+		for (GLuint i = 0; i < 3; i++) glEnableVertexAttribArray(i);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+	// Per-draw records, one step per instance so baseInstance selects the draw's first record
+	for (GLuint i = 3; i <= 10; i++)
+	{
+		glVertexAttribDivisor(i, 1);
+		glEnableVertexAttribArray(i);
+	}
+	view.attributeBase = ~0u;
+	PointDrawAttributes(view, false, 0);
+
+	// Positions only, the same records
+	GLState::BindVertexArray(view.positionVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+	if (positionBuffer)
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+		glEnableVertexAttribArray(0);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, positionIndexBuffer);
+	for (GLuint i = 3; i <= 10; i++)
+	{
+		glVertexAttribDivisor(i, 1);
+		glEnableVertexAttribArray(i);
+	}
+	view.positionAttributeBase = ~0u;
+	PointDrawAttributes(view, true, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Only the GL 3.3 loop moves these, it has no baseInstance. Sets the bound VAO, positions says which one it is
+void DrawBatch::PointDrawAttributes(View& view, bool positions, GLuint baseInstance)
+{
+	GLuint& attributeBase = positions ? view.positionAttributeBase : view.attributeBase;
+	if (attributeBase == baseInstance) return;
+	attributeBase = baseInstance;
+
+	const GLsizei stride = sizeof(BatchDrawData);
+	const size_t base = baseInstance * sizeof(BatchDrawData);
+
+	glBindBuffer(GL_ARRAY_BUFFER, view.records);
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)(base + i * sizeof(glm::vec4)));
+	}
+	glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, specularIntensity)));
+	glVertexAttribIPointer(8, 2, GL_INT, stride, (void*)(base + offsetof(BatchDrawData, objectLightCount)));
+	glVertexAttribIPointer(9, 4, GL_INT, stride, (void*)(base + offsetof(BatchDrawData, objectLights)));
+	glVertexAttribIPointer(10, 4, GL_INT, stride, (void*)(base + offsetof(BatchDrawData, objectLights) + 4 * sizeof(GLint)));
+}
+
+void DrawBatch::Begin()
+{
+	pending.clear();
+	records.clear();
+	recordBounds.clear();
+	changed.clear();
+	groupCount = 0;
+	rebuild = true;
+}
+
+static void SetRecordLights(BatchDrawData& record, const ObjectLightList* lights)
+{
+	if (lights)
+	{
+		record.objectLightCount = lights->count;
+		record.culledLightMask = lights->culledMask;
+		memcpy(record.objectLights, lights->lights, lights->count * sizeof(GLint));
+	}
+}
+
+GLuint DrawBatch::AddRecords(const InstanceData* instances, GLsizei count, const ObjectLightList* lights, const glm::vec4& bounds)
+{
+	GLuint baseInstance = static_cast<GLuint>(records.size());
+
+	BatchDrawData record;
+	memset(&record, 0, sizeof(record));
+	SetRecordLights(record, lights);
+
+	RecordBounds cull = { bounds, groupCount };
+	for (GLsizei i = 0; i < count; i++)
+	{
+		record.instance = instances[i];
+		records.push_back(record);
+		recordBounds.push_back(cull);
+	}
+
+	groupCount++;
+	return baseInstance;
+}
+
+void DrawBatch::AddDraw(Mesh* mesh, Texture* texture, GLuint baseInstance, GLsizei instanceCount)
+{
+	if (instanceCount <= 0 || mesh->GetIndexCount() == 0) return;
+
+	const PoolEntry& entry = Pool(mesh);
+
+	PendingDraw draw;
+	draw.texture = texture;
+	draw.group = recordBounds[baseInstance].group;
+	draw.command.count = mesh->GetIndexCount();
+	draw.command.instanceCount = instanceCount;
+	draw.command.firstIndex = entry.firstIndex;
+	draw.command.baseVertex = entry.baseVertex;
+	draw.command.baseInstance = baseInstance;
+	pending.push_back(draw);
+}
+
+void DrawBatch::UpdateRecords(GLuint baseInstance, GLsizei count, const InstanceData* instances, const ObjectLightList* lights)
+{
+	if (count <= 0 || baseInstance + count > records.size()) return;
+
+	BatchDrawData record;
+	memset(&record, 0, sizeof(record));
+	SetRecordLights(record, lights);
+
+	// A group shares its lights, so one record tells whether a lights-only update changes anything
+	const size_t lightsOffset = offsetof(BatchDrawData, objectLightCount);
+	if (!instances && memcmp(reinterpret_cast<const char*>(&records[baseInstance]) + lightsOffset,
+		reinterpret_cast<const char*>(&record) + lightsOffset, sizeof(record) - lightsOffset) == 0)
+	{
+		return;
+	}
+
+	GLuint first = baseInstance + count, last = baseInstance;
+	for (GLuint i = baseInstance; i < baseInstance + count; i++)
+	{
+		record.instance = instances ? instances[i - baseInstance] : records[i].instance;
+		if (memcmp(&records[i], &record, sizeof(record)) == 0) continue;
+
+		records[i] = record;
+		first = std::min(first, i);
+		last = i + 1;
+	}
+	if (first < last)
+	{
+		changed.push_back({ first, last });
+	}
+}
+
+// Sizes buffer for capacity elements when it grew, then writes the first size of them
+static void UploadBuffer(GLenum target, GLuint buffer, bool allocate, size_t capacity, size_t size, size_t elementSize, const void* data)
+{
+	glBindBuffer(target, buffer);
+	if (allocate)
+	{
+		glBufferData(target, capacity * elementSize, nullptr, GL_DYNAMIC_DRAW);
+	}
+	if (data && size > 0)
+	{
+		glBufferSubData(target, 0, size * elementSize, data);
+	}
+	glBindBuffer(target, 0);
+}
+
+void DrawBatch::UploadChangedRecords()
+{
+	if (changed.empty()) return;
+
+	// Groups come in record order, so neighbours merge into one write
+	std::sort(changed.begin(), changed.end(), [](const RecordRange& a, const RecordRange& b) { return a.first < b.first; });
+	glBindBuffer(GL_ARRAY_BUFFER, views[0].records);
+	RecordRange range = changed[0];
+	for (size_t i = 1; i <= changed.size(); i++)
+	{
+		if (i < changed.size() && changed[i].first <= range.last)
+		{
+			range.last = std::max(range.last, changed[i].last);
+			continue;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, range.first * sizeof(BatchDrawData),
+			(range.last - range.first) * sizeof(BatchDrawData), &records[range.first]);
+		if (i < changed.size()) range = changed[i];
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	changed.clear();
+}
+
+void DrawBatch::Upload()
+{
+	if (!rebuild)
+	{
+		UploadChangedRecords();
+		return;
+	}
+	rebuild = false;
+	changed.clear();
+
+	// Texture is the only state that changes between draws, so it splits the calls
+	std::stable_sort(pending.begin(), pending.end(),
+		[](const PendingDraw& a, const PendingDraw& b) { return a.texture < b.texture; });
+
+	commands.clear();
+	commandSources.clear();
+	ranges.clear();
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		if (ranges.empty() || ranges.back().texture != pending[i].texture)
+		{
+			ranges.push_back({ pending[i].texture, static_cast<GLsizei>(i), 0 });
+		}
+		ranges.back().count++;
+
+		const DrawElementsIndirectCommand& command = pending[i].command;
+		commands.push_back(command);
+		commandSources.push_back({ command.count, command.firstIndex, command.baseVertex, pending[i].group });
+	}
+
+	// Storage only grows, never smaller than one element so the names always have some.
+	// The attribute and command bindings keep pointing at the same names either way
+	bool growRecords = records.size() > recordCapacity;
+	bool growCommands = commands.size() > commandCapacity;
+	if (growRecords) recordCapacity = std::max(records.size(), std::max<size_t>(recordCapacity * 2, 1));
+	if (growCommands) commandCapacity = std::max(commands.size(), std::max<size_t>(commandCapacity * 2, 1));
+
+	UploadBuffer(GL_ARRAY_BUFFER, views[0].records, growRecords, recordCapacity, records.size(), sizeof(BatchDrawData), records.data());
+	if (views[0].commands)
+	{
+		UploadBuffer(GL_DRAW_INDIRECT_BUFFER, views[0].commands, growCommands, commandCapacity,
+			commands.size(), sizeof(DrawElementsIndirectCommand), commands.data());
+	}
+
+	// Culled views are written on the GPU, they only need the room
+	if (views.size() > 1)
+	{
+		UploadBuffer(GL_ARRAY_BUFFER, boundsBuffer, growRecords, recordCapacity, recordBounds.size(), sizeof(RecordBounds), recordBounds.data());
+		UploadBuffer(GL_ARRAY_BUFFER, commandSourceBuffer, growCommands, commandCapacity,
+			commandSources.size(), sizeof(CommandSource), commandSources.data());
+		for (size_t i = 1; i < views.size(); i++)
+		{
+			UploadBuffer(GL_ARRAY_BUFFER, views[i].records, growRecords, recordCapacity, 0, sizeof(BatchDrawData), nullptr);
+			UploadBuffer(GL_ARRAY_BUFFER, views[i].commands, growCommands, commandCapacity, 0, sizeof(DrawElementsIndirectCommand), nullptr);
+		}
+	}
+}
+
+void DrawBatch::Draw(bool wireframe, unsigned int view, int vertexFormat)
+{
+	if (commands.empty()) return;
+	if (view >= views.size() || !UsesCulledViews()) view = 0;
+	View& target = views[view];
+
+	// The loop needs the culled counts on the CPU, this waits for the culling to finish
+	const std::vector<DrawElementsIndirectCommand>* list = &commands;
+	if (view > 0 && !indirect)
+	{
+		readback.resize(commands.size());
+		glBindBuffer(GL_COPY_READ_BUFFER, target.commands);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, readback.size() * sizeof(DrawElementsIndirectCommand), readback.data());
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		list = &readback;
+	}
+
+	// Depth-only draws don't sample, so every command goes in one range
+	bool positions = vertexFormat == VERTEX_FORMAT_POSITION && positionStreams;
+	TextureRange all = { nullptr, 0, static_cast<GLsizei>(commands.size()) };
+	const TextureRange* first = positions ? &all : ranges.data();
+	const TextureRange* last = positions ? &all + 1 : ranges.data() + ranges.size();
+
+	GLState::BindVertexArray(positions ? target.positionVAO : target.VAO);
+	if (wireframe) GLState::PolygonMode(GL_LINE);
+
+	if (indirect)
+	{
+		// Indirect draws source baseInstance themselves
+		PointDrawAttributes(target, positions, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, target.commands);
+	}
+
+	for (const TextureRange* range = first; range != last; range++)
+	{
+		if (range->texture && vertexFormat == VERTEX_FORMAT_STANDARD) range->texture->UseTexture();
+
+		if (indirect)
+		{
+			multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+				(void*)(range->first * sizeof(DrawElementsIndirectCommand)), range->count, 0);
+			frameDrawCalls++;
+			GLState::CountDraws();
+			continue;
+		}
+
+		for (GLsizei i = range->first; i < range->first + range->count; i++)
+		{
+			const DrawElementsIndirectCommand& command = (*list)[i];
+			if (command.instanceCount == 0) continue;
+
+			PointDrawAttributes(target, positions, command.baseInstance);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+				(void*)(command.firstIndex * sizeof(GLuint)), command.instanceCount, command.baseVertex);
+			frameDrawCalls++;
+			GLState::CountDraws();
+		}
+	}
+
+	if (indirect) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	if (wireframe) GLState::PolygonMode(GL_FILL);
+
+	frameCommands += static_cast<unsigned int>(commands.size());
+}
+
+void DrawBatch::EndFrame()
+{
+	totalCommands += frameCommands;
+	totalDrawCalls += frameDrawCalls;
+	totalFrames++;
+
+	frameCommands = 0;
+	frameDrawCalls = 0;
+}
+
+void DrawBatch::ResetStats()
+{
+	frameCommands = frameDrawCalls = 0;
+	totalCommands = totalDrawCalls = 0;
+	totalFrames = 0;
+}
+
+void DrawBatch::Release()
+{
+	for (View& view : views)
+	{
+		GLState::DeleteVertexArray(view.VAO);
+		GLState::DeleteVertexArray(view.positionVAO);
+		glDeleteBuffers(1, &view.records);
+		if (view.commands) glDeleteBuffers(1, &view.commands);
+	}
+	views.clear();
+	recordCapacity = commandCapacity = 0;
+	if (recordVAO) GLState::DeleteVertexArray(recordVAO);
+	if (commandVAO) GLState::DeleteVertexArray(commandVAO);
+	recordVAO = commandVAO = 0;
+
+	GLuint* buffers[] = { &vertexBuffer, &indexBuffer, &positionBuffer, &positionIndexBuffer, &boundsBuffer, &commandSourceBuffer };
+	for (GLuint* buffer : buffers)
+	{
+		if (*buffer) glDeleteBuffers(1, buffer);
+		*buffer = 0;
+	}
+}
+
+DrawBatch::~DrawBatch()
+{
+	Release();
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Mesh.h"
+#include "Texture.h"
+#include "LightAssignment.h"
+
+// GL 4.3 / ARB_multi_draw_indirect, the loader is generated for 3.3 so DrawBatch fetches it itself
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// What glMultiDrawElementsIndirect reads per draw
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// One per drawn copy, starts with InstanceData so the attributes in instancing.glsl line up
+struct BatchDrawData
+{
+	InstanceData instance;
+	GLint objectLightCount;
+	GLint culledLightMask;
+	GLint objectLights[ObjectLightList::MAX_LIGHTS];
+};
+
+// GPU-driven submission of the whole scene. Meshes are copied into one pooled vertex/index
+// buffer on first use, each draw becomes an indirect command whose baseInstance points at its
+// BatchDrawData records, and a pass is one glMultiDrawElementsIndirect per texture.
+// Without GL 4.3 or ARB_multi_draw_indirect the same commands are walked in a loop.
+// Meshes stay pooled for the batch's lifetime.
+//
+// View 0 draws everything as uploaded. Further views hold a culled copy of the records and
+// commands that GpuCulling writes on the GPU, same command order so the texture split holds.
+//
+// The meshes' position streams are pooled alongside at the same baseVertex and firstIndex, so
+// depth-only passes replay the same commands from 12 byte vertices, in one call per pass.
+class DrawBatch
+{
+public:
+	DrawBatch();
+
+	// loader resolves entry points past GL 3.3, e.g. glfwGetProcAddress
+	bool Init(GLADloadproc loader);
+
+	// Begin, add records and draws and Upload when the scene's draws change, then Draw in every pass.
+	// The buffers persist, on the frames between only UpdateRecords and Upload run
+	void Begin();
+	// Returns the baseInstance for AddDraw. Every AddRecords call is one cull group, bounds is
+	// the object space sphere the culling transforms per record (see LocalBounds), lights may be nullptr
+	GLuint AddRecords(const InstanceData* instances, GLsizei count, const ObjectLightList* lights, const glm::vec4& bounds);
+	void AddDraw(Mesh* mesh, Texture* texture, GLuint baseInstance, GLsizei instanceCount);
+	// Rewrites the count records from baseInstance in place, instances nullptr keeps their
+	// transforms and only sets the lights. Records left the same aren't uploaded again
+	void UpdateRecords(GLuint baseInstance, GLsizei count, const InstanceData* instances, const ObjectLightList* lights);
+	// Everything after a Begin or SetViewCount, otherwise just the records UpdateRecords changed
+	void Upload();
+	void Draw(bool wireframe = false, unsigned int view = 0, int vertexFormat = VERTEX_FORMAT_STANDARD);
+
+	bool IsIndirectSupported() const { return multiDrawElementsIndirect != nullptr; }
+	bool IsIndirect() const { return indirect; }
+	void SetIndirect(bool enabled);
+
+	// The loop only draws a culled view by reading its commands back, which waits on the culling.
+	// Off it draws view 0 whole, on is for seeing what the culling would save
+	void SetLoopReadback(bool enabled) { loopReadback = enabled; }
+	bool IsLoopReadback() const { return loopReadback; }
+	bool UsesCulledViews() const { return indirect || loopReadback; }
+
+	// Culled views, takes effect at the next Upload
+	void SetViewCount(unsigned int count);
+	unsigned int GetViewCount() const { return static_cast<unsigned int>(views.size()); }
+
+	// What GpuCulling reads: one point per record and one per command, and where it writes a view
+	GLuint GetRecordArray() const { return recordVAO; }
+	GLuint GetCommandArray() const { return commandVAO; }
+	GLuint GetViewRecords(unsigned int view) const { return views[view].records; }
+	GLuint GetViewCommands(unsigned int view) const { return views[view].commands; }
+	GLsizei GetRecordCount() const { return static_cast<GLsizei>(records.size()); }
+	GLsizei GetGroupCount() const { return groupCount; }
+
+	// Frame stats, EndFrame folds them into the running totals
+	unsigned int GetCommandCount() const { return (unsigned int)commands.size(); }
+	unsigned int GetFrameDrawCalls() const { return frameDrawCalls; }
+	double GetAverageCommands() const { return totalFrames ? (double)totalCommands / totalFrames : 0.0; }
+	double GetAverageDrawCalls() const { return totalFrames ? (double)totalDrawCalls / totalFrames : 0.0; }
+	void EndFrame();
+	void ResetStats();
+
+	// Every buffer and vertex array, before the context goes
+	void Release();
+
+	~DrawBatch();
+
+private:
+	struct PoolEntry
+	{
+		GLint baseVertex;
+		GLuint firstIndex;
+	};
+
+	struct PendingDraw
+	{
+		Texture* texture;
+		GLuint group;
+		DrawElementsIndirectCommand command;
+	};
+
+	// Commands sharing a texture, drawn with one call
+	struct TextureRange
+	{
+		Texture* texture;
+		GLsizei first, count;
+	};
+
+	// Culling inputs, one per record and one per command
+	struct RecordBounds
+	{
+		glm::vec4 sphere;
+		GLint group;
+	};
+
+	struct CommandSource
+	{
+		GLuint count;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint group;
+	};
+
+	// Records UpdateRecords changed since the last Upload, last is one past
+	struct RecordRange
+	{
+		GLuint first, last;
+	};
+
+	struct View
+	{
+		GLuint VAO, positionVAO;
+		GLuint records, commands;
+		GLuint attributeBase, positionAttributeBase;	// baseInstance the loop last pointed each VAO's attributes at
+	};
+
+	const PoolEntry& Pool(Mesh* mesh);
+	void Reserve(GLuint& buffer, GLsizeiptr& capacity, GLsizeiptr used, GLsizeiptr needed);
+	void SetupView(View& view);
+	void PointDrawAttributes(View& view, bool positions, GLuint baseInstance);
+	void UploadChangedRecords();
+
+	typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+	MultiDrawElementsIndirectProc multiDrawElementsIndirect;
+	bool indirect;
+	bool loopReadback;
+
+	GLuint vertexBuffer, indexBuffer;
+	GLsizeiptr vertexCapacity, vertexUsed, indexCapacity, indexUsed;
+	std::unordered_map<Mesh*, PoolEntry> pool;
+
+	// Filled in step with the pool above, indexUsed covers both index buffers
+	GLuint positionBuffer, positionIndexBuffer;
+	GLsizeiptr positionCapacity, positionUsed, positionIndexCapacity;
+	bool positionStreams;	// every pooled mesh had one, otherwise depth passes use the full vertices
+
+	std::vector<View> views;
+	GLuint boundsBuffer, commandSourceBuffer;
+	GLuint recordVAO, commandVAO;
+	size_t recordCapacity, commandCapacity;	// in elements, every record and command sized buffer has this much
+	bool rebuild;	// Upload sends everything
+
+	std::vector<PendingDraw> pending;
+	std::vector<BatchDrawData> records;
+	std::vector<RecordBounds> recordBounds;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<CommandSource> commandSources;
+	std::vector<TextureRange> ranges;
+	std::vector<RecordRange> changed;
+	std::vector<DrawElementsIndirectCommand> readback;
+	GLsizei groupCount;
+
+	unsigned int frameCommands, frameDrawCalls;
+	unsigned long long totalCommands, totalDrawCalls;
+	unsigned int totalFrames;
+};
@@ -0,0 +1,496 @@
+#include "FrameGraph.h"
+
+#include <cstdio>
+
+#include "GLState.h"
+
+static const FrameGraph::Pass NO_PASS = ~0u;
+
+// Upload format for an empty texture of each internal format the graph hands out
+static bool TextureFormat(GLenum internalFormat, GLenum& format, GLenum& type, unsigned int& bytes)
+{
+	switch (internalFormat)
+	{
+	case GL_RGBA8:				format = GL_RGBA; type = GL_UNSIGNED_BYTE; bytes = 4; return true;
+	case GL_RGB10_A2:			format = GL_RGBA; type = GL_UNSIGNED_INT_2_10_10_10_REV; bytes = 4; return true;
+	case GL_RG32F:				format = GL_RG; type = GL_FLOAT; bytes = 8; return true;
+	case GL_R32F:				format = GL_RED; type = GL_FLOAT; bytes = 4; return true;
+	case GL_RGBA16F:			format = GL_RGBA; type = GL_HALF_FLOAT; bytes = 8; return true;
+	case GL_DEPTH_COMPONENT24:	format = GL_DEPTH_COMPONENT; type = GL_FLOAT; bytes = 4; return true;
+	case GL_DEPTH24_STENCIL8:	format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; bytes = 4; return true;
+	}
+	return false;
+}
+
+static bool SameDesc(const FrameTextureDesc& a, const FrameTextureDesc& b)
+{
+	return a.width == b.width && a.height == b.height && a.internalFormat == b.internalFormat;
+}
+
+FrameGraph::FrameGraph()
+{
+	poolIdleFrames = 120;
+	profiler = nullptr;
+	frame = 0;
+	compiled = false;
+}
+
+void FrameGraph::Begin()
+{
+	TrimPool();
+
+	resources.clear();
+	passes.clear();
+	order.clear();
+	compiled = false;
+}
+
+FrameGraph::Resource FrameGraph::Import(const char* name, GLuint texture)
+{
+	ResourceNode node;
+	node.name = name;
+	node.transient = false;
+	node.desc = { 0, 0, 0 };
+	node.texture = texture;
+	node.version = 0;
+	node.producers.push_back(NO_PASS);
+	node.readers.resize(1);
+	node.output = false;
+	node.physical = -1;
+	node.refCount = 0;
+
+	resources.push_back(node);
+	return (Resource)resources.size() - 1;
+}
+
+FrameGraph::Resource FrameGraph::Create(const char* name, const FrameTextureDesc& desc)
+{
+	Resource resource = Import(name);
+	resources[resource].transient = true;
+	resources[resource].desc = desc;
+	return resource;
+}
+
+void FrameGraph::MarkOutput(Resource resource)
+{
+	resources[resource].output = true;
+}
+
+FrameGraph::Pass FrameGraph::AddPass(const char* name, std::function<void()> execute)
+{
+	PassNode node;
+	node.name = name;
+	node.execute = execute;
+	node.sideEffect = false;
+	node.culled = false;
+	node.refCount = 0;
+	node.framebuffer = 0;
+
+	passes.push_back(node);
+	return (Pass)passes.size() - 1;
+}
+
+void FrameGraph::Read(Pass pass, Resource resource)
+{
+	ResourceNode& node = resources[resource];
+	passes[pass].reads.push_back({ resource, node.version });
+	node.readers[node.version].push_back(pass);
+}
+
+void FrameGraph::Write(Pass pass, Resource resource)
+{
+	ResourceNode& node = resources[resource];
+	node.version++;
+	node.producers.push_back(pass);
+	node.readers.resize(node.version + 1);
+	passes[pass].writes.push_back({ resource, node.version });
+}
+
+void FrameGraph::Attach(Pass pass, Resource resource, GLenum attachment)
+{
+	if (!resources[resource].transient)
+	{
+		printf("Frame graph: %s can't be attached to %s, only created textures can\n",
+			resources[resource].name.c_str(), passes[pass].name.c_str());
+		return;
+	}
+
+	Write(pass, resource);
+	passes[pass].attachments.push_back({ resource, attachment });
+}
+
+void FrameGraph::SetSideEffect(Pass pass)
+{
+	passes[pass].sideEffect = true;
+}
+
+void FrameGraph::Compile()
+{
+	// 1. Cull: walk back from the outputs through what every needed pass reads. Writing a
+	// later version keeps the earlier writer, the pass draws over its result
+	std::vector<Pass> needed;
+	for (Pass p = 0; p < passes.size(); p++)
+	{
+		passes[p].culled = true;
+		if (passes[p].sideEffect) needed.push_back(p);
+	}
+	for (const ResourceNode& node : resources)
+	{
+		if (node.output && node.producers.back() != NO_PASS) needed.push_back(node.producers.back());
+	}
+
+	while (!needed.empty())
+	{
+		Pass p = needed.back();
+		needed.pop_back();
+		if (!passes[p].culled) continue;
+		passes[p].culled = false;
+
+		for (const Access& read : passes[p].reads)
+		{
+			Pass producer = resources[read.resource].producers[read.version];
+			if (producer != NO_PASS) needed.push_back(producer);
+		}
+		for (const Access& write : passes[p].writes)
+		{
+			Pass producer = resources[write.resource].producers[write.version - 1];
+			if (producer != NO_PASS) needed.push_back(producer);
+		}
+	}
+
+	// 2. Order what's left: after the producer of everything read, and a write after the previous
+	// version's writer and readers. Ties keep declaration order
+	std::vector<std::vector<Pass>> after(passes.size());
+	for (Pass p = 0; p < passes.size(); p++)
+	{
+		passes[p].refCount = 0;
+	}
+	for (Pass p = 0; p < passes.size(); p++)
+	{
+		if (passes[p].culled) continue;
+
+		std::vector<Pass> before;
+		for (const Access& read : passes[p].reads)
+		{
+			before.push_back(resources[read.resource].producers[read.version]);
+		}
+		for (const Access& write : passes[p].writes)
+		{
+			const ResourceNode& node = resources[write.resource];
+			before.push_back(node.producers[write.version - 1]);
+			before.insert(before.end(), node.readers[write.version - 1].begin(), node.readers[write.version - 1].end());
+		}
+
+		for (Pass b : before)
+		{
+			if (b == NO_PASS || b == p || passes[b].culled) continue;
+			after[b].push_back(p);
+			passes[p].refCount++;
+		}
+	}
+
+	std::vector<bool> placed(passes.size(), false);
+	bool progress = true;
+	while (progress)
+	{
+		progress = false;
+		for (Pass p = 0; p < passes.size(); p++)
+		{
+			if (passes[p].culled || placed[p] || passes[p].refCount > 0) continue;
+
+			order.push_back(p);
+			placed[p] = true;
+			for (Pass next : after[p])
+			{
+				passes[next].refCount--;
+			}
+			progress = true;
+			break;
+		}
+	}
+
+	for (Pass p = 0; p < passes.size(); p++)
+	{
+		if (!passes[p].culled && !placed[p])
+		{
+			printf("Frame graph: %s is part of a dependency cycle, skipped\n", passes[p].name.c_str());
+			passes[p].culled = true;
+		}
+	}
+
+	// 3. Transient lifetimes, a texture is taken before its first pass and given back after its last
+	std::vector<int> first(resources.size(), -1), last(resources.size(), -1);
+	for (int i = 0; i < (int)order.size(); i++)
+	{
+		PassNode& pass = passes[order[i]];
+		pass.firstUse.clear();
+		pass.lastUse.clear();
+
+		std::vector<Access> accesses = pass.reads;
+		accesses.insert(accesses.end(), pass.writes.begin(), pass.writes.end());
+		for (const Access& access : accesses)
+		{
+			if (!resources[access.resource].transient) continue;
+			if (first[access.resource] < 0) first[access.resource] = i;
+			last[access.resource] = i;
+		}
+	}
+	for (Resource r = 0; r < (Resource)resources.size(); r++)
+	{
+		resources[r].physical = -1;
+		resources[r].refCount = 0;
+		if (first[r] < 0) continue;
+
+		passes[order[first[r]]].firstUse.push_back(r);
+		passes[order[last[r]]].lastUse.push_back(r);
+		resources[r].refCount = last[r] - first[r] + 1;
+	}
+
+	compiled = true;
+}
+
+void FrameGraph::Execute()
+{
+	if (!compiled) Compile();
+
+	for (Pass p : order)
+	{
+		PassNode& pass = passes[p];
+
+		for (Resource r : pass.firstUse)
+		{
+			resources[r].physical = AcquireTexture(resources[r].desc);
+			resources[r].texture = pool[resources[r].physical].texture;
+		}
+
+		// Attachment passes get their framebuffer sized to the targets, the rest start on the window
+		pass.framebuffer = pass.attachments.empty() ? 0 : AcquireFramebuffer(pass);
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+		if (!pass.attachments.empty())
+		{
+			const FrameTextureDesc& desc = resources[pass.attachments[0].resource].desc;
+			GLState::Viewport(0, 0, desc.width, desc.height);
+		}
+
+		if (profiler) profiler->BeginScope(pass.name.c_str());
+		pass.execute();
+		if (profiler) profiler->EndScope();
+
+		for (Resource r : pass.lastUse)
+		{
+			pool[resources[r].physical].inUse = false;
+		}
+	}
+
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	frame++;
+}
+
+GLuint FrameGraph::GetTexture(Resource resource) const
+{
+	return resources[resource].texture;
+}
+
+int FrameGraph::AcquireTexture(const FrameTextureDesc& desc)
+{
+	for (size_t i = 0; i < pool.size(); i++)
+	{
+		if (pool[i].inUse || !SameDesc(pool[i].desc, desc)) continue;
+
+		pool[i].inUse = true;
+		pool[i].lastFrame = frame;
+		return (int)i;
+	}
+
+	GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+	unsigned int bytes = 0;
+	if (!TextureFormat(desc.internalFormat, format, type, bytes))
+	{
+		printf("Frame graph: unsupported texture format 0x%x\n", desc.internalFormat);
+	}
+
+	PoolTexture texture;
+	texture.desc = desc;
+	texture.inUse = true;
+	texture.lastFrame = frame;
+
+	glGenTextures(1, &texture.texture);
+	GLState::BindTexture(GL_TEXTURE_2D, texture.texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, nullptr);
+
+	// Read one texel per pixel, never filtered
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
+
+	pool.push_back(texture);
+	return (int)pool.size() - 1;
+}
+
+GLuint FrameGraph::AcquireFramebuffer(const PassNode& pass)
+{
+	std::vector<GLuint> textures;
+	std::vector<GLenum> attachments;
+	for (const Attachment& attachment : pass.attachments)
+	{
+		textures.push_back(resources[attachment.resource].texture);
+		attachments.push_back(attachment.attachment);
+	}
+
+	for (PoolFramebuffer& cached : framebuffers)
+	{
+		if (cached.textures == textures && cached.attachments == attachments)
+		{
+			cached.lastFrame = frame;
+			return cached.framebuffer;
+		}
+	}
+
+	PoolFramebuffer created;
+	created.textures = textures;
+	created.attachments = attachments;
+	created.lastFrame = frame;
+
+	glGenFramebuffers(1, &created.framebuffer);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, created.framebuffer);
+
+	std::vector<GLenum> drawBuffers;
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, textures[i], 0);
+		if (attachments[i] >= GL_COLOR_ATTACHMENT0 && attachments[i] <= GL_COLOR_ATTACHMENT15) drawBuffers.push_back(attachments[i]);
+	}
+	if (drawBuffers.empty())
+	{
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else
+	{
+		glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Frame graph: %s framebuffer error: 0x%x\n", pass.name.c_str(), status);
+	}
+
+	framebuffers.push_back(created);
+	return created.framebuffer;
+}
+
+void FrameGraph::TrimPool()
+{
+	// Whatever a resize or a switched off feature left behind
+	for (size_t i = 0; i < pool.size();)
+	{
+		if (pool[i].inUse || frame - pool[i].lastFrame <= poolIdleFrames)
+		{
+			i++;
+			continue;
+		}
+
+		for (size_t f = 0; f < framebuffers.size();)
+		{
+			const std::vector<GLuint>& textures = framebuffers[f].textures;
+			bool uses = false;
+			for (GLuint texture : textures)
+			{
+				if (texture == pool[i].texture) uses = true;
+			}
+
+			if (uses)
+			{
+				GLState::DeleteFramebuffer(framebuffers[f].framebuffer);
+				framebuffers.erase(framebuffers.begin() + f);
+			}
+			else
+			{
+				f++;
+			}
+		}
+
+		GLState::DeleteTexture(pool[i].texture);
+		pool.erase(pool.begin() + i);
+	}
+}
+
+size_t FrameGraph::GetPoolMemory() const
+{
+	size_t total = 0;
+	for (const PoolTexture& texture : pool)
+	{
+		GLenum format, type;
+		unsigned int bytes = 0;
+		TextureFormat(texture.desc.internalFormat, format, type, bytes);
+		total += (size_t)texture.desc.width * texture.desc.height * bytes;
+	}
+	return total;
+}
+
+void FrameGraph::Dump() const
+{
+	const double megabyte = 1024.0 * 1024.0;
+	printf("Frame graph: %zu of %zu passes run, %zu resources, pool %zu textures %.2f MB, %zu framebuffers\n",
+		order.size(), passes.size(), resources.size(), pool.size(), GetPoolMemory() / megabyte, framebuffers.size());
+
+	for (Pass p : order)
+	{
+		const PassNode& pass = passes[p];
+
+		ProfileStats stats;
+		if (profiler && profiler->GetStats(pass.name, stats))
+		{
+			printf("  %-20s gpu %.3f ms  cpu %.3f ms\n", pass.name.c_str(), stats.gpuAverage, stats.cpuAverage);
+		}
+		else
+		{
+			printf("  %s\n", pass.name.c_str());
+		}
+
+		for (const Access& read : pass.reads)
+		{
+			printf("    read  %s@%u\n", resources[read.resource].name.c_str(), read.version);
+		}
+		for (const Access& write : pass.writes)
+		{
+			const ResourceNode& node = resources[write.resource];
+			if (node.transient)
+			{
+				printf("    write %s@%u (transient %dx%d, pool texture %d, %u passes)\n", node.name.c_str(), write.version,
+					node.desc.width, node.desc.height, node.physical, node.refCount);
+			}
+			else
+			{
+				printf("    write %s@%u%s\n", node.name.c_str(), write.version, node.output ? " (output)" : "");
+			}
+		}
+	}
+
+	for (const PassNode& pass : passes)
+	{
+		if (pass.culled) printf("  %-20s culled\n", pass.name.c_str());
+	}
+}
+
+void FrameGraph::Release()
+{
+	for (const PoolFramebuffer& framebuffer : framebuffers)
+	{
+		GLState::DeleteFramebuffer(framebuffer.framebuffer);
+	}
+	for (const PoolTexture& texture : pool)
+	{
+		GLState::DeleteTexture(texture.texture);
+	}
+	framebuffers.clear();
+	pool.clear();
+}
+
+FrameGraph::~FrameGraph()
+{
+	Release();
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GpuProfiler.h"
+
+// A texture the graph allocates for the frame, nearest filtered and clamped since passes read
+// transients one texel per pixel
+struct FrameTextureDesc
+{
+	GLsizei width, height;
+	GLenum internalFormat;	// GL_RGBA8, GL_RGB10_A2, GL_RG32F, GL_R32F, GL_RGBA16F, GL_DEPTH_COMPONENT24 or GL_DEPTH24_STENCIL8
+};
+
+// Declarative frame. Every frame the passes are added with the resources they read and write,
+// Compile culls the passes nothing marked as an output depends on, orders the rest by their
+// dependencies, and gives each transient texture a pooled one for just the passes that use it,
+// so transients whose lifetimes don't overlap share memory. Passes run in Execute.
+//
+// A write after another write is a new version of the resource: it orders after the earlier
+// writer and everything that read the earlier version, so a pass can draw over what another drew.
+// Imported resources (the window, shadow maps, anything kept between frames) are only tracked.
+//
+// With a profiler set every pass runs in a scope of its own name, Dump shows those timings.
+class FrameGraph
+{
+public:
+	typedef int Resource;
+	typedef unsigned int Pass;
+
+	FrameGraph();
+
+	void SetProfiler(GpuProfiler* profiler) { this->profiler = profiler; }
+
+	// Per frame: Begin, declare everything, Compile, Execute
+	void Begin();
+
+	Resource Import(const char* name, GLuint texture = 0);
+	Resource Create(const char* name, const FrameTextureDesc& desc);
+	void MarkOutput(Resource resource);
+
+	Pass AddPass(const char* name, std::function<void()> execute);
+	void Read(Pass pass, Resource resource);
+	void Write(Pass pass, Resource resource);
+	// Writes a transient through the pass's framebuffer, which the graph binds with the
+	// viewport set to the attachment size before the pass runs
+	void Attach(Pass pass, Resource resource, GLenum attachment);
+	void SetSideEffect(Pass pass);	// never culled, for passes that only matter outside the frame
+
+	void Compile();
+	void Execute();
+
+	// The texture behind a resource, only valid for transients while their passes run
+	GLuint GetTexture(Resource resource) const;
+
+	// Passes in the order they ran with what they touched and what each transient got
+	void Dump() const;
+
+	// Pool textures nobody asked for in this many frames are freed
+	void SetPoolIdleFrames(unsigned int frames) { poolIdleFrames = frames; }
+	size_t GetPoolMemory() const;
+
+	// Empties the transient pool, while the context is still current
+	void Release();
+
+	~FrameGraph();
+
+private:
+	struct ResourceNode
+	{
+		std::string name;
+		bool transient;
+		FrameTextureDesc desc;
+		GLuint texture;				// imported, or the pooled one for this frame
+		unsigned int version;		// writes so far
+		std::vector<Pass> producers;	// writer of each version, ~0u while nobody wrote it
+		std::vector<std::vector<Pass>> readers;	// readers of each version
+		bool output;
+		int physical;				// pool index for transients, -1 while unallocated
+		unsigned int refCount;
+	};
+
+	struct Access
+	{
+		Resource resource;
+		unsigned int version;
+	};
+
+	struct Attachment
+	{
+		Resource resource;
+		GLenum attachment;
+	};
+
+	struct PassNode
+	{
+		std::string name;
+		std::function<void()> execute;
+		std::vector<Access> reads, writes;
+		std::vector<Attachment> attachments;
+		bool sideEffect;
+		bool culled;
+		unsigned int refCount;
+		GLuint framebuffer;
+		std::vector<Resource> firstUse, lastUse;	// transients acquired before and released after
+	};
+
+	struct PoolTexture
+	{
+		FrameTextureDesc desc;
+		GLuint texture;
+		bool inUse;
+		unsigned int lastFrame;
+	};
+
+	struct PoolFramebuffer
+	{
+		std::vector<GLuint> textures;	// one per attachment, in the pass's order
+		std::vector<GLenum> attachments;
+		GLuint framebuffer;
+		unsigned int lastFrame;
+	};
+
+	int AcquireTexture(const FrameTextureDesc& desc);
+	GLuint AcquireFramebuffer(const PassNode& pass);
+	void TrimPool();
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+	std::vector<Pass> order;
+
+	std::vector<PoolTexture> pool;
+	std::vector<PoolFramebuffer> framebuffers;
+	unsigned int poolIdleFrames;
+
+	GpuProfiler* profiler;
+	unsigned int frame;
+	bool compiled;
+};
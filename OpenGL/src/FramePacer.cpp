@@ -0,0 +1,270 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+FramePacer::FramePacer()
+{
+	maxFramesInFlight = 2;
+	frameRateLimit = 0.0;
+	timestamps = false;
+	clockStart = std::chrono::steady_clock::now();
+	gpuOffset = 0.0;
+
+	for (InFlightFrame& inFlightFrame : frames)
+	{
+		inFlightFrame.fence = nullptr;
+		inFlightFrame.query = 0;
+	}
+	oldest = inFlight = 0;
+	for (GLuint& query : queries)
+	{
+		query = 0;
+	}
+	frame = 0;
+	frameStart = 0.0;
+
+	nextFrameTime = 0.0;
+	sleepMean = 1.0;
+	sleepM2 = 0.0;
+	sleepCount = 1;
+
+	fenceWait = limitWait = 0.0;
+	waitFrames = 0;
+}
+
+bool FramePacer::Init()
+{
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	timestamps = bits > 0;
+	if (timestamps) glGenQueries(MAX_FRAMES_IN_FLIGHT, queries);
+	else printf("Frame pacer: no timestamp queries, latency is taken when the fence is seen\n");
+
+	Calibrate();
+	return true;
+}
+
+void FramePacer::SetMaxFramesInFlight(unsigned int frames)
+{
+	if (frames < 1) frames = 1;
+	if (frames > MAX_FRAMES_IN_FLIGHT) frames = MAX_FRAMES_IN_FLIGHT;
+	maxFramesInFlight = frames;
+}
+
+void FramePacer::SetFrameRateLimit(double fps)
+{
+	frameRateLimit = std::max(fps, 0.0);
+	nextFrameTime = 0.0;
+}
+
+double FramePacer::Now() const
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - clockStart;
+	return elapsed.count();
+}
+
+void FramePacer::Calibrate()
+{
+	if (!timestamps) return;
+
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuOffset = Now() - static_cast<double>(gpuNow) / 1000000.0;
+}
+
+void FramePacer::BeginFrame()
+{
+	frameStart = Now();
+}
+
+void FramePacer::EndFrame()
+{
+	// The ring has room, EndFrame never leaves more than maxFramesInFlight out
+	unsigned int slot = (oldest + inFlight) % MAX_FRAMES_IN_FLIGHT;
+	InFlightFrame& current = frames[slot];
+	current.query = queries[slot];
+	if (timestamps) glQueryCounter(current.query, GL_TIMESTAMP);
+	current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	current.frame = frame++;
+	current.start = frameStart;
+	current.submit = Now();
+	current.inFlight = ++inFlight;
+
+	// The GPU clock drifts from the CPU's, a few seconds apart is plenty
+	if (frame % 600 == 0) Calibrate();
+
+	double waitStart = Now();
+	Retire(false);
+	while (inFlight >= maxFramesInFlight)
+	{
+		Retire(true);
+	}
+	double waited = Now();
+	fenceWait += waited - waitStart;
+
+	Limit();
+	limitWait += Now() - waited;
+	waitFrames++;
+}
+
+void FramePacer::Retire(bool wait)
+{
+	while (inFlight > 0)
+	{
+		InFlightFrame& done = frames[oldest];
+
+		// Flushing on the blocking wait, a fence still in the command buffer would never signal
+		GLenum status = glClientWaitSync(done.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 100000000 : 0);
+		if (status == GL_TIMEOUT_EXPIRED && wait) continue;
+		if (status == GL_TIMEOUT_EXPIRED) return;
+		double seen = Now();
+
+		FrameLatency latency;
+		latency.frame = done.frame;
+		latency.start = done.start;
+		latency.submit = done.submit;
+		latency.gpuDone = seen;
+		latency.inFlight = done.inFlight;
+		if (timestamps)
+		{
+			GLuint64 gpuTime = 0;
+			glGetQueryObjectui64v(done.query, GL_QUERY_RESULT, &gpuTime);
+			latency.gpuDone = static_cast<double>(gpuTime) / 1000000.0 + gpuOffset;
+		}
+		history.push_back(latency);
+		while (history.size() > HISTORY_FRAMES)
+		{
+			history.pop_front();
+		}
+
+		glDeleteSync(done.fence);
+		done.fence = nullptr;
+		oldest = (oldest + 1) % MAX_FRAMES_IN_FLIGHT;
+		inFlight--;
+
+		// One is all a blocking retire is after, the rest are picked up when they're done
+		if (wait) return;
+	}
+}
+
+// Sleeps in 1ms steps while there's more left than a sleep is likely to take, then spins
+void FramePacer::Limit()
+{
+	if (frameRateLimit <= 0.0) return;
+
+	double period = 1000.0 / frameRateLimit;
+	double now = Now();
+	// Start over rather than rush to catch up after a long frame
+	if (nextFrameTime <= 0.0 || now - nextFrameTime > period) nextFrameTime = now;
+
+	for (;;)
+	{
+		now = Now();
+		double remaining = nextFrameTime - now;
+		if (remaining <= 0.0) break;
+
+		double estimate = sleepMean + std::sqrt(sleepM2 / sleepCount);
+		if (remaining > estimate)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			double slept = Now() - now;
+
+			sleepCount++;
+			double delta = slept - sleepMean;
+			sleepMean += delta / sleepCount;
+			sleepM2 += delta * (slept - sleepMean);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+	nextFrameTime += period;
+}
+
+void FramePacer::Report() const
+{
+	if (history.empty()) return;
+
+	std::vector<double> latencies, queues;
+	double inFlightSum = 0.0;
+	for (const FrameLatency& latency : history)
+	{
+		latencies.push_back(latency.gpuDone - latency.start);
+		queues.push_back(latency.gpuDone - latency.submit);
+		inFlightSum += latency.inFlight;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	std::sort(queues.begin(), queues.end());
+
+	double latencySum = 0.0, queueSum = 0.0;
+	for (size_t i = 0; i < latencies.size(); i++)
+	{
+		latencySum += latencies[i];
+		queueSum += queues[i];
+	}
+	size_t p95 = std::min(latencies.size() - 1, (size_t)std::ceil(0.95 * latencies.size()) - 1);
+
+	printf("Frame pacing over %zu frames, %u in flight at most%s\n", history.size(), maxFramesInFlight,
+		frameRateLimit > 0.0 ? "" : ", no frame-rate limit");
+	if (frameRateLimit > 0.0) printf("  limited to %.0f fps\n", frameRateLimit);
+	printf("  start to GPU done    %7.3f avg %7.3f p95 %7.3f max ms\n", latencySum / latencies.size(), latencies[p95], latencies.back());
+	printf("  submit to GPU done   %7.3f avg %7.3f p95 %7.3f max ms\n", queueSum / queues.size(), queues[p95], queues.back());
+	printf("  %.2f frames in flight on average\n", inFlightSum / history.size());
+	if (waitFrames > 0)
+	{
+		printf("  waited %.3f ms a frame on fences, %.3f ms in the limiter\n", fenceWait / waitFrames, limitWait / waitFrames);
+	}
+}
+
+bool FramePacer::WriteCsv(const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		printf("Failed to write %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "frame,start_ms,submit_ms,gpu_done_ms,latency_ms,in_flight\n");
+	for (const FrameLatency& latency : history)
+	{
+		fprintf(file, "%u,%.4f,%.4f,%.4f,%.4f,%u\n", latency.frame, latency.start, latency.submit, latency.gpuDone,
+			latency.gpuDone - latency.start, latency.inFlight);
+	}
+
+	fclose(file);
+	return true;
+}
+
+void FramePacer::ResetStats()
+{
+	history.clear();
+	fenceWait = limitWait = 0.0;
+	waitFrames = 0;
+	Calibrate();
+}
+
+void FramePacer::Release()
+{
+	for (InFlightFrame& inFlightFrame : frames)
+	{
+		if (inFlightFrame.fence) glDeleteSync(inFlightFrame.fence);
+		inFlightFrame.fence = nullptr;
+	}
+	inFlight = 0;
+	if (queries[0]) glDeleteQueries(MAX_FRAMES_IN_FLIGHT, queries);
+	for (GLuint& query : queries)
+	{
+		query = 0;
+	}
+}
+
+FramePacer::~FramePacer()
+{
+	Release();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+
+#include <glad/glad.h>
+
+// Latency of one frame, milliseconds on the CPU clock
+struct FrameLatency
+{
+	unsigned int frame;
+	double start;		// when the frame began on the CPU, input is read right after
+	double submit;		// when its last command went in, after the swap
+	double gpuDone;		// when the GPU finished it
+	unsigned int inFlight;	// frames submitted and not done when it was submitted, itself included
+};
+
+// Keeps the CPU from running ahead of the GPU. A fence after each frame's swap marks where
+// it ends, before the next frame starts the oldest fence is waited on once maxFramesInFlight
+// are out, so input is read at most that many frames before it's seen rather than however many
+// the driver cares to queue. An optional frame-rate limit then holds the frame back to its
+// slot, sleeping most of the way and spinning the rest, the sleep's own overshoot is learned.
+//
+// Each frame's latency, start to GPU done, comes from a timestamp query next to the fence,
+// read once the fence has passed and put on the CPU clock.
+class FramePacer
+{
+public:
+	static const unsigned int MAX_FRAMES_IN_FLIGHT = 3;
+
+	FramePacer();
+
+	bool Init();
+
+	// 1 to MAX_FRAMES_IN_FLIGHT
+	void SetMaxFramesInFlight(unsigned int frames);
+	unsigned int GetMaxFramesInFlight() const { return maxFramesInFlight; }
+	// Frames per second, 0 for no limit
+	void SetFrameRateLimit(double fps);
+	double GetFrameRateLimit() const { return frameRateLimit; }
+
+	// Before the frame reads its input
+	void BeginFrame();
+	// After the swap: fences the frame, then waits for a slot and the limiter
+	void EndFrame();
+
+	const FrameLatency* GetLastLatency() const { return history.empty() ? nullptr : &history.back(); }
+	// avg/p95/max latency over the kept frames and how long the CPU waited per frame
+	void Report() const;
+	// One row per kept frame
+	bool WriteCsv(const char* path) const;
+	void ResetStats();
+
+	// Fences and queries still out, before the context goes
+	void Release();
+
+	~FramePacer();
+
+private:
+	struct InFlightFrame
+	{
+		GLsync fence;
+		GLuint query;
+		unsigned int frame;
+		double start, submit;
+		unsigned int inFlight;
+	};
+
+	double Now() const;
+	void Calibrate();
+	// Frames whose fence has passed, blocking on the oldest if wait
+	void Retire(bool wait);
+	void Limit();
+
+	unsigned int maxFramesInFlight;
+	double frameRateLimit;
+	bool timestamps;
+	std::chrono::steady_clock::time_point clockStart;
+	double gpuOffset;	// ms to add to a GL timestamp in ms to land on the CPU clock
+
+	InFlightFrame frames[MAX_FRAMES_IN_FLIGHT];
+	unsigned int oldest, inFlight;
+	GLuint queries[MAX_FRAMES_IN_FLIGHT];
+	unsigned int frame;
+	double frameStart;
+
+	double nextFrameTime;
+	// Running mean and variance of how long a 1ms sleep really takes, Welford's
+	double sleepMean, sleepM2;
+	unsigned int sleepCount;
+
+	static const unsigned int HISTORY_FRAMES = 300;
+	std::deque<FrameLatency> history;
+	double fenceWait, limitWait;	// ms the CPU spent waiting since the stats were reset
+	unsigned int waitFrames;
+};
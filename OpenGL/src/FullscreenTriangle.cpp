@@ -0,0 +1,19 @@
+#include "FullscreenTriangle.h"
+#include "GLState.h"
+
+GLuint FullscreenTriangle::VAO = 0;
+
+void FullscreenTriangle::Draw()
+{
+	// Core profile still wants a VAO bound even without attributes
+	if (!VAO)
+	{
+		glGenVertexArrays(1, &VAO);
+	}
+
+	GLState::BindVertexArray(VAO);
+	GLState::PauseTriangleCount();
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	GLState::ResumeTriangleCount();
+	GLState::CountDraws();
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Draws one triangle covering the viewport, positions come from gl_VertexID in fullscreen.vert
+class FullscreenTriangle
+{
+public:
+	static void Draw();
+
+private:
+	static GLuint VAO;
+};
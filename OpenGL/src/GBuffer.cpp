@@ -0,0 +1,43 @@
+#include "GBuffer.h"
+
+#include <cstdio>
+
+#include "CommonValues.h"
+#include "GLState.h"
+
+GBuffer::GBuffer()
+{
+	albedoSpecular = 0;
+	normalShininess = 0;
+	depth = 0;
+	width = 0;
+	height = 0;
+}
+
+bool GBuffer::Init()
+{
+	GLint maxUnits = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &maxUnits);
+	if (maxUnits <= GBUFFER_DEPTH_UNIT)
+	{
+		printf("Deferred lighting needs %d texture units, only %d available\n", GBUFFER_DEPTH_UNIT + 1, maxUnits);
+		return false;
+	}
+	return true;
+}
+
+void GBuffer::SetTargets(GLuint albedoSpecular, GLuint normalShininess, GLuint depth, unsigned int width, unsigned int height)
+{
+	this->albedoSpecular = albedoSpecular;
+	this->normalShininess = normalShininess;
+	this->depth = depth;
+	this->width = width;
+	this->height = height;
+}
+
+void GBuffer::Read()
+{
+	GLState::BindTexture(GBUFFER_ALBEDO_UNIT, GL_TEXTURE_2D, albedoSpecular);
+	GLState::BindTexture(GBUFFER_NORMAL_UNIT, GL_TEXTURE_2D, normalShininess);
+	GLState::BindTexture(GBUFFER_DEPTH_UNIT, GL_TEXTURE_2D, depth);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+// Render targets of the deferred path, 12 bytes per pixel:
+//  albedoSpecular   RGBA8     albedo, specular intensity
+//  normalShininess  RGB10_A2  octahedral normal, log2 shininess
+//  depth            DEPTH24   world position is rebuilt from it
+// The textures are frame graph transients, the geometry pass hands them over every frame
+class GBuffer
+{
+public:
+	static const unsigned int BYTES_PER_PIXEL = 12;
+
+	GBuffer();
+
+	bool Init();
+
+	void SetTargets(GLuint albedoSpecular, GLuint normalShininess, GLuint depth, unsigned int width, unsigned int height);
+
+	void Read();
+
+	GLuint GetWidth() { return width; }
+	GLuint GetHeight() { return height; }
+	GLuint GetDepthTexture() { return depth; }
+	size_t GetMemorySize() { return (size_t)width * height * BYTES_PER_PIXEL; }
+
+private:
+	GLuint albedoSpecular, normalShininess, depth;
+	GLuint width, height;
+};
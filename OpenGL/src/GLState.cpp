@@ -0,0 +1,316 @@
+#include "GLState.h"
+
+// Starts out at the defaults of a fresh context, only the viewport depends on the window
+GLuint GLState::program = 0;
+GLuint GLState::vertexArray = 0;
+GLuint GLState::activeUnit = 0;
+GLuint GLState::textures[GLState::MAX_UNITS][GLState::TARGET_COUNT] = {};
+GLuint GLState::drawFramebuffer = 0;
+GLuint GLState::readFramebuffer = 0;
+GLuint GLState::defaultFramebuffer = 0;
+GLint GLState::viewport[4] = {};
+bool GLState::viewportKnown = false;
+GLuint GLState::cullFaceEnabled = GL_FALSE;
+GLuint GLState::depthTestEnabled = GL_FALSE;
+GLuint GLState::scissorTestEnabled = GL_FALSE;
+GLuint GLState::cullFace = GL_BACK;
+GLuint GLState::depthFunc = GL_LESS;
+GLuint GLState::depthMask = GL_TRUE;
+GLuint GLState::polygonMode = GL_FILL;
+
+TriangleQueries* GLState::triangleQueries = nullptr;
+unsigned int GLState::trianglePauses = 0;
+
+unsigned int GLState::frameIssued = 0;
+unsigned int GLState::frameSuppressed = 0;
+unsigned int GLState::frameDraws = 0;
+unsigned long long GLState::totalIssued = 0;
+unsigned long long GLState::totalSuppressed = 0;
+unsigned long long GLState::totalDraws = 0;
+unsigned int GLState::totalFrames = 0;
+
+bool GLState::Matches(GLuint& cached, GLuint value)
+{
+	if (cached == value)
+	{
+		frameSuppressed++;
+		return true;
+	}
+
+	cached = value;
+	frameIssued++;
+	return false;
+}
+
+int GLState::TargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return TARGET_2D;
+	case GL_TEXTURE_CUBE_MAP: return TARGET_CUBE_MAP;
+	case GL_TEXTURE_BUFFER: return TARGET_BUFFER;
+	default: return -1;
+	}
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (!Matches(GLState::program, program))
+	{
+		glUseProgram(program);
+	}
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	if (!Matches(vertexArray, vao))
+	{
+		glBindVertexArray(vao);
+	}
+}
+
+void GLState::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	int targetIndex = TargetIndex(target);
+	if (unit >= MAX_UNITS || targetIndex < 0)
+	{
+		// Untracked, pass it through and forget the active unit
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		activeUnit = unit;
+		frameIssued += 2;
+		return;
+	}
+
+	if (Matches(textures[unit][targetIndex], texture))
+	{
+		return;
+	}
+
+	if (activeUnit != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+		frameIssued++;
+	}
+	glBindTexture(target, texture);
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture)
+{
+	BindTexture(activeUnit == UNKNOWN ? 0 : activeUnit, target, texture);
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	if (framebuffer == 0) framebuffer = defaultFramebuffer;
+
+	if ((!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer))
+	{
+		frameSuppressed++;
+		return;
+	}
+
+	if (draw) drawFramebuffer = framebuffer;
+	if (read) readFramebuffer = framebuffer;
+	frameIssued++;
+	glBindFramebuffer(target, framebuffer);
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (viewportKnown && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+	{
+		frameSuppressed++;
+		return;
+	}
+
+	viewport[0] = x; viewport[1] = y; viewport[2] = width; viewport[3] = height;
+	viewportKnown = true;
+	frameIssued++;
+	glViewport(x, y, width, height);
+}
+
+static GLuint* EnabledSlot(GLenum capability, GLuint& cull, GLuint& depth, GLuint& scissor)
+{
+	switch (capability)
+	{
+	case GL_CULL_FACE: return &cull;
+	case GL_DEPTH_TEST: return &depth;
+	case GL_SCISSOR_TEST: return &scissor;
+	default: return nullptr;
+	}
+}
+
+void GLState::SetEnabled(GLenum capability, bool enabled)
+{
+	GLuint* cached = EnabledSlot(capability, cullFaceEnabled, depthTestEnabled, scissorTestEnabled);
+	if (cached && Matches(*cached, enabled ? GL_TRUE : GL_FALSE))
+	{
+		return;
+	}
+
+	if (!cached) frameIssued++;
+	if (enabled) glEnable(capability);
+	else glDisable(capability);
+}
+
+bool GLState::IsEnabled(GLenum capability)
+{
+	GLuint* cached = EnabledSlot(capability, cullFaceEnabled, depthTestEnabled, scissorTestEnabled);
+	if (!cached)
+	{
+		return glIsEnabled(capability) == GL_TRUE;
+	}
+
+	if (*cached == UNKNOWN)
+	{
+		*cached = glIsEnabled(capability);
+	}
+	return *cached == GL_TRUE;
+}
+
+void GLState::CullFace(GLenum face)
+{
+	if (!Matches(cullFace, face))
+	{
+		glCullFace(face);
+	}
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+	if (!Matches(depthFunc, func))
+	{
+		glDepthFunc(func);
+	}
+}
+
+void GLState::DepthMask(GLboolean mask)
+{
+	if (!Matches(depthMask, mask))
+	{
+		glDepthMask(mask);
+	}
+}
+
+void GLState::PolygonMode(GLenum mode)
+{
+	if (!Matches(polygonMode, mode))
+	{
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+	}
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+	// A deleted program stays current until something else is used, so just stop trusting the copy
+	if (GLState::program == program) GLState::program = UNKNOWN;
+	glDeleteProgram(program);
+}
+
+void GLState::DeleteVertexArray(GLuint vao)
+{
+	if (vertexArray == vao) vertexArray = 0;
+	glDeleteVertexArrays(1, &vao);
+}
+
+void GLState::DeleteTexture(GLuint texture)
+{
+	for (int unit = 0; unit < MAX_UNITS; unit++)
+	{
+		for (int target = 0; target < TARGET_COUNT; target++)
+		{
+			if (textures[unit][target] == texture) textures[unit][target] = 0;
+		}
+	}
+	glDeleteTextures(1, &texture);
+}
+
+void GLState::DeleteFramebuffer(GLuint framebuffer)
+{
+	if (drawFramebuffer == framebuffer) drawFramebuffer = 0;
+	if (readFramebuffer == framebuffer) readFramebuffer = 0;
+	glDeleteFramebuffers(1, &framebuffer);
+}
+
+void GLState::Invalidate()
+{
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	activeUnit = UNKNOWN;
+	for (int unit = 0; unit < MAX_UNITS; unit++)
+	{
+		for (int target = 0; target < TARGET_COUNT; target++)
+		{
+			textures[unit][target] = UNKNOWN;
+		}
+	}
+	drawFramebuffer = readFramebuffer = UNKNOWN;
+	viewportKnown = false;
+	cullFaceEnabled = depthTestEnabled = scissorTestEnabled = UNKNOWN;
+	cullFace = depthFunc = depthMask = polygonMode = UNKNOWN;
+}
+
+void GLState::BeginTriangleCount(TriangleQueries* queries)
+{
+	triangleQueries = queries;
+	triangleQueries->used = 0;
+	trianglePauses = 0;
+	StartTriangleQuery();
+}
+
+void GLState::EndTriangleCount()
+{
+	if (!triangleQueries) return;
+
+	if (trianglePauses == 0) glEndQuery(GL_PRIMITIVES_GENERATED);
+	triangleQueries = nullptr;
+}
+
+void GLState::PauseTriangleCount()
+{
+	if (!triangleQueries || trianglePauses++ > 0) return;
+
+	glEndQuery(GL_PRIMITIVES_GENERATED);
+}
+
+void GLState::ResumeTriangleCount()
+{
+	if (!triangleQueries || --trianglePauses > 0) return;
+
+	StartTriangleQuery();
+}
+
+void GLState::StartTriangleQuery()
+{
+	std::vector<GLuint>& queries = triangleQueries->queries;
+	if (triangleQueries->used == queries.size())
+	{
+		GLuint query = 0;
+		glGenQueries(1, &query);
+		queries.push_back(query);
+	}
+	glBeginQuery(GL_PRIMITIVES_GENERATED, queries[triangleQueries->used++]);
+}
+
+void GLState::EndFrame()
+{
+	totalIssued += frameIssued;
+	totalSuppressed += frameSuppressed;
+	totalDraws += frameDraws;
+	totalFrames++;
+
+	frameIssued = 0;
+	frameSuppressed = 0;
+	frameDraws = 0;
+}
+
+void GLState::ResetStats()
+{
+	frameIssued = frameSuppressed = frameDraws = 0;
+	totalIssued = totalSuppressed = totalDraws = 0;
+	totalFrames = 0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+// GL_PRIMITIVES_GENERATED queries over one frame's scene drawing, one per stretch between pauses.
+// Queries are kept for the next frame that uses the set, used says how many this one took
+struct TriangleQueries
+{
+	std::vector<GLuint> queries;
+	size_t used = 0;
+};
+
+// Shadow copy of the GL state the renderer flips every frame. Everything binds and toggles
+// through here so calls that would not change anything never reach the driver.
+// Anything that changes this state behind its back has to call Invalidate() afterwards.
+class GLState
+{
+public:
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vao);
+
+	// unit is an index, not GL_TEXTUREi. Without one the texture goes on the active unit,
+	// which is what creation code wants
+	static void BindTexture(GLuint unit, GLenum target, GLuint texture);
+	static void BindTexture(GLenum target, GLuint texture);
+
+	// GL_FRAMEBUFFER sets both the draw and read binding, like in GL
+	static void BindFramebuffer(GLenum target, GLuint framebuffer);
+	// Framebuffer 0 binds this one instead, so everything drawn for the window lands offscreen
+	static void SetDefaultFramebuffer(GLuint framebuffer) { defaultFramebuffer = framebuffer; }
+	static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	// GL_CULL_FACE, GL_DEPTH_TEST and GL_SCISSOR_TEST are tracked, anything else goes straight through
+	static void SetEnabled(GLenum capability, bool enabled);
+	static bool IsEnabled(GLenum capability);
+
+	static void CullFace(GLenum face);
+	static void DepthFunc(GLenum func);
+	static void DepthMask(GLboolean mask);
+	static void PolygonMode(GLenum mode);	// front and back together
+
+	// Deleting a bound object unbinds it in GL, these keep the copy in step so a reused name still binds
+	static void DeleteProgram(GLuint program);
+	static void DeleteVertexArray(GLuint vao);
+	static void DeleteTexture(GLuint texture);
+	static void DeleteFramebuffer(GLuint framebuffer);
+
+	// Forget everything, the next call of each kind goes through
+	static void Invalidate();
+
+	// Every glDraw* call counts itself here
+	static void CountDraws(unsigned int calls = 1) { frameDraws += calls; }
+
+	// Scene triangles into queries, started by whoever wants them. Passes that draw anything else
+	// (culling points, fullscreen triangles, query proxies) sit between Pause and Resume, which
+	// nest and do nothing while no count runs
+	static void BeginTriangleCount(TriangleQueries* queries);
+	static void EndTriangleCount();
+	static void PauseTriangleCount();
+	static void ResumeTriangleCount();
+
+	// Frame stats, EndFrame folds them into the running totals
+	static unsigned int GetFrameIssued() { return frameIssued; }
+	static unsigned int GetFrameSuppressed() { return frameSuppressed; }
+	static double GetAverageIssued() { return totalFrames ? (double)totalIssued / totalFrames : 0.0; }
+	static double GetAverageSuppressed() { return totalFrames ? (double)totalSuppressed / totalFrames : 0.0; }
+	static unsigned int GetFrameDraws() { return frameDraws; }
+	static double GetAverageDraws() { return totalFrames ? (double)totalDraws / totalFrames : 0.0; }
+	static void EndFrame();
+	static void ResetStats();
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFF;
+	static const int MAX_UNITS = 32;
+
+	enum TextureTarget { TARGET_2D, TARGET_CUBE_MAP, TARGET_BUFFER, TARGET_COUNT };
+	static int TargetIndex(GLenum target);
+
+	// true when the cached value already matches, otherwise stores it and counts the GL call
+	static bool Matches(GLuint& cached, GLuint value);
+
+	static GLuint program;
+	static GLuint vertexArray;
+	static GLuint activeUnit;
+	static GLuint textures[MAX_UNITS][TARGET_COUNT];
+	static GLuint drawFramebuffer, readFramebuffer, defaultFramebuffer;
+	static GLint viewport[4];
+	static bool viewportKnown;
+	static GLuint cullFaceEnabled, depthTestEnabled, scissorTestEnabled;
+	static GLuint cullFace, depthFunc, depthMask, polygonMode;
+
+	static void StartTriangleQuery();
+
+	static TriangleQueries* triangleQueries;
+	static unsigned int trianglePauses;
+
+	static unsigned int frameIssued, frameSuppressed, frameDraws;
+	static unsigned long long totalIssued, totalSuppressed, totalDraws;
+	static unsigned int totalFrames;
+};
@@ -0,0 +1,64 @@
+#include "GlfwWindow.h"
+#include "GLState.h"
+#include "io/keyboard.h"
+#include "io/mouse.h"
+
+GlfwWindow::GlfwWindow(GLint windowWidth, GLint windowHeight, bool visible)
+    : Window(windowWidth, windowHeight), mainWindow(nullptr), visible(visible) {
+}
+
+void GlfwWindow::FramebufferSizeCallback(GLFWwindow* window, int width, int height) {
+    GlfwWindow* self = static_cast<GlfwWindow*>(glfwGetWindowUserPointer(window));
+    self->bufferWidth = width;
+    self->bufferHeight = height;
+    GLState::Viewport(0, 0, width, height);
+    if (self->resizeCallback) self->resizeCallback(width, height);
+}
+
+int GlfwWindow::Initialise() {
+    if (!glfwInit()) {
+        std::cout << "Failed to initialize GLFW" << std::endl;
+        return -1;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+
+    mainWindow = glfwCreateWindow(width, height, visible ? "OpenGL Window" : "OpenGL Offscreen", nullptr, nullptr);
+    if (!mainWindow) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        return -1;
+    }
+    glfwMakeContextCurrent(mainWindow);
+
+    if (!LoadGL()) return -1;
+
+    // A hidden window's pixels aren't its own to keep, it draws offscreen like a headless one
+    if (!visible) return CreateOffscreenTarget() ? 0 : -1;
+
+    glfwGetFramebufferSize(mainWindow, &bufferWidth, &bufferHeight);
+    GLState::Viewport(0, 0, bufferWidth, bufferHeight);
+
+    glfwSetWindowUserPointer(mainWindow, this);
+    glfwSetFramebufferSizeCallback(mainWindow, FramebufferSizeCallback);
+
+    // keyboard input
+    glfwSetKeyCallback(mainWindow, Keyboard::keyCallback);
+
+    // mouse input
+    glfwSetCursorPosCallback(mainWindow, Mouse::cursorPosCallback);
+    glfwSetMouseButtonCallback(mainWindow, Mouse::mouseButtonCallback);
+    glfwSetScrollCallback(mainWindow, Mouse::scrollCallback);
+
+    return 0;
+}
+
+GlfwWindow::~GlfwWindow() {
+    if (mainWindow) {
+        DestroyOffscreenTarget();
+        glfwDestroyWindow(mainWindow);
+    }
+    glfwTerminate();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Window.h"
+
+#include<GLFW/glfw3.h>
+
+// A GLFW window with the keyboard and mouse hooked up. A hidden one takes no input and renders
+// offscreen, as the headless fallback
+class GlfwWindow : public Window
+{
+
+private:
+	GLFWwindow* mainWindow;
+	bool visible;
+
+	static void FramebufferSizeCallback(GLFWwindow* window, int width, int height);
+
+public:
+	GlfwWindow(GLint windowWidth, GLint windowHeight, bool visible = true);
+
+	int Initialise() override;
+
+	GLFWwindow* getWindow() const override { return visible ? mainWindow : nullptr; }
+	GLADloadproc getProcLoader() const override { return (GLADloadproc)glfwGetProcAddress; }
+
+	void setSwapInterval(int interval) override {
+		glfwSwapInterval(interval);
+	}
+
+	bool getShouldClose() override {
+		return glfwWindowShouldClose(mainWindow);
+	}
+
+	void swapBuffers() override {
+		glfwSwapBuffers(mainWindow);
+	}
+
+	void pollEvents() override {
+		glfwPollEvents();
+	}
+
+	~GlfwWindow();
+};
@@ -0,0 +1,375 @@
+#include "GpuCulling.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <glm\gtc\type_ptr.hpp>
+
+#include "CommonValues.h"
+#include "FullscreenTriangle.h"
+#include "GLState.h"
+
+GpuCulling::GpuCulling()
+{
+	uniformCullMode = uniformFrustumPlanes = uniformRangeSphere = -1;
+	uniformOcclusion = uniformOcclusionViewProjection = uniformHiZLevels = uniformGroupCount = -1;
+	uniformReduceCopy = -1;
+
+	hiZ = 0;
+	hiZWidth = hiZHeight = 0;
+	hiZValid = false;
+	depthCopySupported = true;
+	hiZViewProjection = glm::mat4(1.0f);
+	depthCopy = depthCopyFBO = 0;
+
+	counts = countsFBO = 0;
+	countsWidth = 0;
+
+	visibleQueries[0] = visibleQueries[1] = 0;
+	queryRecords[0] = queryRecords[1] = 0;
+	queryFrame = 0;
+	ResetStats();
+}
+
+bool GpuCulling::Init()
+{
+	// Interleaved exactly like BatchDrawData and DrawElementsIndirectCommand
+	cullShader.SetFeedbackVaryings({ "outModel", "outMaterial", "outLightInfo", "outLights0", "outLights1" });
+	cullShader.CreateFromFiles("Shaders/cull.vert", "Shaders/cull.geom", "Shaders/cull.frag");
+	commandShader.SetFeedbackVaryings({ "outCount", "outInstanceCount", "outFirstIndex", "outBaseVertex", "outBaseInstance" });
+	commandShader.CreateFromFiles("Shaders/cull_commands.vert", "Shaders/cull.frag");
+	reduceShader.CreateFromFiles("Shaders/fullscreen.vert", "Shaders/hiz_reduce.frag");
+
+	GLuint programs[] = { cullShader.GetShaderID(), commandShader.GetShaderID(), reduceShader.GetShaderID() };
+	for (GLuint program : programs)
+	{
+		GLint linked = GL_FALSE;
+		if (program) glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			printf("GPU culling shaders failed to build\n");
+			return false;
+		}
+	}
+
+	GLuint cull = cullShader.GetShaderID();
+	uniformCullMode = glGetUniformLocation(cull, "cullMode");
+	uniformFrustumPlanes = glGetUniformLocation(cull, "frustumPlanes");
+	uniformRangeSphere = glGetUniformLocation(cull, "rangeSphere");
+	uniformOcclusion = glGetUniformLocation(cull, "occlusion");
+	uniformOcclusionViewProjection = glGetUniformLocation(cull, "occlusionViewProjection");
+	uniformHiZLevels = glGetUniformLocation(cull, "hiZLevels");
+	uniformGroupCount = glGetUniformLocation(cull, "groupCount");
+	uniformReduceCopy = glGetUniformLocation(reduceShader.GetShaderID(), "copy");
+
+	GLState::UseProgram(cull);
+	glUniform1i(glGetUniformLocation(cull, "hiZ"), HIZ_UNIT);
+	GLState::UseProgram(commandShader.GetShaderID());
+	glUniform1i(glGetUniformLocation(commandShader.GetShaderID(), "groupCounts"), CULL_COUNTS_UNIT);
+	GLState::UseProgram(reduceShader.GetShaderID());
+	glUniform1i(glGetUniformLocation(reduceShader.GetShaderID(), "source"), HIZ_UNIT);
+	GLState::UseProgram(0);
+
+	glGenQueries(2, visibleQueries);
+	return true;
+}
+
+bool GpuCulling::ResizeHiZ(GLsizei width, GLsizei height)
+{
+	if (width <= 0 || height <= 0) return false;
+	if (hiZ && width == hiZWidth && height == hiZHeight) return true;
+
+	for (GLuint framebuffer : hiZFramebuffers) GLState::DeleteFramebuffer(framebuffer);
+	hiZFramebuffers.clear();
+	if (hiZ) GLState::DeleteTexture(hiZ);
+	if (depthCopyFBO) GLState::DeleteFramebuffer(depthCopyFBO);
+	if (depthCopy) GLState::DeleteTexture(depthCopy);
+	depthCopy = depthCopyFBO = 0;
+
+	hiZWidth = width;
+	hiZHeight = height;
+	int levels = 1;
+	while ((std::max(width, height) >> levels) > 0) levels++;
+
+	glGenTextures(1, &hiZ);
+	GLState::BindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZ);
+	for (int level = 0; level < levels; level++)
+	{
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(1, width >> level), std::max(1, height >> level), 0, GL_RED, GL_FLOAT, nullptr);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+	hiZFramebuffers.resize(levels);
+	glGenFramebuffers(levels, hiZFramebuffers.data());
+	for (int level = 0; level < levels; level++)
+	{
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, hiZFramebuffers[level]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hiZ, level);
+	}
+
+	// Copy target for the default framebuffer's depth, blits need the same format on both sides
+	glGenTextures(1, &depthCopy);
+	GLState::BindTexture(HIZ_UNIT, GL_TEXTURE_2D, depthCopy);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenFramebuffers(1, &depthCopyFBO);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, depthCopyFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthCopy, 0);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Hi-Z framebuffer error: %u\n", status);
+		return false;
+	}
+
+	hiZValid = false;
+	return true;
+}
+
+void GpuCulling::BuildHiZ(GLuint depthTexture, GLsizei width, GLsizei height, const glm::mat4& viewProjection)
+{
+	if (!ResizeHiZ(width, height)) return;
+
+	GLuint source = depthTexture;
+	if (!source)
+	{
+		if (!depthCopySupported) return;
+
+		// Only fails when the window's depth format differs, checked once
+		while (glGetError() != GL_NO_ERROR) {}
+		GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, depthCopyFBO);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		if (glGetError() != GL_NO_ERROR)
+		{
+			printf("Can't copy the window's depth buffer, occlusion culling is off in forward mode\n");
+			depthCopySupported = false;
+			hiZValid = false;
+			return;
+		}
+		source = depthCopy;
+	}
+
+	bool depthTest = GLState::IsEnabled(GL_DEPTH_TEST);
+	GLState::SetEnabled(GL_DEPTH_TEST, false);
+	reduceShader.UseShader();
+
+	for (size_t level = 0; level < hiZFramebuffers.size(); level++)
+	{
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, hiZFramebuffers[level]);
+		GLState::Viewport(0, 0, std::max(1, width >> level), std::max(1, height >> level));
+
+		if (level == 0)
+		{
+			GLState::BindTexture(HIZ_UNIT, GL_TEXTURE_2D, source);
+			glUniform1i(uniformReduceCopy, 1);
+		}
+		else
+		{
+			// Read only the previous level, the one being written stays out of the sampled range
+			SetHiZLevels(static_cast<GLint>(level - 1), static_cast<GLint>(level - 1));
+			GLState::BindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZ);
+			glUniform1i(uniformReduceCopy, 0);
+		}
+		FullscreenTriangle::Draw();
+	}
+
+	SetHiZLevels(0, static_cast<GLint>(hiZFramebuffers.size() - 1));
+
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::SetEnabled(GL_DEPTH_TEST, depthTest);
+
+	hiZViewProjection = viewProjection;
+	hiZValid = true;
+}
+
+void GpuCulling::SetHiZLevels(GLint base, GLint max)
+{
+	// Parameters go to whatever is on the active unit, and a bind the cache skipped may have left
+	// that on another unit, so bind through the active unit like the other parameter setters
+	GLState::BindTexture(GL_TEXTURE_2D, hiZ);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max);
+}
+
+void GpuCulling::ResizeCounts(GLsizei groups)
+{
+	if (counts && groups <= countsWidth) return;
+
+	if (countsFBO) GLState::DeleteFramebuffer(countsFBO);
+	if (counts) GLState::DeleteTexture(counts);
+
+	countsWidth = std::max(groups, countsWidth * 2);
+	glGenTextures(1, &counts);
+	GLState::BindTexture(CULL_COUNTS_UNIT, GL_TEXTURE_2D, counts);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, countsWidth, 1, 0, GL_RED, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenFramebuffers(1, &countsFBO);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, countsFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, counts, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Gribb/Hartmann planes, pointing inwards
+static void ExtractFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		planes[i * 2] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+void GpuCulling::CullFrustum(DrawBatch& batch, unsigned int view, const glm::mat4& viewProjection, bool occlusion)
+{
+	glm::vec4 planes[6];
+	ExtractFrustumPlanes(viewProjection, planes);
+	// Only the occlusion-tested view is counted, the queries are a two-entry ring for one view a frame
+	bool countVisible = occlusion;
+	occlusion = occlusion && hiZValid;
+
+	cullShader.UseShader();
+	glUniform1i(uniformCullMode, CULL_FRUSTUM);
+	glUniform4fv(uniformFrustumPlanes, 6, glm::value_ptr(planes[0]));
+	glUniform1i(uniformOcclusion, occlusion ? 1 : 0);
+	if (occlusion)
+	{
+		glUniformMatrix4fv(uniformOcclusionViewProjection, 1, GL_FALSE, glm::value_ptr(hiZViewProjection));
+		glUniform1i(uniformHiZLevels, static_cast<GLint>(hiZFramebuffers.size()));
+		GLState::BindTexture(HIZ_UNIT, GL_TEXTURE_2D, hiZ);
+	}
+
+	Cull(batch, view, countVisible);
+}
+
+void GpuCulling::CullRange(DrawBatch& batch, unsigned int view, const glm::vec3& position, float range)
+{
+	cullShader.UseShader();
+	glUniform1i(uniformCullMode, CULL_RANGE);
+	glUniform4f(uniformRangeSphere, position.x, position.y, position.z, range);
+	glUniform1i(uniformOcclusion, 0);
+
+	Cull(batch, view, false);
+}
+
+void GpuCulling::Cull(DrawBatch& batch, unsigned int view, bool countVisible)
+{
+	GLsizei records = batch.GetRecordCount();
+	GLsizei groups = batch.GetGroupCount();
+	GLsizei commands = static_cast<GLsizei>(batch.GetCommandCount());
+	if (view == 0 || view >= batch.GetViewCount() || records == 0 || commands == 0) return;
+
+	ResizeCounts(groups);
+	bool depthTest = GLState::IsEnabled(GL_DEPTH_TEST);
+	GLState::SetEnabled(GL_DEPTH_TEST, false);
+	GLState::PauseTriangleCount();		// one point per record and command, none of it scene
+
+	// 1. Survivors captured into the view's records, each also adds 1 to its group's texel
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, countsFBO);
+	GLState::Viewport(0, 0, groups, 1);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	glUniform1i(uniformGroupCount, groups);
+	GLState::BindVertexArray(batch.GetRecordArray());
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, batch.GetViewRecords(view));
+
+	if (countVisible)
+	{
+		ReadVisible();
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, visibleQueries[queryFrame % 2]);
+		queryRecords[queryFrame % 2] = records;
+	}
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, records);
+	GLState::CountDraws();
+	glEndTransformFeedback();
+	if (countVisible)
+	{
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+		queryFrame++;
+	}
+
+	glDisable(GL_BLEND);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// 2. Commands rewritten from the counts, nothing rasterised
+	glEnable(GL_RASTERIZER_DISCARD);
+	commandShader.UseShader();
+	GLState::BindTexture(CULL_COUNTS_UNIT, GL_TEXTURE_2D, counts);
+	GLState::BindVertexArray(batch.GetCommandArray());
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, batch.GetViewCommands(view));
+
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, commands);
+	GLState::CountDraws();
+	glEndTransformFeedback();
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+	GLState::SetEnabled(GL_DEPTH_TEST, depthTest);
+	GLState::ResumeTriangleCount();
+}
+
+void GpuCulling::ReadVisible()
+{
+	if (queryFrame == 0) return;
+
+	unsigned int previous = (queryFrame - 1) % 2;
+	GLint available = 0;
+	glGetQueryObjectiv(visibleQueries[previous], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return;
+
+	GLuint visible = 0;
+	glGetQueryObjectuiv(visibleQueries[previous], GL_QUERY_RESULT, &visible);
+	visibleTotal += visible;
+	recordTotal += queryRecords[previous];
+	statFrames++;
+}
+
+void GpuCulling::ResetStats()
+{
+	visibleTotal = recordTotal = 0.0;
+	statFrames = 0;
+}
+
+void GpuCulling::Release()
+{
+	for (GLuint framebuffer : hiZFramebuffers) GLState::DeleteFramebuffer(framebuffer);
+	hiZFramebuffers.clear();
+	if (hiZ) GLState::DeleteTexture(hiZ);
+	if (depthCopyFBO) GLState::DeleteFramebuffer(depthCopyFBO);
+	if (depthCopy) GLState::DeleteTexture(depthCopy);
+	if (countsFBO) GLState::DeleteFramebuffer(countsFBO);
+	if (counts) GLState::DeleteTexture(counts);
+	hiZ = depthCopyFBO = depthCopy = countsFBO = counts = 0;
+	if (visibleQueries[0]) glDeleteQueries(2, visibleQueries);
+	visibleQueries[0] = visibleQueries[1] = 0;
+}
+
+GpuCulling::~GpuCulling()
+{
+	Release();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm\glm.hpp>
+
+#include "Shader.h"
+#include "DrawBatch.h"
+
+// How a view tests records, must match CULL_* in cull.vert
+enum CullMode
+{
+	CULL_FRUSTUM = 0,	// camera or directional light, optionally against the Hi-Z pyramid
+	CULL_RANGE,			// omni light, anything within the far plane
+};
+
+// Culls DrawBatch records per view on the GPU with transform feedback, so it runs on GL 3.3.
+// Survivors are compacted into the view's records and the view's indirect commands are
+// rewritten from per-group counts, nothing comes back to the CPU and the CPU cost per view
+// is the same few calls whatever the instance count.
+// Camera views can also test against a max depth pyramid of the previous frame's depth.
+class GpuCulling
+{
+public:
+	GpuCulling();
+
+	bool Init();
+
+	// Pyramid of the frame just drawn with viewProjection. depthTexture is sampled directly,
+	// 0 copies the default framebuffer's depth first
+	void BuildHiZ(GLuint depthTexture, GLsizei width, GLsizei height, const glm::mat4& viewProjection);
+	void InvalidateHiZ() { hiZValid = false; }
+
+	void CullFrustum(DrawBatch& batch, unsigned int view, const glm::mat4& viewProjection, bool occlusion);
+	void CullRange(DrawBatch& batch, unsigned int view, const glm::vec3& position, float range);
+
+	// Records the occlusion tested view kept, read back a frame late so it never stalls
+	double GetAverageVisible() const { return statFrames ? visibleTotal / statFrames : 0.0; }
+	double GetAverageRecords() const { return statFrames ? recordTotal / statFrames : 0.0; }
+	void ResetStats();
+
+	// The Hi-Z pyramid and readback targets, while there is still a context
+	void Release();
+
+	~GpuCulling();
+
+private:
+	void Cull(DrawBatch& batch, unsigned int view, bool countVisible);
+	bool ResizeHiZ(GLsizei width, GLsizei height);
+	void SetHiZLevels(GLint base, GLint max);
+	void ResizeCounts(GLsizei groups);
+	void ReadVisible();
+
+	Shader cullShader, commandShader, reduceShader;
+	GLint uniformCullMode, uniformFrustumPlanes, uniformRangeSphere;
+	GLint uniformOcclusion, uniformOcclusionViewProjection, uniformHiZLevels, uniformGroupCount;
+	GLint uniformReduceCopy;
+
+	// Max depth pyramid, R32F with one framebuffer per level
+	GLuint hiZ;
+	std::vector<GLuint> hiZFramebuffers;
+	GLsizei hiZWidth, hiZHeight;
+	bool hiZValid, depthCopySupported;
+	glm::mat4 hiZViewProjection;
+	GLuint depthCopy, depthCopyFBO;
+
+	// Survivors per group, one R32F texel each
+	GLuint counts, countsFBO;
+	GLsizei countsWidth;
+
+	GLuint visibleQueries[2];
+	GLsizei queryRecords[2];
+	unsigned int queryFrame;
+	double visibleTotal, recordTotal;
+	unsigned int statFrames;
+};
@@ -0,0 +1,339 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+GpuProfiler::GpuProfiler()
+{
+	enabled = true;
+	timestamps = false;
+	start = std::chrono::steady_clock::now();
+	gpuOffset = 0.0;
+
+	for (PendingFrame& pending : frames)
+	{
+		pending.frame = 0;
+		pending.pending = false;
+	}
+	frame = 0;
+	inFrame = false;
+
+	historyFrames = 300;
+	droppedFrames = 0;
+}
+
+bool GpuProfiler::Init()
+{
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	timestamps = bits > 0;
+	if (!timestamps) printf("GPU profiler: no timestamp queries, CPU times only\n");
+
+	Calibrate();
+	return true;
+}
+
+double GpuProfiler::Now() const
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+void GpuProfiler::Calibrate()
+{
+	if (!timestamps) return;
+
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuOffset = Now() - static_cast<double>(gpuNow) / 1000000.0;
+}
+
+void GpuProfiler::BeginFrame()
+{
+	if (!enabled) return;
+
+	// Read whatever finished since, the slot this frame takes last of all
+	for (unsigned int i = 1; i <= FRAME_LATENCY; i++)
+	{
+		PendingFrame& pending = frames[(frame + i) % FRAME_LATENCY];
+		if (pending.pending) ReadBack(pending);
+	}
+
+	PendingFrame& current = frames[frame % FRAME_LATENCY];
+	if (current.pending)
+	{
+		// Still not in after FRAME_LATENCY frames
+		current.pending = false;
+		droppedFrames++;
+	}
+	current.frame = frame;
+	current.scopes.clear();
+	open.clear();
+	inFrame = true;
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (!enabled || !inFrame) return;
+
+	while (!open.empty())
+	{
+		EndScope();
+	}
+
+	frames[frame % FRAME_LATENCY].pending = true;
+	inFrame = false;
+	frame++;
+}
+
+void GpuProfiler::Flush()
+{
+	glFinish();
+	for (unsigned int i = 1; i <= FRAME_LATENCY; i++)
+	{
+		PendingFrame& pending = frames[(frame + i) % FRAME_LATENCY];
+		if (pending.pending) ReadBack(pending);
+	}
+}
+
+void GpuProfiler::BeginScope(const char* name)
+{
+	if (!enabled || !inFrame) return;
+
+	PendingFrame& current = frames[frame % FRAME_LATENCY];
+
+	Scope scope;
+	scope.name = NameIndex(name);
+	scope.depth = (unsigned int)open.size();
+	scope.cpuBegin = Now();
+	scope.cpuEnd = scope.cpuBegin;
+	scope.gpuBegin = scope.gpuEnd = 0;
+
+	size_t index = current.scopes.size();
+	current.scopes.push_back(scope);
+	open.push_back((unsigned int)index);
+
+	if (timestamps)
+	{
+		if (current.queries.size() < current.scopes.size() * 2)
+		{
+			size_t old = current.queries.size();
+			current.queries.resize(current.scopes.size() * 2);
+			glGenQueries((GLsizei)(current.queries.size() - old), &current.queries[old]);
+		}
+		glQueryCounter(current.queries[index * 2], GL_TIMESTAMP);
+	}
+}
+
+void GpuProfiler::EndScope()
+{
+	if (!enabled || !inFrame || open.empty()) return;
+
+	PendingFrame& current = frames[frame % FRAME_LATENCY];
+	unsigned int index = open.back();
+	open.pop_back();
+
+	if (timestamps) glQueryCounter(current.queries[index * 2 + 1], GL_TIMESTAMP);
+	current.scopes[index].cpuEnd = Now();
+}
+
+void GpuProfiler::ReadBack(PendingFrame& pending)
+{
+	if (timestamps && !pending.scopes.empty())
+	{
+		// The last end stamp is the last issued, everything before it is in with it
+		GLint available = 0;
+		glGetQueryObjectiv(pending.queries[pending.scopes.size() * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return;
+	}
+	pending.pending = false;
+
+	FrameRecord record;
+	record.frame = pending.frame;
+	for (size_t i = 0; i < pending.scopes.size(); i++)
+	{
+		Scope& scope = pending.scopes[i];
+		if (timestamps)
+		{
+			glGetQueryObjectui64v(pending.queries[i * 2], GL_QUERY_RESULT, &scope.gpuBegin);
+			glGetQueryObjectui64v(pending.queries[i * 2 + 1], GL_QUERY_RESULT, &scope.gpuEnd);
+		}
+
+		Sample sample;
+		sample.name = scope.name;
+		sample.depth = scope.depth;
+		sample.cpuBegin = scope.cpuBegin;
+		sample.cpuTime = scope.cpuEnd - scope.cpuBegin;
+		sample.gpuBegin = timestamps ? static_cast<double>(scope.gpuBegin) / 1000000.0 + gpuOffset : sample.cpuBegin;
+		sample.gpuTime = static_cast<double>(scope.gpuEnd - scope.gpuBegin) / 1000000.0;
+		record.samples.push_back(sample);
+	}
+
+	history.push_back(record);
+	while (history.size() > historyFrames)
+	{
+		history.pop_front();
+	}
+}
+
+unsigned int GpuProfiler::NameIndex(const char* name)
+{
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i] == name) return (unsigned int)i;
+	}
+	names.push_back(name);
+	return (unsigned int)names.size() - 1;
+}
+
+// Nearest rank on sorted values
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+	size_t rank = (size_t)std::ceil(p * sorted.size());
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+bool GpuProfiler::GetStats(const std::string& name, ProfileStats& stats) const
+{
+	std::vector<double> gpu, cpu;
+	for (const FrameRecord& record : history)
+	{
+		// A scope that runs more than once a frame counts once with its total
+		double gpuTotal = 0.0, cpuTotal = 0.0;
+		bool found = false;
+		for (const Sample& sample : record.samples)
+		{
+			if (names[sample.name] != name) continue;
+			gpuTotal += sample.gpuTime;
+			cpuTotal += sample.cpuTime;
+			found = true;
+		}
+		if (!found) continue;
+
+		gpu.push_back(gpuTotal);
+		cpu.push_back(cpuTotal);
+	}
+
+	stats.samples = (unsigned int)gpu.size();
+	if (gpu.empty())
+	{
+		stats.gpuMin = stats.gpuAverage = stats.gpuP95 = stats.gpuP99 = 0.0;
+		stats.cpuMin = stats.cpuAverage = stats.cpuP95 = stats.cpuP99 = 0.0;
+		return false;
+	}
+
+	std::sort(gpu.begin(), gpu.end());
+	std::sort(cpu.begin(), cpu.end());
+
+	double gpuSum = 0.0, cpuSum = 0.0;
+	for (size_t i = 0; i < gpu.size(); i++)
+	{
+		gpuSum += gpu[i];
+		cpuSum += cpu[i];
+	}
+
+	stats.gpuMin = gpu.front();
+	stats.gpuAverage = gpuSum / gpu.size();
+	stats.gpuP95 = Percentile(gpu, 0.95);
+	stats.gpuP99 = Percentile(gpu, 0.99);
+	stats.cpuMin = cpu.front();
+	stats.cpuAverage = cpuSum / cpu.size();
+	stats.cpuP95 = Percentile(cpu, 0.95);
+	stats.cpuP99 = Percentile(cpu, 0.99);
+	return true;
+}
+
+void GpuProfiler::Report() const
+{
+	if (history.empty()) return;
+
+	printf("GPU profile over %zu frames (%u dropped), ms         gpu min/avg/p95/p99            cpu min/avg/p95/p99\n",
+		history.size(), droppedFrames);
+	for (const std::string& name : names)
+	{
+		ProfileStats stats;
+		if (!GetStats(name, stats)) continue;
+
+		printf("  %-24s %7.3f %7.3f %7.3f %7.3f    %7.3f %7.3f %7.3f %7.3f\n", name.c_str(),
+			stats.gpuMin, stats.gpuAverage, stats.gpuP95, stats.gpuP99,
+			stats.cpuMin, stats.cpuAverage, stats.cpuP95, stats.cpuP99);
+	}
+}
+
+bool GpuProfiler::WriteCsv(const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		printf("Failed to write %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "frame,scope,depth,cpu_begin_ms,cpu_ms,gpu_begin_ms,gpu_ms\n");
+	for (const FrameRecord& record : history)
+	{
+		for (const Sample& sample : record.samples)
+		{
+			fprintf(file, "%u,\"%s\",%u,%.4f,%.4f,%.4f,%.4f\n", record.frame, names[sample.name].c_str(), sample.depth,
+				sample.cpuBegin, sample.cpuTime, sample.gpuBegin, sample.gpuTime);
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool GpuProfiler::WriteChromeTrace(const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		printf("Failed to write %s\n", path);
+		return false;
+	}
+
+	// Microseconds, tid 1 is the CPU and tid 2 the GPU
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+	for (const FrameRecord& record : history)
+	{
+		for (const Sample& sample : record.samples)
+		{
+			const char* name = names[sample.name].c_str();
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+				name, sample.cpuBegin * 1000.0, sample.cpuTime * 1000.0, record.frame);
+			if (timestamps)
+			{
+				fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+					name, sample.gpuBegin * 1000.0, sample.gpuTime * 1000.0, record.frame);
+			}
+		}
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	fclose(file);
+	return true;
+}
+
+void GpuProfiler::ResetStats()
+{
+	history.clear();
+	droppedFrames = 0;
+	Calibrate();
+}
+
+void GpuProfiler::Release()
+{
+	for (PendingFrame& pending : frames)
+	{
+		if (!pending.queries.empty()) glDeleteQueries((GLsizei)pending.queries.size(), pending.queries.data());
+		pending.queries.clear();
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	Release();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Rolling stats of one scope, milliseconds
+struct ProfileStats
+{
+	unsigned int samples;
+	double gpuMin, gpuAverage, gpuP95, gpuP99;
+	double cpuMin, cpuAverage, cpuP95, cpuP99;
+};
+
+// Named, nestable scopes timed on the CPU and the GPU. The GPU side is a timestamp query at
+// each end of a scope rather than GL_TIME_ELAPSED, which can't nest. Queries are kept per
+// frame in a small ring and read a few frames late, a frame whose results aren't in by the
+// time its slot comes round is dropped rather than waited on.
+//
+// The last historyFrames complete frames are kept, the stats, the CSV and the Chrome trace
+// (chrome://tracing, Perfetto) all come from those. GPU times are put on the CPU clock with an
+// offset taken at Init and ResetStats.
+class GpuProfiler
+{
+public:
+	GpuProfiler();
+
+	bool Init();
+
+	void BeginFrame();
+	void EndFrame();
+	// Waits for every frame still in flight, for runs that need all of them
+	void Flush();
+
+	void BeginScope(const char* name);
+	void EndScope();
+
+	void SetEnabled(bool enabled) { this->enabled = enabled; }
+	bool IsEnabled() const { return enabled; }
+	void SetHistoryFrames(unsigned int frames) { historyFrames = frames; }
+
+	bool GetStats(const std::string& name, ProfileStats& stats) const;
+	const std::vector<std::string>& GetScopeNames() const { return names; }
+	unsigned int GetFrameCount() const { return (unsigned int)history.size(); }
+	unsigned int GetDroppedFrames() const { return droppedFrames; }
+
+	// Every scope's rolling stats, in the order the scopes first ran
+	void Report() const;
+	// One row per scope per kept frame
+	bool WriteCsv(const char* path) const;
+	// Complete ("X") events, CPU scopes on one track and GPU scopes on another
+	bool WriteChromeTrace(const char* path) const;
+
+	void ResetStats();
+
+	// Queries still in flight, before the context goes
+	void Release();
+
+	~GpuProfiler();
+
+private:
+	struct Scope
+	{
+		unsigned int name;	// index into names
+		unsigned int depth;
+		double cpuBegin, cpuEnd;	// ms since the profiler started
+		GLuint64 gpuBegin, gpuEnd;	// ns, GL clock
+	};
+
+	struct PendingFrame
+	{
+		unsigned int frame;
+		std::vector<Scope> scopes;
+		std::vector<GLuint> queries;	// begin and end per scope
+		bool pending;
+	};
+
+	struct Sample
+	{
+		unsigned int name;
+		unsigned int depth;
+		double cpuBegin, cpuTime;
+		double gpuBegin, gpuTime;	// on the CPU clock
+	};
+
+	struct FrameRecord
+	{
+		unsigned int frame;
+		std::vector<Sample> samples;
+	};
+
+	static const unsigned int FRAME_LATENCY = 4;
+
+	double Now() const;
+	void Calibrate();
+	void ReadBack(PendingFrame& pending);
+	unsigned int NameIndex(const char* name);
+
+	bool enabled;
+	bool timestamps;
+	std::chrono::steady_clock::time_point start;
+	double gpuOffset;	// ms to add to a GL timestamp in ms to land on the CPU clock
+
+	PendingFrame frames[FRAME_LATENCY];
+	std::vector<unsigned int> open;	// scopes begun and not ended, indices into the frame's scopes
+	unsigned int frame;
+	bool inFrame;
+
+	std::vector<std::string> names;
+	std::deque<FrameRecord> history;
+	unsigned int historyFrames;
+	unsigned int droppedFrames;
+};
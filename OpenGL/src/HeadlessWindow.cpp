@@ -0,0 +1,340 @@
+// Before glad, so its APIENTRY is the one windows.h wants
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "HeadlessWindow.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "GLState.h"
+
+namespace {
+
+// Just the parts of egl.h and osmesa.h used here, neither is needed to build
+typedef int32_t EGLint;
+typedef unsigned int EGLBoolean;
+typedef unsigned int EGLenum;
+typedef void* EGLDisplay;
+typedef void* EGLConfig;
+typedef void* EGLContext;
+typedef void* EGLSurface;
+typedef void* EGLDeviceEXT;
+
+const EGLint EGL_NONE = 0x3038;
+const EGLint EGL_EXTENSIONS = 0x3055;
+const EGLint EGL_VENDOR = 0x3053;
+const EGLint EGL_SURFACE_TYPE = 0x3033;
+const EGLint EGL_PBUFFER_BIT = 0x0001;
+const EGLint EGL_RENDERABLE_TYPE = 0x3040;
+const EGLint EGL_OPENGL_BIT = 0x0008;
+const EGLint EGL_RED_SIZE = 0x3024;
+const EGLint EGL_GREEN_SIZE = 0x3023;
+const EGLint EGL_BLUE_SIZE = 0x3022;
+const EGLint EGL_ALPHA_SIZE = 0x3021;
+const EGLint EGL_WIDTH = 0x3057;
+const EGLint EGL_HEIGHT = 0x3056;
+const EGLenum EGL_OPENGL_API = 0x30A2;
+const EGLint EGL_CONTEXT_MAJOR_VERSION = 0x3098;
+const EGLint EGL_CONTEXT_MINOR_VERSION = 0x30FB;
+const EGLint EGL_CONTEXT_OPENGL_PROFILE_MASK = 0x30FD;
+const EGLint EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT = 0x0001;
+const EGLenum EGL_PLATFORM_DEVICE_EXT = 0x313F;
+const EGLenum EGL_PLATFORM_SURFACELESS_MESA = 0x31DD;
+
+typedef void* (APIENTRY* PFN_eglGetProcAddress)(const char* name);
+typedef const char* (APIENTRY* PFN_eglQueryString)(EGLDisplay display, EGLint name);
+typedef EGLDisplay(APIENTRY* PFN_eglGetDisplay)(void* nativeDisplay);
+typedef EGLDisplay(APIENTRY* PFN_eglGetPlatformDisplayEXT)(EGLenum platform, void* nativeDisplay, const EGLint* attribs);
+typedef EGLBoolean(APIENTRY* PFN_eglQueryDevicesEXT)(EGLint maxDevices, EGLDeviceEXT* devices, EGLint* count);
+typedef EGLBoolean(APIENTRY* PFN_eglInitialize)(EGLDisplay display, EGLint* major, EGLint* minor);
+typedef EGLBoolean(APIENTRY* PFN_eglTerminate)(EGLDisplay display);
+typedef EGLBoolean(APIENTRY* PFN_eglBindAPI)(EGLenum api);
+typedef EGLBoolean(APIENTRY* PFN_eglChooseConfig)(EGLDisplay display, const EGLint* attribs, EGLConfig* configs, EGLint size, EGLint* count);
+typedef EGLContext(APIENTRY* PFN_eglCreateContext)(EGLDisplay display, EGLConfig config, EGLContext share, const EGLint* attribs);
+typedef EGLBoolean(APIENTRY* PFN_eglDestroyContext)(EGLDisplay display, EGLContext context);
+typedef EGLSurface(APIENTRY* PFN_eglCreatePbufferSurface)(EGLDisplay display, EGLConfig config, const EGLint* attribs);
+typedef EGLBoolean(APIENTRY* PFN_eglDestroySurface)(EGLDisplay display, EGLSurface surface);
+typedef EGLBoolean(APIENTRY* PFN_eglMakeCurrent)(EGLDisplay display, EGLSurface draw, EGLSurface read, EGLContext context);
+
+const int OSMESA_FORMAT = 0x22;
+const int OSMESA_DEPTH_BITS = 0x30;
+const int OSMESA_STENCIL_BITS = 0x31;
+const int OSMESA_ACCUM_BITS = 0x32;
+const int OSMESA_PROFILE = 0x33;
+const int OSMESA_CORE_PROFILE = 0x34;
+const int OSMESA_CONTEXT_MAJOR_VERSION = 0x36;
+const int OSMESA_CONTEXT_MINOR_VERSION = 0x37;
+
+typedef void* (APIENTRY* PFN_OSMesaCreateContextAttribs)(const int* attribs, void* share);
+typedef void (APIENTRY* PFN_OSMesaDestroyContext)(void* context);
+typedef GLboolean(APIENTRY* PFN_OSMesaMakeCurrent)(void* context, void* buffer, GLenum type, GLsizei width, GLsizei height);
+typedef void* (APIENTRY* PFN_OSMesaGetProcAddress)(const char* name);
+
+struct EGLFunctions
+{
+    PFN_eglGetProcAddress GetProcAddress;
+    PFN_eglQueryString QueryString;
+    PFN_eglGetDisplay GetDisplay;
+    PFN_eglGetPlatformDisplayEXT GetPlatformDisplayEXT;
+    PFN_eglQueryDevicesEXT QueryDevicesEXT;
+    PFN_eglInitialize Initialize;
+    PFN_eglTerminate Terminate;
+    PFN_eglBindAPI BindAPI;
+    PFN_eglChooseConfig ChooseConfig;
+    PFN_eglCreateContext CreateContext;
+    PFN_eglDestroyContext DestroyContext;
+    PFN_eglCreatePbufferSurface CreatePbufferSurface;
+    PFN_eglDestroySurface DestroySurface;
+    PFN_eglMakeCurrent MakeCurrent;
+};
+
+struct OSMesaFunctions
+{
+    PFN_OSMesaCreateContextAttribs CreateContextAttribs;
+    PFN_OSMesaDestroyContext DestroyContext;
+    PFN_OSMesaMakeCurrent MakeCurrent;
+    PFN_OSMesaGetProcAddress GetProcAddress;
+};
+
+EGLFunctions egl;
+OSMesaFunctions osmesa;
+const char* displayName = "";
+
+void* OpenLibrary(const char* const* names) {
+    for (const char* const* name = names; *name; name++) {
+#ifdef _WIN32
+        void* library = (void*)LoadLibraryA(*name);
+#else
+        void* library = dlopen(*name, RTLD_LAZY | RTLD_LOCAL);
+#endif
+        if (library) return library;
+    }
+    return nullptr;
+}
+
+void* LibrarySymbol(void* library, const char* name) {
+#ifdef _WIN32
+    return (void*)GetProcAddress((HMODULE)library, name);
+#else
+    return dlsym(library, name);
+#endif
+}
+
+void CloseLibrary(void* library) {
+#ifdef _WIN32
+    FreeLibrary((HMODULE)library);
+#else
+    dlclose(library);
+#endif
+}
+
+// Whole names only, one extension can be the start of another
+bool HasExtension(const char* extensions, const char* name) {
+    if (!extensions) return false;
+
+    size_t length = strlen(name);
+    for (const char* found = strstr(extensions, name); found; found = strstr(found + length, name)) {
+        bool starts = found == extensions || found[-1] == ' ';
+        bool ends = found[length] == ' ' || found[length] == '\0';
+        if (starts && ends) return true;
+    }
+    return false;
+}
+
+}
+
+HeadlessWindow::HeadlessWindow(GLint windowWidth, GLint windowHeight)
+    : Window(windowWidth, windowHeight), backend(BACKEND_NONE), library(nullptr),
+      display(nullptr), surface(nullptr), context(nullptr) {
+    memset(osmesaPixel, 0, sizeof(osmesaPixel));
+}
+
+void* HeadlessWindow::LoadProc(const char* name) {
+    return osmesa.GetProcAddress ? osmesa.GetProcAddress(name) : egl.GetProcAddress(name);
+}
+
+const char* HeadlessWindow::getBackendName() const {
+    if (backend == BACKEND_EGL) return displayName;
+    if (backend == BACKEND_OSMESA) return "OSMesa";
+    return "none";
+}
+
+int HeadlessWindow::Initialise() {
+    if (!InitEGL() && !InitOSMesa()) {
+        std::cout << "Failed to create a headless context, neither EGL nor OSMesa gave one" << std::endl;
+        return -1;
+    }
+
+    if (!LoadGL() || !CreateOffscreenTarget()) {
+        Release();
+        return -1;
+    }
+
+    std::cout << "Headless context from " << getBackendName() << ": " << glGetString(GL_RENDERER) << std::endl;
+    return 0;
+}
+
+bool HeadlessWindow::InitEGL() {
+#ifdef _WIN32
+    const char* names[] = { "libEGL.dll", nullptr };
+#else
+    const char* names[] = { "libEGL.so.1", "libEGL.so", nullptr };
+#endif
+    library = OpenLibrary(names);
+    if (!library) return false;
+
+    egl.GetProcAddress = (PFN_eglGetProcAddress)LibrarySymbol(library, "eglGetProcAddress");
+    egl.QueryString = (PFN_eglQueryString)LibrarySymbol(library, "eglQueryString");
+    egl.GetDisplay = (PFN_eglGetDisplay)LibrarySymbol(library, "eglGetDisplay");
+    egl.Initialize = (PFN_eglInitialize)LibrarySymbol(library, "eglInitialize");
+    egl.Terminate = (PFN_eglTerminate)LibrarySymbol(library, "eglTerminate");
+    egl.BindAPI = (PFN_eglBindAPI)LibrarySymbol(library, "eglBindAPI");
+    egl.ChooseConfig = (PFN_eglChooseConfig)LibrarySymbol(library, "eglChooseConfig");
+    egl.CreateContext = (PFN_eglCreateContext)LibrarySymbol(library, "eglCreateContext");
+    egl.DestroyContext = (PFN_eglDestroyContext)LibrarySymbol(library, "eglDestroyContext");
+    egl.CreatePbufferSurface = (PFN_eglCreatePbufferSurface)LibrarySymbol(library, "eglCreatePbufferSurface");
+    egl.DestroySurface = (PFN_eglDestroySurface)LibrarySymbol(library, "eglDestroySurface");
+    egl.MakeCurrent = (PFN_eglMakeCurrent)LibrarySymbol(library, "eglMakeCurrent");
+    if (!egl.GetProcAddress || !egl.QueryString || !egl.GetDisplay || !egl.Initialize || !egl.Terminate || !egl.BindAPI ||
+        !egl.ChooseConfig || !egl.CreateContext || !egl.DestroyContext || !egl.CreatePbufferSurface ||
+        !egl.DestroySurface || !egl.MakeCurrent) {
+        Release();
+        return false;
+    }
+    backend = BACKEND_EGL;
+
+    // Null without EGL_EXT_client_extensions, then only the default display is on offer
+    const char* clientExtensions = egl.QueryString(nullptr, EGL_EXTENSIONS);
+    egl.GetPlatformDisplayEXT = (PFN_eglGetPlatformDisplayEXT)egl.GetProcAddress("eglGetPlatformDisplayEXT");
+    egl.QueryDevicesEXT = (PFN_eglQueryDevicesEXT)egl.GetProcAddress("eglQueryDevicesEXT");
+
+    if (egl.GetPlatformDisplayEXT && egl.QueryDevicesEXT && HasExtension(clientExtensions, "EGL_EXT_platform_device")) {
+        EGLDeviceEXT devices[8];
+        EGLint deviceCount = 0;
+        if (egl.QueryDevicesEXT(8, devices, &deviceCount)) {
+            for (EGLint i = 0; i < deviceCount; i++) {
+                displayName = "EGL device";
+                if (InitEGLDisplay(egl.GetPlatformDisplayEXT(EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr))) return true;
+            }
+        }
+    }
+
+    if (egl.GetPlatformDisplayEXT && HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        displayName = "EGL surfaceless";
+        if (InitEGLDisplay(egl.GetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr))) return true;
+    }
+
+    displayName = "EGL default display";
+    if (InitEGLDisplay(egl.GetDisplay(nullptr))) return true;
+
+    Release();
+    return false;
+}
+
+bool HeadlessWindow::InitEGLDisplay(void* eglDisplay) {
+    if (!eglDisplay) return false;
+
+    EGLint major, minor;
+    if (!egl.Initialize(eglDisplay, &major, &minor)) return false;
+    display = eglDisplay;
+
+    // Depth and stencil live in the offscreen target, the config only has to do desktop GL
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    if (egl.BindAPI(EGL_OPENGL_API) && egl.ChooseConfig(eglDisplay, configAttribs, &config, 1, &configCount) && configCount > 0) {
+        context = egl.CreateContext(eglDisplay, config, nullptr, contextAttribs);
+    }
+
+    if (context) {
+        if (!HasExtension(egl.QueryString(eglDisplay, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+            const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            surface = egl.CreatePbufferSurface(eglDisplay, config, pbufferAttribs);
+        }
+        if (egl.MakeCurrent(eglDisplay, surface, surface, context)) return true;
+    }
+
+    if (surface) egl.DestroySurface(eglDisplay, surface);
+    if (context) egl.DestroyContext(eglDisplay, context);
+    egl.Terminate(eglDisplay);
+    display = surface = context = nullptr;
+    return false;
+}
+
+bool HeadlessWindow::InitOSMesa() {
+#ifdef _WIN32
+    const char* names[] = { "osmesa.dll", nullptr };
+#else
+    const char* names[] = { "libOSMesa.so.8", "libOSMesa.so.6", "libOSMesa.so", nullptr };
+#endif
+    library = OpenLibrary(names);
+    if (!library) return false;
+
+    osmesa.CreateContextAttribs = (PFN_OSMesaCreateContextAttribs)LibrarySymbol(library, "OSMesaCreateContextAttribs");
+    osmesa.DestroyContext = (PFN_OSMesaDestroyContext)LibrarySymbol(library, "OSMesaDestroyContext");
+    osmesa.MakeCurrent = (PFN_OSMesaMakeCurrent)LibrarySymbol(library, "OSMesaMakeCurrent");
+    osmesa.GetProcAddress = (PFN_OSMesaGetProcAddress)LibrarySymbol(library, "OSMesaGetProcAddress");
+    if (!osmesa.CreateContextAttribs || !osmesa.DestroyContext || !osmesa.MakeCurrent || !osmesa.GetProcAddress) {
+        Release();
+        return false;
+    }
+    backend = BACKEND_OSMESA;
+
+    const int attribs[] = {
+        OSMESA_FORMAT, GL_RGBA,
+        OSMESA_DEPTH_BITS, 0,
+        OSMESA_STENCIL_BITS, 0,
+        OSMESA_ACCUM_BITS, 0,
+        OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+        OSMESA_CONTEXT_MAJOR_VERSION, 3,
+        OSMESA_CONTEXT_MINOR_VERSION, 3,
+        0
+    };
+    context = osmesa.CreateContextAttribs(attribs, nullptr);
+    if (!context || !osmesa.MakeCurrent(context, osmesaPixel, GL_UNSIGNED_BYTE, 1, 1)) {
+        Release();
+        return false;
+    }
+    return true;
+}
+
+void HeadlessWindow::Release() {
+    if (backend == BACKEND_EGL && display) {
+        egl.MakeCurrent(display, nullptr, nullptr, nullptr);
+        if (surface) egl.DestroySurface(display, surface);
+        if (context) egl.DestroyContext(display, context);
+        egl.Terminate(display);
+    }
+    else if (backend == BACKEND_OSMESA && context) {
+        osmesa.DestroyContext(context);
+    }
+    if (library) CloseLibrary(library);
+
+    egl = EGLFunctions();
+    osmesa = OSMesaFunctions();
+    backend = BACKEND_NONE;
+    library = display = surface = context = nullptr;
+}
+
+HeadlessWindow::~HeadlessWindow() {
+    if (context) DestroyOffscreenTarget();
+    Release();
+}
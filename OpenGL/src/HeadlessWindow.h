@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Window.h"
+
+// A GL 3.3 core context with no display, drawing into the offscreen target. EGL comes first,
+// a GPU through EGL_EXT_platform_device, then Mesa's surfaceless platform, then the default
+// display, each made current without a surface where it can and on a 1x1 pbuffer where it
+// can't. OSMesa is the last resort, Mesa's llvmpipe needs no GPU either.
+//
+// Both are loaded when the window is made rather than linked, machines without them still run
+// the windowed build. Only one headless window at a time
+class HeadlessWindow : public Window
+{
+
+private:
+	enum Backend
+	{
+		BACKEND_NONE,
+		BACKEND_EGL,
+		BACKEND_OSMESA
+	};
+
+	Backend backend;
+	void* library;
+
+	void* display;	// EGL
+	void* surface;
+	void* context;	// EGL or OSMesa
+	unsigned char osmesaPixel[4];	// OSMesa wants somewhere to draw, the offscreen target is where it goes
+
+	bool InitEGL();
+	bool InitEGLDisplay(void* eglDisplay);
+	bool InitOSMesa();
+	void Release();
+
+	static void* LoadProc(const char* name);
+
+public:
+	HeadlessWindow(GLint windowWidth, GLint windowHeight);
+
+	int Initialise() override;
+
+	GLADloadproc getProcLoader() const override { return LoadProc; }
+	const char* getBackendName() const;
+
+	// Runs until whatever drives it stops
+	bool getShouldClose() override { return false; }
+	// Nothing to present, the flush keeps a frame's commands moving like a swap would
+	void swapBuffers() override { glFlush(); }
+	void pollEvents() override {}
+
+	~HeadlessWindow();
+};
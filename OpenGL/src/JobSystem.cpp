@@ -0,0 +1,460 @@
+#include "JobSystem.h"
+
+#include <cstdio>
+
+thread_local int JobSystem::threadIndex = -1;
+thread_local unsigned int JobSystem::executing = 0;
+
+JobSystem::JobDeque::JobDeque()
+{
+	top.store(0);
+	bottom.store(0);
+	for (std::atomic<Job*>& job : jobs)
+	{
+		job.store(nullptr);
+	}
+}
+
+bool JobSystem::JobDeque::Push(Job* job)
+{
+	int64_t b = bottom.load(std::memory_order_relaxed);
+	int64_t t = top.load(std::memory_order_acquire);
+	if (b - t >= CAPACITY) return false;
+
+	jobs[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+	return true;
+}
+
+Job* JobSystem::JobDeque::Pop()
+{
+	// Claim the bottom before looking at the top, a thief reading the old bottom races for it below
+	int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job* job = jobs[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// The last one, whoever moves the top gets it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job* JobSystem::JobDeque::Steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t b = bottom.load(std::memory_order_acquire);
+	if (t >= b) return nullptr;
+
+	Job* job = jobs[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+	return job;
+}
+
+JobSystem& JobSystem::Get()
+{
+	static JobSystem jobSystem;
+	return jobSystem;
+}
+
+JobSystem::JobSystem()
+{
+	clockStart = std::chrono::steady_clock::now();
+	workerCount = 0;
+	running.store(false);
+	queued.store(0);
+	sleepers.store(0);
+	ResetStats();
+}
+
+uint64_t JobSystem::Now() const
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clockStart).count();
+}
+
+void JobSystem::Init(unsigned int workers)
+{
+	if (running.load()) return;
+
+	threadIndex = 0;
+	if (workers == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		workers = cores > 1 ? cores - 1 : 0;
+	}
+	workerCount = workers < MAX_WORKERS ? workers : MAX_WORKERS;
+
+	running.store(true);
+	ResetStats();
+	for (unsigned int i = 1; i <= workerCount; i++)
+	{
+		workerThreads.emplace_back(&JobSystem::WorkerLoop, this, i);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	if (!running.load()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running.store(false);
+	}
+	wake.notify_all();
+	for (std::thread& worker : workerThreads)
+	{
+		worker.join();
+	}
+	workerThreads.clear();
+	workerCount = 0;
+
+	// Nobody else is left to run these
+	std::deque<Job*> jobs;
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		jobs.swap(workerJobs);
+	}
+	queued.fetch_sub(static_cast<int>(jobs.size()));
+	for (Job* job : jobs)
+	{
+		Execute(job, threadIndex);
+	}
+}
+
+Job* JobSystem::Create(std::function<void()> work, Job* parent)
+{
+	uint64_t start = Now();
+
+	Job* job = new Job();
+	job->work = std::move(work);
+	job->parent = parent;
+	job->unfinished.store(1, std::memory_order_relaxed);
+	job->references.store(parent ? 1 : 2, std::memory_order_relaxed);
+	if (parent) parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+
+	if (threadIndex >= 0) threads[threadIndex].stats.scheduling.fetch_add(Now() - start, std::memory_order_relaxed);
+	return job;
+}
+
+void JobSystem::Run(Job* job)
+{
+	int index = threadIndex;
+	if (index < 0 || workerCount == 0)
+	{
+		Execute(job, index);
+		return;
+	}
+
+	uint64_t start = Now();
+	// Counted first, a worker that sees the job before the count just looks again
+	queued.fetch_add(1);
+	if (!threads[index].deque.Push(job))
+	{
+		queued.fetch_sub(1);
+		Execute(job, index);
+		return;
+	}
+	if (sleepers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wake.notify_one();
+	}
+	threads[index].stats.scheduling.fetch_add(Now() - start, std::memory_order_relaxed);
+}
+
+void JobSystem::RunOnMainThread(Job* job)
+{
+	if (!running.load())
+	{
+		Execute(job, threadIndex);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mainMutex);
+	mainJobs.push_back(job);
+}
+
+void JobSystem::RunOnWorker(Job* job)
+{
+	if (!running.load() || workerCount == 0)
+	{
+		Execute(job, threadIndex);
+		return;
+	}
+
+	queued.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		workerJobs.push_back(job);
+	}
+	if (sleepers.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wake.notify_one();
+	}
+}
+
+Job* JobSystem::Find(int index)
+{
+	Job* job = threads[index].deque.Pop();
+	if (job)
+	{
+		queued.fetch_sub(1);
+		return job;
+	}
+
+	if (index == 0)
+	{
+		std::lock_guard<std::mutex> lock(mainMutex);
+		if (!mainJobs.empty())
+		{
+			job = mainJobs.front();
+			mainJobs.pop_front();
+			return job;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(workerMutex);
+		if (!workerJobs.empty())
+		{
+			job = workerJobs.front();
+			workerJobs.pop_front();
+			queued.fetch_sub(1);
+			return job;
+		}
+	}
+
+	// Each thread starts its round of the others somewhere else, so thieves spread out
+	static thread_local unsigned int victim = 0;
+	unsigned int threadCount = workerCount + 1;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		victim = (victim + 1) % threadCount;
+		if ((int)victim == index) continue;
+
+		job = threads[victim].deque.Steal();
+		if (job)
+		{
+			queued.fetch_sub(1);
+			threads[index].stats.steals.fetch_add(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::Execute(Job* job, int index)
+{
+	executing++;
+	uint64_t start = Now();
+	if (job->work) job->work();
+	uint64_t end = Now();
+	executing--;
+
+	Finish(job);
+
+	if (index < 0) return;
+	ThreadStats& stats = threads[index].stats;
+	stats.jobs.fetch_add(1, std::memory_order_relaxed);
+	if (executing == 0) stats.busy.fetch_add(end - start, std::memory_order_relaxed);
+	stats.scheduling.fetch_add(Now() - end, std::memory_order_relaxed);
+}
+
+void JobSystem::Finish(Job* job)
+{
+	// Read first, the job may be gone once it's released
+	Job* parent = job->parent;
+	if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+	Release(job);
+	if (parent) Finish(parent);
+}
+
+void JobSystem::Release(Job* job)
+{
+	if (job->references.fetch_sub(1, std::memory_order_acq_rel) == 1) delete job;
+}
+
+void JobSystem::Wait(Job* job)
+{
+	int index = threadIndex;
+	while (job->unfinished.load(std::memory_order_acquire) > 0)
+	{
+		if (index < 0)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		uint64_t start = Now();
+		Job* next = Find(index);
+		if (next)
+		{
+			threads[index].stats.scheduling.fetch_add(Now() - start, std::memory_order_relaxed);
+			Execute(next, index);
+		}
+		else
+		{
+			// Everything left is running elsewhere
+			std::this_thread::yield();
+			if (executing == 0) threads[index].stats.waiting.fetch_add(Now() - start, std::memory_order_relaxed);
+		}
+	}
+	Release(job);
+}
+
+void JobSystem::Detach(Job* job)
+{
+	Release(job);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, const std::function<void(size_t first, size_t last)>& body)
+{
+	if (count == 0) return;
+	if (grain == 0) grain = 1;
+	if (threadIndex < 0 || workerCount == 0 || count <= grain)
+	{
+		body(0, count);
+		return;
+	}
+
+	// A few chunks a thread, one held up by a slow chunk has the rest stolen around it
+	size_t chunks = (workerCount + 1) * 4;
+	size_t chunk = (count + chunks - 1) / chunks;
+	if (chunk < grain) chunk = grain;
+
+	Job* root = Create(nullptr);
+	for (size_t first = 0; first < count; first += chunk)
+	{
+		size_t last = first + chunk < count ? first + chunk : count;
+		Run(Create([&body, first, last]() { body(first, last); }, root));
+	}
+	Run(root);
+	Wait(root);
+}
+
+void JobSystem::RunMainThreadJobs()
+{
+	// Only what's queued now, jobs these queue wait for the next call
+	std::deque<Job*> jobs;
+	{
+		std::lock_guard<std::mutex> lock(mainMutex);
+		jobs.swap(mainJobs);
+	}
+	for (Job* job : jobs)
+	{
+		Execute(job, threadIndex);
+	}
+}
+
+void JobSystem::WorkerLoop(unsigned int index)
+{
+	threadIndex = (int)index;
+	ThreadStats& stats = threads[index].stats;
+
+	unsigned int idle = 0;
+	while (running.load(std::memory_order_acquire))
+	{
+		uint64_t start = Now();
+		Job* job = Find((int)index);
+		if (job)
+		{
+			stats.scheduling.fetch_add(Now() - start, std::memory_order_relaxed);
+			Execute(job, (int)index);
+			idle = 0;
+			continue;
+		}
+
+		// Spin a little before parking, jobs tend to come in bursts
+		if (++idle < 64)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		uint64_t sleepStart = Now();
+		{
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepers.fetch_add(1);
+			wake.wait(lock, [this]() { return queued.load() > 0 || !running.load(); });
+			sleepers.fetch_sub(1);
+		}
+		stats.sleeping.fetch_add(Now() - sleepStart, std::memory_order_relaxed);
+		idle = 0;
+	}
+}
+
+void JobSystem::Report() const
+{
+	double elapsed = (Now() - statsStart) / 1000000.0;
+	if (elapsed <= 0.0) return;
+
+	printf("Job system over %.0f ms, %u workers and the main thread\n", elapsed, workerCount);
+
+	uint64_t totalJobs = 0, totalBusy = 0, totalScheduling = 0;
+	for (unsigned int i = 0; i <= workerCount; i++)
+	{
+		const ThreadStats& stats = threads[i].stats;
+		uint64_t jobs = stats.jobs.load(), busy = stats.busy.load(), scheduling = stats.scheduling.load();
+		totalJobs += jobs;
+		totalBusy += busy;
+		totalScheduling += scheduling;
+
+		double busyShare = busy / 10000.0 / elapsed;
+		double schedulingShare = scheduling / 10000.0 / elapsed;
+		if (i == 0)
+		{
+			printf("  main      %7llu jobs %6llu steals  busy %5.1f%%  scheduling %4.1f%%  waiting %5.1f%%\n",
+				(unsigned long long)jobs, (unsigned long long)stats.steals.load(), busyShare, schedulingShare,
+				stats.waiting.load() / 10000.0 / elapsed);
+		}
+		else
+		{
+			// Whatever isn't work, bookkeeping or sleep went on looking for something to steal
+			double sleepShare = stats.sleeping.load() / 10000.0 / elapsed;
+			double searchShare = 100.0 - busyShare - schedulingShare - sleepShare;
+			printf("  worker %2u %7llu jobs %6llu steals  busy %5.1f%%  scheduling %4.1f%%  searching %5.1f%%  asleep %5.1f%%\n", i,
+				(unsigned long long)jobs, (unsigned long long)stats.steals.load(), busyShare, schedulingShare,
+				searchShare > 0.0 ? searchShare : 0.0, sleepShare);
+		}
+	}
+
+	if (totalJobs > 0)
+	{
+		printf("  %llu jobs, %.2f us of scheduling and %.2f us of work a job\n", (unsigned long long)totalJobs,
+			totalScheduling / 1000.0 / totalJobs, totalBusy / 1000.0 / totalJobs);
+	}
+}
+
+void JobSystem::ResetStats()
+{
+	for (ThreadState& thread : threads)
+	{
+		ThreadStats& stats = thread.stats;
+		stats.jobs.store(0);
+		stats.steals.store(0);
+		stats.busy.store(0);
+		stats.sleeping.store(0);
+		stats.waiting.store(0);
+		stats.scheduling.store(0);
+	}
+	statsStart = Now();
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
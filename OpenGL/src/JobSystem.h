@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One piece of work. unfinished counts the job itself and every child not yet done, so a
+// parent only finishes once all of its children have
+struct Job
+{
+	std::function<void()> work;
+	Job* parent;
+	std::atomic<int> unfinished;
+	std::atomic<int> references;	// the scheduler's, and the creator's when there's no parent
+};
+
+// Work-stealing scheduler. Every thread, the main one included, pushes and pops jobs at the
+// bottom of its own deque and idle threads steal from the top of the others', so the owner
+// works newest first on what's still in its cache and thieves take the oldest, biggest pieces.
+// Waiting on a job runs other jobs until it's done rather than blocking.
+//
+// GL calls stay on the main thread, RunOnMainThread queues a job there instead and the main
+// thread runs it from RunMainThreadJobs or while it waits. RunOnWorker is the other way round,
+// a shared queue only the workers take from. Before Init, or with no workers, everything runs
+// on the calling thread.
+class JobSystem
+{
+public:
+	static const unsigned int MAX_WORKERS = 15;
+
+	static JobSystem& Get();
+
+	// On the main thread. 0 workers picks one less than the cores
+	void Init(unsigned int workers = 0);
+	void Shutdown();
+	unsigned int GetWorkerCount() const { return workerCount; }
+	bool IsMainThread() const { return threadIndex == 0; }
+
+	// A job with a parent holds the parent open until it's done, then frees itself. One without
+	// is the creator's to Wait on, which frees it. Children are created before the parent
+	// finishes, from the creator or from one of its other children
+	Job* Create(std::function<void()> work, Job* parent = nullptr);
+	// Onto the calling thread's deque
+	void Run(Job* job);
+	// Onto the main thread's queue, for GL work
+	void RunOnMainThread(Job* job);
+	// Onto the workers' shared queue, for work that has to get off the main thread even while it waits
+	void RunOnWorker(Job* job);
+	// Runs other jobs until job and its children are done, then frees it
+	void Wait(Job* job);
+	// Lets go of a job with no parent that nobody will Wait on, it frees itself once done
+	void Detach(Job* job);
+
+	// body(first, last) over [0, count), a few chunks per thread and at least grain in each.
+	// Returns once every chunk is done
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t first, size_t last)>& body);
+
+	// Main thread, once a frame
+	void RunMainThreadJobs();
+
+	// Per thread jobs, steals and where the time went since the stats were reset, and what
+	// each job cost the scheduler
+	void Report() const;
+	void ResetStats();
+
+	~JobSystem();
+
+private:
+	// Chase-Lev deque over a fixed ring. The owner pushes and pops at the bottom, thieves take
+	// from the top and only the last job is contended
+	class JobDeque
+	{
+	public:
+		static const int64_t CAPACITY = 4096;
+
+		JobDeque();
+
+		bool Push(Job* job);	// false when full
+		Job* Pop();
+		Job* Steal();
+
+	private:
+		alignas(64) std::atomic<int64_t> top;
+		alignas(64) std::atomic<int64_t> bottom;
+		std::atomic<Job*> jobs[CAPACITY];
+	};
+
+	// Nanoseconds, written by the owning thread only
+	struct ThreadStats
+	{
+		std::atomic<uint64_t> jobs, steals;
+		std::atomic<uint64_t> busy;		// inside job work
+		std::atomic<uint64_t> sleeping;	// workers parked with nothing to steal
+		std::atomic<uint64_t> waiting;	// main thread in Wait with nothing to run
+		std::atomic<uint64_t> scheduling;	// creating, pushing, taking and finishing jobs
+	};
+
+	struct alignas(64) ThreadState
+	{
+		JobDeque deque;
+		ThreadStats stats;
+	};
+
+	JobSystem();
+
+	uint64_t Now() const;
+	void WorkerLoop(unsigned int index);
+	// A job from this thread's deque, the main or worker queue or another thread's deque
+	Job* Find(int index);
+	// index -1 for a thread the scheduler doesn't know, which keeps no stats
+	void Execute(Job* job, int index);
+	void Finish(Job* job);
+	void Release(Job* job);
+
+	static thread_local int threadIndex;	// 0 main, workers from 1, -1 for anyone else
+	static thread_local unsigned int executing;	// nested Executes, busy time is the outermost's
+
+	std::chrono::steady_clock::time_point clockStart;
+	uint64_t statsStart;
+
+	unsigned int workerCount;
+	ThreadState threads[MAX_WORKERS + 1];
+	std::vector<std::thread> workerThreads;
+	std::atomic<bool> running;
+
+	// Jobs in the deques, a hint for sleeping workers
+	std::atomic<int> queued;
+	std::atomic<int> sleepers;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	std::mutex mainMutex;
+	std::deque<Job*> mainJobs;
+
+	// Counted in queued like the deques
+	std::mutex workerMutex;
+	std::deque<Job*> workerJobs;
+};
@@ -1,10 +1,18 @@
 #include "Light.h"
 
+#include <algorithm>
+
+#include "VarianceShadowMap.h"
+
 Light::Light()
 {
 	colour = glm::vec3(1.0f, 1.0f, 1.0f);
 	ambientIntensity = 1.0f;
 	diffuseIntensity = 0.0f;
+
+	shadowMap = nullptr;
+	momentsMap = nullptr;
+	shadowFilter = SHADOW_FILTER_PCF4;
 }
 
 Light::Light(GLuint shadowWidth, GLuint shadowHeight, GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity)
@@ -15,6 +23,42 @@ Light::Light(GLuint shadowWidth, GLuint shadowHeight, GLfloat red, GLfloat green
 
 	shadowMap = new ShadowMap();
 	shadowMap->Init(shadowWidth, shadowHeight);
+
+	momentsMap = nullptr;
+	shadowFilter = SHADOW_FILTER_PCF4;
+}
+
+void Light::SetShadowFilter(ShadowFilter filter)
+{
+	shadowFilter = filter;
+
+	if (!shadowMap) return;
+
+	if (filter == SHADOW_FILTER_VSM)
+	{
+		if (!momentsMap)
+		{
+			momentsMap = CreateMomentsMap(shadowMap->GetShadowWidth(), shadowMap->GetShadowHeight());
+		}
+		return;
+	}
+
+	shadowMap->SetFiltering(filter != SHADOW_FILTER_HARD);
+}
+
+void Light::GetLightData(LightData& data) const
+{
+	data.colour = colour;
+	data.ambientIntensity = ambientIntensity;
+	data.diffuseIntensity = diffuseIntensity;
+}
+
+ShadowMap* Light::CreateMomentsMap(GLuint shadowWidth, GLuint shadowHeight)
+{
+	// Moments get blurred anyway, half the depth map resolution is plenty
+	VarianceShadowMap* map = new VarianceShadowMap();
+	map->Init(std::min(shadowWidth / 2, 1024u), std::min(shadowHeight / 2, 1024u));
+	return map;
 }
 
 Light::~Light()
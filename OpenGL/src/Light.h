@@ -4,7 +4,9 @@
 #include <glm\glm.hpp>
 #include <glm\gtc\matrix_transform.hpp>
 
+#include "CommonValues.h"
 #include "ShadowMap.h"
+#include "UniformBlocks.h"
 
 class Light
 {
@@ -15,10 +17,23 @@ public:
 		GLfloat aIntensity, GLfloat dIntensity);
 
 	ShadowMap* getShadowMap() { return shadowMap; }
+	ShadowMap* getMomentsMap() { return momentsMap; }
+
+	void SetShadowFilter(ShadowFilter filter);
+	ShadowFilter GetShadowFilter() const { return shadowFilter; }
+
+	const glm::vec3& GetColour() const { return colour; }
+	GLfloat GetAmbientIntensity() const { return ambientIntensity; }
+	GLfloat GetDiffuseIntensity() const { return diffuseIntensity; }
+
+	void GetLightData(LightData& data) const;
 
 	~Light();
 
 protected:
+	// Created the first time the light switches to SHADOW_FILTER_VSM
+	virtual ShadowMap* CreateMomentsMap(GLuint shadowWidth, GLuint shadowHeight);
+
 	glm::vec3 colour;
 	GLfloat ambientIntensity;
 	GLfloat diffuseIntensity;
@@ -26,5 +41,7 @@ protected:
 	glm::mat4 lightProj;
 
 	ShadowMap* shadowMap;
+	ShadowMap* momentsMap;
+	ShadowFilter shadowFilter;
 };
 
@@ -0,0 +1,133 @@
+#include "LightAssignment.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+
+#include "JobSystem.h"
+
+LightAssignment::LightAssignment()
+{
+	objects = nullptr;
+	shadowedLights = nullptr;
+	sceneLights = nullptr;
+
+	candidateCount = 0;
+	evaluatedCount = 0;
+	maxLightsPerObject = 0;
+	cappedObjectCount = 0;
+	assignTime = 0.0;
+}
+
+// Strongest the light can be anywhere on the sphere, zero when it provably can't reach it
+static GLfloat LightImportance(const ClusterLight& light, GLfloat radius, bool rangeLimited, const BoundingSphere& object)
+{
+	GLfloat peak = std::max(std::max(light.colour.r, light.colour.g), light.colour.b) *
+		std::max(light.diffuseIntensity, light.ambientIntensity);
+	if (peak <= 0.0f) return 0.0f;
+
+	glm::vec3 toObject = object.center - light.position;
+	GLfloat centerDistance = glm::length(toObject);
+	GLfloat distance = std::max(centerDistance - object.radius, 0.0f);
+
+	// Range limited lights are windowed to zero at their radius in the shader
+	if (rangeLimited && distance >= radius) return 0.0f;
+
+	// Spot cone against the sphere, only when the light sits outside it
+	if (light.edge > -1.0f && centerDistance > object.radius)
+	{
+		GLfloat axisAngle = acosf(glm::clamp(glm::dot(toObject / centerDistance, light.direction), -1.0f, 1.0f));
+		GLfloat coneAngle = acosf(glm::clamp(light.edge, -1.0f, 1.0f));
+		GLfloat sphereAngle = asinf(object.radius / centerDistance);
+		if (axisAngle - sphereAngle >= coneAngle) return 0.0f;
+	}
+
+	GLfloat attenuation = light.constant + light.linear * distance + light.exponent * distance * distance;
+	return peak / std::max(attenuation, 0.0001f);
+}
+
+void LightAssignment::AssignRange(size_t first, size_t last)
+{
+	std::vector<std::pair<GLfloat, GLint>> ranked;
+
+	for (size_t i = first; i < last; i++)
+	{
+		const BoundingSphere& object = (*objects)[i];
+		ObjectLightList& list = objectLights[i];
+
+		list.culledMask = 0;
+		unsigned int shadowedCount = 0;
+		for (size_t l = 0; l < shadowedLights->size(); l++)
+		{
+			if (LightImportance((*shadowedLights)[l], 0.0f, false, object) > 0.0f)
+			{
+				shadowedCount++;
+			}
+			else
+			{
+				list.culledMask |= 1 << l;
+			}
+		}
+
+		ranked.clear();
+		for (size_t l = 0; l < sceneLights->size(); l++)
+		{
+			GLfloat importance = LightImportance((*sceneLights)[l], sceneLightRadius[l], true, object);
+			if (importance > 0.0f)
+			{
+				ranked.push_back(std::make_pair(importance, (GLint)l));
+			}
+		}
+
+		size_t kept = std::min(ranked.size(), (size_t)ObjectLightList::MAX_LIGHTS);
+		std::partial_sort(ranked.begin(), ranked.begin() + kept, ranked.end(),
+			[](const std::pair<GLfloat, GLint>& a, const std::pair<GLfloat, GLint>& b) { return a.first > b.first; });
+
+		list.count = (GLint)kept;
+		for (size_t k = 0; k < kept; k++)
+		{
+			list.lights[k] = ranked[k].second;
+		}
+
+		evaluatedLights[i] = shadowedCount + (unsigned int)kept;
+		capped[i] = ranked.size() > kept;
+	}
+}
+
+void LightAssignment::Assign(const std::vector<BoundingSphere>& objects, const std::vector<ClusterLight>& shadowedLights,
+	const std::vector<ClusterLight>& sceneLights)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	this->objects = &objects;
+	this->shadowedLights = &shadowedLights;
+	this->sceneLights = &sceneLights;
+
+	sceneLightRadius.resize(sceneLights.size());
+	for (size_t l = 0; l < sceneLights.size(); l++)
+	{
+		sceneLightRadius[l] = sceneLights[l].CalcRadius();
+	}
+
+	objectLights.resize(objects.size());
+	evaluatedLights.resize(objects.size());
+	capped.resize(objects.size());
+
+	// Objects are independent, small scenes aren't worth splitting
+	const size_t objectsPerJob = 32;
+	JobSystem::Get().ParallelFor(objects.size(), objectsPerJob, [this](size_t first, size_t last) { AssignRange(first, last); });
+
+	candidateCount = (unsigned int)(objects.size() * (shadowedLights.size() + sceneLights.size()));
+	evaluatedCount = 0;
+	maxLightsPerObject = 0;
+	cappedObjectCount = 0;
+	for (size_t i = 0; i < objects.size(); i++)
+	{
+		evaluatedCount += evaluatedLights[i];
+		maxLightsPerObject = std::max(maxLightsPerObject, evaluatedLights[i]);
+		cappedObjectCount += capped[i];
+	}
+
+	assignTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
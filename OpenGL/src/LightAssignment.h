@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Bounds.h"
+#include "ClusteredLighting.h"
+
+// Lights reaching one object, sent with its draw
+struct ObjectLightList
+{
+	static const unsigned int MAX_LIGHTS = 8;
+
+	GLint count;
+	GLint lights[MAX_LIGHTS];	// scene light indices, most important first
+	GLint culledMask;			// shadowed lights that can't reach the object, bit = shadow index
+};
+
+// Ranks lights per object by their attenuated intensity at the object's bounding
+// sphere and keeps the MAX_LIGHTS strongest, objects are split across the job system.
+class LightAssignment
+{
+public:
+	LightAssignment();
+
+	// shadowedLights are the uniform array lights in shadow index order. The forward shader
+	// doesn't window them, so they are only dropped when provably dark (off, or outside the cone).
+	void Assign(const std::vector<BoundingSphere>& objects, const std::vector<ClusterLight>& shadowedLights,
+		const std::vector<ClusterLight>& sceneLights);
+
+	const ObjectLightList& GetObjectLights(size_t object) const { return objectLights[object]; }
+
+	unsigned int GetObjectCount() const { return (unsigned int)objectLights.size(); }
+	unsigned int GetCandidateCount() const { return candidateCount; }
+	unsigned int GetEvaluatedCount() const { return evaluatedCount; }
+	unsigned int GetMaxLightsPerObject() const { return maxLightsPerObject; }
+	unsigned int GetCappedObjectCount() const { return cappedObjectCount; }
+	double GetAssignTime() const { return assignTime; }
+
+private:
+	void AssignRange(size_t first, size_t last);
+
+	const std::vector<BoundingSphere>* objects;
+	const std::vector<ClusterLight>* shadowedLights;
+	const std::vector<ClusterLight>* sceneLights;
+
+	std::vector<GLfloat> sceneLightRadius;
+	std::vector<ObjectLightList> objectLights;
+	std::vector<unsigned int> evaluatedLights;	// per object, shadowed + listed
+	std::vector<unsigned char> capped;			// per object, more lights reached it than fit
+
+	unsigned int candidateCount, evaluatedCount, maxLightsPerObject, cappedObjectCount;
+	double assignTime;
+};
@@ -14,12 +14,6 @@ Material::Material(GLfloat sIntensity, GLfloat shine)
 	shininess = shine;
 }
 
-void Material::UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation)
-{
-	glUniform1f(specularIntensityLocation, specularIntensity);
-	glUniform1f(shininessLocation, shininess);
-}
-
 Material::~Material()
 {
 }
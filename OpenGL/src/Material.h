@@ -9,7 +9,8 @@ public:
 	Material();
 	Material(GLfloat sIntensity, GLfloat shine);
 
-	void UseMaterial(GLuint specularIntensityLocation, GLuint shininessLocation);
+	GLfloat GetSpecularIntensity() const { return specularIntensity; }
+	GLfloat GetShininess() const { return shininess; }
 
 	~Material();
 
@@ -1,18 +1,172 @@
 #include "Mesh.h"
+#include "GLState.h"
+
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+// Post-transform cache the triangle order is tuned for, and the FIFO size the miss ratio is measured with
+static const int OPTIMIZE_CACHE_SIZE = 32;
+static const int MEASURE_CACHE_SIZE = 16;
+
+static float CacheMissRatio(const GLuint* indices, unsigned int numOfIndices, unsigned int numOfVertices)
+{
+    if (numOfIndices < 3) return 0.0f;
+
+    // Each vertex remembers when it entered the FIFO, it is still in there for MEASURE_CACHE_SIZE misses
+    std::vector<unsigned int> entered(numOfVertices, 0);
+    unsigned int misses = 0;
+    for (unsigned int i = 0; i < numOfIndices; i++) {
+        GLuint vertex = indices[i];
+        if (entered[vertex] == 0 || misses - entered[vertex] >= MEASURE_CACHE_SIZE) {
+            misses++;
+            entered[vertex] = misses;
+        }
+    }
+    return static_cast<float>(misses) / (numOfIndices / 3);
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation: triangles are emitted greedily, best
+// scoring first, where a vertex scores for being recently used and for having few triangles left
+static float VertexScore(int cachePosition, unsigned int remaining)
+{
+    if (remaining == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // The last triangle's vertices score the same, so strips aren't favoured over fans
+        score = cachePosition < 3 ? 0.75f
+            : std::pow(1.0f - static_cast<float>(cachePosition - 3) / (OPTIMIZE_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f * std::pow(static_cast<float>(remaining), -0.5f);
+}
+
+static std::vector<GLuint> OptimizeVertexCache(const std::vector<GLuint>& indices, unsigned int numOfVertices)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    // Triangles around every vertex, the live ones first
+    std::vector<unsigned int> remaining(numOfVertices, 0);
+    for (GLuint index : indices) remaining[index]++;
+    std::vector<unsigned int> firstTriangle(numOfVertices + 1, 0);
+    for (unsigned int v = 0; v < numOfVertices; v++) firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> filled(numOfVertices, 0);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            GLuint v = indices[t * 3 + k];
+            adjacency[firstTriangle[v] + filled[v]++] = static_cast<unsigned int>(t);
+        }
+    }
+
+    std::vector<int> cachePosition(numOfVertices, -1);
+    std::vector<float> vertexScore(numOfVertices);
+    for (unsigned int v = 0; v < numOfVertices; v++) vertexScore[v] = VertexScore(-1, remaining[v]);
+
+    std::vector<bool> emitted(triangleCount, false);
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    std::vector<GLuint> cache, nextCache;
+    size_t scan = 0;
+    long best = -1;
+
+    while (result.size() < indices.size()) {
+        // Nothing in the cache touches a live triangle, restart from the next one in input order
+        if (best < 0) {
+            while (emitted[scan]) scan++;
+            best = static_cast<long>(scan);
+        }
+
+        emitted[best] = true;
+        nextCache.clear();
+        for (int k = 0; k < 3; k++) {
+            GLuint v = indices[best * 3 + k];
+            result.push_back(v);
+            nextCache.push_back(v);
+
+            // Drop the triangle from the vertex's live list
+            unsigned int* live = &adjacency[firstTriangle[v]];
+            for (unsigned int i = 0; i < remaining[v]; i++) {
+                if (live[i] == static_cast<unsigned int>(best)) {
+                    std::swap(live[i], live[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+        for (GLuint v : cache) {
+            if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2]) nextCache.push_back(v);
+        }
+
+        // Everything that entered, moved or fell out of the cache scores again
+        for (GLuint v : cache) cachePosition[v] = -1;
+        if (nextCache.size() > OPTIMIZE_CACHE_SIZE) {
+            for (size_t i = OPTIMIZE_CACHE_SIZE; i < nextCache.size(); i++) vertexScore[nextCache[i]] = VertexScore(-1, remaining[nextCache[i]]);
+            nextCache.resize(OPTIMIZE_CACHE_SIZE);
+        }
+        for (size_t i = 0; i < nextCache.size(); i++) {
+            cachePosition[nextCache[i]] = static_cast<int>(i);
+            vertexScore[nextCache[i]] = VertexScore(static_cast<int>(i), remaining[nextCache[i]]);
+        }
+        std::swap(cache, nextCache);
+
+        // The next triangle comes from the ones the cache touches
+        best = -1;
+        float bestScore = 0.0f;
+        for (GLuint v : cache) {
+            for (unsigned int i = 0; i < remaining[v]; i++) {
+                unsigned int t = adjacency[firstTriangle[v] + i];
+                float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = static_cast<long>(t);
+                }
+            }
+        }
+    }
+    return result;
+}
 
 Mesh::Mesh() {
     VAO = 0;
     VBO = 0;
     EBO = 0;
+    vertexCount = 0;
     indexCount = 0;
+    instanceBuffer = 0;
+    instanceOffset = 0;
+    positionVAO = 0;
+    positionVBO = 0;
+    positionEBO = 0;
+    positionCount = 0;
+    cacheMissRatio = 0.0f;
+    positionCacheMissRatio = 0.0f;
+    boundsMin = glm::vec3(0.0f);
+    boundsMax = glm::vec3(0.0f);
 }
 
-void Mesh::CreateMesh(GLfloat* vertices, GLuint* indices, unsigned int numOfVertices, unsigned int numOfIndices) {
+void Mesh::CreateMesh(GLfloat* vertices, GLuint* indices, unsigned int numOfVertices, unsigned int numOfIndices,
+    bool positionStream) {
     indexCount = numOfIndices;
+    vertexCount = numOfVertices / 8;
+    cacheMissRatio = CacheMissRatio(indices, numOfIndices, vertexCount);
+
+    // Positions lead every 8 float vertex
+    boundsMin = glm::vec3(vertices[0], vertices[1], vertices[2]);
+    boundsMax = boundsMin;
+    for (unsigned int i = 8; i + 2 < numOfVertices; i += 8) {
+        glm::vec3 position(vertices[i], vertices[i + 1], vertices[i + 2]);
+        boundsMin = glm::min(boundsMin, position);
+        boundsMax = glm::max(boundsMax, position);
+    }
 
 	// Vertex Array Object
     glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    GLState::BindVertexArray(VAO);
 
     // Vertex Buffer Object
     glGenBuffers(1, &VBO);
@@ -37,13 +191,103 @@ void Mesh::CreateMesh(GLfloat* vertices, GLuint* indices, unsigned int numOfVert
     glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
     glEnableVertexAttribArray(2);
 
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
+
+    if (positionStream && numOfIndices > 0) {
+        CreatePositionStream(vertices, indices);
+    }
 }
 
-void Mesh::RenderMesh() {
-    glBindVertexArray(VAO);
+// Depth passes only read location 0, so they get 12 byte vertices. Vertices split for their UVs
+// or normals are welded back together, bitwise equal positions only so the depth can't change,
+// and the triangles are reordered for the cache. Each triangle keeps its winding and first vertex.
+void Mesh::CreatePositionStream(const GLfloat* vertices, const GLuint* indices) {
+    std::map<std::tuple<GLuint, GLuint, GLuint>, GLuint> welded;
+    std::vector<GLuint> weldedIndex(vertexCount);
+    std::vector<glm::vec3> positions;
+    for (unsigned int v = 0; v < vertexCount; v++) {
+        GLuint bits[3];
+        memcpy(bits, &vertices[v * 8], sizeof(bits));
+        auto found = welded.emplace(std::make_tuple(bits[0], bits[1], bits[2]), static_cast<GLuint>(positions.size()));
+        if (found.second) positions.push_back(glm::vec3(vertices[v * 8], vertices[v * 8 + 1], vertices[v * 8 + 2]));
+        weldedIndex[v] = found.first->second;
+    }
+
+    std::vector<GLuint> order(indexCount);
+    for (unsigned int i = 0; i < indexCount; i++) order[i] = weldedIndex[indices[i]];
+    order = OptimizeVertexCache(order, static_cast<unsigned int>(positions.size()));
+
+    // Vertices in the order the triangles first use them, so fetches walk the buffer forwards
+    const GLuint unused = 0xFFFFFFFF;
+    std::vector<GLuint> remap(positions.size(), unused);
+    std::vector<glm::vec3> packed;
+    packed.reserve(positions.size());
+    for (GLuint& index : order) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<GLuint>(packed.size());
+            packed.push_back(positions[index]);
+        }
+        index = remap[index];
+    }
+    positionCount = static_cast<unsigned int>(packed.size());
+    positionCacheMissRatio = CacheMissRatio(order.data(), indexCount, positionCount);
+
+    glGenVertexArrays(1, &positionVAO);
+    GLState::BindVertexArray(positionVAO);
+
+    glGenBuffers(1, &positionVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * packed.size(), packed.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &positionEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, positionEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * order.size(), order.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    GLState::BindVertexArray(0);
+}
+
+void Mesh::RenderMesh(int vertexFormat) {
+    GLState::BindVertexArray(vertexFormat == VERTEX_FORMAT_POSITION && positionVAO ? positionVAO : VAO);
     glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    GLState::CountDraws();
+}
+
+void Mesh::SetInstanceBuffer(GLuint buffer, GLintptr offset) {
+    if (buffer == instanceBuffer && offset == instanceOffset) return;
+    instanceBuffer = buffer;
+    instanceOffset = offset;
+
+    // Both streams draw the same copies
+    GLuint arrays[] = { VAO, positionVAO };
+    for (GLuint vertexArray : arrays) {
+        if (!vertexArray) continue;
+
+        GLState::BindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+        // Transform (locations 3-6): one vec4 column each, advancing once per instance
+        for (GLuint i = 0; i < 4; i++) {
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + i, 1);
+            glEnableVertexAttribArray(3 + i);
+        }
+
+        // Material (location 7): specular intensity, shininess
+        glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + offsetof(InstanceData, specularIntensity)));
+        glVertexAttribDivisor(7, 1);
+        glEnableVertexAttribArray(7);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::RenderMeshInstanced(GLsizei instanceCount, int vertexFormat) {
+    GLState::BindVertexArray(vertexFormat == VERTEX_FORMAT_POSITION && positionVAO ? positionVAO : VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+    GLState::CountDraws();
 }
 
 void Mesh::ClearMesh() {
@@ -56,9 +300,17 @@ void Mesh::ClearMesh() {
         EBO = 0;
     }
     if (VAO != 0) {
-        glDeleteVertexArrays(1, &VAO);
+        GLState::DeleteVertexArray(VAO);
         VAO = 0;
     }
+    instanceBuffer = 0;
+    instanceOffset = 0;
+    if (positionVAO != 0) {
+        glDeleteBuffers(1, &positionVBO);
+        glDeleteBuffers(1, &positionEBO);
+        GLState::DeleteVertexArray(positionVAO);
+        positionVAO = positionVBO = positionEBO = 0;
+    }
 }
 
 Mesh::~Mesh() {
@@ -1,17 +1,68 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "CommonValues.h"
+
+// One copy in an instance buffer, read by the attributes in instancing.glsl
+struct InstanceData
+{
+    glm::mat4 transform;
+    GLfloat specularIntensity;
+    GLfloat shininess;
+};
 
 class Mesh
 {
 public:
     Mesh();
-    void CreateMesh(GLfloat* vertices, GLuint* indices, unsigned int numOfVertices, unsigned int numOfIndices);
-    void RenderMesh();
+    // positionStream also keeps a packed copy of the positions for depth-only passes, duplicates
+    // welded and the triangles reordered for the post-transform cache
+    void CreateMesh(GLfloat* vertices, GLuint* indices, unsigned int numOfVertices, unsigned int numOfIndices,
+        bool positionStream = false);
+
+    // VERTEX_FORMAT_POSITION draws from the position stream when there is one, same triangles either way
+    void RenderMesh(int vertexFormat = VERTEX_FORMAT_STANDARD);
+
+    // Points the per-instance attributes at the InstanceData in buffer from offset bytes on,
+    // pointing them where they already are costs nothing
+    void SetInstanceBuffer(GLuint buffer, GLintptr offset = 0);
+    void RenderMeshInstanced(GLsizei instanceCount, int vertexFormat = VERTEX_FORMAT_STANDARD);
     void ClearMesh();
+
+    // Raw buffers, DrawBatch copies them into its pool
+    GLuint GetVertexBuffer() const { return VBO; }
+    GLuint GetIndexBuffer() const { return EBO; }
+    unsigned int GetVertexCount() const { return vertexCount; }
+    unsigned int GetIndexCount() const { return indexCount; }
+
+    // The position stream, 3 floats per vertex and indexCount indices of its own
+    bool HasPositionStream() const { return positionVAO != 0; }
+    GLuint GetPositionBuffer() const { return positionVBO; }
+    GLuint GetPositionIndexBuffer() const { return positionEBO; }
+    unsigned int GetPositionCount() const { return positionCount; }
+
+    // Average cache miss ratio, vertices transformed per triangle with a FIFO post-transform cache
+    float GetCacheMissRatio() const { return cacheMissRatio; }
+    float GetPositionCacheMissRatio() const { return positionCacheMissRatio; }
+
+    // Object space box around the positions, taken at CreateMesh
+    const glm::vec3& GetBoundsMin() const { return boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return boundsMax; }
+
     ~Mesh();
 
 private:
+    void CreatePositionStream(const GLfloat* vertices, const GLuint* indices);
+
     GLuint VAO, VBO, EBO;
-    unsigned int indexCount;
+    unsigned int vertexCount, indexCount;
+    GLuint instanceBuffer;
+    GLintptr instanceOffset;
+
+    GLuint positionVAO, positionVBO, positionEBO;
+    unsigned int positionCount;
+    float cacheMissRatio, positionCacheMissRatio;
+    glm::vec3 boundsMin, boundsMax;
 };
@@ -1,28 +1,134 @@
 #include "Model.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cstdio>
 
 
 Model::Model()
 {
+	boundsMin = glm::vec3(0.0f);
+	boundsMax = glm::vec3(0.0f);
+	instanceBuffer = 0;
+	instanceCapacity = 0;
+	instanceCount = visibleCount = 0;
+	instanceVersion = 0;
 }
 
-void Model::RenderModel(bool wireframe)
+void Model::RenderModel(bool wireframe, int vertexFormat)
 {
 	if (wireframe) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+		GLState::PolygonMode(GL_LINE);
+	}
+	for (size_t i = 0; i < meshList.size(); i++) {
+		RenderMesh(i, vertexFormat);
+	}
+	if (wireframe) {
+		GLState::PolygonMode(GL_FILL);
+	}
+}
+
+void Model::RenderMesh(size_t index, int vertexFormat)
+{
+	GLuint materialIndex = meshToTex[index];
+	if (vertexFormat == VERTEX_FORMAT_STANDARD && materialIndex < textureList.size() && textureList[materialIndex]) {
+		textureList[materialIndex]->UseTexture();
+	}
+	meshList[index]->RenderMesh(vertexFormat);
+}
+
+Texture* Model::GetMeshTexture(size_t index) const
+{
+	GLuint materialIndex = meshToTex[index];
+	return materialIndex < textureList.size() ? textureList[materialIndex] : nullptr;
+}
+
+void Model::SetInstances(const std::vector<glm::mat4>& transforms, const Material* material)
+{
+	instanceData.resize(transforms.size());
+	for (size_t i = 0; i < transforms.size(); i++) {
+		instanceData[i] = { transforms[i], material->GetSpecularIntensity(), material->GetShininess() };
+	}
+	SetInstances(instanceData);
+}
+
+void Model::SetInstances(const std::vector<InstanceData>& instances)
+{
+	if (!instanceBuffer) {
+		glGenBuffers(1, &instanceBuffer);
+		for (size_t i = 0; i < meshList.size(); i++) {
+			meshList[i]->SetInstanceBuffer(instanceBuffer);
+		}
+	}
+
+	// Only reallocated when the copies outgrow it. Never empty, plain draws through the same
+	// VAOs still fetch instance 0
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	if (instanceCapacity == 0 || instances.size() > instanceCapacity) {
+		instanceCapacity = std::max<size_t>(instances.size(), 1);
+		glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(InstanceData) * instanceCapacity, nullptr, GL_DYNAMIC_DRAW);
+	}
+	if (!instances.empty()) {
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(InstanceData) * instances.size(), instances.data());
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Kept for DrawBatch, which streams the copies with its own per-draw data
+	if (&instances != &instanceData) {
+		instanceData = instances;
+	}
+	instanceCount = static_cast<GLsizei>(instances.size());
+	visibleCount = 0;
+	instanceVersion++;
+}
+
+GLsizei Model::SetVisibleInstances(const std::vector<unsigned char>& visible)
+{
+	visibleData.clear();
+	for (size_t i = 0; i < instanceData.size() && i < visible.size(); i++) {
+		if (visible[i]) visibleData.push_back(instanceData[i]);
+	}
+	visibleCount = static_cast<GLsizei>(visibleData.size());
+
+	// Just the visible ones, after the full set
+	if (visibleCount > 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, sizeof(InstanceData) * instanceCapacity, sizeof(InstanceData) * visibleData.size(), visibleData.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return visibleCount;
+}
+
+void Model::RenderModelInstanced(bool wireframe, bool visibleOnly, int vertexFormat)
+{
+	GLsizei copies = visibleOnly ? visibleCount : instanceCount;
+	if (copies == 0) return;
+	GLintptr offset = visibleOnly ? sizeof(InstanceData) * instanceCapacity : 0;
+
+	if (wireframe) {
+		GLState::PolygonMode(GL_LINE);
 	}
 	for (size_t i = 0; i < meshList.size(); i++) {
 		GLuint materialIndex = meshToTex[i];
-		if (materialIndex < textureList.size() && textureList[materialIndex]) {
+		if (vertexFormat == VERTEX_FORMAT_STANDARD && materialIndex < textureList.size() && textureList[materialIndex]) {
 			textureList[materialIndex]->UseTexture();
 		}
-		meshList[i]->RenderMesh();
+		meshList[i]->SetInstanceBuffer(instanceBuffer, offset);
+		meshList[i]->RenderMeshInstanced(copies, vertexFormat);
 	}
 	if (wireframe) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+		GLState::PolygonMode(GL_FILL);
 	}
 }
 
 void Model::LoadModel(const std::string & fileName)
+{
+	if (ReadModel(fileName)) {
+		UploadModel();
+	}
+}
+
+bool Model::ReadModel(const std::string& fileName)
 {
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(fileName,
@@ -32,10 +138,59 @@ void Model::LoadModel(const std::string & fileName)
 	    aiProcess_JoinIdenticalVertices);
 	if (!scene) {
 		std::cout << "Model load failed: " << importer.GetErrorString() << std::endl;
-		return;
+		return false;
 	}
+	loadName = fileName;
 	LoadNode(scene->mRootNode, scene);
 	LoadMaterials(scene);
+
+	return true;
+}
+
+void Model::UploadModel()
+{
+	for (StagedMesh& staged : stagedMeshes) {
+		Mesh* newMesh = new Mesh();
+		newMesh->CreateMesh(&staged.vertices[0], &staged.indices[0], staged.vertices.size(), staged.indices.size(), true);
+		meshList.push_back(newMesh);
+		meshToTex.push_back(staged.materialIndex);
+	}
+	stagedMeshes = std::vector<StagedMesh>();
+
+	for (size_t i = 0; i < textureList.size(); i++) {
+		if (textureList[i]) {
+			textureList[i]->Upload();
+		}
+	}
+
+	unsigned int vertices = 0, positions = 0, triangles = 0;
+	double misses = 0.0, positionMisses = 0.0;
+	for (size_t i = 0; i < meshList.size(); i++) {
+		boundsMin = i == 0 ? meshList[i]->GetBoundsMin() : glm::min(boundsMin, meshList[i]->GetBoundsMin());
+		boundsMax = i == 0 ? meshList[i]->GetBoundsMax() : glm::max(boundsMax, meshList[i]->GetBoundsMax());
+
+		unsigned int meshTriangles = meshList[i]->GetIndexCount() / 3;
+		triangles += meshTriangles;
+		vertices += meshList[i]->GetVertexCount();
+		positions += meshList[i]->GetPositionCount();
+		misses += meshList[i]->GetCacheMissRatio() * meshTriangles;
+		positionMisses += meshList[i]->GetPositionCacheMissRatio() * meshTriangles;
+	}
+	if (triangles > 0) {
+		printf("%s: depth stream %u of %u vertices, cache miss ratio %.2f -> %.2f\n", loadName.c_str(),
+			positions, vertices, misses / triangles, positionMisses / triangles);
+	}
+}
+
+// fileName by value, the coroutine outlives the caller's string
+AssetTask Model::LoadModelAsync(std::string fileName)
+{
+	co_await ResumeOnWorker();
+	if (!ReadModel(fileName)) co_return false;
+
+	co_await ResumeOnMainThread();
+	UploadModel();
+	co_return true;
 }
 
 void Model::LoadNode(aiNode* node, const aiScene* scene)
@@ -51,8 +206,10 @@ void Model::LoadNode(aiNode* node, const aiScene* scene)
 
 void Model::LoadMesh(aiMesh* mesh, const aiScene* scene)
 {
-	std::vector<GLfloat> vertices;
-	std::vector<unsigned int> indices;
+	stagedMeshes.push_back(StagedMesh());
+	std::vector<GLfloat>& vertices = stagedMeshes.back().vertices;
+	std::vector<unsigned int>& indices = stagedMeshes.back().indices;
+	stagedMeshes.back().materialIndex = mesh->mMaterialIndex;
 
 	for (size_t i = 0; i < mesh->mNumVertices; i++) {
 		vertices.insert(vertices.end(), { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z });
@@ -71,11 +228,6 @@ void Model::LoadMesh(aiMesh* mesh, const aiScene* scene)
 			indices.push_back(face.mIndices[j]);
 		}
 	}
-
-	Mesh* newMesh = new Mesh();
-	newMesh->CreateMesh(&vertices[0], &indices[0], vertices.size(), indices.size());
-	meshList.push_back(newMesh);
-	meshToTex.push_back(mesh->mMaterialIndex);
 }
 
 void Model::LoadMaterials(const aiScene* scene)
@@ -100,7 +252,7 @@ void Model::LoadMaterials(const aiScene* scene)
 
 				textureList[i] = new Texture(texPath.c_str());
 
-				if (!textureList[i]->LoadTexture()) {
+				if (!textureList[i]->Decode(false)) {
 					std::cout << "Failed to load texture at: " << texPath << std::endl;
 					delete textureList[i];
 					textureList[i] = nullptr;
@@ -110,13 +262,20 @@ void Model::LoadMaterials(const aiScene* scene)
 
 		if(!textureList[i]) {
 			textureList[i] = new Texture("Textures/plain.png");
-			textureList[i]->LoadTexture();
+			textureList[i]->Decode(false);
 		}
 	}
 }
 
 void Model::ClearModel()
 {
+	if (instanceBuffer) {
+		glDeleteBuffers(1, &instanceBuffer);
+		instanceBuffer = 0;
+		instanceCapacity = 0;
+		instanceCount = visibleCount = 0;
+	}
+
 	for (size_t i = 0; i < meshList.size(); i++) {
 		if(meshList[i]) 
 		{
@@ -9,6 +9,8 @@
 
 #include "Mesh.h"
 #include "Texture.h"
+#include "Material.h"
+#include "AssetTask.h"
 
 class Model
 {
@@ -16,13 +18,51 @@ public:
 	Model();
 
 	void LoadModel(const std::string& fileName);
-	void RenderModel(bool wireframe = false);
+	// LoadModel in two halves: ReadModel imports the file and decodes its textures on any thread,
+	// UploadModel creates the meshes and textures on the main thread
+	bool ReadModel(const std::string& fileName);
+	void UploadModel();
+	// Both halves as a coroutine, read on a worker and uploaded on the main thread
+	AssetTask LoadModelAsync(std::string fileName);
+	// VERTEX_FORMAT_POSITION draws the meshes' position streams and leaves the textures alone
+	void RenderModel(bool wireframe = false, int vertexFormat = VERTEX_FORMAT_STANDARD);
+	void RenderMesh(size_t index, int vertexFormat = VERTEX_FORMAT_STANDARD);	// one sub-mesh with its texture
 	void ClearModel();
 
+	// Copies drawn by RenderModelInstanced, uploaded on every call.
+	// The first form gives every copy the same material
+	void SetInstances(const std::vector<glm::mat4>& transforms, const Material* material);
+	void SetInstances(const std::vector<InstanceData>& instances);
+	// Writes the copies flagged in visible to a range of their own, the full set stays as it is.
+	// Returns how many there are
+	GLsizei SetVisibleInstances(const std::vector<unsigned char>& visible);
+	void RenderModelInstanced(bool wireframe = false, bool visibleOnly = false,	// only what SetVisibleInstances kept
+		int vertexFormat = VERTEX_FORMAT_STANDARD);
+	GLsizei GetInstanceCount() const { return instanceCount; }
+	unsigned int GetInstanceVersion() const { return instanceVersion; }	// changes with every SetInstances
+	const std::vector<InstanceData>& GetInstances() const { return instanceData; }
+
+	// Sub-meshes and the texture each one draws with, for DrawBatch
+	size_t GetMeshCount() const { return meshList.size(); }
+	Mesh* GetMesh(size_t index) const { return meshList[index]; }
+	Texture* GetMeshTexture(size_t index) const;
+
+	// Union of the mesh bounds, object space
+	const glm::vec3& GetBoundsMin() const { return boundsMin; }
+	const glm::vec3& GetBoundsMax() const { return boundsMax; }
+
 	~Model();
 
 private:
 
+	// Vertices and indices read and not yet uploaded
+	struct StagedMesh
+	{
+		std::vector<GLfloat> vertices;
+		std::vector<unsigned int> indices;
+		unsigned int materialIndex;
+	};
+
 	void LoadNode(aiNode* node, const aiScene* scene);
 	void LoadMesh(aiMesh* mesh, const aiScene* scene);
 	void LoadMaterials(const aiScene* scene);
@@ -30,4 +70,15 @@ private:
 	std::vector<Mesh*> meshList;
 	std::vector<Texture*> textureList;
 	std::vector<unsigned int> meshToTex;
+
+	glm::vec3 boundsMin, boundsMax;
+
+	std::vector<StagedMesh> stagedMeshes;
+	std::string loadName;
+
+	GLuint instanceBuffer;
+	size_t instanceCapacity;	// copies, the buffer holds twice this: the set, then the visible range
+	GLsizei instanceCount, visibleCount;
+	unsigned int instanceVersion;
+	std::vector<InstanceData> instanceData, visibleData;
 };
\ No newline at end of file
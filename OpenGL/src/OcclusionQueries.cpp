@@ -0,0 +1,298 @@
+#include "OcclusionQueries.h"
+#include "GLState.h"
+#include "Bounds.h"
+
+#include <glm\gtc\matrix_transform.hpp>
+#include <glm\gtc\type_ptr.hpp>
+
+// Camera this close to a model could be inside its box, where near plane clipping hides it
+static const float INSIDE_MARGIN = 0.5f;
+
+OcclusionQueries::OcclusionQueries()
+{
+	uniformBoxTransform = -1;
+
+	viewProjection = glm::mat4(1.0f);
+	cameraPosition = glm::vec3(0.0f);
+	cullFace = false;
+
+	costThreshold = 5000;
+	maxQueriesPerFrame = 64;
+	visibleInterval = 4;
+	frame = 0;
+
+	frameTracked = frameHidden = frameQueries = 0;
+	ResetStats();
+}
+
+bool OcclusionQueries::Init()
+{
+	boxShader.CreateFromFiles("Shaders/occlusion_box.vert", "Shaders/occlusion_box.frag");
+
+	GLint linked = GL_FALSE;
+	if (boxShader.GetShaderID()) glGetProgramiv(boxShader.GetShaderID(), GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		printf("Occlusion query shader failed to build\n");
+		return false;
+	}
+	uniformBoxTransform = glGetUniformLocation(boxShader.GetShaderID(), "boxTransform");
+
+	// Unit cube around the origin, positions only
+	GLfloat vertices[8 * 8] = {};
+	for (int i = 0; i < 8; i++)
+	{
+		vertices[i * 8 + 0] = i & 1 ? 0.5f : -0.5f;
+		vertices[i * 8 + 1] = i & 2 ? 0.5f : -0.5f;
+		vertices[i * 8 + 2] = i & 4 ? 0.5f : -0.5f;
+	}
+	GLuint indices[] = {
+		0, 1, 3, 3, 2, 0,	// -z
+		4, 6, 7, 7, 5, 4,	// +z
+		0, 4, 5, 5, 1, 0,	// -y
+		2, 3, 7, 7, 6, 2,	// +y
+		0, 2, 6, 6, 4, 0,	// -x
+		1, 5, 7, 7, 3, 1	// +x
+	};
+	box.CreateMesh(vertices, indices, 8 * 8, 36);
+
+	return true;
+}
+
+unsigned int OcclusionQueries::Cost(const Model& model)
+{
+	unsigned int triangles = 0;
+	for (size_t i = 0; i < model.GetMeshCount(); i++)
+	{
+		triangles += model.GetMesh(i)->GetIndexCount() / 3;
+	}
+	return triangles;
+}
+
+// Only a hidden result from the frame before is trusted, a visible or older one draws outright
+bool OcclusionQueries::IsConditional(const Check& check) const
+{
+	return !check.visible && check.issued + 1 == frame;
+}
+
+bool OcclusionQueries::Render(size_t object, Model& model, bool wireframe, int vertexFormat)
+{
+	if (object >= nodes.size()) return false;
+	Node& node = nodes[object];
+	if (node.model != &model) return false;
+
+	// NO_WAIT draws anyway if a result is somehow still in flight, it never stalls
+	if (wireframe) GLState::PolygonMode(GL_LINE);
+	if (IsConditional(node.whole))
+	{
+		glBeginConditionalRender(node.whole.query, GL_QUERY_NO_WAIT);
+		for (size_t i = 0; i < model.GetMeshCount(); i++)
+		{
+			model.RenderMesh(i, vertexFormat);
+		}
+		glEndConditionalRender();
+	}
+	else
+	{
+		for (size_t i = 0; i < model.GetMeshCount(); i++)
+		{
+			bool conditional = IsConditional(node.meshes[i]);
+			if (conditional) glBeginConditionalRender(node.meshes[i].query, GL_QUERY_NO_WAIT);
+			model.RenderMesh(i, vertexFormat);
+			if (conditional) glEndConditionalRender();
+		}
+	}
+	if (wireframe) GLState::PolygonMode(GL_FILL);
+
+	return true;
+}
+
+void OcclusionQueries::BeginQueries(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+	this->viewProjection = viewProjection;
+	this->cameraPosition = cameraPosition;
+
+	boxShader.UseShader();
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	GLState::DepthMask(GL_FALSE);
+	cullFace = GLState::IsEnabled(GL_CULL_FACE);
+	GLState::SetEnabled(GL_CULL_FACE, false);
+	GLState::PauseTriangleCount();		// the boxes aren't scene
+
+	frameTracked = frameHidden = frameQueries = 0;
+}
+
+// Never waits, a result still in flight keeps its query for another frame
+void OcclusionQueries::Read(Check& check)
+{
+	if (!check.pending) return;
+
+	GLint available = 0;
+	glGetQueryObjectiv(check.query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return;
+
+	GLuint passed = 0;
+	glGetQueryObjectuiv(check.query, GL_QUERY_RESULT, &passed);
+	check.visible = passed != 0;
+	check.pending = false;
+}
+
+// Hidden every frame so it comes back quickly, visible only now and then to notice it going
+bool OcclusionQueries::Due(const Check& check, bool periodic) const
+{
+	return !check.pending && (!check.visible || periodic);
+}
+
+void OcclusionQueries::Issue(Check& check, const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& margin)
+{
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, check.query);
+	DrawBox(transform, boundsMin, boundsMax, margin);
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+	check.issued = frame;
+	check.pending = true;
+}
+
+void OcclusionQueries::Query(size_t object, const Model& model, const glm::mat4& transform)
+{
+	if (Cost(model) < costThreshold) return;
+
+	const Check unused = { 0, 0, false, true };
+	if (object >= nodes.size())
+	{
+		nodes.resize(object + 1, Node{ nullptr, unused, std::vector<Check>() });
+	}
+	Node& node = nodes[object];
+	if (node.model != &model)
+	{
+		Release(node);
+		node.model = &model;
+		node.whole = unused;
+		glGenQueries(1, &node.whole.query);
+		node.meshes.assign(model.GetMeshCount(), unused);
+		for (Check& mesh : node.meshes)
+		{
+			glGenQueries(1, &mesh.query);
+		}
+	}
+	frameTracked++;
+
+	Read(node.whole);
+	for (Check& mesh : node.meshes)
+	{
+		Read(mesh);
+	}
+	if (!node.whole.visible) frameHidden++;
+
+	BoundingSphere bounds = TransformBounds(model.GetBoundsMin(), model.GetBoundsMax(), transform);
+	if (glm::length(cameraPosition - bounds.center) < bounds.radius + INSIDE_MARGIN)
+	{
+		node.whole.visible = true;
+		for (Check& mesh : node.meshes)
+		{
+			mesh.visible = true;
+		}
+		return;
+	}
+
+	// Parts only while the whole model is in view, it is one box otherwise
+	bool periodic = (frame + object) % visibleInterval == 0;
+	bool wholeDue = Due(node.whole, periodic);
+	bool meshLevel = node.whole.visible && model.GetMeshCount() > 1;
+	unsigned int boxes = wholeDue ? 1 : 0;
+	for (size_t i = 0; meshLevel && i < node.meshes.size(); i++)
+	{
+		if (Due(node.meshes[i], periodic)) boxes++;
+	}
+	if (boxes == 0 || frameQueries + boxes > maxQueriesPerFrame) return;
+
+	// A little bigger so the model's own surface in the depth buffer can't hide its box
+	glm::vec3 margin = (model.GetBoundsMax() - model.GetBoundsMin()) * 0.02f;
+
+	if (wholeDue)
+	{
+		Issue(node.whole, transform, model.GetBoundsMin(), model.GetBoundsMax(), margin);
+	}
+	if (meshLevel)
+	{
+		// Nested under the whole-model box when it went out too: if that fails the part boxes
+		// are skipped and every part reads hidden
+		if (wholeDue) glBeginConditionalRender(node.whole.query, GL_QUERY_WAIT);
+		for (size_t i = 0; i < node.meshes.size(); i++)
+		{
+			if (!Due(node.meshes[i], periodic)) continue;
+			Issue(node.meshes[i], transform, model.GetMesh(i)->GetBoundsMin(), model.GetMesh(i)->GetBoundsMax(), margin);
+		}
+		if (wholeDue) glEndConditionalRender();
+	}
+	frameQueries += boxes;
+}
+
+void OcclusionQueries::EndQueries()
+{
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	GLState::DepthMask(GL_TRUE);
+	GLState::SetEnabled(GL_CULL_FACE, cullFace);
+	GLState::ResumeTriangleCount();
+
+	totalTracked += frameTracked;
+	totalHidden += frameHidden;
+	totalQueries += frameQueries;
+	totalFrames++;
+	frame++;
+}
+
+void OcclusionQueries::DrawBox(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& margin)
+{
+	glm::mat4 boxTransform = viewProjection * transform *
+		glm::translate(glm::mat4(1.0f), (boundsMin + boundsMax) * 0.5f) *
+		glm::scale(glm::mat4(1.0f), boundsMax - boundsMin + margin * 2.0f);
+	glUniformMatrix4fv(uniformBoxTransform, 1, GL_FALSE, glm::value_ptr(boxTransform));
+	box.RenderMesh();
+}
+
+void OcclusionQueries::Reset()
+{
+	// Pending results are still read back, but only a fresh hidden one is ever drawn on
+	for (Node& node : nodes)
+	{
+		node.whole.visible = true;
+		for (Check& mesh : node.meshes)
+		{
+			mesh.visible = true;
+		}
+	}
+}
+
+void OcclusionQueries::ResetStats()
+{
+	totalTracked = totalHidden = totalQueries = 0;
+	totalFrames = 0;
+}
+
+void OcclusionQueries::Release(Node& node)
+{
+	if (node.whole.query)
+	{
+		glDeleteQueries(1, &node.whole.query);
+		node.whole.query = 0;
+	}
+	for (Check& mesh : node.meshes)
+	{
+		glDeleteQueries(1, &mesh.query);
+	}
+	node.meshes.clear();
+}
+
+void OcclusionQueries::Release()
+{
+	for (Node& node : nodes)
+	{
+		Release(node);
+	}
+	nodes.clear();
+}
+
+OcclusionQueries::~OcclusionQueries()
+{
+	Release();
+}
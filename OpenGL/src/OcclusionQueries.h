@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm\glm.hpp>
+
+#include "Shader.h"
+#include "Mesh.h"
+#include "Model.h"
+
+// Hardware occlusion queries for expensive models. After the camera pass each tracked model's
+// bounding box is drawn against the finished depth with colour and depth writes off, and the
+// next frame draws a hidden model under glBeginConditionalRender, so it is dropped on the GPU
+// without the CPU ever waiting on a result.
+//
+// Coherent like CHC: whatever was visible last time is drawn outright and only re-queried every
+// few frames to notice it going hidden, whatever was hidden is queried every frame and drawn
+// conditionally on that query. Visible models do the same per sub-mesh, nested under their
+// whole-model box, so parts drop out one at a time instead of the whole model popping. A draw
+// only leans on a query from the frame before, anything older is drawn outright. Only models
+// over the triangle threshold are tracked, and the boxes drawn per frame are capped.
+class OcclusionQueries
+{
+public:
+	OcclusionQueries();
+
+	bool Init();
+
+	// Objects are identified by their index in the frame's object list, a different model
+	// at an index starts it over
+	bool Render(size_t object, Model& model, bool wireframe,	// false when the caller should draw it normally
+		int vertexFormat = VERTEX_FORMAT_STANDARD);
+
+	// After the camera pass, with its depth still bound
+	void BeginQueries(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+	void Query(size_t object, const Model& model, const glm::mat4& transform);
+	void EndQueries();
+
+	// Forget every result, the next frame draws everything and queries again
+	void Reset();
+
+	void SetCostThreshold(unsigned int triangles) { costThreshold = triangles; }
+	void SetMaxQueriesPerFrame(unsigned int count) { maxQueriesPerFrame = count; }
+	void SetVisibleInterval(unsigned int frames) { visibleInterval = frames ? frames : 1; }
+
+	// Frame stats, EndQueries folds them into the running totals
+	double GetAverageTracked() const { return totalFrames ? (double)totalTracked / totalFrames : 0.0; }
+	double GetAverageHidden() const { return totalFrames ? (double)totalHidden / totalFrames : 0.0; }
+	double GetAverageQueries() const { return totalFrames ? (double)totalQueries / totalFrames : 0.0; }
+	void ResetStats();
+
+	// Every node's queries, before the context goes
+	void Release();
+
+	~OcclusionQueries();
+
+private:
+	// One box's query and what it last said
+	struct Check
+	{
+		GLuint query;
+		unsigned int issued;	// frame it last went out
+		bool pending;			// out and not read back yet
+		bool visible;			// last result read back
+	};
+
+	struct Node
+	{
+		const Model* model;
+		Check whole;
+		std::vector<Check> meshes;
+	};
+
+	static unsigned int Cost(const Model& model);
+	void Read(Check& check);
+	bool Due(const Check& check, bool periodic) const;
+	bool IsConditional(const Check& check) const;
+	void Issue(Check& check, const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& margin);
+	void Release(Node& node);
+	void DrawBox(const glm::mat4& transform, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& margin);
+
+	Shader boxShader;
+	GLint uniformBoxTransform;
+	Mesh box;
+
+	std::vector<Node> nodes;
+
+	glm::mat4 viewProjection;
+	glm::vec3 cameraPosition;
+	bool cullFace;	// restored by EndQueries
+
+	unsigned int costThreshold, maxQueriesPerFrame, visibleInterval;
+	unsigned int frame;
+
+	unsigned int frameTracked, frameHidden, frameQueries;
+	unsigned long long totalTracked, totalHidden, totalQueries;
+	unsigned int totalFrames;
+};
@@ -1,4 +1,5 @@
 #include "OmniShadowMap.h"
+#include "GLState.h"
 
 OmniShadowMap::OmniShadowMap() : ShadowMap()
 {
@@ -12,7 +13,7 @@ bool OmniShadowMap::Init(unsigned int width, unsigned int height)
     glGenFramebuffers(1, &FBO);
 
     glGenTextures(1, &shadowMap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
 
     for (GLuint i = 0; i < 6; i++)
     {
@@ -26,7 +27,11 @@ bool OmniShadowMap::Init(unsigned int width, unsigned int height)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    // Stored depth is distance / farPlane, compared against the same value via samplerCubeShadow
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
     glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMap, 0);
 
     glDrawBuffer(GL_NONE);
@@ -36,23 +41,32 @@ bool OmniShadowMap::Init(unsigned int width, unsigned int height)
     if (status != GL_FRAMEBUFFER_COMPLETE)
     {
         std::cout << "Omni shadow framebuffer error: " << status << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
         return false;
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
     return true;
 }
 
 void OmniShadowMap::Write()
 {
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+    GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
 }
 
 void OmniShadowMap::Read(GLenum texUnit)
 {
-    glActiveTexture(texUnit);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+    GLState::BindTexture(texUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, shadowMap);
+}
+
+void OmniShadowMap::SetFiltering(bool linear)
+{
+    GLint filter = linear ? GL_LINEAR : GL_NEAREST;
+
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, shadowMap);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, filter);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 OmniShadowMap::~OmniShadowMap()
@@ -9,6 +9,7 @@ public:
     bool Init(unsigned int width, unsigned int height) override;
     void Write() override;
     void Read(GLenum TextureUnit) override;
+    void SetFiltering(bool linear) override;
 
     ~OmniShadowMap();
 };
@@ -0,0 +1,141 @@
+#include "OmniVarianceShadowMap.h"
+
+#include "Shader.h"
+#include "FullscreenTriangle.h"
+#include "GLState.h"
+
+Shader* OmniVarianceShadowMap::blurShader = nullptr;
+GLint OmniVarianceShadowMap::uniformBlurStep = -1;
+GLint OmniVarianceShadowMap::uniformFace = -1;
+
+OmniVarianceShadowMap::OmniVarianceShadowMap() : OmniShadowMap()
+{
+    depthMap = 0;
+    blurFBO = 0;
+    blurMap[0] = blurMap[1] = 0;
+    blurSize = 0;
+}
+
+static GLuint CreateCubeTexture(unsigned int size, GLenum internalFormat, GLenum format, bool mipmapped)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, texture);
+
+    for (GLuint i = 0; i < 6; i++)
+    {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internalFormat, size, size, 0, format, GL_FLOAT, nullptr);
+    }
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    if (mipmapped)
+    {
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    }
+
+    return texture;
+}
+
+bool OmniVarianceShadowMap::Init(unsigned int width, unsigned int height)
+{
+    shadowWidth = width;
+    shadowHeight = height;
+    blurSize = width > 1 ? width / 2 : 1;
+
+    // Layered rendering needs every attachment layered, so depth is a cube map too
+    shadowMap = CreateCubeTexture(width, GL_RG32F, GL_RG, false);
+    depthMap = CreateCubeTexture(width, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, false);
+
+    glGenFramebuffers(1, &FBO);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, shadowMap, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMap, 0);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Omni variance shadow framebuffer error: " << status << std::endl;
+        GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+        return false;
+    }
+
+    // Faces get attached one at a time while blurring
+    blurMap[0] = CreateCubeTexture(blurSize, GL_RG32F, GL_RG, false);
+    blurMap[1] = CreateCubeTexture(blurSize, GL_RG32F, GL_RG, true);
+    glGenFramebuffers(1, &blurFBO);
+
+    GLState::BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    return true;
+}
+
+void OmniVarianceShadowMap::Write()
+{
+    GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+}
+
+void OmniVarianceShadowMap::Read(GLenum texUnit)
+{
+    GLState::BindTexture(texUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP, blurMap[1]);
+}
+
+void OmniVarianceShadowMap::Prefilter()
+{
+    if (!blurShader)
+    {
+        blurShader = new Shader();
+        blurShader->CreateFromFiles("Shaders/fullscreen.vert", "Shaders/vsm_blur_cube.frag");
+        uniformBlurStep = glGetUniformLocation(blurShader->GetShaderID(), "blurStep");
+        uniformFace = glGetUniformLocation(blurShader->GetShaderID(), "face");
+    }
+
+    blurShader->UseShader();
+    GLState::SetEnabled(GL_DEPTH_TEST, false);
+    GLState::Viewport(0, 0, blurSize, blurSize);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, blurFBO);
+
+    // Step is in face coordinates, which span [-1, 1]
+    float step = 2.0f / blurSize;
+    GLuint source[2] = { shadowMap, blurMap[0] };
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, source[pass]);
+        glUniform2f(uniformBlurStep, pass == 0 ? step : 0.0f, pass == 0 ? 0.0f : step);
+
+        for (GLint face = 0; face < 6; face++)
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, blurMap[pass], 0);
+            glUniform1i(uniformFace, face);
+            FullscreenTriangle::Draw();
+        }
+    }
+
+    GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, blurMap[1]);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
+
+    GLState::SetEnabled(GL_DEPTH_TEST, true);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+OmniVarianceShadowMap::~OmniVarianceShadowMap()
+{
+    if (depthMap)
+    {
+        GLState::DeleteTexture(depthMap);
+    }
+
+    if (blurFBO)
+    {
+        GLState::DeleteFramebuffer(blurFBO);
+    }
+
+    GLState::DeleteTexture(blurMap[0]);
+    GLState::DeleteTexture(blurMap[1]);
+}
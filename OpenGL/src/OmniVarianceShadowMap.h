@@ -0,0 +1,28 @@
+#pragma once
+#include "OmniShadowMap.h"
+
+class Shader;
+
+// Cube map version of VarianceShadowMap. The blur runs per face in direction
+// space, so taps near an edge read across the seam from the neighbouring face.
+class OmniVarianceShadowMap : public OmniShadowMap
+{
+public:
+    OmniVarianceShadowMap();
+
+    bool Init(unsigned int width, unsigned int height) override;
+    void Write() override;
+    void Read(GLenum TextureUnit) override;
+    void SetFiltering(bool linear) override {}
+    void Prefilter() override;
+
+    ~OmniVarianceShadowMap();
+
+private:
+    GLuint depthMap;
+    GLuint blurFBO, blurMap[2];
+    GLuint blurSize;
+
+    static Shader* blurShader;
+    static GLint uniformBlurStep, uniformFace;
+};
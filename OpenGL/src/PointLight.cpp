@@ -1,5 +1,9 @@
 #include "PointLight.h"
 
+#include <algorithm>
+
+#include "OmniVarianceShadowMap.h"
+
 PointLight::PointLight() : Light()
 {
     position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -30,19 +34,13 @@ PointLight::PointLight(GLuint shadowWidth, GLuint shadowHeight,
     shadowMap->Init(shadowWidth, shadowHeight);
 }
 
-void PointLight::UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
-                          GLuint diffuseIntensityLocation, GLuint positionLocation,
-                          GLuint constantLocation, GLuint linearLocation,
-                          GLuint exponentLocation)
+void PointLight::GetLightData(PointLightData& data) const
 {
-    glUniform3f(ambientColourLocation, colour.r, colour.g, colour.b);
-    glUniform1f(ambientIntensityLocation, ambientIntensity);
-    glUniform1f(diffuseIntensityLocation, diffuseIntensity);
-
-    glUniform3f(positionLocation, position.x, position.y, position.z);
-    glUniform1f(constantLocation, constant);
-    glUniform1f(linearLocation, linear);
-    glUniform1f(exponentLocation, exponent);
+    Light::GetLightData(data.base);
+    data.position = position;
+    data.constant = constant;
+    data.linear = linear;
+    data.exponent = exponent;
 }
 
 std::vector<glm::mat4> PointLight :: CalculateLightTransform()
@@ -71,4 +69,12 @@ glm::vec3 PointLight::GetPosition()
     return position;
 }
 
+ShadowMap* PointLight::CreateMomentsMap(GLuint shadowWidth, GLuint shadowHeight)
+{
+    // Six RG32F faces add up quickly, keep the cube small
+    OmniVarianceShadowMap* map = new OmniVarianceShadowMap();
+    map->Init(std::min(shadowWidth / 2, 512u), std::min(shadowHeight / 2, 512u));
+    return map;
+}
+
 PointLight::~PointLight() {}
\ No newline at end of file
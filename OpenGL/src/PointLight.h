@@ -16,18 +16,18 @@ public:
                GLfloat xPos, GLfloat yPos, GLfloat zPos,
                GLfloat con, GLfloat lin, GLfloat exp);
 
-    void UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
-                  GLuint diffuseIntensityLocation, GLuint positionLocation,
-                  GLuint constantLocation, GLuint linearLocation,
-                  GLuint exponentLocation);
+    void GetLightData(PointLightData& data) const;
 
 	std::vector<glm::mat4> CalculateLightTransform();
     GLfloat GetFarPlane();
 	glm::vec3 GetPosition();
+	glm::vec3 GetAttenuation() const { return glm::vec3(constant, linear, exponent); }
 
     ~PointLight();
 
 protected:
+    ShadowMap* CreateMomentsMap(GLuint shadowWidth, GLuint shadowHeight) override;
+
     glm::vec3 position;
 
     GLfloat constant, linear, exponent;
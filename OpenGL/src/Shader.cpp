@@ -1,13 +1,11 @@
 #include "Shader.h"
+#include "GLState.h"
 
 Shader::Shader()
 {
 	shaderID = 0;
 	uniformModel = 0;
 	uniformProjection = 0;
-
-	pointLightCount = 0;
-	spotLightCount = 0;
 }
 
 void Shader::CreateFromString(const char* vertexCode, const char* fragmentCode)
@@ -25,6 +23,17 @@ void Shader::CreateFromFiles(const char* vertexLocation, const char* fragmentLoc
 	CompileShader(vertexCode, fragmentCode);
 }
 
+// Same as above with a block of #defines spliced in after each #version line
+void Shader::CreateFromFiles(const char* vertexLocation, const char* fragmentLocation, const std::string& defines)
+{
+	std::string vertexString = InsertDefines(ReadFile(vertexLocation), defines);
+	std::string fragmentString = InsertDefines(ReadFile(fragmentLocation), defines);
+	const char* vertexCode = vertexString.c_str();
+	const char* fragmentCode = fragmentString.c_str();
+
+	CompileShader(vertexCode, fragmentCode);
+}
+
 void Shader::CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation)
 {
 	std::string vertexString = ReadFile(vertexLocation);
@@ -51,6 +60,19 @@ std::string Shader::ReadFile(const char* fileLocation)
 	while (!fileStream.eof())
 	{
 		std::getline(fileStream, line);
+
+		// Splice in #include "file", paths are relative to the including file
+		if (line.compare(0, 10, "#include \"") == 0)
+		{
+			std::string path = fileLocation;
+			size_t slash = path.find_last_of("/\\");
+			std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+			std::string includeName = line.substr(10, line.find('"', 10) - 10);
+
+			content.append(ReadFile((directory + includeName).c_str()));
+			continue;
+		}
+
 		content.append(line + "\n");
 	}
 
@@ -58,6 +80,24 @@ std::string Shader::ReadFile(const char* fileLocation)
 	return content;
 }
 
+std::string Shader::InsertDefines(const std::string& code, const std::string& defines)
+{
+	// #version has to stay the first statement
+	size_t version = code.find("#version");
+	if (version == std::string::npos)
+	{
+		return defines + code;
+	}
+
+	size_t lineEnd = code.find('\n', version);
+	if (lineEnd == std::string::npos)
+	{
+		return code + "\n" + defines;
+	}
+
+	return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+}
+
 void Shader::CompileShader(const char* vertexCode, const char* fragmentCode)
 {
 	shaderID = glCreateProgram();
@@ -91,9 +131,10 @@ void Shader::CompileShader(const char* vertexCode, const char* geometryCode, con
 	CompileProgram();
 }
 
+// Driver round trip on every pass, debug builds only
 void Shader::Validate()
 {
-
+#ifndef NDEBUG
 	GLint result = 0;
 	GLchar eLog[1024] = { 0 };
 
@@ -105,7 +146,7 @@ void Shader::Validate()
 		printf("Error validating program: '%s'\n", eLog);
 		return;
 	}
-
+#endif
 }
 
 void Shader::CompileProgram()
@@ -113,6 +154,13 @@ void Shader::CompileProgram()
 	GLint result = 0;
 	GLchar eLog[1024] = { 0 };
 
+	if (!feedbackVaryings.empty())
+	{
+		std::vector<const char*> names;
+		for (const std::string& varying : feedbackVaryings) names.push_back(varying.c_str());
+		glTransformFeedbackVaryings(shaderID, static_cast<GLsizei>(names.size()), names.data(), GL_INTERLEAVED_ATTRIBS);
+	}
+
 	glLinkProgram(shaderID);
 	glGetProgramiv(shaderID, GL_LINK_STATUS, &result);
 	if (!result)
@@ -125,83 +173,24 @@ void Shader::CompileProgram()
 	uniformProjection = glGetUniformLocation(shaderID, "projection");
 	uniformModel = glGetUniformLocation(shaderID, "model");
 	uniformView = glGetUniformLocation(shaderID, "view");
-	uniformDirectionalLight.uniformColour = glGetUniformLocation(shaderID, "directionalLight.base.colour");
-	uniformDirectionalLight.uniformAmbientIntensity = glGetUniformLocation(shaderID, "directionalLight.base.ambientIntensity");
-	uniformDirectionalLight.uniformDirection = glGetUniformLocation(shaderID, "directionalLight.direction");
-	uniformDirectionalLight.uniformDiffuseIntensity = glGetUniformLocation(shaderID, "directionalLight.base.diffuseIntensity");
-	uniformSpecularIntensity = glGetUniformLocation(shaderID, "material.specularIntensity");
-	uniformShininess = glGetUniformLocation(shaderID, "material.shininess");
-	uniformEyePosition = glGetUniformLocation(shaderID, "eyePosition");
-
-	uniformPointLightCount = glGetUniformLocation(shaderID, "pointLightCount");
-
-	for (size_t i = 0; i < MAX_POINT_LIGHTS; i++)
-	{
-		char locBuff[100] = { '\0' };
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.colour", i);
-		uniformPointLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.ambientIntensity", i);
-		uniformPointLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.diffuseIntensity", i);
-		uniformPointLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].position", i);
-		uniformPointLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].constant", i);
-		uniformPointLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].linear", i);
-		uniformPointLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "pointLights[%d].exponent", i);
-		uniformPointLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
-	}
-
-	uniformSpotLightCount = glGetUniformLocation(shaderID, "spotLightCount");
-
-	for (size_t i = 0; i < MAX_SPOT_LIGHTS; i++)
-	{
-		char locBuff[100] = { '\0' };
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.colour", i);
-		uniformSpotLight[i].uniformColour = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.ambientIntensity", i);
-		uniformSpotLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.diffuseIntensity", i);
-		uniformSpotLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.position", i);
-		uniformSpotLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.constant", i);
-		uniformSpotLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.linear", i);
-		uniformSpotLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.exponent", i);
-		uniformSpotLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].direction", i);
-		uniformSpotLight[i].uniformDirection = glGetUniformLocation(shaderID, locBuff);
-
-		snprintf(locBuff, sizeof(locBuff), "spotLights[%d].edge", i);
-		uniformSpotLight[i].uniformEdge = glGetUniformLocation(shaderID, locBuff);
-	}
-
-	uniformDirectionalLightTransform = glGetUniformLocation(shaderID, "directionalLightTransform");
 	uniformTexture = glGetUniformLocation(shaderID, "theTexture");
 	uniformDirectionalShadowMap = glGetUniformLocation(shaderID, "directionalShadowMap");
+	uniformDirectionalMomentsMap = glGetUniformLocation(shaderID, "directionalMomentsMap");
 
 	uniformOmniLightPos = glGetUniformLocation(shaderID, "lightPos");
 	uniformFarPlane = glGetUniformLocation(shaderID, "farPlane");
 
+	uniformClusterLights = glGetUniformLocation(shaderID, "clusterLights");
+	uniformClusterIndices = glGetUniformLocation(shaderID, "clusterIndices");
+	uniformClusterDims = glGetUniformLocation(shaderID, "clusterDims");
+	uniformClusterTileSize = glGetUniformLocation(shaderID, "clusterTileSize");
+	uniformClusterZParams = glGetUniformLocation(shaderID, "clusterZParams");
+
+	uniformGAlbedoSpecular = glGetUniformLocation(shaderID, "gAlbedoSpecular");
+	uniformGNormalShininess = glGetUniformLocation(shaderID, "gNormalShininess");
+	uniformGDepth = glGetUniformLocation(shaderID, "gDepth");
+	uniformInverseViewProjection = glGetUniformLocation(shaderID, "inverseViewProjection");
+
 	for (size_t i = 0; i < 6; i++)
 	{
 		char locBuff[100] = { '\0' };
@@ -217,9 +206,40 @@ void Shader::CompileProgram()
 		snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].shadowMap", i);
 		uniformOmniShadowMap[i].shadowMap = glGetUniformLocation(shaderID, locBuff);
 
-		snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].farPlane", i);
-		uniformOmniShadowMap[i].farPlane = glGetUniformLocation(shaderID, locBuff);
+		snprintf(locBuff, sizeof(locBuff), "omniShadowMaps[%d].momentsMap", i);
+		uniformOmniShadowMap[i].momentsMap = glGetUniformLocation(shaderID, locBuff);
+	}
+
+	// Shared blocks go on fixed binding points, programs without a block just skip it
+	const struct { const char* name; GLuint binding; } blocks[] = {
+		{ "FrameBlock", FRAME_BLOCK_BINDING },
+		{ "LightBlock", LIGHT_BLOCK_BINDING },
+		{ "DrawBlock", DRAW_BLOCK_BINDING },
+	};
+	for (auto& block : blocks)
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(shaderID, block.name);
+		if (blockIndex != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(shaderID, blockIndex, block.binding);
+		}
+	}
+
+	// Give every shadow sampler its own unit up front, unused slots left on unit 0
+	// would mix sampler types on one unit and fail validation
+	GLState::UseProgram(shaderID);
+	glUniform1i(uniformDirectionalMomentsMap, SHADOW_MOMENTS_UNIT);
+	for (size_t i = 0; i < MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS; i++)
+	{
+		glUniform1i(uniformOmniShadowMap[i].shadowMap, 3 + i);
+		glUniform1i(uniformOmniShadowMap[i].momentsMap, SHADOW_MOMENTS_UNIT + 1 + i);
 	}
+	glUniform1i(uniformClusterLights, CLUSTER_LIGHTS_UNIT);
+	glUniform1i(uniformClusterIndices, CLUSTER_INDICES_UNIT);
+	glUniform1i(uniformGAlbedoSpecular, GBUFFER_ALBEDO_UNIT);
+	glUniform1i(uniformGNormalShininess, GBUFFER_NORMAL_UNIT);
+	glUniform1i(uniformGDepth, GBUFFER_DEPTH_UNIT);
+	GLState::UseProgram(0);
 }
 
 GLuint Shader::GetProjectionLocation()
@@ -234,35 +254,6 @@ GLuint Shader::GetViewLocation()
 {
 	return uniformView;
 }
-GLuint Shader::GetAmbientColourLocation()
-{
-	return uniformDirectionalLight.uniformColour;
-}
-GLuint Shader::GetAmbientIntensityLocation()
-{
-	return uniformDirectionalLight.uniformAmbientIntensity;
-}
-GLuint Shader::GetDiffuseIntensityLocation()
-{
-	return uniformDirectionalLight.uniformDiffuseIntensity;
-}
-GLuint Shader::GetDirectionLocation()
-{
-	return uniformDirectionalLight.uniformDirection;
-}
-GLuint Shader::GetSpecularIntensityLocation()
-{
-	return uniformSpecularIntensity;
-}
-GLuint Shader::GetShininessLocation()
-{
-	return uniformShininess;
-}
-GLuint Shader::GetEyePositionLocation()
-{
-	return uniformEyePosition;
-}
-
 GLuint Shader::GetOmniLightPosLocation()
 {
 	return uniformOmniLightPos;
@@ -273,83 +264,57 @@ GLuint Shader::GetFarPlaneLocation()
 	return uniformFarPlane;
 }
 
-void Shader::SetDirectionalLight(DirectionalLight* dLight)
+void Shader::SetTexture(GLuint textureUnit)
 {
-	dLight->UseLight(uniformDirectionalLight.uniformAmbientIntensity, uniformDirectionalLight.uniformColour,
-		uniformDirectionalLight.uniformDiffuseIntensity, uniformDirectionalLight.uniformDirection);
+	glUniform1i(uniformTexture, textureUnit);
 }
 
-void Shader::SetPointLights(PointLight* pLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset)
+void Shader::SetDirectionalShadowMap(GLuint textureUnit)
 {
-	if (lightCount > MAX_POINT_LIGHTS) lightCount = MAX_POINT_LIGHTS;
-
-	glUniform1i(uniformPointLightCount, lightCount);
-
-	for (size_t i = 0; i < lightCount; i++)
-	{
-		pLight[i].UseLight(uniformPointLight[i].uniformAmbientIntensity, uniformPointLight[i].uniformColour,
-			uniformPointLight[i].uniformDiffuseIntensity, uniformPointLight[i].uniformPosition,
-			uniformPointLight[i].uniformConstant, uniformPointLight[i].uniformLinear, uniformPointLight[i].uniformExponent);
-		
-		pLight[i].getShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniShadowMap[i + offset].shadowMap, textureUnit + i);
-		glUniform1f(uniformOmniShadowMap[i + offset].farPlane, pLight[i].GetFarPlane());
-
-	}
+	glUniform1i(uniformDirectionalShadowMap, textureUnit);
 }
 
-void Shader::SetSpotLights(SpotLight* sLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset)
+void Shader::SetLightMatrices(std::vector<glm::mat4> lightMatrices)
 {
-	if (lightCount > MAX_SPOT_LIGHTS) lightCount = MAX_SPOT_LIGHTS;
-
-	glUniform1i(uniformSpotLightCount, lightCount);
-
-	for (size_t i = 0; i < lightCount; i++)
+	for(size_t i = 0; i < lightMatrices.size(); i++)
 	{
-		sLight[i].UseLight(uniformSpotLight[i].uniformAmbientIntensity, uniformSpotLight[i].uniformColour,
-			uniformSpotLight[i].uniformDiffuseIntensity, uniformSpotLight[i].uniformPosition, uniformSpotLight[i].uniformDirection,
-			uniformSpotLight[i].uniformConstant, uniformSpotLight[i].uniformLinear, uniformSpotLight[i].uniformExponent,
-			uniformSpotLight[i].uniformEdge);
-
-		sLight[i].getShadowMap()->Read(GL_TEXTURE0 + textureUnit + i);
-		glUniform1i(uniformOmniShadowMap[i + offset].shadowMap, textureUnit + i);
-		glUniform1f(uniformOmniShadowMap[i + offset].farPlane, sLight[i].GetFarPlane());
+		glUniformMatrix4fv(uniformlightMatrices[i], 1, GL_FALSE, glm::value_ptr(lightMatrices[i]));
 	}
 }
 
-void Shader::SetTexture(GLuint textureUnit)
+void Shader::SetClusters(ClusteredLighting* clusters)
 {
-	glUniform1i(uniformTexture, textureUnit);
-}
+	// A zero sized grid switches the clustered loop off in the shader
+	if (!clusters)
+	{
+		glUniform3i(uniformClusterDims, 0, 0, 0);
+		return;
+	}
 
-void Shader::SetDirectionalShadowMap(GLuint textureUnit)
-{
-	glUniform1i(uniformDirectionalShadowMap, textureUnit);
-}
+	glm::ivec3 dims = clusters->GetDimensions();
+	glUniform3i(uniformClusterDims, dims.x, dims.y, dims.z);
+	glUniform2fv(uniformClusterTileSize, 1, glm::value_ptr(clusters->GetTileSize()));
+	glUniform2f(uniformClusterZParams, clusters->GetZScale(), clusters->GetZBias());
 
-void Shader::SetDirectionalLightTransform(glm::mat4* lTransform)
-{
-	glUniformMatrix4fv(uniformDirectionalLightTransform, 1, GL_FALSE, glm::value_ptr(*lTransform));
+	clusters->Bind();
 }
 
-void Shader::SetLightMatrices(std::vector<glm::mat4> lightMatrices)
+void Shader::SetGBuffer(GBuffer* gBuffer, glm::mat4* inverseViewProjection)
 {
-	for(size_t i = 0; i < lightMatrices.size(); i++)
-	{
-		glUniformMatrix4fv(uniformlightMatrices[i], 1, GL_FALSE, glm::value_ptr(lightMatrices[i]));
-	}
+	glUniformMatrix4fv(uniformInverseViewProjection, 1, GL_FALSE, glm::value_ptr(*inverseViewProjection));
+	gBuffer->Read();
 }
 
 void Shader::UseShader()
 {
-	glUseProgram(shaderID);
+	GLState::UseProgram(shaderID);
 }
 
 void Shader::ClearShader()
 {
 	if (shaderID != 0)
 	{
-		glDeleteProgram(shaderID);
+		GLState::DeleteProgram(shaderID);
 		shaderID = 0;
 	}
 
@@ -4,6 +4,7 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 #include <glad/glad.h>
 
@@ -16,6 +17,8 @@
 #include "DirectionalLight.h"
 #include "PointLight.h"
 #include "SpotLight.h"
+#include "ClusteredLighting.h"
+#include "GBuffer.h"
 
 class Shader
 {
@@ -24,8 +27,12 @@ public:
 
 	void CreateFromString(const char* vertexCode, const char* fragmentCode);
 	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation);
+	void CreateFromFiles(const char* vertexLocation, const char* fragmentLocation, const std::string& defines);
 	void CreateFromFiles(const char* vertexLocation, const char* geometryLocation, const char* fragmentLocation);
 
+	// Outputs captured interleaved by transform feedback, set before creating the program
+	void SetFeedbackVaryings(const std::vector<std::string>& varyings) { feedbackVaryings = varyings; }
+
 	void Validate();
 
 	std::string ReadFile(const char* fileLocation);
@@ -35,23 +42,15 @@ public:
 	GLuint GetProjectionLocation();
 	GLuint GetModelLocation();
 	GLuint GetViewLocation();
-	GLuint GetAmbientIntensityLocation();
-	GLuint GetAmbientColourLocation();
-	GLuint GetDiffuseIntensityLocation();
-	GLuint GetDirectionLocation();
-	GLuint GetSpecularIntensityLocation();
-	GLuint GetShininessLocation();
-	GLuint GetEyePositionLocation();
 	GLuint GetOmniLightPosLocation();
 	GLuint GetFarPlaneLocation();
 
-	void SetDirectionalLight(DirectionalLight* dLight);
-	void SetPointLights(PointLight* pLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset);
-	void SetSpotLights(SpotLight* sLight, unsigned int lightCount, unsigned int textureUnit, unsigned int offset);
+	// Camera, lights and per-draw data come from the blocks in UniformBlocks
 	void SetTexture(GLuint textureUnit);
 	void SetDirectionalShadowMap(GLuint textureUnit);
-	void SetDirectionalLightTransform(glm::mat4* lTransform);
 	void SetLightMatrices(std::vector<glm::mat4> lightMatrices);
+	void SetClusters(ClusteredLighting* clusters);
+	void SetGBuffer(GBuffer* gBuffer, glm::mat4* inverseViewProjection);
 
 	void UseShader();
 	void ClearShader();
@@ -59,62 +58,26 @@ public:
 	~Shader();
 
 private:
-	int pointLightCount;
-	int spotLightCount;
-
-	GLuint shaderID, uniformProjection, uniformModel, uniformView, uniformEyePosition,
-		uniformSpecularIntensity, uniformShininess,
-		uniformTexture, uniformDirectionalShadowMap,
-		uniformDirectionalLightTransform,
+	GLuint shaderID, uniformProjection, uniformModel, uniformView,
+		uniformTexture, uniformDirectionalShadowMap, uniformDirectionalMomentsMap,
 		uniformOmniLightPos, uniformFarPlane;
 
-	GLuint uniformlightMatrices[6];
-
-	struct {
-		GLuint uniformColour;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformDirection;
-	} uniformDirectionalLight;
-
-	GLuint uniformPointLightCount;
-
-	struct {
-		GLuint uniformColour;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformPosition;
-		GLuint uniformConstant;
-		GLuint uniformLinear;
-		GLuint uniformExponent;
-	} uniformPointLight[MAX_POINT_LIGHTS];
-
-	GLuint uniformSpotLightCount;
-
-	struct {
-		GLuint uniformColour;
-		GLuint uniformAmbientIntensity;
-		GLuint uniformDiffuseIntensity;
-
-		GLuint uniformPosition;
-		GLuint uniformConstant;
-		GLuint uniformLinear;
-		GLuint uniformExponent;
+	GLuint uniformClusterLights, uniformClusterIndices, uniformClusterDims, uniformClusterTileSize, uniformClusterZParams;
+	GLuint uniformGAlbedoSpecular, uniformGNormalShininess, uniformGDepth, uniformInverseViewProjection;
 
-		GLuint uniformDirection;
-		GLuint uniformEdge;
-	} uniformSpotLight[MAX_SPOT_LIGHTS];
+	GLuint uniformlightMatrices[6];
 
 	struct {
 		GLuint shadowMap;
-		GLuint farPlane;
+		GLuint momentsMap;
 	} uniformOmniShadowMap[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
 
+	std::vector<std::string> feedbackVaryings;
+
 	void CompileShader(const char* vertexCode, const char* fragmentCode);
 	void CompileShader(const char* vertexCode, const char* geometryCode, const char* fragmentCode);
 	void AddShader(GLuint theProgram, const char* shaderCode, GLenum shaderType);
+	std::string InsertDefines(const std::string& code, const std::string& defines);
 
 	void CompileProgram();
 };
@@ -0,0 +1,70 @@
+#include "ShaderCache.h"
+
+#include <chrono>
+
+std::string ShaderPermutation::GetDefines() const
+{
+	std::string defines;
+	if (pointLights >= 0) defines += "#define POINT_LIGHT_COUNT " + std::to_string(pointLights) + "\n";
+	if (spotLights >= 0) defines += "#define SPOT_LIGHT_COUNT " + std::to_string(spotLights) + "\n";
+	if (directionalFilter >= 0) defines += "#define DIRECTIONAL_SHADOW_FILTER " + std::to_string(directionalFilter) + "\n";
+	if (omniFilter >= 0) defines += "#define OMNI_SHADOW_FILTER " + std::to_string(omniFilter) + "\n";
+	defines += "#define CLUSTERED_LIGHTS " + std::to_string(clusteredLights) + "\n";
+	defines += "#define OBJECT_LIGHTS " + std::to_string(objectLights) + "\n";
+	defines += "#define VERTEX_FORMAT " + std::to_string(vertexFormat) + "\n";
+	return defines;
+}
+
+ShaderCache::ShaderCache()
+{
+	compileTime = 0.0;
+}
+
+void ShaderCache::Init(const char* vertexLocation, const char* fragmentLocation)
+{
+	Clear();
+
+	this->vertexLocation = vertexLocation;
+	this->fragmentLocation = fragmentLocation;
+}
+
+Shader* ShaderCache::Get(const ShaderPermutation& permutation)
+{
+	std::string defines = permutation.GetDefines();
+
+	auto found = variants.find(defines);
+	if (found != variants.end())
+	{
+		return found->second;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	Shader* shader = new Shader();
+	shader->CreateFromFiles(vertexLocation.c_str(), fragmentLocation.c_str(), defines);
+	variants[defines] = shader;
+
+	double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	compileTime += elapsed;
+	printf("Compiled %s variant %zu in %.1f ms (point %d, spot %d, filters %d/%d, clustered %d, per-object %d)\n",
+		fragmentLocation.c_str(), variants.size(), elapsed,
+		permutation.pointLights, permutation.spotLights, permutation.directionalFilter, permutation.omniFilter,
+		permutation.clusteredLights, permutation.objectLights);
+
+	return shader;
+}
+
+void ShaderCache::Clear()
+{
+	for (auto& variant : variants)
+	{
+		delete variant.second;
+	}
+	variants.clear();
+	compileTime = 0.0;
+}
+
+ShaderCache::~ShaderCache()
+{
+	Clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "Shader.h"
+
+// Compile-time specialisation of shader.frag / deferred_lighting.frag.
+// Every field set becomes a #define, -1 leaves it to the uniforms like the generic shader.
+struct ShaderPermutation
+{
+	int pointLights = -1;
+	int spotLights = -1;
+	int directionalFilter = -1;			// ShadowFilter
+	int omniFilter = -1;				// ShadowFilter, every omni light has to share it
+	int clusteredLights = 1;
+	int objectLights = 1;
+	int vertexFormat = VERTEX_FORMAT_STANDARD;
+
+	std::string GetDefines() const;
+};
+
+// Lazily compiled variants of one vertex/fragment pair, keyed by their #define block
+class ShaderCache
+{
+public:
+	ShaderCache();
+
+	void Init(const char* vertexLocation, const char* fragmentLocation);
+
+	// Compiles the variant the first time a permutation is asked for
+	Shader* Get(const ShaderPermutation& permutation);
+
+	size_t GetVariantCount() const { return variants.size(); }
+	double GetCompileTime() const { return compileTime; }
+
+	void Clear();
+
+	~ShaderCache();
+
+private:
+	std::string vertexLocation, fragmentLocation;
+	std::map<std::string, Shader*> variants;
+
+	double compileTime;
+};
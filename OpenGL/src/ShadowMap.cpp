@@ -1,4 +1,5 @@
 #include "ShadowMap.h"
+#include "GLState.h"
 
 
 
@@ -15,7 +16,7 @@ bool ShadowMap::Init(unsigned int width, unsigned int height)
 	glGenFramebuffers(1, &FBO);
 
 	glGenTextures(1, &shadowMap);
-	glBindTexture(GL_TEXTURE_2D, shadowMap);
+	GLState::BindTexture(GL_TEXTURE_2D, shadowMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
 
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -27,7 +28,11 @@ bool ShadowMap::Init(unsigned int width, unsigned int height)
 	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
 
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+	// Sampled through sampler2DShadow, so the depth compare happens in the texture unit
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
 	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
 
 	glDrawBuffer(GL_NONE);
@@ -40,30 +45,39 @@ bool ShadowMap::Init(unsigned int width, unsigned int height)
 		std::cout << "Framebuffer error: " << Status << std::endl;
 		return false;
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 	return true;
 }
 
 void ShadowMap::Write()
 {
-	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
 }
 
 void ShadowMap::Read(GLenum texUnit)
 {
-	glActiveTexture(texUnit);
-	glBindTexture(GL_TEXTURE_2D, shadowMap);
+	GLState::BindTexture(texUnit - GL_TEXTURE0, GL_TEXTURE_2D, shadowMap);
+}
+
+void ShadowMap::SetFiltering(bool linear)
+{
+	GLint filter = linear ? GL_LINEAR : GL_NEAREST;
+
+	GLState::BindTexture(GL_TEXTURE_2D, shadowMap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
 }
 
 ShadowMap::~ShadowMap()
 {
 	if (FBO)
 	{
-		glDeleteFramebuffers(1, &FBO);
+		GLState::DeleteFramebuffer(FBO);
 	}
 
 	if (shadowMap)
 	{
-		glDeleteTextures(1, &shadowMap);
+		GLState::DeleteTexture(shadowMap);
 	}
 }
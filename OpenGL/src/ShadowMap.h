@@ -15,10 +15,16 @@ public:
 
 	virtual void Read(GLenum TextureUnit);
 
+	// Nearest for hard shadows, linear lets the hardware compare do 2x2 PCF per tap
+	virtual void SetFiltering(bool linear);
+
+	// Called after the shadow pass, only prefiltered maps have work to do
+	virtual void Prefilter() {}
+
 	GLuint GetShadowWidth() { return shadowWidth; }
 	GLuint GetShadowHeight() { return shadowHeight; }
 
-	~ShadowMap();
+	virtual ~ShadowMap();
 protected:
 	GLuint FBO, shadowMap;
 	GLuint shadowWidth, shadowHeight;
@@ -0,0 +1,238 @@
+#include "Simulation.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+glm::mat4 SimTransform::GetMatrix() const
+{
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+	model *= glm::mat4_cast(orientation);
+	return glm::scale(model, scale);
+}
+
+// The short way round, so 359 to 1 goes through 0 rather than back past 180
+static float BlendAngle(float from, float to, float t, float period)
+{
+	float delta = to - from;
+	if (delta > period * 0.5f) delta -= period;
+	if (delta < -period * 0.5f) delta += period;
+
+	float angle = from + delta * t;
+	if (angle >= period) angle -= period;
+	if (angle < 0.0f) angle += period;
+	return angle;
+}
+
+Simulation::Simulation()
+{
+	tickLength = 1.0 / 60.0;
+	running.store(false);
+	tick = 0;
+	back = 0;
+	shared.store(1);
+	front = 2;
+	publishedTick.store(0);
+	targetTick.store(0);
+	clockStart = std::chrono::steady_clock::now();
+	ResetStats();
+}
+
+uint64_t Simulation::Now() const
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - clockStart).count();
+}
+
+void Simulation::Start(const SimState& initial, double tickLength, StepFunction stepFunction)
+{
+	Stop();
+
+	this->tickLength = tickLength > 0.0 ? tickLength : 1.0 / 60.0;
+	this->stepFunction = stepFunction;
+
+	tick = 0;
+	previous = current = initial;
+	previous.time = current.time = 0.0;
+	for (Published& slot : slots)
+	{
+		slot.tick = 0;
+		slot.previous = previous;
+		slot.current = current;
+	}
+	back = 0;
+	shared.store(1);
+	front = 2;
+	publishedTick.store(0);
+	targetTick.store(0);
+	ResetStats();
+
+	running.store(true);
+	thread = std::thread(&Simulation::ThreadLoop, this);
+}
+
+void Simulation::Stop()
+{
+	if (!running.load()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running.store(false);
+	}
+	posted.notify_all();
+	published.notify_all();
+	thread.join();
+}
+
+uint64_t Simulation::TickAt(double time) const
+{
+	return time > 0.0 ? (uint64_t)std::floor(time / tickLength) : 0;
+}
+
+void Simulation::AdvanceTo(double time)
+{
+	uint64_t target = TickAt(time);
+	if (target <= targetTick.load()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		targetTick.store(target);
+	}
+	posted.notify_one();
+}
+
+void Simulation::Sample(double time, SimState& state)
+{
+	uint64_t needed = TickAt(time);
+	AdvanceTo(time);
+
+	uint64_t start = Now();
+	if (!running.load())
+	{
+		if (tick < needed) Step(needed);
+	}
+	else if (publishedTick.load(std::memory_order_acquire) < needed)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		published.wait(lock, [this, needed]() { return publishedTick.load() >= needed || !running.load(); });
+	}
+	waitTime += Now() - start;
+	samples++;
+
+	// Only a fresh pair is worth swapping for, the shared slot is otherwise older than ours
+	if (shared.load(std::memory_order_acquire) & FRESH)
+	{
+		front = shared.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+	}
+
+	// Drawn a tick behind, between the last two ticks at or before time
+	const Published& pair = slots[front];
+	double t = (time - tickLength - pair.previous.time) / tickLength;
+	if (t < 0.0) t = 0.0;
+	if (t > 1.0) t = 1.0;
+	Blend(pair.previous, pair.current, static_cast<float>(t), state);
+}
+
+void Simulation::Blend(const SimState& from, const SimState& to, float t, SimState& state)
+{
+	state.time = from.time + (to.time - from.time) * t;
+	state.sunAngle = BlendAngle(from.sunAngle, to.sunAngle, t, 6.28318f);
+	state.sunDirection = glm::normalize(glm::mix(from.sunDirection, to.sunDirection, t));
+	state.seahawkAngle = BlendAngle(from.seahawkAngle, to.seahawkAngle, t, 360.0f);
+
+	state.transforms.resize(to.transforms.size());
+	for (size_t i = 0; i < to.transforms.size(); i++)
+	{
+		const SimTransform& end = to.transforms[i];
+		if (i >= from.transforms.size())
+		{
+			state.transforms[i] = end;
+			continue;
+		}
+
+		const SimTransform& begin = from.transforms[i];
+		state.transforms[i].position = glm::mix(begin.position, end.position, t);
+		state.transforms[i].orientation = glm::slerp(begin.orientation, end.orientation, t);
+		state.transforms[i].scale = glm::mix(begin.scale, end.scale, t);
+	}
+
+	state.lightPositions.resize(to.lightPositions.size());
+	for (size_t i = 0; i < to.lightPositions.size(); i++)
+	{
+		state.lightPositions[i] = i < from.lightPositions.size() ? glm::mix(from.lightPositions[i], to.lightPositions[i], t) : to.lightPositions[i];
+	}
+}
+
+void Simulation::ThreadLoop()
+{
+	for (;;)
+	{
+		uint64_t target;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			posted.wait(lock, [this]() { return targetTick.load() > tick || !running.load(); });
+			if (!running.load()) return;
+			target = targetTick.load();
+		}
+		Step(target);
+	}
+}
+
+void Simulation::Step(uint64_t target)
+{
+	if (tick >= target) return;
+
+	uint64_t start = Now();
+	uint64_t ticks = target - tick;
+	while (tick < target)
+	{
+		previous = current;
+		tick++;
+		current.time = tick * tickLength;
+		if (stepFunction) stepFunction(current, current.time, static_cast<float>(tickLength));
+	}
+	tickTime.fetch_add(Now() - start, std::memory_order_relaxed);
+	ticksRun.fetch_add(ticks, std::memory_order_relaxed);
+
+	Publish();
+}
+
+void Simulation::Publish()
+{
+	Published& slot = slots[back];
+	slot.tick = tick;
+	slot.previous = previous;
+	slot.current = current;
+
+	// A pair the renderer never took comes back to be written over
+	back = shared.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		publishedTick.store(tick, std::memory_order_release);
+	}
+	published.notify_all();
+}
+
+void Simulation::Report() const
+{
+	uint64_t ticks = ticksRun.load();
+	if (ticks == 0) return;
+
+	printf("Simulation: %llu ticks at %.0f Hz, %.3f ms a tick on %s\n", (unsigned long long)ticks, 1.0 / tickLength,
+		tickTime.load() / 1000000.0 / ticks, running.load() ? "its own thread" : "the main thread");
+	if (samples > 0) printf("  the renderer waited %.3f ms a frame for ticks\n", waitTime / 1000000.0 / samples);
+}
+
+void Simulation::ResetStats()
+{
+	ticksRun.store(0);
+	tickTime.store(0);
+	waitTime = 0;
+	samples = 0;
+}
+
+Simulation::~Simulation()
+{
+	Stop();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Where an animated object is, kept apart so two ticks blend without shearing the matrix
+struct SimTransform
+{
+	glm::vec3 position;
+	glm::quat orientation;
+	glm::vec3 scale;
+
+	glm::mat4 GetMatrix() const;
+};
+
+// Everything the simulation decides in one tick
+struct SimState
+{
+	double time;
+	float sunAngle;		// radians, wrapping at 2 pi
+	glm::vec3 sunDirection;
+	float seahawkAngle;	// degrees, wrapping at 360
+	std::vector<SimTransform> transforms;	// the animated objects
+	std::vector<glm::vec3> lightPositions;	// the scene lights
+};
+
+// Runs the scene's animation on its own thread at a fixed tick while the main thread renders.
+// Each tick is published with the one before it through a triple buffer, the thread always has a
+// slot to write and the renderer always has the newest pair, neither waits on the other's copy.
+//
+// The renderer asks for the state at its frame time and gets it blended between the two ticks
+// before it, a tick behind but smooth at any frame rate. Ticks are only run up to a time the
+// renderer has posted, never past it, so what's drawn at a time is the same however far ahead
+// the thread got and a replay or bench stays deterministic. Posting the next frame's time
+// early lets its ticks run while this frame is still being submitted.
+class Simulation
+{
+public:
+	// Advances state by one tick of step seconds, to time. Called on the simulation thread
+	typedef std::function<void(SimState& state, double time, float step)> StepFunction;
+
+	Simulation();
+
+	// initial is the state at time 0
+	void Start(const SimState& initial, double tickLength, StepFunction stepFunction);
+	void Stop();
+	bool IsRunning() const { return running.load(); }
+	double GetTickLength() const { return tickLength; }
+
+	// Lets ticks run up to time, no frame is ever sampled before it. Times only move forward
+	void AdvanceTo(double time);
+	// The state at time a tick ago, waits for the ticks it needs. Posts time first. Steps on
+	// the calling thread when the simulation thread isn't running
+	void Sample(double time, SimState& state);
+
+	static void Blend(const SimState& from, const SimState& to, float t, SimState& state);
+
+	// Ticks run, what they cost and how long the renderer waited on them
+	void Report() const;
+	void ResetStats();
+
+	~Simulation();
+
+private:
+	struct Published
+	{
+		uint64_t tick;
+		SimState previous, current;
+	};
+
+	static const unsigned int FRESH = 4;	// set on the shared slot index when it holds an unread pair
+
+	uint64_t Now() const;
+	void ThreadLoop();
+	// Runs ticks up to target, then publishes the last pair
+	void Step(uint64_t target);
+	void Publish();
+	uint64_t TickAt(double time) const;
+
+	double tickLength;
+	StepFunction stepFunction;
+	std::thread thread;
+	std::atomic<bool> running;
+
+	// Only the stepping thread touches these
+	uint64_t tick;
+	SimState previous, current;
+
+	// Triple buffer: back is the writer's, front the reader's and shared holds the one between
+	Published slots[3];
+	unsigned int back, front;
+	std::atomic<unsigned int> shared;
+	std::atomic<uint64_t> publishedTick;
+
+	std::atomic<uint64_t> targetTick;
+	std::mutex mutex;
+	std::condition_variable posted, published;
+
+	std::chrono::steady_clock::time_point clockStart;
+	std::atomic<uint64_t> ticksRun;
+	std::atomic<uint64_t> tickTime;	// ns spent in stepFunction
+	uint64_t waitTime;	// ns the renderer spent waiting in Sample
+	unsigned int samples;
+};
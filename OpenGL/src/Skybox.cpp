@@ -1,12 +1,45 @@
 #include "Skybox.h"
+#include "GLState.h"
+#include "JobSystem.h"
+#include <atomic>
 #include <iostream>
 #include <stb/stb_image.h>
 
 Skybox::Skybox()
 {
+	skyMesh = nullptr;
+	skyShader = nullptr;
+	textureId = 0;
+	uniformProjection = uniformView = 0;
 }
 
 Skybox::Skybox(std::vector<std::string> faceLocations)
+{
+	Decode(faceLocations);
+	Upload();
+}
+
+bool Skybox::Decode(const std::vector<std::string>& faceLocations)
+{
+	faces.assign(faceLocations.size(), Face());
+
+	std::atomic<bool> found(true);
+	JobSystem::Get().ParallelFor(faces.size(), 1, [&](size_t first, size_t last) {
+		// Per thread, another load may want its images the other way up
+		stbi_set_flip_vertically_on_load_thread(false);
+		for (size_t i = first; i < last; i++) {
+			Face& face = faces[i];
+			face.pixels = stbi_load(faceLocations[i].c_str(), &face.width, &face.height, &face.bitDepth, 0);
+			if (!face.pixels) {
+				std::cout << "Failed to find: " << faceLocations[i] << std::endl;
+				found.store(false);
+			}
+		}
+	});
+	return found.load();
+}
+
+void Skybox::Upload()
 {
 	// Shader setup
 	skyShader = new Shader();
@@ -22,31 +55,26 @@ Skybox::Skybox(std::vector<std::string> faceLocations)
 
 	// Texture setup
 	glGenTextures(1, &textureId);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
-
-	int width, height, bitDepth;
-	stbi_set_flip_vertically_on_load(false);
+	GLState::BindTexture(GL_TEXTURE_CUBE_MAP, textureId);
 
 	// Safe unpack alignment for any channel count/width
 	GLint prevUnpackAlign = 4;
 	glGetIntegerv(GL_UNPACK_ALIGNMENT, &prevUnpackAlign);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-	for (size_t i = 0; i < faceLocations.size(); i++) {
-		unsigned char* texData = stbi_load(faceLocations[i].c_str(), &width, &height, &bitDepth, 0);
-		if (!texData) {
-			std::cout << "Failed to find: " << faceLocations[i] << std::endl;
-			continue;
-		}
+	for (size_t i = 0; i < faces.size(); i++) {
+		Face& face = faces[i];
+		if (!face.pixels) continue;
 
-		GLenum format = (bitDepth == 4) ? GL_RGBA : GL_RGB;
-		GLenum internalFormat = (bitDepth == 4) ? GL_RGBA8 : GL_RGB8;
+		GLenum format = (face.bitDepth == 4) ? GL_RGBA : GL_RGB;
+		GLenum internalFormat = (face.bitDepth == 4) ? GL_RGBA8 : GL_RGB8;
 
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(i),
-			0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, texData);
+			0, internalFormat, face.width, face.height, 0, format, GL_UNSIGNED_BYTE, face.pixels);
 
-		stbi_image_free(texData);
+		stbi_image_free(face.pixels);
 	}
+	faces.clear();
 
 	// Restore unpack alignment
 	glPixelStorei(GL_UNPACK_ALIGNMENT, prevUnpackAlign);
@@ -84,26 +112,35 @@ Skybox::Skybox(std::vector<std::string> faceLocations)
 	skyMesh->CreateMesh(skyboxVertices, skyboxIndices, 64, 36);
 }
 
+AssetTask Skybox::LoadAsync(std::vector<std::string> faceLocations)
+{
+	co_await ResumeOnWorker();
+	bool found = Decode(faceLocations);
+
+	co_await ResumeOnMainThread();
+	Upload();
+	co_return found;
+}
+
 void Skybox::DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 {
 	viewMatrix = glm::mat4(glm::mat3(viewMatrix));
 
-	glDepthMask(GL_FALSE);
-	glDepthFunc(GL_LEQUAL); // ensure skybox passes at depth = 1.0
+	GLState::DepthMask(GL_FALSE);
+	GLState::DepthFunc(GL_LEQUAL); // ensure skybox passes at depth = 1.0
 
 	skyShader->UseShader();
 
 	glUniformMatrix4fv(uniformProjection, 1, GL_FALSE, glm::value_ptr(projectionMatrix));
 	glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureId);
+	GLState::BindTexture(0, GL_TEXTURE_CUBE_MAP, textureId);
 
 	skyShader->Validate();
 	skyMesh->RenderMesh();
 
-	glDepthFunc(GL_LESS);
-	glDepthMask(GL_TRUE);
+	GLState::DepthFunc(GL_LESS);
+	GLState::DepthMask(GL_TRUE);
 }
 
 Skybox::~Skybox()
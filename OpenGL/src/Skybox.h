@@ -12,6 +12,7 @@
 
 #include "Mesh.h"
 #include "Shader.h"
+#include "AssetTask.h"
 
 class Skybox
 {
@@ -20,6 +21,13 @@ public:
 
 	Skybox(std::vector<std::string> faceLocations);
 
+	// The constructor in two halves: the faces read and decoded on any thread, then the cube map,
+	// shader and mesh on the main thread. Missing faces are left black
+	bool Decode(const std::vector<std::string>& faceLocations);
+	void Upload();
+	// Both halves as a coroutine, the faces decoded side by side on the workers
+	AssetTask LoadAsync(std::vector<std::string> faceLocations);
+
 	void DrawSkybox(glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
 
 	~Skybox();
@@ -30,5 +38,13 @@ private:
 	
 	GLuint textureId;
 	GLuint uniformProjection, uniformView;
+
+	// Decoded and not yet uploaded
+	struct Face
+	{
+		unsigned char* pixels;
+		int width, height, bitDepth;
+	};
+	std::vector<Face> faces;
 };
 
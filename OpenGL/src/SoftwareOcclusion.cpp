@@ -0,0 +1,322 @@
+#include "SoftwareOcclusion.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+#include <emmintrin.h>
+
+#include "JobSystem.h"
+
+OccluderMesh MakeOccluder(const GLfloat* vertices, unsigned int numOfVertices, const GLuint* indices, unsigned int numOfIndices)
+{
+	OccluderMesh mesh;
+	for (unsigned int i = 0; i + 2 < numOfVertices; i += 8)
+	{
+		mesh.positions.push_back(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+	}
+	mesh.indices.assign(indices, indices + numOfIndices);
+	return mesh;
+}
+
+SoftwareOcclusion::SoftwareOcclusion()
+{
+	viewProjection = glm::mat4(1.0f);
+	depth.assign(WIDTH * HEIGHT, 1.0f);
+
+	maxOccluders = 32;
+	workerCount = 0;
+
+	frameOccluders = frameTriangles = frameTested = frameCulled = 0;
+	frameRasterTime = frameTestTime = 0.0;
+	ResetStats();
+}
+
+void SoftwareOcclusion::Begin(const glm::mat4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	candidates.clear();
+
+	frameOccluders = frameTriangles = frameTested = frameCulled = 0;
+	frameRasterTime = frameTestTime = 0.0;
+}
+
+void SoftwareOcclusion::AddOccluder(const OccluderMesh* mesh, const glm::mat4& transform, const BoundingSphere& bounds)
+{
+	if (!mesh || mesh->IsEmpty()) return;
+
+	// Entirely behind the camera can't hide anything
+	glm::vec4 clip = viewProjection * glm::vec4(bounds.center, 1.0f);
+	if (clip.w + bounds.radius <= 0.0f) return;
+
+	Candidate candidate = { mesh, transform, bounds.radius / std::max(clip.w, 0.01f) };
+	candidates.push_back(candidate);
+}
+
+void SoftwareOcclusion::Rasterize()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Only the biggest on screen are worth their triangles
+	if (candidates.size() > maxOccluders)
+	{
+		std::nth_element(candidates.begin(), candidates.begin() + maxOccluders, candidates.end(),
+			[](const Candidate& a, const Candidate& b) { return a.score > b.score; });
+		candidates.resize(maxOccluders);
+	}
+
+	triangles.clear();
+	for (const Candidate& candidate : candidates)
+	{
+		const OccluderMesh& mesh = *candidate.mesh;
+		glm::mat4 transform = viewProjection * candidate.transform;
+
+		clipPositions.resize(mesh.positions.size());
+		for (size_t i = 0; i < mesh.positions.size(); i++)
+		{
+			clipPositions[i] = transform * glm::vec4(mesh.positions[i], 1.0f);
+		}
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			glm::vec4 clip[3] = { clipPositions[mesh.indices[i]], clipPositions[mesh.indices[i + 1]], clipPositions[mesh.indices[i + 2]] };
+			SetupTriangle(clip);
+		}
+	}
+
+	std::fill(depth.begin(), depth.end(), 1.0f);
+
+	// Every band owns its rows, so the split never changes the buffer
+	const size_t trianglesPerJob = 64;
+	if (workerCount == 1 || triangles.size() <= trianglesPerJob)
+	{
+		RasterizeRows(0, HEIGHT);
+	}
+	else
+	{
+		// A set worker count gets that many bands, the job system picks otherwise
+		size_t band = workerCount ? (HEIGHT + workerCount - 1) / workerCount : 8;
+		JobSystem::Get().ParallelFor(HEIGHT, band, [this](size_t first, size_t last) {
+			RasterizeRows(static_cast<int>(first), static_cast<int>(last));
+		});
+	}
+
+	frameOccluders = static_cast<unsigned int>(candidates.size());
+	frameTriangles = static_cast<unsigned int>(triangles.size());
+	frameRasterTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void SoftwareOcclusion::SetupTriangle(const glm::vec4 clip[3])
+{
+	// Clip against the near plane (z >= -w), one corner behind it turns the triangle into a quad
+	glm::vec4 polygon[4];
+	int count = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::vec4& a = clip[i];
+		const glm::vec4& b = clip[(i + 1) % 3];
+		float distanceA = a.z + a.w;
+		float distanceB = b.z + b.w;
+
+		if (distanceA >= 0.0f) polygon[count++] = a;
+		if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+		{
+			polygon[count++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+		}
+	}
+	if (count < 3) return;
+
+	glm::vec3 screen[4];
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec3 ndc = glm::vec3(polygon[i]) / polygon[i].w;
+		screen[i] = glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z * 0.5f + 0.5f);
+	}
+
+	EmitTriangle(screen[0], screen[1], screen[2]);
+	if (count == 4) EmitTriangle(screen[0], screen[2], screen[3]);
+}
+
+void SoftwareOcclusion::EmitTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	// Back facing or edge on, occluders are closed so the front faces cover it
+	float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+	if (area <= 0.0f) return;
+
+	// Pixels whose centre falls inside the box, clamped before the int conversion
+	auto firstPixel = [](float low, int size) { return static_cast<int>(std::ceil(glm::clamp(low - 0.5f, -1.0f, static_cast<float>(size)))); };
+	auto lastPixel = [](float high, int size) { return static_cast<int>(std::floor(glm::clamp(high - 0.5f, -1.0f, static_cast<float>(size)))); };
+
+	Triangle triangle;
+	triangle.v[0] = a;
+	triangle.v[1] = b;
+	triangle.v[2] = c;
+	triangle.minX = std::max(firstPixel(std::min(a.x, std::min(b.x, c.x)), WIDTH), 0);
+	triangle.maxX = std::min(lastPixel(std::max(a.x, std::max(b.x, c.x)), WIDTH), WIDTH - 1);
+	triangle.minY = std::max(firstPixel(std::min(a.y, std::min(b.y, c.y)), HEIGHT), 0);
+	triangle.maxY = std::min(lastPixel(std::max(a.y, std::max(b.y, c.y)), HEIGHT), HEIGHT - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) return;
+
+	triangles.push_back(triangle);
+}
+
+void SoftwareOcclusion::RasterizeRows(int firstRow, int lastRow)
+{
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (const Triangle& triangle : triangles)
+	{
+		int minY = std::max(triangle.minY, firstRow);
+		int maxY = std::min(triangle.maxY, lastRow - 1);
+		if (minY > maxY) continue;
+
+		// Edge functions, positive inside a counter-clockwise triangle
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int e = 0; e < 3; e++)
+		{
+			const glm::vec3& from = triangle.v[e];
+			const glm::vec3& to = triangle.v[(e + 1) % 3];
+			edgeA[e] = from.y - to.y;
+			edgeB[e] = to.x - from.x;
+			edgeC[e] = from.x * to.y - from.y * to.x;
+		}
+
+		// Depth is linear in screen space
+		glm::vec3 normal = glm::cross(triangle.v[1] - triangle.v[0], triangle.v[2] - triangle.v[0]);
+		float depthA = -normal.x / normal.z;
+		float depthB = -normal.y / normal.z;
+		float depthC = triangle.v[0].z - depthA * triangle.v[0].x - depthB * triangle.v[0].y;
+
+		__m128 a0 = _mm_set1_ps(edgeA[0]), a1 = _mm_set1_ps(edgeA[1]), a2 = _mm_set1_ps(edgeA[2]);
+		__m128 slopeX = _mm_set1_ps(depthA);
+		int startX = triangle.minX & ~3;
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			float py = y + 0.5f;
+			__m128 row0 = _mm_set1_ps(edgeB[0] * py + edgeC[0]);
+			__m128 row1 = _mm_set1_ps(edgeB[1] * py + edgeC[1]);
+			__m128 row2 = _mm_set1_ps(edgeB[2] * py + edgeC[2]);
+			__m128 rowDepth = _mm_set1_ps(depthB * py + depthC);
+			float* row = &depth[y * WIDTH];
+
+			// Four pixels a step, WIDTH is a multiple of 4 so a block never leaves the row
+			for (int x = startX; x <= triangle.maxX; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+				__m128 inside = _mm_and_ps(
+					_mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero),
+						_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+				if (_mm_movemask_ps(inside) == 0) continue;
+
+				__m128 z = _mm_max_ps(_mm_add_ps(_mm_mul_ps(slopeX, px), rowDepth), zero);
+				__m128 stored = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(stored, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, stored)));
+			}
+		}
+	}
+}
+
+bool SoftwareOcclusion::IsVisible(const BoundingSphere& bounds)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	bool visible = TestBounds(bounds);
+
+	frameTested++;
+	if (!visible) frameCulled++;
+	frameTestTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return visible;
+}
+
+void SoftwareOcclusion::AreVisible(const std::vector<BoundingSphere>& bounds, std::vector<unsigned char>& visible)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	visible.resize(bounds.size());
+	const size_t boundsPerJob = 64;
+	JobSystem::Get().ParallelFor(bounds.size(), boundsPerJob, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++)
+		{
+			visible[i] = TestBounds(bounds[i]) ? 1 : 0;
+		}
+	});
+
+	for (unsigned char seen : visible)
+	{
+		if (!seen) frameCulled++;
+	}
+	frameTested += static_cast<unsigned int>(bounds.size());
+	frameTestTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool SoftwareOcclusion::TestBounds(const BoundingSphere& bounds) const
+{
+	glm::vec2 minScreen(FLT_MAX), maxScreen(-FLT_MAX);
+	float nearest = 1.0f;
+	bool visible = false;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner = bounds.center + bounds.radius * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+		glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+		if (clip.z < -clip.w)
+		{
+			visible = true;		// reaches the near plane
+			break;
+		}
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		glm::vec2 screen((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT);
+		minScreen = glm::min(minScreen, screen);
+		maxScreen = glm::max(maxScreen, screen);
+		nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	if (!visible)
+	{
+		// Every pixel the box touches, off screen is left to frustum culling
+		int minX = std::max(static_cast<int>(std::floor(std::max(minScreen.x, -1.0f))), 0);
+		int maxX = std::min(static_cast<int>(std::floor(std::min(maxScreen.x, static_cast<float>(WIDTH)))), WIDTH - 1);
+		int minY = std::max(static_cast<int>(std::floor(std::max(minScreen.y, -1.0f))), 0);
+		int maxY = std::min(static_cast<int>(std::floor(std::min(maxScreen.y, static_cast<float>(HEIGHT)))), HEIGHT - 1);
+		visible = minX > maxX || minY > maxY;
+
+		// Hidden only if every occluder depth under it is nearer, whole blocks of 4 keep it conservative
+		__m128 boxDepth = _mm_set1_ps(nearest);
+		for (int y = minY; y <= maxY && !visible; y++)
+		{
+			const float* row = &depth[y * WIDTH];
+			for (int x = minX & ~3; x <= maxX; x += 4)
+			{
+				if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)))
+				{
+					visible = true;
+					break;
+				}
+			}
+		}
+	}
+
+	return visible;
+}
+
+void SoftwareOcclusion::EndFrame()
+{
+	totalOccluders += frameOccluders;
+	totalTriangles += frameTriangles;
+	totalTested += frameTested;
+	totalCulled += frameCulled;
+	totalRasterTime += frameRasterTime;
+	totalTestTime += frameTestTime;
+	totalFrames++;
+}
+
+void SoftwareOcclusion::ResetStats()
+{
+	totalOccluders = totalTriangles = totalTested = totalCulled = 0;
+	totalRasterTime = totalTestTime = 0.0;
+	totalFrames = 0;
+}
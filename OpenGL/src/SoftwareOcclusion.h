@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm\glm.hpp>
+
+#include "Bounds.h"
+
+// Stand-in geometry an object occludes with, object space and CPU only
+struct OccluderMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<GLuint> indices;
+
+	bool IsEmpty() const { return indices.empty(); }
+};
+
+// Positions from an 8 float vertex array like Mesh::CreateMesh takes, for occluders tagged by hand.
+// An occluder has to lie inside what it stands in for, anything it covers must really be hidden
+OccluderMesh MakeOccluder(const GLfloat* vertices, unsigned int numOfVertices, const GLuint* indices, unsigned int numOfIndices);
+
+// CPU occlusion culling. The biggest occluders on screen are rasterized into a small depth
+// buffer with SSE, split into row bands across threads, then object boxes are tested against
+// it before anything is submitted. No GL, so it runs the same without a context, and the
+// result doesn't depend on the thread count.
+class SoftwareOcclusion
+{
+public:
+	static const int WIDTH = 256;
+	static const int HEIGHT = 128;
+
+	SoftwareOcclusion();
+
+	// Per frame: Begin, AddOccluder for every candidate, Rasterize, then IsVisible per object
+	void Begin(const glm::mat4& viewProjection);
+	void AddOccluder(const OccluderMesh* mesh, const glm::mat4& transform, const BoundingSphere& bounds);
+	void Rasterize();
+
+	// Box around the sphere against the nearest occluder depth under it
+	bool IsVisible(const BoundingSphere& bounds);
+	// IsVisible for many at once, split across the job system
+	void AreVisible(const std::vector<BoundingSphere>& bounds, std::vector<unsigned char>& visible);
+
+	void SetMaxOccluders(unsigned int count) { maxOccluders = count; }
+	void SetWorkerCount(unsigned int count) { workerCount = count; }	// 0 leaves it to the job system
+
+	// NDC depth mapped to 0..1, row 0 at the bottom like GL, 1 where nothing was drawn
+	const float* GetDepth() const { return depth.data(); }
+
+	// Frame stats, EndFrame folds them into the running totals
+	unsigned int GetFrameOccluders() const { return frameOccluders; }
+	unsigned int GetFrameTriangles() const { return frameTriangles; }
+	unsigned int GetFrameTested() const { return frameTested; }
+	unsigned int GetFrameCulled() const { return frameCulled; }
+	double GetFrameRasterTime() const { return frameRasterTime; }
+	double GetFrameTestTime() const { return frameTestTime; }
+	double GetAverageRasterTime() const { return totalFrames ? totalRasterTime / totalFrames : 0.0; }
+	double GetAverageTestTime() const { return totalFrames ? totalTestTime / totalFrames : 0.0; }
+	double GetAverageOccluders() const { return totalFrames ? (double)totalOccluders / totalFrames : 0.0; }
+	double GetAverageTriangles() const { return totalFrames ? (double)totalTriangles / totalFrames : 0.0; }
+	double GetCullRate() const { return totalTested ? (double)totalCulled / totalTested : 0.0; }
+	void EndFrame();
+	void ResetStats();
+
+private:
+	struct Candidate
+	{
+		const OccluderMesh* mesh;
+		glm::mat4 transform;
+		float score;	// rough screen size, the biggest get drawn
+	};
+
+	// Screen space, x/y in pixels and z in 0..1
+	struct Triangle
+	{
+		glm::vec3 v[3];
+		int minX, maxX, minY, maxY;
+	};
+
+	void SetupTriangle(const glm::vec4 clip[3]);
+	void EmitTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+	void RasterizeRows(int firstRow, int lastRow);
+	bool TestBounds(const BoundingSphere& bounds) const;
+
+	glm::mat4 viewProjection;
+	std::vector<Candidate> candidates;
+	std::vector<Triangle> triangles;
+	std::vector<glm::vec4> clipPositions;
+	std::vector<float> depth;
+
+	unsigned int maxOccluders, workerCount;
+
+	unsigned int frameOccluders, frameTriangles, frameTested, frameCulled;
+	double frameRasterTime, frameTestTime;
+	unsigned long long totalOccluders, totalTriangles, totalTested, totalCulled;
+	double totalRasterTime, totalTestTime;
+	unsigned int totalFrames;
+};
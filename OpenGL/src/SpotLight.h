@@ -15,14 +15,15 @@ public:
 		GLfloat con, GLfloat lin, GLfloat exp,
 		GLfloat edg);
 
-	void UseLight(GLuint ambientIntensityLocation, GLuint ambientColourLocation,
-		GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint directionLocation,
-		GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation,
-		GLuint edgeLocation);
+	void GetLightData(SpotLightData& data) const;
 
 	void SetFlash(glm::vec3 pos, glm::vec3 dir);
 
 	void Toggle() { isOn = !isOn; }
+	bool IsOn() const { return isOn; }
+
+	const glm::vec3& GetDirection() const { return direction; }
+	GLfloat GetEdge() const { return procEdge; }	// cosine of the cone angle
 
 	~SpotLight();
 
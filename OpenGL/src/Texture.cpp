@@ -1,4 +1,5 @@
 #include "Texture.h"
+#include "GLState.h"
 #include <iostream>
 
 Texture::Texture()
@@ -8,6 +9,8 @@ Texture::Texture()
     height = 0;
     bitDepth = 0;
     fileLocation = "";
+    pixels = nullptr;
+    alpha = false;
 }
 
 Texture::Texture(const std::string& fileLoc)
@@ -17,18 +20,37 @@ Texture::Texture(const std::string& fileLoc)
     height = 0;
     bitDepth = 0;
     fileLocation = fileLoc;
+    pixels = nullptr;
+    alpha = false;
 }
 
 bool Texture::LoadTexture()
 {
-    unsigned char* texData = stbi_load(fileLocation.c_str(), &width, &height, &bitDepth, 0);
-    if (!texData) {
+    return Decode(false) && Upload();
+}
+
+bool Texture::LoadTextureA()
+{
+    return Decode(true) && Upload();
+}
+
+bool Texture::Decode(bool alpha)
+{
+    this->alpha = alpha;
+    pixels = stbi_load(fileLocation.c_str(), &width, &height, &bitDepth, alpha ? 4 : 0);
+    if (!pixels) {
         std::cout << "Failed to find: " << fileLocation << std::endl;
         return false;
     }
+    return true;
+}
+
+bool Texture::Upload()
+{
+    if (!pixels) return false;
 
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::BindTexture(GL_TEXTURE_2D, textureID);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -37,48 +59,46 @@ bool Texture::LoadTexture()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    if (alpha) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // safe for all channel counts
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+        if (glGetError() == GL_NO_ERROR)
+            glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::BindTexture(GL_TEXTURE_2D, 0);
 
-    stbi_image_free(texData);
+    stbi_image_free(pixels);
+    pixels = nullptr;
     return true;
 }
 
-bool Texture::LoadTextureA()
+AssetTask Texture::LoadAsync(bool alpha)
 {
-    unsigned char* texData = stbi_load(fileLocation.c_str(), &width, &height, &bitDepth, 4); // force RGBA
-    if (!texData) { std::cout << "Failed to find: " << fileLocation << std::endl; return false; }
-
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    co_await ResumeOnWorker();
+    if (!Decode(alpha)) co_return false;
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // safe for all channel counts
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texData);
-
-    if (glGetError() == GL_NO_ERROR)
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(texData);
-    return true;
+    co_await ResumeOnMainThread();
+    co_return Upload();
 }
 
 void Texture::UseTexture(GLenum texUnit)
 {
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::BindTexture(texUnit - GL_TEXTURE0, GL_TEXTURE_2D, textureID);
 }
 
 void Texture::ClearTexture()
 {
-    glDeleteTextures(1, &textureID);
+    if (pixels) {
+        stbi_image_free(pixels);
+        pixels = nullptr;
+    }
+    GLState::DeleteTexture(textureID);
     textureID = 0;
     width = 0;
     height = 0;
@@ -2,6 +2,7 @@
 
 #include<glad/glad.h>
 #include "CommonValues.h"
+#include "AssetTask.h"
 #include<string>
 
 class Texture
@@ -13,7 +14,14 @@ public:
 	bool LoadTexture();
 	bool LoadTextureA();
 
-	void UseTexture(GLenum texUnit = GL_TEXTURE0);
+	// LoadTexture in two halves: the file read and decode, safe on any thread, then the GL upload
+	// on the main thread. alpha decodes to RGBA like LoadTextureA
+	bool Decode(bool alpha);
+	bool Upload();
+	// Both halves as a coroutine, decoded on a worker and uploaded on the main thread
+	AssetTask LoadAsync(bool alpha);
+
+	void UseTexture(GLenum texUnit = GL_TEXTURE1);
 	void ClearTexture();
 
 	~Texture();
@@ -22,5 +30,8 @@ private:
 	GLuint textureID;
 	int width, height, bitDepth;
 
+	unsigned char* pixels;	// decoded and not yet uploaded
+	bool alpha;
+
 	std::string fileLocation;
 };
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "UniformBlocks.h"
+
+#include <string.h>
+
+#include "DirectionalLight.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+#include "Material.h"
+#include "LightAssignment.h"
+
+static_assert(ObjectLightList::MAX_LIGHTS == 8, "DrawBlock::objectLights is sized for 8 lights");
+
+UniformBlocks::UniformBlocks()
+{
+	frameBuffer = { 0, {}, false };
+	lightBuffer = { 0, {}, false };
+	drawBuffer = { 0, {}, false };
+
+	memset(&frame, 0, sizeof(frame));
+	memset(&lights, 0, sizeof(lights));
+	memset(&draw, 0, sizeof(draw));
+
+	ResetStats();
+}
+
+bool UniformBlocks::Init()
+{
+	GLint maxBindings = 0;
+	glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &maxBindings);
+	if (maxBindings <= DRAW_BLOCK_BINDING)
+	{
+		printf("Uniform blocks need %d binding points, only %d available\n", DRAW_BLOCK_BINDING + 1, maxBindings);
+		return false;
+	}
+
+	struct { Buffer* buffer; GLuint binding; GLsizeiptr size; } blocks[] = {
+		{ &frameBuffer, FRAME_BLOCK_BINDING, sizeof(FrameBlock) },
+		{ &lightBuffer, LIGHT_BLOCK_BINDING, sizeof(LightBlock) },
+		{ &drawBuffer, DRAW_BLOCK_BINDING, sizeof(DrawBlock) },
+	};
+
+	for (auto& block : blocks)
+	{
+		glGenBuffers(1, &block.buffer->id);
+		glBindBuffer(GL_UNIFORM_BUFFER, block.buffer->id);
+		glBufferData(GL_UNIFORM_BUFFER, block.size, nullptr, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, block.binding, block.buffer->id);
+
+		block.buffer->contents.assign(block.size, 0);
+		block.buffer->valid = false;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	return true;
+}
+
+void UniformBlocks::SetCamera(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& eyePosition)
+{
+	frame.projection = projection;
+	frame.view = view;
+	frame.eyePosition = eyePosition;
+	Upload(frameBuffer, &frame);
+}
+
+void UniformBlocks::SetDirectionalLight(DirectionalLight* dLight, const glm::mat4& lightTransform)
+{
+	dLight->GetLightData(lights.directionalLight);
+	lights.directionalLightTransform = lightTransform;
+	lights.directionalShadowFilter = dLight->GetShadowFilter();
+}
+
+void UniformBlocks::SetPointLights(PointLight* pLight, unsigned int lightCount, unsigned int offset)
+{
+	if (lightCount > MAX_POINT_LIGHTS) lightCount = MAX_POINT_LIGHTS;
+
+	lights.pointLightCount = lightCount;
+
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		pLight[i].GetLightData(lights.pointLights[i]);
+		lights.omniShadows[i + offset].farPlane = pLight[i].GetFarPlane();
+		lights.omniShadows[i + offset].filterTier = pLight[i].GetShadowFilter();
+	}
+}
+
+void UniformBlocks::SetSpotLights(SpotLight* sLight, unsigned int lightCount, unsigned int offset)
+{
+	if (lightCount > MAX_SPOT_LIGHTS) lightCount = MAX_SPOT_LIGHTS;
+
+	lights.spotLightCount = lightCount;
+
+	for (size_t i = 0; i < lightCount; i++)
+	{
+		sLight[i].GetLightData(lights.spotLights[i]);
+		lights.omniShadows[i + offset].farPlane = sLight[i].GetFarPlane();
+		lights.omniShadows[i + offset].filterTier = sLight[i].GetShadowFilter();
+	}
+}
+
+void UniformBlocks::UploadLights()
+{
+	Upload(lightBuffer, &lights);
+}
+
+void UniformBlocks::SetDraw(const glm::mat4& model, const Material* material, const ObjectLightList* objectLights, int drawSource)
+{
+	draw.model = model;
+	draw.specularIntensity = material->GetSpecularIntensity();
+	draw.shininess = material->GetShininess();
+	draw.drawSource = drawSource;
+
+	// nullptr leaves every shadowed light on and no listed lights
+	if (objectLights)
+	{
+		draw.objectLightCount = objectLights->count;
+		draw.culledLightMask = objectLights->culledMask;
+		memcpy(draw.objectLights, objectLights->lights, objectLights->count * sizeof(GLint));
+	}
+	else
+	{
+		draw.objectLightCount = 0;
+		draw.culledLightMask = 0;
+	}
+
+	Upload(drawBuffer, &draw);
+}
+
+void UniformBlocks::SetBatchedDraw(bool objectLights)
+{
+	// Without lights the records still supply transform and material, the block says no lights
+	draw.drawSource = objectLights ? DRAW_SOURCE_BATCH : DRAW_SOURCE_INSTANCE;
+	if (!objectLights)
+	{
+		draw.objectLightCount = 0;
+		draw.culledLightMask = 0;
+	}
+	Upload(drawBuffer, &draw);
+}
+
+void UniformBlocks::Upload(Buffer& buffer, const void* data)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	size_t size = buffer.contents.size();
+
+	size_t first = 0, last = size;
+	if (buffer.valid)
+	{
+		while (first < size && bytes[first] == buffer.contents[first]) first++;
+		if (first == size)
+		{
+			frameSkipped++;
+			return;
+		}
+		while (bytes[last - 1] == buffer.contents[last - 1]) last--;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer.id);
+	glBufferSubData(GL_UNIFORM_BUFFER, first, last - first, bytes + first);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	memcpy(buffer.contents.data() + first, bytes + first, last - first);
+	buffer.valid = true;
+
+	frameUploads++;
+	frameBytes += last - first;
+}
+
+void UniformBlocks::EndFrame()
+{
+	totalUploads += frameUploads;
+	totalSkipped += frameSkipped;
+	totalBytes += frameBytes;
+	totalFrames++;
+
+	frameUploads = 0;
+	frameSkipped = 0;
+	frameBytes = 0;
+}
+
+void UniformBlocks::ResetStats()
+{
+	frameUploads = 0;
+	frameSkipped = 0;
+	frameBytes = 0;
+	totalUploads = 0;
+	totalSkipped = 0;
+	totalBytes = 0;
+	totalFrames = 0;
+}
+
+void UniformBlocks::Release()
+{
+	if (frameBuffer.id) glDeleteBuffers(1, &frameBuffer.id);
+	if (lightBuffer.id) glDeleteBuffers(1, &lightBuffer.id);
+	if (drawBuffer.id) glDeleteBuffers(1, &drawBuffer.id);
+	frameBuffer.id = lightBuffer.id = drawBuffer.id = 0;
+}
+
+UniformBlocks::~UniformBlocks()
+{
+	Release();
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "CommonValues.h"
+
+class DirectionalLight;
+class PointLight;
+class SpotLight;
+class Material;
+struct ObjectLightList;
+
+// std140 mirrors of the blocks in Shaders/uniform_blocks.glsl, padding spelled out.
+// vec3 takes 16 bytes unless a scalar follows it, structs and array elements round up to 16.
+struct LightData
+{
+	glm::vec3 colour;
+	GLfloat ambientIntensity;
+	GLfloat diffuseIntensity;
+	GLfloat pad[3];
+};
+
+struct DirectionalLightData
+{
+	LightData base;
+	glm::vec3 direction;
+	GLfloat pad;
+};
+
+struct PointLightData
+{
+	LightData base;
+	glm::vec3 position;
+	GLfloat constant;
+	GLfloat linear;
+	GLfloat exponent;
+	GLfloat pad[2];
+};
+
+struct SpotLightData
+{
+	PointLightData base;
+	glm::vec3 direction;
+	GLfloat edge;
+};
+
+struct OmniShadowData
+{
+	GLfloat farPlane;
+	GLint filterTier;
+	GLfloat pad[2];
+};
+
+struct FrameBlock
+{
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec3 eyePosition;
+	GLfloat pad;
+};
+
+struct LightBlock
+{
+	DirectionalLightData directionalLight;
+	PointLightData pointLights[MAX_POINT_LIGHTS];
+	SpotLightData spotLights[MAX_SPOT_LIGHTS];
+	OmniShadowData omniShadows[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+	glm::mat4 directionalLightTransform;
+	GLint pointLightCount;
+	GLint spotLightCount;
+	GLint directionalShadowFilter;
+	GLint pad;
+};
+
+struct DrawBlock
+{
+	glm::mat4 model;
+	GLfloat specularIntensity;
+	GLfloat shininess;
+	GLint objectLightCount;
+	GLint culledLightMask;
+	GLint objectLights[8];		// ivec4[2] in the shader
+	GLint drawSource;			// DrawSource
+	GLint pad[3];
+};
+
+static_assert(sizeof(FrameBlock) == 144, "FrameBlock no longer matches std140");
+static_assert(sizeof(LightBlock) == 656, "LightBlock no longer matches std140");
+static_assert(sizeof(DrawBlock) == 128, "DrawBlock no longer matches std140");
+
+// One GL buffer per block, shared by every program through the fixed binding points.
+// Uploads compare against what the GPU already holds and send only the changed
+// byte range in a single glBufferSubData, or nothing at all.
+class UniformBlocks
+{
+public:
+	UniformBlocks();
+
+	bool Init();
+
+	// Per view
+	void SetCamera(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& eyePosition);
+
+	// Per frame, sent by UploadLights
+	void SetDirectionalLight(DirectionalLight* dLight, const glm::mat4& lightTransform);
+	void SetPointLights(PointLight* pLight, unsigned int lightCount, unsigned int offset);
+	void SetSpotLights(SpotLight* sLight, unsigned int lightCount, unsigned int offset);
+	void UploadLights();
+
+	// Per draw, objectLights may be nullptr. Instanced draws ignore model and material
+	void SetDraw(const glm::mat4& model, const Material* material, const ObjectLightList* objectLights, int drawSource = DRAW_SOURCE_BLOCK);
+	// DrawBatch carries everything per draw, the block only says so. Without objectLights the
+	// batch's light lists are ignored, like SetDraw with nullptr
+	void SetBatchedDraw(bool objectLights = true);
+
+	// Frame stats, EndFrame folds them into the running totals
+	unsigned int GetFrameUploads() const { return frameUploads; }
+	unsigned int GetFrameSkipped() const { return frameSkipped; }
+	size_t GetFrameBytes() const { return frameBytes; }
+	double GetAverageUploads() const { return totalFrames ? (double)totalUploads / totalFrames : 0.0; }
+	double GetAverageBytes() const { return totalFrames ? (double)totalBytes / totalFrames : 0.0; }
+	double GetAverageSkipped() const { return totalFrames ? (double)totalSkipped / totalFrames : 0.0; }
+	void EndFrame();
+	void ResetStats();
+
+	// Deletes the buffers, while the context is still current
+	void Release();
+
+	~UniformBlocks();
+
+private:
+	struct Buffer
+	{
+		GLuint id;
+		std::vector<unsigned char> contents;	// what the GPU copy holds
+		bool valid;
+	};
+
+	void Upload(Buffer& buffer, const void* data);
+
+	Buffer frameBuffer, lightBuffer, drawBuffer;
+
+	FrameBlock frame;
+	LightBlock lights;
+	DrawBlock draw;
+
+	unsigned int frameUploads, frameSkipped;
+	size_t frameBytes;
+	unsigned long long totalUploads, totalSkipped, totalBytes;
+	unsigned int totalFrames;
+};
@@ -0,0 +1,146 @@
+#include "VarianceShadowMap.h"
+
+#include "Shader.h"
+#include "FullscreenTriangle.h"
+#include "GLState.h"
+
+Shader* VarianceShadowMap::blurShader = nullptr;
+GLint VarianceShadowMap::uniformBlurStep = -1;
+
+VarianceShadowMap::VarianceShadowMap() : ShadowMap()
+{
+	depthBuffer = 0;
+	blurFBO[0] = blurFBO[1] = 0;
+	blurMap[0] = blurMap[1] = 0;
+	blurWidth = blurHeight = 0;
+}
+
+static GLuint CreateMomentsTexture(unsigned int width, unsigned int height, bool mipmapped)
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	GLState::BindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, nullptr);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Outside the map counts as lit, same as the depth map border
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	float borderColor[] = { 1.0f, 1.0f, 0.0f, 0.0f };
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+	if (mipmapped)
+	{
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	return texture;
+}
+
+bool VarianceShadowMap::Init(unsigned int width, unsigned int height)
+{
+	shadowWidth = width; shadowHeight = height;
+	blurWidth = width > 1 ? width / 2 : 1;
+	blurHeight = height > 1 ? height / 2 : 1;
+
+	// Moments target, shadowMap holds the full resolution moments here
+	shadowMap = CreateMomentsTexture(width, height, false);
+
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &FBO);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, FBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, shadowMap, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Variance shadow framebuffer error: " << status << std::endl;
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+		return false;
+	}
+
+	// Half resolution ping-pong targets, the second one ends up mipmapped and is what gets sampled
+	glGenFramebuffers(2, blurFBO);
+	for (int i = 0; i < 2; i++)
+	{
+		blurMap[i] = CreateMomentsTexture(blurWidth, blurHeight, i == 1);
+
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, blurFBO[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurMap[i], 0);
+
+		status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Variance shadow blur framebuffer error: " << status << std::endl;
+			GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+			return false;
+		}
+	}
+
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+	return true;
+}
+
+void VarianceShadowMap::Write()
+{
+	GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+}
+
+void VarianceShadowMap::Read(GLenum texUnit)
+{
+	GLState::BindTexture(texUnit - GL_TEXTURE0, GL_TEXTURE_2D, blurMap[1]);
+}
+
+void VarianceShadowMap::Prefilter()
+{
+	if (!blurShader)
+	{
+		blurShader = new Shader();
+		blurShader->CreateFromFiles("Shaders/fullscreen.vert", "Shaders/vsm_blur.frag");
+		uniformBlurStep = glGetUniformLocation(blurShader->GetShaderID(), "blurStep");
+	}
+
+	blurShader->UseShader();
+	GLState::SetEnabled(GL_DEPTH_TEST, false);
+	GLState::Viewport(0, 0, blurWidth, blurHeight);
+
+	// Horizontal, full resolution into half: the bilinear taps also do the 2x2 downsample
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, blurFBO[0]);
+	GLState::BindTexture(0, GL_TEXTURE_2D, shadowMap);
+	glUniform2f(uniformBlurStep, 1.0f / blurWidth, 0.0f);
+	FullscreenTriangle::Draw();
+
+	// Vertical
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, blurFBO[1]);
+	GLState::BindTexture(0, GL_TEXTURE_2D, blurMap[0]);
+	glUniform2f(uniformBlurStep, 0.0f, 1.0f / blurHeight);
+	FullscreenTriangle::Draw();
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, blurMap[1]);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+	GLState::SetEnabled(GL_DEPTH_TEST, true);
+	GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+VarianceShadowMap::~VarianceShadowMap()
+{
+	if (depthBuffer)
+	{
+		glDeleteRenderbuffers(1, &depthBuffer);
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		GLState::DeleteFramebuffer(blurFBO[i]);
+		GLState::DeleteTexture(blurMap[i]);
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "ShadowMap.h"
+
+class Shader;
+
+// Shadow pass writes depth moments, Prefilter() blurs them separably at half
+// resolution and builds mips, so the lit pass needs a single filtered fetch.
+class VarianceShadowMap : public ShadowMap
+{
+public:
+	VarianceShadowMap();
+
+	bool Init(unsigned int width, unsigned int height) override;
+	void Write() override;
+	void Read(GLenum TextureUnit) override;
+	void SetFiltering(bool linear) override {}
+	void Prefilter() override;
+
+	~VarianceShadowMap();
+
+private:
+	GLuint depthBuffer;
+	GLuint blurFBO[2], blurMap[2];
+	GLuint blurWidth, blurHeight;
+
+	static Shader* blurShader;
+	static GLint uniformBlurStep;
+};
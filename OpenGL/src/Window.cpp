@@ -1,47 +1,74 @@
 #include "Window.h"
-
-Window::Window() : width(800), height(600), mainWindow(nullptr), bufferWidth(0), bufferHeight(0) {
-}
+#include "GLState.h"
+#include "GlfwWindow.h"
+#include "HeadlessWindow.h"
 
 Window::Window(GLint windowWidth, GLint windowHeight)
-    : width(windowWidth), height(windowHeight), mainWindow(nullptr), bufferWidth(0), bufferHeight(0) {
+    : width(windowWidth), height(windowHeight), bufferWidth(0), bufferHeight(0),
+      offscreenFramebuffer(0), offscreenColour(0), offscreenDepth(0), resizeCallback(nullptr) {
 }
-int Window::Initialise() {
-    if (!glfwInit()) {
-        std::cout << "Failed to initialize GLFW" << std::endl;
-        return -1;
-    }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    mainWindow = glfwCreateWindow(width, height, "OpenGL Window", nullptr, nullptr);
-    if (!mainWindow) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+Window* Window::Create(GLint windowWidth, GLint windowHeight, bool headless) {
+    if (headless) {
+        Window* window = new HeadlessWindow(windowWidth, windowHeight);
+        if (window->Initialise() == 0) return window;
+        delete window;
+        std::cout << "No headless context, trying a hidden GLFW window" << std::endl;
     }
-    glfwMakeContextCurrent(mainWindow);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    Window* window = new GlfwWindow(windowWidth, windowHeight, !headless);
+    if (window->Initialise() == 0) return window;
+    delete window;
+    return nullptr;
+}
+
+bool Window::LoadGL() {
+    if (!gladLoadGLLoader(getProcLoader())) {
         std::cout << "Failed to initialize GLAD" << std::endl;
-        glfwDestroyWindow(mainWindow);
-        glfwTerminate();
-        return -1;
+        return false;
     }
 
-    glEnable(GL_DEPTH_TEST);
+    GLState::SetEnabled(GL_DEPTH_TEST, true);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    return true;
+}
+
+// Depth and stencil together like a window's, the Hi-Z copy blits from it
+bool Window::CreateOffscreenTarget() {
+    glGenRenderbuffers(1, &offscreenColour);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenColour);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &offscreenDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
-    glfwGetFramebufferSize(mainWindow, &bufferWidth, &bufferHeight);
-    glViewport(0, 0, bufferWidth, bufferHeight);
+    glGenFramebuffers(1, &offscreenFramebuffer);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColour);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
 
-    return 0;
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "Offscreen framebuffer error: 0x" << std::hex << status << std::dec << std::endl;
+        DestroyOffscreenTarget();
+        return false;
+    }
+
+    GLState::SetDefaultFramebuffer(offscreenFramebuffer);
+    bufferWidth = width;
+    bufferHeight = height;
+    GLState::Viewport(0, 0, bufferWidth, bufferHeight);
+    return true;
 }
 
-Window::~Window() {
-    if (mainWindow) {
-        glfwDestroyWindow(mainWindow);
+void Window::DestroyOffscreenTarget() {
+    if (offscreenFramebuffer) {
+        GLState::SetDefaultFramebuffer(0);
+        GLState::DeleteFramebuffer(offscreenFramebuffer);
     }
-    glfwTerminate();
-}
\ No newline at end of file
+    if (offscreenColour) glDeleteRenderbuffers(1, &offscreenColour);
+    if (offscreenDepth) glDeleteRenderbuffers(1, &offscreenDepth);
+    offscreenFramebuffer = offscreenColour = offscreenDepth = 0;
+}
@@ -3,23 +3,41 @@
 #include<iostream>
 
 #include<glad/glad.h>
-#include<GLFW/glfw3.h>
 
+struct GLFWwindow;
+
+// Where the GL context comes from. GlfwWindow is a window on screen with input, HeadlessWindow
+// a context with no display at all. Either can render offscreen, into a framebuffer that stands
+// in for the default one through GLState, so the renderer never knows the difference
 class Window
 {
 
-private:
-	GLFWwindow* mainWindow;
+protected:
 	GLint width, height;
 	GLint bufferWidth, bufferHeight;
 
-public:
-	Window();
+	GLuint offscreenFramebuffer, offscreenColour, offscreenDepth;
+	void (*resizeCallback)(int width, int height);
+
 	Window(GLint windowWidth, GLint windowHeight);
 
-	GLFWwindow* getWindow() const { return mainWindow; }
+	// Once a context is current
+	bool LoadGL();
+	bool CreateOffscreenTarget();
+	// Before the context goes
+	void DestroyOffscreenTarget();
+
+public:
+	// An initialised window or nullptr. Headless falls back to a hidden GLFW window when there's
+	// neither EGL nor OSMesa to be had, offscreen all the same
+	static Window* Create(GLint windowWidth, GLint windowHeight, bool headless);
+
+	virtual int Initialise() = 0;
 
-	int Initialise();
+	// Null when the window takes no input
+	virtual GLFWwindow* getWindow() const { return nullptr; }
+	virtual GLADloadproc getProcLoader() const = 0;
+	bool isOffscreen() const { return offscreenFramebuffer != 0; }
 
 	GLfloat getBufferWidth() {
 		return bufferWidth;
@@ -28,17 +46,17 @@ public:
 		return bufferHeight;
 	}
 
-	bool getShouldClose() {
-		return glfwWindowShouldClose(mainWindow);
+	// Called with the new framebuffer size, offscreen targets never change size
+	void setResizeCallback(void (*callback)(int width, int height)) {
+		resizeCallback = callback;
 	}
 
-	void swapBuffers() {
-		glfwSwapBuffers(mainWindow);
-	}
+	// Swaps per vertical blank, 0 for none. Nothing to wait on offscreen
+	virtual void setSwapInterval(int interval) {}
 
-	void pollEvents() {
-		glfwPollEvents();
-	}
+	virtual bool getShouldClose() = 0;
+	virtual void swapBuffers() = 0;
+	virtual void pollEvents() = 0;
 
-	~Window();
-};
\ No newline at end of file
+	virtual ~Window() {}
+};
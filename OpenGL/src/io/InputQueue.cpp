@@ -0,0 +1,50 @@
+#include "InputQueue.h"
+
+#include "keyboard.h"
+#include "mouse.h"
+
+InputQueue::InputQueue() : head(0), tail(0), dropped(0) {
+}
+
+bool InputQueue::push(const InputEvent& event) {
+	unsigned int write = tail.load(std::memory_order_relaxed);
+	if (write - head.load(std::memory_order_acquire) >= CAPACITY) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	slots[write & (CAPACITY - 1)] = event;
+	tail.store(write + 1, std::memory_order_release);
+	return true;
+}
+
+bool InputQueue::pop(InputEvent& event) {
+	unsigned int read = head.load(std::memory_order_relaxed);
+	if (read == tail.load(std::memory_order_acquire)) return false;
+
+	event = slots[read & (CAPACITY - 1)];
+	head.store(read + 1, std::memory_order_release);
+	return true;
+}
+
+InputQueue& InputQueue::events() {
+	static InputQueue queue;
+	return queue;
+}
+
+void InputQueue::dispatch(const InputEvent& event) {
+	switch (event.type) {
+	case InputEventType::KEY:
+		Keyboard::keyEvent(event.code, event.action, event.time);
+		break;
+	case InputEventType::MOUSE_BUTTON:
+		Mouse::buttonEvent(event.code, event.action);
+		break;
+	case InputEventType::CURSOR:
+		Mouse::cursorEvent(event.x, event.y);
+		break;
+	case InputEventType::SCROLL:
+		Mouse::scrollEvent(event.x, event.y);
+		break;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <atomic>
+
+enum class InputEventType : unsigned char {
+	KEY,
+	MOUSE_BUTTON,
+	CURSOR,
+	SCROLL
+};
+
+struct InputEvent {
+	InputEventType type;
+	int code;		// key or button
+	int action;		// GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+	double x, y;	// cursor position or scroll offsets
+	double time;	// glfwGetTime() when it came in
+};
+
+// Lock-free single producer, single consumer ring of input events. The GLFW callbacks push,
+// the frame pops everything at once when it reads input, so nothing a poll delivers is lost or
+// overwritten and each event keeps the time it arrived. Either side may be on its own thread.
+// A full queue drops new events and counts them
+class InputQueue {
+public:
+	static const unsigned int CAPACITY = 1024;	// power of two
+
+	InputQueue();
+
+	// Producer side
+	bool push(const InputEvent& event);
+	// Consumer side, false once empty
+	bool pop(InputEvent& event);
+
+	unsigned int getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+	// The one the window's callbacks fill
+	static InputQueue& events();
+	// Hands an event to Keyboard or Mouse
+	static void dispatch(const InputEvent& event);
+
+private:
+	InputEvent slots[CAPACITY];
+
+	// Both only ever count up, the slot is the count modulo CAPACITY. Apart so the two sides
+	// don't share a cache line
+	alignas(64) std::atomic<unsigned int> head;	// next to pop, written by the consumer
+	alignas(64) std::atomic<unsigned int> tail;	// next to push, written by the producer
+	std::atomic<unsigned int> dropped;
+};
+
+#endif
@@ -0,0 +1,226 @@
+#include "InputRecorder.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "keyboard.h"
+#include "mouse.h"
+
+static const char RECORDING_MAGIC[4] = { 'O', 'G', 'L', 'I' };
+static const uint32_t RECORDING_VERSION = 2;
+static const unsigned char LATE_EVENT = 0x80;
+
+InputRecorder* InputRecorder::active = nullptr;
+
+InputRecorder::InputRecorder()
+	: file(nullptr), framePending(false), late(false), replaying(false), aborted(false), window(nullptr), timestep(0.0), frame(0) {
+	pending.time = 0.0;
+}
+
+bool InputRecorder::startRecording(const char* path) {
+	stop();
+
+	file = fopen(path, "wb");
+	if (!file) {
+		printf("Failed to write %s\n", path);
+		return false;
+	}
+	fwrite(RECORDING_MAGIC, 1, sizeof(RECORDING_MAGIC), file);
+	fwrite(&RECORDING_VERSION, sizeof(RECORDING_VERSION), 1, file);
+	return true;
+}
+
+bool InputRecorder::startReplay(const char* path, GLFWwindow* window, double timestep) {
+	stop();
+
+	FILE* input = fopen(path, "rb");
+	if (!input) {
+		printf("Failed to open %s\n", path);
+		return false;
+	}
+	bool read = readFrames(input);
+	fclose(input);
+	if (!read) {
+		printf("%s is not an input recording\n", path);
+		return false;
+	}
+
+	replaying = true;
+	aborted = false;
+	this->window = window;
+	this->timestep = timestep;
+	frame = 0;
+
+	// Anything queued before now isn't in the recording
+	InputEvent event;
+	while (InputQueue::events().pop(event)) {}
+
+	active = this;
+	if (window) {
+		glfwSetKeyCallback(window, keyCallback);
+		glfwSetMouseButtonCallback(window, nullptr);
+		glfwSetCursorPosCallback(window, nullptr);
+		glfwSetScrollCallback(window, nullptr);
+	}
+	return true;
+}
+
+bool InputRecorder::readFrames(FILE* input) {
+	char magic[4];
+	uint32_t version = 0;
+	if (fread(magic, 1, sizeof(magic), input) != sizeof(magic) || memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0) return false;
+	if (fread(&version, sizeof(version), 1, input) != 1 || version != RECORDING_VERSION) return false;
+
+	// A session that didn't get to stop still has every frame written before it ended
+	frames.clear();
+	RecordedFrame recorded;
+	uint16_t eventCount;
+	while (fread(&recorded.time, sizeof(recorded.time), 1, input) == 1 && fread(&eventCount, sizeof(eventCount), 1, input) == 1) {
+		recorded.events.resize(eventCount);
+		for (RecordedEvent& recordedEvent : recorded.events) {
+			InputEvent& event = recordedEvent.event;
+			unsigned char type;
+			if (fread(&type, 1, 1, input) != 1 || fread(&event.time, sizeof(event.time), 1, input) != 1) return !frames.empty();
+			recordedEvent.late = (type & LATE_EVENT) != 0;
+			event.type = static_cast<InputEventType>(type & ~LATE_EVENT);
+			event.code = event.action = 0;
+			event.x = event.y = 0.0;
+
+			bool complete = true;
+			if (event.type == InputEventType::KEY) {
+				uint16_t key;
+				uint8_t action;
+				complete = fread(&key, sizeof(key), 1, input) == 1 && fread(&action, 1, 1, input) == 1;
+				event.code = key;
+				event.action = action;
+			}
+			else if (event.type == InputEventType::MOUSE_BUTTON) {
+				uint8_t button, action;
+				complete = fread(&button, 1, 1, input) == 1 && fread(&action, 1, 1, input) == 1;
+				event.code = button;
+				event.action = action;
+			}
+			else {
+				complete = fread(&event.x, sizeof(event.x), 1, input) == 1 && fread(&event.y, sizeof(event.y), 1, input) == 1;
+			}
+			if (!complete) return !frames.empty();
+		}
+		frames.push_back(recorded);
+	}
+	return !frames.empty();
+}
+
+void InputRecorder::writeFrame(const RecordedFrame& recorded) {
+	uint16_t eventCount = static_cast<uint16_t>(recorded.events.size());
+	fwrite(&recorded.time, sizeof(recorded.time), 1, file);
+	fwrite(&eventCount, sizeof(eventCount), 1, file);
+
+	for (uint16_t i = 0; i < eventCount; i++) {
+		const InputEvent& event = recorded.events[i].event;
+		unsigned char type = static_cast<unsigned char>(event.type) | (recorded.events[i].late ? LATE_EVENT : 0);
+		fwrite(&type, 1, 1, file);
+		fwrite(&event.time, sizeof(event.time), 1, file);
+
+		if (event.type == InputEventType::KEY) {
+			uint16_t key = static_cast<uint16_t>(event.code);
+			uint8_t action = static_cast<uint8_t>(event.action);
+			fwrite(&key, sizeof(key), 1, file);
+			fwrite(&action, 1, 1, file);
+		}
+		else if (event.type == InputEventType::MOUSE_BUTTON) {
+			uint8_t button = static_cast<uint8_t>(event.code);
+			uint8_t action = static_cast<uint8_t>(event.action);
+			fwrite(&button, 1, 1, file);
+			fwrite(&action, 1, 1, file);
+		}
+		else {
+			fwrite(&event.x, sizeof(event.x), 1, file);
+			fwrite(&event.y, sizeof(event.y), 1, file);
+		}
+	}
+}
+
+void InputRecorder::record(const InputEvent& event) {
+	// More than a frame can hold is a frame nobody would want back
+	if (!file || !framePending || pending.events.size() >= UINT16_MAX) return;
+
+	RecordedEvent recorded = { event, late };
+	pending.events.push_back(recorded);
+}
+
+double InputRecorder::beginFrame(double time) {
+	late = false;
+
+	if (file) {
+		// The last frame's events are all in once the next one starts
+		if (framePending) writeFrame(pending);
+		pending.time = time;
+		pending.events.clear();
+		framePending = true;
+		frame++;
+		return time;
+	}
+
+	if (!replaying || isFinished()) return time;
+
+	queueEvents(false);
+	frame++;
+	return timestep > 0.0 ? frame * timestep : frames[frame - 1].time;
+}
+
+void InputRecorder::beginLateInput() {
+	late = true;
+	if (replaying && frame > 0 && frame <= frames.size()) queueEvents(true);
+}
+
+// On a fixed step the events keep their place between the frame before and this one
+void InputRecorder::queueEvents(bool lateEvents) {
+	unsigned int index = lateEvents ? frame - 1 : frame;
+	const RecordedFrame& recorded = frames[index];
+
+	double recordedStart = index > 0 ? frames[index - 1].time : 0.0;
+	double recordedSpan = recorded.time - recordedStart;
+	double start = index * timestep;
+
+	for (const RecordedEvent& recordedEvent : recorded.events) {
+		if (recordedEvent.late != lateEvents) continue;
+
+		InputEvent event = recordedEvent.event;
+		if (timestep > 0.0) {
+			double position = recordedSpan > 0.0 ? (event.time - recordedStart) / recordedSpan : 1.0;
+			event.time = start + position * timestep;
+		}
+		InputQueue::events().push(event);
+	}
+}
+
+void InputRecorder::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) active->aborted = true;
+}
+
+void InputRecorder::stop() {
+	if (file) {
+		if (framePending) writeFrame(pending);
+		fclose(file);
+		file = nullptr;
+	}
+	pending.events.clear();
+	framePending = false;
+
+	// Live input back to Keyboard and Mouse
+	if (replaying && window) {
+		glfwSetKeyCallback(window, Keyboard::keyCallback);
+		glfwSetMouseButtonCallback(window, Mouse::mouseButtonCallback);
+		glfwSetCursorPosCallback(window, Mouse::cursorPosCallback);
+		glfwSetScrollCallback(window, Mouse::scrollCallback);
+	}
+	replaying = false;
+	window = nullptr;
+	frames.clear();
+	frame = 0;
+}
+
+InputRecorder::~InputRecorder() {
+	stop();
+	if (active == this) active = nullptr;
+}
@@ -0,0 +1,81 @@
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include <cstdio>
+#include <vector>
+
+#include<glad/glad.h>
+#include<GLFW/glfw3.h>
+
+#include "InputQueue.h"
+
+// Records a session's input events and frame times to a file, and plays them back. Events are
+// recorded as the frame takes them off the InputQueue, early with the rest of its input or late
+// just before the view is built, and a replay puts each back on the queue for the same frame
+// and stage. The camera, sun and seahawk come out the same whatever machine runs it.
+// Recordings start with the program, Keyboard and Mouse begin from the same state either way.
+//
+// The file is a short header then per frame: the frame's time (double), its event count
+// (uint16) and the events, a type byte with the top bit set for late ones, the event's time
+// (double) and its own few bytes
+class InputRecorder {
+public:
+	InputRecorder();
+
+	bool startRecording(const char* path);
+	// timestep > 0 replays on a fixed step, otherwise at the recorded frame times. Live input
+	// would make the run differ from the recording, window's callbacks are taken until stop and
+	// only listen for Esc. window may be null
+	bool startReplay(const char* path, GLFWwindow* window, double timestep = 0.0);
+	void stop();
+
+	bool isRecording() const { return file != nullptr; }
+	bool isReplaying() const { return replaying; }
+	// The replay has run out of frames or Esc was pressed
+	bool isFinished() const { return replaying && (frame >= frames.size() || aborted); }
+	// Frames recorded or replayed so far
+	unsigned int getFrame() const { return frame; }
+
+	// Before each frame's input is read, with the clock's time. Gives the time the frame runs
+	// at, a replay's rather than the clock's, having queued a replay's early events
+	double beginFrame(double time);
+	// Before the late input is read, queues a replay's late events
+	void beginLateInput();
+	// Every event the frame takes off the queue, while recording
+	void record(const InputEvent& event);
+
+	~InputRecorder();
+
+private:
+	struct RecordedEvent {
+		InputEvent event;
+		bool late;
+	};
+
+	struct RecordedFrame {
+		double time;
+		std::vector<RecordedEvent> events;
+	};
+
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+
+	static InputRecorder* active;
+
+	void writeFrame(const RecordedFrame& recorded);
+	bool readFrames(FILE* input);
+	void queueEvents(bool late);
+
+	FILE* file;
+	RecordedFrame pending;		// the frame being recorded
+	bool framePending;
+	bool late;
+
+	bool replaying;
+	bool aborted;
+	GLFWwindow* window;
+	double timestep;
+	std::vector<RecordedFrame> frames;
+	unsigned int frame;
+};
+
+#endif
@@ -60,6 +60,16 @@ void Camera::updateCameraZoom(double dy) {
     }
 }
 
+void Camera::lookAt(glm::vec3 position, glm::vec3 target) {
+    cameraPos = position;
+
+    glm::vec3 direction = glm::normalize(target - position);
+    // Same limit as the mouse, straight up or down has no right vector
+    pitch = glm::clamp(glm::degrees(asinf(glm::clamp(direction.y, -1.0f, 1.0f))), -89.0f, 89.0f);
+    yaw = glm::degrees(atan2f(direction.z, direction.x));
+    updateCameraVectors();
+}
+
 glm::mat4 Camera::getViewMatrix() {
     return glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 }
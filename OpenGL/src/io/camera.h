@@ -32,6 +32,8 @@ public:
     void updateCameraDirection(double dx, double dy);
     void updateCameraPos(CameraDirection dir, double dt);
     void updateCameraZoom(double dy);
+    // Moves to position facing target, yaw and pitch follow
+    void lookAt(glm::vec3 position, glm::vec3 target);
 
     glm::vec3 getCameraPosition();
     glm::vec3 getCameraDirection();
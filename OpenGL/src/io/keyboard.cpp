@@ -1,20 +1,41 @@
 #include "keyboard.h"
+#include "InputQueue.h"
+
+#include <algorithm>
 
 bool Keyboard::keys[GLFW_KEY_LAST + 1] = { 0 };
 bool Keyboard::keysChanged[GLFW_KEY_LAST + 1] = { 0 };
+bool Keyboard::keysWentDown[GLFW_KEY_LAST + 1] = { 0 };
+bool Keyboard::keysWentUp[GLFW_KEY_LAST + 1] = { 0 };
+
+double Keyboard::pressTime[GLFW_KEY_LAST + 1] = { 0 };
+double Keyboard::releasedHeld[GLFW_KEY_LAST + 1] = { 0 };
+double Keyboard::sampleTime[GLFW_KEY_LAST + 1] = { 0 };
 
 void Keyboard::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (key < 0 || key > GLFW_KEY_LAST) return; // bounds check
+    if (action == GLFW_REPEAT) return;
+
+    InputEvent event = { InputEventType::KEY, key, action, 0.0, 0.0, glfwGetTime() };
+    InputQueue::events().push(event);
+}
+
+void Keyboard::keyEvent(int key, int action, double time) {
+    if (key < 0 || key > GLFW_KEY_LAST) return; // bounds check
 
     if (action == GLFW_PRESS) {
         if (!keys[key]) {
             keys[key] = true;
             keysChanged[key] = true;
+            keysWentDown[key] = true;
+            pressTime[key] = time;
         }
     } else if (action == GLFW_RELEASE) {
         if (keys[key]) {
             keys[key] = false;
             keysChanged[key] = true;
+            keysWentUp[key] = true;
+            releasedHeld[key] += std::max(0.0, time - std::max(pressTime[key], sampleTime[key]));
         }
     }
     // Do nothing for GLFW_REPEAT
@@ -34,10 +55,28 @@ bool Keyboard::keyChanged(int key) {
 
 bool Keyboard::keyWentUp(int key) {
     if (key < 0 || key > GLFW_KEY_LAST) return false;
-    return !keys[key] && keyChanged(key);
+    bool ret = keysWentUp[key];
+    keysWentUp[key] = false;
+    keysChanged[key] = false;
+    return ret;
 }
 
 bool Keyboard::keyWentDown(int key) {
     if (key < 0 || key > GLFW_KEY_LAST) return false;
-    return keys[key] && keyChanged(key);
-}
\ No newline at end of file
+    bool ret = keysWentDown[key];
+    keysWentDown[key] = false;
+    keysChanged[key] = false;
+    return ret;
+}
+
+double Keyboard::heldTime(int key, double from, double to) {
+    if (key < 0 || key > GLFW_KEY_LAST) return 0.0;
+
+    // A press that came in after to counts from the next frame on
+    double held = releasedHeld[key];
+    if (keys[key]) held += std::max(0.0, to - std::max(pressTime[key], from));
+
+    releasedHeld[key] = 0.0;
+    sampleTime[key] = to;
+    return held;
+}
@@ -6,17 +6,30 @@
 
 class Keyboard {
 public:
+	// Queues the key for the frame, see InputQueue
 	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+	// A queued key reaching the frame
+	static void keyEvent(int key, int action, double time);
 
 	//acessors
 	static bool key(int key);
 	static bool keyChanged(int key);
+	// Both latch until asked, a press and release between two frames still went down once
 	static bool keyWentUp(int key);
 	static bool keyWentDown(int key);
+	// How long key was down between from and to, counting presses and releases in between.
+	// Asked once per frame with the frame's span
+	static double heldTime(int key, double from, double to);
 
 private:
 	static bool keys[];
 	static bool keysChanged[];
+	static bool keysWentDown[];
+	static bool keysWentUp[];
+
+	static double pressTime[];		// when the key last went down
+	static double releasedHeld[];	// time held in presses that ended since heldTime last asked
+	static double sampleTime[];		// the to of the last heldTime
 };
 
-#endif
\ No newline at end of file
+#endif
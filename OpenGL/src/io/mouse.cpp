@@ -1,4 +1,5 @@
 #include"mouse.h"
+#include"InputQueue.h"
 
 double Mouse::x = 0;
 double Mouse::y = 0;
@@ -14,10 +15,27 @@ double Mouse::scrollDY = 0;
 
 bool Mouse::firstMouse = true;
 
-bool Mouse::buttons[GLFW_MOUSE_BUTTON_LAST] = { 0 };
-bool Mouse::buttonsChanged[GLFW_MOUSE_BUTTON_LAST] = { 0 };
+bool Mouse::buttons[GLFW_MOUSE_BUTTON_LAST + 1] = { 0 };
+bool Mouse::buttonsChanged[GLFW_MOUSE_BUTTON_LAST + 1] = { 0 };
+bool Mouse::buttonsWentDown[GLFW_MOUSE_BUTTON_LAST + 1] = { 0 };
+bool Mouse::buttonsWentUp[GLFW_MOUSE_BUTTON_LAST + 1] = { 0 };
 
  void Mouse:: cursorPosCallback(GLFWwindow* window, double _x, double _y){
+	 InputEvent event = { InputEventType::CURSOR, 0, 0, _x, _y, glfwGetTime() };
+	 InputQueue::events().push(event);
+ }
+ void Mouse:: mouseButtonCallback(GLFWwindow* window, int button, int action, int mods){ 
+	 if (button < 0 || button > GLFW_MOUSE_BUTTON_LAST || action == GLFW_REPEAT) return;
+
+	 InputEvent event = { InputEventType::MOUSE_BUTTON, button, action, 0.0, 0.0, glfwGetTime() };
+	 InputQueue::events().push(event);
+ }
+ void Mouse:: scrollCallback(GLFWwindow* window, double dx, double dy){
+	 InputEvent event = { InputEventType::SCROLL, 0, 0, dx, dy, glfwGetTime() };
+	 InputQueue::events().push(event);
+ }
+
+ void Mouse:: cursorEvent(double _x, double _y){
 	 x = _x;
 	 y = _y;
 
@@ -27,30 +45,28 @@ bool Mouse::buttonsChanged[GLFW_MOUSE_BUTTON_LAST] = { 0 };
 		 firstMouse = false;
 	 }
 
-	 dx = x - lastX;
-	 dy = lastY - y;
+	 dx += x - lastX;
+	 dy += lastY - y;
 	 lastX = x;
 	 lastY = y;
 
  }
- void Mouse:: mouseButtonCallback(GLFWwindow* window, int button, int action, int mods){ 
- 
-	 if (action != GLFW_RELEASE) {
-		 if (!buttons[button]) {
-			 buttons[button] = true;
-		 }
-	 }
-	 else {
-		 buttons[button] = false;
+ void Mouse:: buttonEvent(int button, int action){ 
+	 if (button < 0 || button > GLFW_MOUSE_BUTTON_LAST) return;
+
+	 bool down = action != GLFW_RELEASE;
+	 if (down != buttons[button]) {
+		 buttons[button] = down;
+		 buttonsChanged[button] = true;
+		 if (down) buttonsWentDown[button] = true;
+		 else buttonsWentUp[button] = true;
 	 }
-	 
-	 buttonsChanged[button] = action != GLFW_REPEAT;
 
  }
- void Mouse:: scrollCallback(GLFWwindow* window, double dx, double dy){
+ void Mouse:: scrollEvent(double dx, double dy){
 
-	 scrollDX = dx;
-	 scrollDY = dy;
+	 scrollDX += dx;
+	 scrollDY += dy;
 
  }
 
@@ -109,11 +125,17 @@ bool Mouse::buttonsChanged[GLFW_MOUSE_BUTTON_LAST] = { 0 };
  }
  bool Mouse:: buttonWentUp(int button){ 
  
-	 return !buttons[button] && buttonChanged(button);
+	 bool ret = buttonsWentUp[button];
+	 buttonsWentUp[button] = false;
+	 buttonsChanged[button] = false;
+	 return ret;
 
  }
  bool Mouse:: buttonWentDown(int button){ 
  
-	 return buttons[button] && buttonChanged(button);
+	 bool ret = buttonsWentDown[button];
+	 buttonsWentDown[button] = false;
+	 buttonsChanged[button] = false;
+	 return ret;
 
  }
\ No newline at end of file
@@ -6,10 +6,17 @@
 
 class Mouse {
 public:
+	// Queue the event for the frame, see InputQueue
 	static void cursorPosCallback(GLFWwindow* window, double x, double y);
 	static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 	static void scrollCallback(GLFWwindow* window, double dx, double dy);
 
+	// Queued events reaching the frame. Motion and scroll add up until read, every event in a
+	// poll counts rather than the last
+	static void cursorEvent(double x, double y);
+	static void buttonEvent(int button, int action);
+	static void scrollEvent(double dx, double dy);
+
 	static double getMouseX();
 	static double getMouseY();
 
@@ -41,6 +48,8 @@ private:
 
 	static bool buttons[];
 	static bool buttonsChanged[];
+	static bool buttonsWentDown[];
+	static bool buttonsWentUp[];
 
 };
 